@@ -107,7 +107,8 @@ namespace xla
 
       for (size_t i = 0; i < max_epoch; i++)
       {
-         auto grad_loss = MakeMatrixMul(*xla::Transpose(_a), *MakeMatrixMul(_a, _x) - _b);
+         auto grad_loss = MakeMatrixMul(_a, gemm::Transpose::kTranspose,
+                                        *MakeMatrixMul(_a, _x) - _b, gemm::Transpose::kNoTranspose);
 
          grad_loss->mul(learn_rate);
          _x = _x - (*grad_loss);
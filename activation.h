@@ -0,0 +1,84 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+
+#ifndef TENSORFLOW_COMPILER_XLA_ACTIVATION_H_
+#define TENSORFLOW_COMPILER_XLA_ACTIVATION_H_
+
+#include <cmath>
+
+#include "types.h"
+
+namespace xla {
+
+// Pointwise activations that the GEMM and convolution kernels can apply to
+// their output before storing it (see gemm::Epilogue and conv::ConvEpilogue).
+enum class ActivationFunction {
+  kNone,
+  kRelu,
+  // x for x > 0, exp(x) - 1 otherwise.
+  kElu,
+  kTanh,
+  // 1 / (1 + exp(-x)).
+  kSigmoid,
+};
+
+// Returns activation(x).
+template <typename T>
+T Activate(ActivationFunction activation, T x) {
+  switch (activation) {
+    case ActivationFunction::kNone:
+      return x;
+    case ActivationFunction::kRelu:
+      return x > T(0) ? x : T(0);
+    case ActivationFunction::kElu:
+      return x > T(0) ? x : std::expm1(x);
+    case ActivationFunction::kTanh:
+      return std::tanh(x);
+    case ActivationFunction::kSigmoid:
+      return T(1) / (T(1) + std::exp(-x));
+  }
+  return x;
+}
+
+// Replaces each of the n values by scale * activation(value). The switch is
+// hoisted out of the loops so that the cheap cases vectorize.
+template <typename T>
+void ActivateAndScale(ActivationFunction activation, T scale, T* values,
+                      int64 n) {
+  switch (activation) {
+    case ActivationFunction::kNone:
+      break;
+    case ActivationFunction::kRelu:
+      for (int64 i = 0; i < n; ++i) {
+        values[i] = values[i] > T(0) ? values[i] : T(0);
+      }
+      break;
+    default:
+      for (int64 i = 0; i < n; ++i) {
+        values[i] = Activate(activation, values[i]);
+      }
+      break;
+  }
+  if (scale != T(1)) {
+    for (int64 i = 0; i < n; ++i) {
+      values[i] *= scale;
+    }
+  }
+}
+
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_ACTIVATION_H_
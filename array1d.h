@@ -3,9 +3,13 @@
 #ifndef TENSORFLOW_COMPILER_XLA_ARRAY1D_H_
 #define TENSORFLOW_COMPILER_XLA_ARRAY1D_H_
 
+#include <algorithm>
 #include <vector>
 #include <math.h>
 
+#include "half.h"
+#include "simd_kernels.h"
+#include "summation.h"
 #include "types.h"
 
 
@@ -40,6 +44,183 @@ namespace xla
       }
       return accumulator;
    }
+
+   // values[i] = max(values[i], 0) for i in [0, n).
+   template <typename TType>
+   static void ReluInPlace(TType* values, int64 n)
+   {
+      for (int64 i = 0; i < n; i++)
+      {
+         values[i] = values[i] > TType(0) ? values[i] : TType(0);
+      }
+   }
+
+   // to[i] = To(from[i]) for i in [0, n), the element conversion of
+   // Array4D::convert.
+   template <typename From, typename To>
+   static void ConvertValues(const From* from, To* to, int64 n)
+   {
+      for (int64 i = 0; i < n; i++)
+      {
+         to[i] = To(from[i]);
+      }
+   }
+
+   // values = exp(values) / sum(exp(values)), with the maximum subtracted
+   // first so that exp cannot overflow.
+   template <typename TType>
+   static void SoftMaxInPlace(TType* values, int64 n)
+   {
+      if (n == 0)
+      {
+         return;
+      }
+      TType max = values[0];
+      for (int64 i = 1; i < n; i++)
+      {
+         max = std::max(max, values[i]);
+      }
+      TType sum = TType(0);
+      for (int64 i = 0; i < n; i++)
+      {
+         values[i] = std::exp(values[i] - max);
+         sum += values[i];
+      }
+      for (int64 i = 0; i < n; i++)
+      {
+         values[i] /= sum;
+      }
+   }
+
+   // values[i] += other[i], values[i] -= other[i], values[i] *= other[i] and
+   // values[i] *= scale for i in [0, n), the elementwise loops of the array
+   // classes.
+   template <typename TType>
+   static void AddInPlace(TType* values, const TType* other, int64 n)
+   {
+      for (int64 i = 0; i < n; i++)
+      {
+         values[i] += other[i];
+      }
+   }
+
+   template <typename TType>
+   static void SubtractInPlace(TType* values, const TType* other, int64 n)
+   {
+      for (int64 i = 0; i < n; i++)
+      {
+         values[i] -= other[i];
+      }
+   }
+
+   template <typename TType>
+   static void MultiplyInPlace(TType* values, const TType* other, int64 n)
+   {
+      for (int64 i = 0; i < n; i++)
+      {
+         values[i] *= other[i];
+      }
+   }
+
+   template <typename TType, typename TScale>
+   static void ScaleInPlace(TType* values, TScale scale, int64 n)
+   {
+      for (int64 i = 0; i < n; i++)
+      {
+         values[i] *= scale;
+      }
+   }
+
+   // The float loops run on the vector kernels of simd_kernels.h, exp and log
+   // in the DefaultAccuracy() mode, and the float sum is ParallelSum in the
+   // DefaultSummation() mode of summation.h.
+   template <>
+   inline void Square<float>(std::vector<float>& flatten)
+   {
+      simd::Square(flatten.data(), flatten.size());
+   }
+
+   template <>
+   inline void Log<float>(std::vector<float>& flatten)
+   {
+      simd::Log(flatten.data(), flatten.data(), flatten.size());
+   }
+
+   template <>
+   inline float Sum<float>(const std::vector<float>& flatten)
+   {
+      return ParallelSum(flatten.data(), flatten.size());
+   }
+
+   template <>
+   inline void AddInPlace<float>(float* values, const float* other, int64 n)
+   {
+      simd::Add(values, other, values, n);
+   }
+
+   template <>
+   inline void SubtractInPlace<float>(float* values, const float* other, int64 n)
+   {
+      simd::Subtract(values, other, values, n);
+   }
+
+   template <>
+   inline void MultiplyInPlace<float>(float* values, const float* other, int64 n)
+   {
+      simd::Multiply(values, other, values, n);
+   }
+
+   template <>
+   inline void ScaleInPlace<float, float>(float* values, float scale, int64 n)
+   {
+      simd::Scale(scale, values, n);
+   }
+
+   template <>
+   inline void ReluInPlace<float>(float* values, int64 n)
+   {
+      simd::ActivateAndScale(ActivationFunction::kRelu, 1.0f, values, n);
+   }
+
+   // Conversions between float and the 16-bit types run on the bulk
+   // converters of half.h.
+   template <>
+   inline void ConvertValues<float, half>(const float* from, half* to, int64 n)
+   {
+      ConvertFromFloat(from, to, n);
+   }
+
+   template <>
+   inline void ConvertValues<float, bfloat16>(const float* from, bfloat16* to,
+                                              int64 n)
+   {
+      ConvertFromFloat(from, to, n);
+   }
+
+   template <>
+   inline void ConvertValues<half, float>(const half* from, float* to, int64 n)
+   {
+      ConvertToFloat(from, to, n);
+   }
+
+   template <>
+   inline void ConvertValues<bfloat16, float>(const bfloat16* from, float* to,
+                                              int64 n)
+   {
+      ConvertToFloat(from, to, n);
+   }
+
+   template <>
+   inline void SoftMaxInPlace<float>(float* values, int64 n)
+   {
+      if (n == 0)
+      {
+         return;
+      }
+      simd::AddScalar(-simd::Max(values, n), values, n);
+      simd::Exp(values, values, n);
+      simd::Scale(1.0f / simd::Sum(values, n), values, n);
+   }
 }  // ns
 
 #endif
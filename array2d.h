@@ -23,9 +23,11 @@ limitations under the License.
 #include "logging.h"
 #include "macros.h"
 
+#include "gemm.h"
 #include "tensor_array.h"
 #include "array1d.h"
 #include "ptr_util.h"
+#include "transpose.h"
 
 //#include "tensorflow/compiler/xla/types.h"
 //#include "tensorflow/core/lib/core/bits.h"
@@ -190,10 +192,7 @@ class Array2D : public TensorArray
      if (n1() == rhs.n1() && n2() == rhs.n2())
      {
         xla::Array2D<T> result(n1(), n2(), values_);
-        for (size_t i = 0; i < values_.size(); i++)
-        {
-           result.values_[i] -= rhs.values_[i];
-        }
+        SubtractInPlace(result.values_.data(), rhs.values_.data(), num_elements());
         return result;
      }
      else
@@ -208,10 +207,7 @@ class Array2D : public TensorArray
      if (n1() == rhs.n1() && n2() == rhs.n2())
      {
         xla::Array2D<T> result(n1(), n2(), values_);
-        for (size_t i = 0; i < values_.size(); i++)
-        {
-           result.values_[i] += rhs.values_[i];
-        }
+        AddInPlace(result.values_.data(), rhs.values_.data(), num_elements());
         return result;
      }
      else
@@ -223,10 +219,7 @@ class Array2D : public TensorArray
 
   void mul(T scalar)
   {
-     for (size_t i = 0; i < values_.size(); i++)
-     {
-        values_[i] *= scalar;
-     }
+     ScaleInPlace(values_.data(), scalar, num_elements());
   }
 
   const std::vector<T>& flatten() const
@@ -250,36 +243,73 @@ class Array2D : public TensorArray
 std::unique_ptr<Array2D<float>> MakeLinspaceArray2D(float from, float to,
                                                     int64 n1, int64 n2);
 
+namespace internal {
+
+// Generic fallback for element types without an optimized GEMM. The i-r-j
+// order keeps the inner loop walking rows of rhs and result contiguously.
 template <typename T>
-void MatrixMul(const xla::Array2D<T>& lhs, const xla::Array2D<T>& rhs, xla::Array2D<T>& result)
+void MatrixMulImpl(const xla::Array2D<T>& lhs, gemm::Transpose transpose_lhs,
+                   const xla::Array2D<T>& rhs, gemm::Transpose transpose_rhs,
+                   xla::Array2D<T>& result, std::false_type)
 {
-   // multiply lsh(p, r) * rhs(r, q) = result(p, q)
-
-   CHECK_EQ(lhs.Width(), rhs.Height());
-   CHECK_EQ(lhs.Height(), result.Height());
-   CHECK_EQ(rhs.Width(), result.Width());
-
-   assert(lhs.Width() == rhs.Height());
-   assert(lhs.Height() == result.Height());
-   assert(rhs.Width() == result.Width());
-
-   int64 i = 0;
-   int64 j = 0;
-   int64 r = 0;
-
-   for (i = 0; i < lhs.Height(); i++)
+   const bool lhs_t = (transpose_lhs == gemm::Transpose::kTranspose);
+   const bool rhs_t = (transpose_rhs == gemm::Transpose::kTranspose);
+   const int64 m = result.n1();
+   const int64 n = result.n2();
+   const int64 k = lhs_t ? lhs.n1() : lhs.n2();
+
+   result.Fill(T(0));
+   for (int64 i = 0; i < m; i++)
    {
-      for (j = 0; j < rhs.Width(); j++)
+      for (int64 r = 0; r < k; r++)
       {
-         result(i, j) = 0.f;
-         for (r = 0; r < lhs.Width(); r++)
+         const T lhs_value = lhs_t ? lhs(r, i) : lhs(i, r);
+         for (int64 j = 0; j < n; j++)
          {
-            result(i, j) += lhs(i, r) * rhs(r, j);
+            result(i, j) += lhs_value * (rhs_t ? rhs(j, r) : rhs(r, j));
          }
       }
    }
 }
 
+template <typename T>
+void MatrixMulImpl(const xla::Array2D<T>& lhs, gemm::Transpose transpose_lhs,
+                   const xla::Array2D<T>& rhs, gemm::Transpose transpose_rhs,
+                   xla::Array2D<T>& result, std::true_type)
+{
+   const int64 k = (transpose_lhs == gemm::Transpose::kTranspose) ? lhs.n1() : lhs.n2();
+   gemm::Gemm<T>(transpose_lhs, transpose_rhs, result.n1(), result.n2(), k,
+                 T(1), lhs.data(), lhs.n2(), rhs.data(), rhs.n2(), T(0),
+                 result.data(), result.n2());
+}
+
+}  // namespace internal
+
+// Computes result = op(lhs) * op(rhs), where op optionally transposes its
+// operand. float and double run on the packed GEMM engine in gemm.h.
+template <typename T>
+void MatrixMul(const xla::Array2D<T>& lhs, gemm::Transpose transpose_lhs,
+               const xla::Array2D<T>& rhs, gemm::Transpose transpose_rhs,
+               xla::Array2D<T>& result)
+{
+   const bool lhs_t = (transpose_lhs == gemm::Transpose::kTranspose);
+   const bool rhs_t = (transpose_rhs == gemm::Transpose::kTranspose);
+
+   CHECK_EQ(lhs_t ? lhs.n1() : lhs.n2(), rhs_t ? rhs.n2() : rhs.n1());
+   CHECK_EQ(lhs_t ? lhs.n2() : lhs.n1(), result.n1());
+   CHECK_EQ(rhs_t ? rhs.n1() : rhs.n2(), result.n2());
+
+   internal::MatrixMulImpl(lhs, transpose_lhs, rhs, transpose_rhs, result,
+                           std::integral_constant<bool, gemm::IsGemmType<T>::value>());
+}
+
+template <typename T>
+void MatrixMul(const xla::Array2D<T>& lhs, const xla::Array2D<T>& rhs, xla::Array2D<T>& result)
+{
+   // multiply lsh(p, r) * rhs(r, q) = result(p, q)
+   MatrixMul(lhs, gemm::Transpose::kNoTranspose, rhs, gemm::Transpose::kNoTranspose, result);
+}
+
 template <typename T>
 std::unique_ptr<xla::Array2D<T>> MakeMatrixMul(const xla::Array2D<T>& lhs, const xla::Array2D<T>& rhs)
 {
@@ -288,18 +318,25 @@ std::unique_ptr<xla::Array2D<T>> MakeMatrixMul(const xla::Array2D<T>& lhs, const
    return result;
 }
 
+// Returns op(lhs) * op(rhs) without materializing a transposed copy.
+template <typename T>
+std::unique_ptr<xla::Array2D<T>> MakeMatrixMul(const xla::Array2D<T>& lhs, gemm::Transpose transpose_lhs,
+                                               const xla::Array2D<T>& rhs, gemm::Transpose transpose_rhs)
+{
+   const int64 m = (transpose_lhs == gemm::Transpose::kTranspose) ? lhs.n2() : lhs.n1();
+   const int64 n = (transpose_rhs == gemm::Transpose::kTranspose) ? rhs.n1() : rhs.n2();
+   std::unique_ptr<xla::Array2D<T>> result = xla::MakeUnique<xla::Array2D<T>>(m, n);
+   xla::MatrixMul(lhs, transpose_lhs, rhs, transpose_rhs, *result);
+   return result;
+}
+
 
+// Returns the transpose of rhs; see transpose.h.
 template <typename T>
 std::unique_ptr<xla::Array2D<T>> Transpose(const xla::Array2D<T>& rhs)
 {
    std::unique_ptr<xla::Array2D<T>> result = xla::MakeUnique<xla::Array2D<T>>(rhs.n2(), rhs.n1());
-   for (int64 i1 = 0; i1 < rhs.n1(); ++i1)
-   {
-      for (int64 i2 = 0; i2 < rhs.n2(); ++i2)
-      {
-         (*result)(i2, i1) = rhs(i1, i2);
-      }
-   }
+   xla::Transpose2D(rhs.data(), rhs.n1(), rhs.n2(), result->data());
    return result;
 }
 
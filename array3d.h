@@ -17,6 +17,7 @@ limitations under the License.
 #define TENSORFLOW_COMPILER_XLA_ARRAY3D_H_
 
 #include "types.h"
+#include "gemm.h"
 #include "str_util.h"
 #include "strcat.h"
 #include "logging.h"
@@ -145,6 +146,16 @@ class Array3D : public TensorArray
      return values_;
   }
 
+  const std::vector<T>& flatten() const
+  {
+     return values_;
+  }
+
+  std::vector<T>& flatten()
+  {
+     return values_;
+  }
+
   string ToString() const 
   {
      std::vector<string> pieces = {
@@ -177,49 +188,95 @@ class Array3D : public TensorArray
 };
 
 
-template <typename T>
-void MatrixMul(const xla::Array3D<T>& lhs, const xla::Array3D<T>& rhs, xla::Array3D<T>& result)
-{
-   // multiply lsh(d, p, r) * rhs(d, r, q) = result(d, p, q)
-
-   CHECK_EQ(lhs.Width(), rhs.Height());
-   CHECK_EQ(lhs.Height(), result.Height());
-   CHECK_EQ(rhs.Width(), result.Width());
+namespace internal {
 
-   CHECK_EQ(lhs.Depth(), rhs.Depth());
-   CHECK_EQ(rhs.Depth(), result.Depth());
-
-   assert(lhs.Width() == rhs.Height());
-   assert(lhs.Height() == result.Height());
-   assert(rhs.Width() == result.Width());
-
-   int64 i = 0;
-   int64 j = 0;
-   int64 r = 0;
+// Distance between consecutive matrices of a batched matmul operand whose
+// leading dimension is either the batch size or 1; the latter is broadcast
+// with a stride of 0.
+inline int64 BatchStride(int64 operand_batch, int64 batch, int64 matrix_size)
+{
+   CHECK(operand_batch == batch || operand_batch == 1);
+   return operand_batch == batch ? matrix_size : 0;
+}
 
-   for (int64 d = 0; d < result.Depth(); d++)
+// Generic fallback for element types without an optimized GEMM: one i-r-j
+// matmul per matrix of the batch. result is dense.
+template <typename T>
+void BatchedMatrixMulImpl(int64 batch, int64 m, int64 n, int64 k,
+                          const T* lhs, int64 lhs_stride,
+                          const T* rhs, int64 rhs_stride,
+                          T* result, std::false_type)
+{
+   for (int64 d = 0; d < batch; d++)
    {
-      for (i = 0; i < lhs.Height(); i++)
+      const T* lhs_d = lhs + d * lhs_stride;
+      const T* rhs_d = rhs + d * rhs_stride;
+      T* result_d = result + d * m * n;
+      std::fill(result_d, result_d + m * n, T(0));
+      for (int64 i = 0; i < m; i++)
       {
-         for (j = 0; j < rhs.Width(); j++)
+         for (int64 r = 0; r < k; r++)
          {
-            result(d, i, j) = 0.f;
-            for (r = 0; r < lhs.Width(); r++)
+            const T lhs_value = lhs_d[i * k + r];
+            for (int64 j = 0; j < n; j++)
             {
-               result(d, i, j) += lhs(d, i, r) * rhs(d, r, j);
+               result_d[i * n + j] += lhs_value * rhs_d[r * n + j];
             }
          }
       }
    }
+}
+
+template <typename T>
+void BatchedMatrixMulImpl(int64 batch, int64 m, int64 n, int64 k,
+                          const T* lhs, int64 lhs_stride,
+                          const T* rhs, int64 rhs_stride,
+                          T* result, std::true_type)
+{
+   gemm::BatchedGemm<T>(gemm::Transpose::kNoTranspose, gemm::Transpose::kNoTranspose,
+                        m, n, k, T(1), lhs, k, lhs_stride, rhs, n, rhs_stride,
+                        T(0), result, n, m * n, batch);
+}
+
+template <typename T>
+void BatchedMatrixMul(int64 batch, int64 m, int64 n, int64 k,
+                      const T* lhs, int64 lhs_stride,
+                      const T* rhs, int64 rhs_stride, T* result)
+{
+   BatchedMatrixMulImpl(batch, m, n, k, lhs, lhs_stride, rhs, rhs_stride, result,
+                        std::integral_constant<bool, gemm::IsGemmType<T>::value>());
+}
+
+}  // namespace internal
+
+// Computes result(d) = lhs(d) * rhs(d) for every depth d. An operand of depth
+// 1 is broadcast to every matrix of the result. float and double run as one
+// batched GEMM (see gemm::BatchedGemm).
+template <typename T>
+void MatrixMul(const xla::Array3D<T>& lhs, const xla::Array3D<T>& rhs, xla::Array3D<T>& result)
+{
+   // multiply lsh(d, p, r) * rhs(d, r, q) = result(d, p, q)
+
+   CHECK_EQ(lhs.Width(), rhs.Height());
+   CHECK_EQ(lhs.Height(), result.Height());
+   CHECK_EQ(rhs.Width(), result.Width());
 
+   const int64 m = result.Height();
+   const int64 n = result.Width();
+   const int64 k = lhs.Width();
+   const int64 depth = result.Depth();
+   internal::BatchedMatrixMul(depth, m, n, k,
+                              lhs.data(), internal::BatchStride(lhs.Depth(), depth, m * k),
+                              rhs.data(), internal::BatchStride(rhs.Depth(), depth, k * n),
+                              result.flatten().data());
 }
 
 template <typename T>
 std::unique_ptr<xla::Array3D<T>> MakeMatrixMul(const xla::Array3D<T>& lhs, const xla::Array3D<T>& rhs)
 {
-   assert(lhs.n1() == rhs.n1());
+   const int64 depth = std::max(lhs.n1(), rhs.n1());
 
-   std::unique_ptr<xla::Array3D<T>> result = xla::MakeUnique<xla::Array3D<T>>(lhs.n1(), lhs.n2(), rhs.n3());
+   std::unique_ptr<xla::Array3D<T>> result = xla::MakeUnique<xla::Array3D<T>>(depth, lhs.n2(), rhs.n3());
    xla::MatrixMul(lhs, rhs, *result);
 
    return result;
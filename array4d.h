@@ -17,6 +17,7 @@ limitations under the License.
 #define TENSORFLOW_COMPILER_XLA_ARRAY4D_H_
 
 #include "array2d.h"
+#include "array3d.h"
 #include "types.h"
 #include "array_slice.h"
 #include "str_util.h"
@@ -219,10 +220,7 @@ class Array4D : public TensorArray
 
   void mul(float multiplier)
   {
-     for (int64 i = 0; i < num_elements(); ++i) 
-     {
-        values_[i] *= multiplier;
-     }
+     ScaleInPlace(values_.data(), multiplier, num_elements());
   }
 
   // Invokes a callback with the (indices, value_ptr) for each cell in the 4D
@@ -329,12 +327,7 @@ class Array4D : public TensorArray
   {
      std::unique_ptr<xla::Array4D<U>> result(new xla::Array4D<U>(size(0), size(1), size(2), size(3)));
 
-     std::vector<U>& to = result->flatten();
-
-     for (size_t i = 0; i < values_.size(); i++)
-     {
-        to[i] = U(values_[i]);
-     }
+     ConvertValues(values_.data(), result->flatten().data(), num_elements());
 
      return result;
   }
@@ -347,10 +340,7 @@ class Array4D : public TensorArray
         && (rhs.size(3) == this->size(3))
         )
      {
-        for (size_t i = 0; i < values_.size(); i++)
-        {
-           values_[i] *= rhs.values_[i];
-        }
+        MultiplyInPlace(values_.data(), rhs.values_.data(), num_elements());
      }
      else
      {
@@ -367,6 +357,9 @@ class Array4D : public TensorArray
 };
 
 
+// Computes result(b, d) = lhs(b, d) * rhs(b, d) for every batch b and depth d.
+// Each of the two leading dimensions of an operand may be 1, in which case it
+// is broadcast over that dimension of the result.
 template <typename T>
 void MatrixMul(const xla::Array4D<T>& lhs, const xla::Array4D<T>& rhs, xla::Array4D<T>& result)
 {
@@ -376,46 +369,39 @@ void MatrixMul(const xla::Array4D<T>& lhs, const xla::Array4D<T>& rhs, xla::Arra
    CHECK_EQ(lhs.Height(), result.Height());
    CHECK_EQ(rhs.Width(), result.Width());
 
-   CHECK_EQ(lhs.Depth(), rhs.Depth());
-   CHECK_EQ(rhs.Depth(), result.Depth());
-
-   CHECK_EQ(lhs.Batch(), rhs.Batch());
-   CHECK_EQ(rhs.Batch(), result.Batch());
-
-   assert(lhs.Width() == rhs.Height());
-   assert(lhs.Height() == result.Height());
-   assert(rhs.Width() == result.Width());
-
-   int64 i = 0;
-   int64 j = 0;
-   int64 r = 0;
-
-   for (int64 b = 0; b < result.Batch(); b++)
+   const int64 m = result.Height();
+   const int64 n = result.Width();
+   const int64 k = lhs.Width();
+   const int64 batch = result.Batch();
+   const int64 depth = result.Depth();
+   const int64 lhs_depth_stride = internal::BatchStride(lhs.Depth(), depth, m * k);
+   const int64 lhs_batch_stride = internal::BatchStride(lhs.Batch(), batch, lhs.Depth() * m * k);
+   const int64 rhs_depth_stride = internal::BatchStride(rhs.Depth(), depth, k * n);
+   const int64 rhs_batch_stride = internal::BatchStride(rhs.Batch(), batch, rhs.Depth() * k * n);
+   T* result_data = result.flatten().data();
+
+   // Unless one operand broadcasts over depth but not over batch, the two
+   // leading dimensions collapse into a single batch of matrices.
+   if (lhs_batch_stride == depth * lhs_depth_stride &&
+       rhs_batch_stride == depth * rhs_depth_stride)
    {
-      for (int64 d = 0; d < result.Depth(); d++)
-      {
-         for (i = 0; i < lhs.Height(); i++)
-         {
-            for (j = 0; j < rhs.Width(); j++)
-            {
-               result(b, d, i, j) = 0.f;
-               for (r = 0; r < lhs.Width(); r++)
-               {
-                  result(b, d, i, j) += lhs(b, d, i, r) * rhs(b, d, r, j);
-               }
-            }
-         }
-      }
+      internal::BatchedMatrixMul(batch * depth, m, n, k, lhs.data(), lhs_depth_stride,
+                                 rhs.data(), rhs_depth_stride, result_data);
+      return;
+   }
+   for (int64 b = 0; b < batch; b++)
+   {
+      internal::BatchedMatrixMul(depth, m, n, k, lhs.data() + b * lhs_batch_stride,
+                                 lhs_depth_stride, rhs.data() + b * rhs_batch_stride,
+                                 rhs_depth_stride, result_data + b * depth * m * n);
    }
 }
 
 template <typename T>
 std::unique_ptr<xla::Array4D<T>> MakeMatrixMul(const xla::Array4D<T>& lhs, const xla::Array4D<T>& rhs)
 {
-   assert(lhs.n1() == rhs.n1());
-   assert(lhs.n2() == rhs.n2());
-
-   std::unique_ptr<xla::Array4D<T>> result = xla::MakeUnique<xla::Array4D<T>>(lhs.n1(), lhs.n2(), lhs.n3(), rhs.n4());
+   std::unique_ptr<xla::Array4D<T>> result = xla::MakeUnique<xla::Array4D<T>>(
+       std::max(lhs.n1(), rhs.n1()), std::max(lhs.n2(), rhs.n2()), lhs.n3(), rhs.n4());
    xla::MatrixMul(lhs, rhs, *result);
 
    return result;
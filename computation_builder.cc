@@ -763,7 +763,8 @@ ComputationDataHandle ComputationBuilder::ConvGeneralDilated(
     tensorflow::gtl::ArraySlice<std::pair<int64, int64>> padding,
     tensorflow::gtl::ArraySlice<int64> lhs_dilation,
     tensorflow::gtl::ArraySlice<int64> rhs_dilation,
-    const ConvolutionDimensionNumbers& dimension_numbers) 
+    const ConvolutionDimensionNumbers& dimension_numbers,
+    int64 feature_group_count) 
 {
   if (!first_error_.ok() || !PrepareComputation().ok()) 
   {
@@ -789,6 +790,23 @@ ComputationDataHandle ComputationBuilder::ConvGeneralDilated(
     return ComputationDataHandle();
   }
 
+  const int64 input_features = lhs_shape->dimensions(
+      static_cast<int>(dimension_numbers.feature_dimension()));
+  const int64 kernel_input_features = rhs_shape->dimensions(
+      static_cast<int>(dimension_numbers.kernel_input_feature_dimension()));
+  const int64 kernel_output_features = rhs_shape->dimensions(
+      static_cast<int>(dimension_numbers.kernel_output_feature_dimension()));
+  if (feature_group_count < 1 || input_features % feature_group_count != 0 ||
+      kernel_output_features % feature_group_count != 0 ||
+      kernel_input_features * feature_group_count != input_features) {
+    NoteError(InvalidArgument(
+        "Convolution with %lld feature groups cannot split %lld input and "
+        "%lld output features over a kernel with %lld input features.",
+        feature_group_count, input_features, kernel_output_features,
+        kernel_input_features));
+    return ComputationDataHandle();
+  }
+
   std::vector<int64> window_dimensions(
       dimension_numbers.kernel_spatial_dimensions_size());
   for (size_t i = 0; i < window_dimensions.size(); ++i) 
@@ -375,13 +375,21 @@ class ComputationBuilder {
 
   // Enqueues a convolution instruction onto the computation, with the caller
   // provided padding configuration, dilation factors and dimension numbers.
+  // With feature_group_count > 1 the convolution is grouped: the input and
+  // output features are split into that many groups, output group k only
+  // reads input group k, and the kernel's input feature dimension holds the
+  // features of one group. The builder only checks that the group count
+  // divides the features: like the rest of the convolution request, it is not
+  // sent to a service in this tree. Grouped convolutions are computed by
+  // ReferenceUtil::ConvArray4DGeneralDimensionsDilated.
   ComputationDataHandle ConvGeneralDilated(
       const ComputationDataHandle& lhs, const ComputationDataHandle& rhs,
       tensorflow::gtl::ArraySlice<int64> window_strides,
       tensorflow::gtl::ArraySlice<std::pair<int64, int64>> padding,
       tensorflow::gtl::ArraySlice<int64> lhs_dilation,
       tensorflow::gtl::ArraySlice<int64> rhs_dilation,
-      const ConvolutionDimensionNumbers& dimension_numbers);
+      const ConvolutionDimensionNumbers& dimension_numbers,
+      int64 feature_group_count = 1);
 
   // Enqueues an infeed instruction onto the computation, which reads data of
   // the given shape from the infeed buffer of the device.
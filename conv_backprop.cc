@@ -0,0 +1,119 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "conv_backprop.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "conv_im2col.h"
+#include "gemm.h"
+#include "intra_op_thread_pool.h"
+#include "logging.h"
+#include "simd_kernels.h"
+
+namespace xla {
+namespace conv {
+namespace {
+
+// Number of patch-matrix chunks whose filter gradients are summed into one
+// partial. Fixing it, rather than deriving it from the thread count, keeps
+// ConvBackwardFilter deterministic.
+constexpr int64 kChunksPerPartial = 4;
+
+}  // namespace
+
+void ConvBackwardFilter(const ConvGeometry& g, const float* input,
+                        const float* output_gradient, float* filter_gradient) {
+  CHECK_EQ(g.feature_group_count, 1);
+  const int64 pixels = g.output_height * g.output_width;
+  const int64 depth = g.input_features * g.kernel_height * g.kernel_width;
+  const int64 image_size = g.input_features * g.input_height * g.input_width;
+  const int64 output_image_size = g.output_features * pixels;
+  const int64 filter_size = g.output_features * depth;
+  std::fill(filter_gradient, filter_gradient + filter_size, 0.0f);
+  if (g.batch == 0 || pixels == 0 || filter_size == 0) {
+    return;
+  }
+
+  const int64 chunk = Im2ColChunkPixels(g);
+  const int64 chunks_per_image = (pixels + chunk - 1) / chunk;
+  const std::vector<float> gradient = ParallelReduce(
+      g.batch * chunks_per_image, kChunksPerPartial,
+      2 * g.output_features * depth * chunk, std::vector<float>(filter_size),
+      [&](int64 first, int64 last) {
+        std::vector<float> partial(filter_size);
+        std::vector<float> patches(depth * chunk);
+        for (int64 task = first; task < last; ++task) {
+          const int64 b = task / chunks_per_image;
+          const int64 first_pixel = task % chunks_per_image * chunk;
+          const int64 last_pixel = std::min(pixels, first_pixel + chunk);
+          const int64 width = last_pixel - first_pixel;
+          Im2ColPatches(g, input + b * image_size, first_pixel, last_pixel,
+                        patches.data());
+          gemm::Gemm<float>(gemm::Transpose::kNoTranspose,
+                            gemm::Transpose::kTranspose, g.output_features,
+                            depth, width, 1.0f,
+                            output_gradient + b * output_image_size +
+                                first_pixel,
+                            pixels, patches.data(), width, 1.0f,
+                            partial.data(), depth);
+        }
+        return partial;
+      },
+      [](std::vector<float> sum, const std::vector<float>& partial) {
+        simd::Add(sum.data(), partial.data(), sum.data(), sum.size());
+        return sum;
+      });
+  std::copy(gradient.begin(), gradient.end(), filter_gradient);
+}
+
+void ConvBackwardInput(const ConvGeometry& g, const float* filter,
+                       const float* output_gradient, float* input_gradient) {
+  CHECK_EQ(g.feature_group_count, 1);
+  const int64 pixels = g.output_height * g.output_width;
+  const int64 depth = g.input_features * g.kernel_height * g.kernel_width;
+  const int64 image_size = g.input_features * g.input_height * g.input_width;
+  const int64 output_image_size = g.output_features * pixels;
+  std::fill(input_gradient, input_gradient + g.batch * image_size, 0.0f);
+  if (g.batch == 0 || pixels == 0 || depth == 0) {
+    return;
+  }
+
+  // Overlapping patches of one image add into the same input values, so an
+  // image is processed chunk by chunk on one thread; with a single image the
+  // GEMMs parallelize instead.
+  const int64 chunk = Im2ColChunkPixels(g);
+  ParallelFor(g.batch, 2 * g.output_features * depth * pixels,
+              [&](int64 first, int64 last) {
+    std::vector<float> patches(depth * chunk);
+    for (int64 b = first; b < last; ++b) {
+      for (int64 first_pixel = 0; first_pixel < pixels; first_pixel += chunk) {
+        const int64 last_pixel = std::min(pixels, first_pixel + chunk);
+        const int64 width = last_pixel - first_pixel;
+        gemm::Gemm<float>(gemm::Transpose::kTranspose,
+                          gemm::Transpose::kNoTranspose, depth, width,
+                          g.output_features, 1.0f, filter, depth,
+                          output_gradient + b * output_image_size + first_pixel,
+                          pixels, 0.0f, patches.data(), width);
+        Col2ImPatches(g, patches.data(), first_pixel, last_pixel,
+                      input_gradient + b * image_size);
+      }
+    }
+  });
+}
+
+}  // namespace conv
+}  // namespace xla
@@ -0,0 +1,51 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_CONV_BACKPROP_H_
+#define TENSORFLOW_COMPILER_XLA_CONV_BACKPROP_H_
+
+#include "conv_geometry.h"
+#include "types.h"
+
+namespace xla {
+namespace conv {
+
+// Gradients of the convolution described by geometry, the CPU counterparts of
+// the backward-filter and backward-input convolutions. Both are lowered to
+// GEMM over the same chunked patch matrix as ConvIm2Col:
+//
+//   filter_gradient (features x patch)  = sum over images and chunks of
+//       output_gradient (features x pixels) * patches^T
+//   input_gradient = col2im(filter^T (patch x features) * output_gradient)
+//
+// Every stride, padding and dilation that MakeConvGeometry accepts is
+// supported; feature groups are not. All operands are in the canonical
+// layouts of conv_geometry.h; output_gradient has the shape of the
+// convolution output.
+
+// Computes the gradient with respect to the filter. The per-image sums are
+// combined in a fixed order, so the result does not depend on the thread
+// count.
+void ConvBackwardFilter(const ConvGeometry& geometry, const float* input,
+                        const float* output_gradient, float* filter_gradient);
+
+// Computes the gradient with respect to the input.
+void ConvBackwardInput(const ConvGeometry& geometry, const float* filter,
+                       const float* output_gradient, float* input_gradient);
+
+}  // namespace conv
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_CONV_BACKPROP_H_
@@ -0,0 +1,197 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "conv_backprop.h"
+
+#include <cmath>
+#include <memory>
+
+#include "array4d.h"
+#include "computation_builder.h"
+#include "literal_test_util.h"
+#include "literal_util.h"
+#include "reference_util.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+// The convolution is linear in both operands, so its gradients are the
+// adjoints of the forward convolution: for any output gradient g,
+//   <conv(x, w), g> == <w, backward_filter(x, g)> == <x, backward_input(w, g)>.
+// The tests check these identities against the direct forward convolution
+// for every combination of stride, padding and dilation.
+class ConvBackpropTest /* : public ::testing::Test */
+{
+public:
+
+   ConvBackpropTest() { run(); }
+
+   void UnitStride();
+   void StridedAndDilated();
+   void GeneralDimensions();
+   void SingleTapGradients();
+
+   void run();
+};
+
+double Dot(const Array4D<float>& a, const Array4D<float>& b)
+{
+   CHECK_EQ(a.num_elements(), b.num_elements());
+   double sum = 0.0;
+   for (int64 i = 0; i < a.num_elements(); ++i) {
+      sum += static_cast<double>(a.flatten()[i]) * b.flatten()[i];
+   }
+   return sum;
+}
+
+void ExpectAdjoint(const Array4D<float>& input, const Array4D<float>& kernel,
+                   std::pair<int64, int64> kernel_spatial_dims,
+                   std::pair<int64, int64> input_spatial_dims,
+                   std::pair<int64, int64> stride, Padding padding,
+                   std::pair<int64, int64> lhs_dilation,
+                   std::pair<int64, int64> rhs_dilation,
+                   const ConvolutionDimensionNumbers& dnums)
+{
+   auto output = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+       input, kernel, stride, padding, lhs_dilation, rhs_dilation, dnums,
+       conv::ConvAlgorithm::kDirect);
+   Array4D<float> output_gradient(output->n1(), output->n2(), output->n3(),
+                                  output->n4());
+   output_gradient.FillRandom(1.0f, 0.0, 83);
+
+   auto filter_gradient =
+       ReferenceUtil::ConvArray4DGeneralDimensionsDilatedBackwardFilter(
+           input, output_gradient, kernel_spatial_dims, stride, padding,
+           lhs_dilation, rhs_dilation, dnums);
+   auto input_gradient =
+       ReferenceUtil::ConvArray4DGeneralDimensionsDilatedBackwardInput(
+           kernel, output_gradient, input_spatial_dims, stride, padding,
+           lhs_dilation, rhs_dilation, dnums);
+   ASSERT_TRUE(filter_gradient->n1() == kernel.n1());
+   ASSERT_TRUE(filter_gradient->n2() == kernel.n2());
+   ASSERT_TRUE(filter_gradient->n3() == kernel.n3());
+   ASSERT_TRUE(filter_gradient->n4() == kernel.n4());
+   ASSERT_TRUE(input_gradient->n1() == input.n1());
+   ASSERT_TRUE(input_gradient->n2() == input.n2());
+   ASSERT_TRUE(input_gradient->n3() == input.n3());
+   ASSERT_TRUE(input_gradient->n4() == input.n4());
+
+   const double forward = Dot(*output, output_gradient);
+   const double tolerance = 1e-4 * std::max(1.0, std::abs(forward));
+   ASSERT_TRUE(std::abs(Dot(kernel, *filter_gradient) - forward) < tolerance);
+   ASSERT_TRUE(std::abs(Dot(input, *input_gradient) - forward) < tolerance);
+}
+
+void ExpectAdjointDefaultDims(int64 height, int64 width, int64 kernel_height,
+                              int64 kernel_width, std::pair<int64, int64> stride,
+                              Padding padding,
+                              std::pair<int64, int64> lhs_dilation,
+                              std::pair<int64, int64> rhs_dilation)
+{
+   Array4D<float> input(2, 3, height, width);
+   Array4D<float> kernel(4, 3, kernel_height, kernel_width);
+   input.FillRandom(1.0f, 0.0, 81);
+   kernel.FillRandom(1.0f, 0.0, 82);
+   ExpectAdjoint(input, kernel, {kernel_height, kernel_width}, {height, width},
+                 stride, padding, lhs_dilation, rhs_dilation,
+                 ComputationBuilder::CreateDefaultConvDimensionNumbers());
+}
+
+void ConvBackpropTest::UnitStride()
+{
+   for (Padding padding : {Padding::kSame, Padding::kValid}) {
+      ExpectAdjointDefaultDims(9, 11, 3, 3, {1, 1}, padding, {1, 1}, {1, 1});
+      ExpectAdjointDefaultDims(10, 8, 4, 2, {1, 1}, padding, {1, 1}, {1, 1});
+      ExpectAdjointDefaultDims(6, 7, 1, 1, {1, 1}, padding, {1, 1}, {1, 1});
+   }
+}
+
+void ConvBackpropTest::StridedAndDilated()
+{
+   ExpectAdjointDefaultDims(13, 12, 3, 3, {2, 3}, Padding::kValid, {1, 1},
+                            {1, 1});
+   ExpectAdjointDefaultDims(12, 10, 3, 2, {1, 1}, Padding::kSame, {1, 1},
+                            {2, 3});
+   ExpectAdjointDefaultDims(7, 6, 3, 3, {1, 1}, Padding::kValid, {2, 2},
+                            {1, 1});
+   ExpectAdjointDefaultDims(7, 9, 2, 3, {2, 2}, Padding::kValid, {3, 2},
+                            {2, 1});
+}
+
+void ConvBackpropTest::GeneralDimensions()
+{
+   // NHWC input, HWIO filter.
+   ConvolutionDimensionNumbers dnums;
+   dnums.set_batch_dimension(0);
+   dnums.add_spatial_dimensions(1);
+   dnums.add_spatial_dimensions(2);
+   dnums.set_feature_dimension(3);
+   dnums.add_kernel_spatial_dimensions(0);
+   dnums.add_kernel_spatial_dimensions(1);
+   dnums.set_kernel_input_feature_dimension(2);
+   dnums.set_kernel_output_feature_dimension(3);
+
+   Array4D<float> input(2, 11, 9, 3);
+   Array4D<float> kernel(3, 2, 3, 5);
+   input.FillRandom(1.0f, 0.0, 84);
+   kernel.FillRandom(1.0f, 0.0, 85);
+   ExpectAdjoint(input, kernel, {3, 2}, {11, 9}, {2, 1}, Padding::kValid,
+                 {1, 2}, {2, 1}, dnums);
+}
+
+void ConvBackpropTest::SingleTapGradients()
+{
+   // With a 1x1 kernel of weight w, every output is w times one input, so the
+   // input gradient is w * g and the filter gradient is sum(x * g).
+   Array4D<float> input(1, 1, 2, 2);
+   input.FillWithYX(Array2D<float>({{1.0f, 2.0f}, {3.0f, 4.0f}}));
+   Array4D<float> kernel(1, 1, 1, 1);
+   kernel.FillWithYX(Array2D<float>({{3.0f}}));
+   Array4D<float> output_gradient(1, 1, 2, 2);
+   output_gradient.FillWithYX(Array2D<float>({{1.0f, 0.0f}, {-1.0f, 2.0f}}));
+   const auto dnums = ComputationBuilder::CreateDefaultConvDimensionNumbers();
+
+   auto filter_gradient =
+       ReferenceUtil::ConvArray4DGeneralDimensionsDilatedBackwardFilter(
+           input, output_gradient, {1, 1}, {1, 1}, Padding::kValid, {1, 1},
+           {1, 1}, dnums);
+   Array4D<float> expected_filter(1, 1, 1, 1);
+   expected_filter.FillWithYX(Array2D<float>({{6.0f}}));
+   LiteralTestUtil::ExpectR4NearArray4D(
+       expected_filter, *LiteralUtil::CreateR4FromArray4D(*filter_gradient),
+       ErrorSpec(1e-6));
+
+   auto input_gradient =
+       ReferenceUtil::ConvArray4DGeneralDimensionsDilatedBackwardInput(
+           kernel, output_gradient, {2, 2}, {1, 1}, Padding::kValid, {1, 1},
+           {1, 1}, dnums);
+   Array4D<float> expected_input(1, 1, 2, 2);
+   expected_input.FillWithYX(Array2D<float>({{3.0f, 0.0f}, {-3.0f, 6.0f}}));
+   LiteralTestUtil::ExpectR4NearArray4D(
+       expected_input, *LiteralUtil::CreateR4FromArray4D(*input_gradient),
+       ErrorSpec(1e-6));
+}
+
+void ConvBackpropTest::run()
+{
+   UnitStride();
+   StridedAndDilated();
+   GeneralDimensions();
+   SingleTapGradients();
+}
+
+}  // namespace
+}  // namespace xla
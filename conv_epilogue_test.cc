@@ -0,0 +1,196 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+
+#include "conv_geometry.h"
+
+#include <memory>
+#include <vector>
+
+#include "array4d.h"
+#include "computation_builder.h"
+#include "literal_test_util.h"
+#include "literal_util.h"
+#include "reference_util.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+// Tests the epilogues fused into every convolution algorithm against the
+// unfused direct convolution followed by a separate bias, residual and
+// activation pass.
+class ConvEpilogueTest /* : public ::testing::Test */
+{
+public:
+
+   ConvEpilogueTest() { run(); }
+
+   void AllAlgorithms();
+   void AllActivations();
+   void GeneralDimensionNumbers();
+   void BiasOnly();
+
+   void run();
+};
+
+void ExpectFusedMatchesUnfused(const Array4D<float>& input,
+                               const Array4D<float>& kernel,
+                               std::pair<int64, int64> stride, Padding padding,
+                               const ConvolutionDimensionNumbers& dnums,
+                               conv::ConvAlgorithm algorithm,
+                               ActivationFunction activation, bool residual,
+                               float tolerance)
+{
+   auto unfused = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+       input, kernel, stride, padding, {1, 1}, {1, 1}, dnums,
+       conv::ConvAlgorithm::kDirect);
+   const int64 dims[] = {unfused->n1(), unfused->n2(), unfused->n3(),
+                         unfused->n4()};
+   std::vector<float> bias(dims[dnums.feature_dimension()]);
+   for (size_t f = 0; f < bias.size(); ++f) {
+      bias[f] = 0.3f * static_cast<float>(f % 5) - 0.6f;
+   }
+   Array4D<float> shortcut(unfused->n1(), unfused->n2(), unfused->n3(),
+                           unfused->n4());
+   shortcut.FillRandom(1.0f, 0.0, 91);
+
+   Array4D<float> expected(unfused->n1(), unfused->n2(), unfused->n3(),
+                           unfused->n4());
+   expected.Each([&](tensorflow::gtl::ArraySlice<int64> indices, float* value) {
+      float x = (*unfused)(indices[0], indices[1], indices[2], indices[3]) +
+                bias[indices[dnums.feature_dimension()]];
+      if (residual) {
+         x += shortcut(indices[0], indices[1], indices[2], indices[3]);
+      }
+      *value = 1.5f * Activate(activation, x);
+   });
+
+   auto actual = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+       input, kernel, stride, padding, {1, 1}, {1, 1}, dnums, algorithm, bias,
+       residual ? &shortcut : nullptr, activation, 1.5f);
+   LiteralTestUtil::ExpectR4NearArray4D(
+       expected, *LiteralUtil::CreateR4FromArray4D(*actual),
+       ErrorSpec(tolerance));
+}
+
+void ConvEpilogueTest::AllAlgorithms()
+{
+   const auto dnums = ComputationBuilder::CreateDefaultConvDimensionNumbers();
+   Array4D<float> input(2, 4, 13, 11);
+   Array4D<float> kernel3(5, 4, 3, 3);
+   Array4D<float> kernel1(5, 4, 1, 1);
+   Array4D<float> kernel9(5, 4, 9, 9);
+   input.FillRandom(1.0f, 0.0, 92);
+   kernel3.FillRandom(1.0f, 0.0, 93);
+   kernel1.FillRandom(1.0f, 0.0, 94);
+   kernel9.FillRandom(0.1f, 0.0, 95);
+
+   const ActivationFunction relu = ActivationFunction::kRelu;
+   for (bool residual : {false, true}) {
+      ExpectFusedMatchesUnfused(input, kernel3, {1, 1}, Padding::kSame, dnums,
+                                conv::ConvAlgorithm::kDirect, relu, residual,
+                                1e-5f);
+      ExpectFusedMatchesUnfused(input, kernel3, {2, 1}, Padding::kValid, dnums,
+                                conv::ConvAlgorithm::kIm2Col, relu, residual,
+                                1e-4f);
+      // The pointwise fast path of ConvIm2Col.
+      ExpectFusedMatchesUnfused(input, kernel1, {1, 1}, Padding::kValid, dnums,
+                                conv::ConvAlgorithm::kIm2Col, relu, residual,
+                                1e-4f);
+      ExpectFusedMatchesUnfused(input, kernel3, {1, 1}, Padding::kSame, dnums,
+                                conv::ConvAlgorithm::kWinogradF2x2, relu,
+                                residual, 1e-4f);
+      ExpectFusedMatchesUnfused(input, kernel3, {1, 1}, Padding::kValid, dnums,
+                                conv::ConvAlgorithm::kWinogradF4x4, relu,
+                                residual, 1e-3f);
+      ExpectFusedMatchesUnfused(input, kernel9, {1, 1}, Padding::kSame, dnums,
+                                conv::ConvAlgorithm::kFft, relu, residual,
+                                1e-4f);
+   }
+}
+
+void ConvEpilogueTest::AllActivations()
+{
+   const auto dnums = ComputationBuilder::CreateDefaultConvDimensionNumbers();
+   Array4D<float> input(1, 3, 10, 12);
+   Array4D<float> kernel(6, 3, 3, 2);
+   input.FillRandom(1.0f, 0.0, 96);
+   kernel.FillRandom(1.0f, 0.0, 97);
+   for (ActivationFunction activation :
+        {ActivationFunction::kNone, ActivationFunction::kRelu,
+         ActivationFunction::kElu, ActivationFunction::kTanh,
+         ActivationFunction::kSigmoid}) {
+      ExpectFusedMatchesUnfused(input, kernel, {1, 1}, Padding::kSame, dnums,
+                                conv::ConvAlgorithm::kIm2Col, activation,
+                                true, 1e-4f);
+   }
+}
+
+void ConvEpilogueTest::GeneralDimensionNumbers()
+{
+   // NHWC input, HWIO filter: bias and residual follow the feature dimension
+   // of the result rather than the canonical layout.
+   ConvolutionDimensionNumbers dnums;
+   dnums.set_batch_dimension(0);
+   dnums.add_spatial_dimensions(1);
+   dnums.add_spatial_dimensions(2);
+   dnums.set_feature_dimension(3);
+   dnums.add_kernel_spatial_dimensions(0);
+   dnums.add_kernel_spatial_dimensions(1);
+   dnums.set_kernel_input_feature_dimension(2);
+   dnums.set_kernel_output_feature_dimension(3);
+
+   Array4D<float> input(2, 9, 8, 3);
+   Array4D<float> kernel(3, 3, 3, 4);
+   input.FillRandom(1.0f, 0.0, 98);
+   kernel.FillRandom(1.0f, 0.0, 99);
+   ExpectFusedMatchesUnfused(input, kernel, {1, 1}, Padding::kSame, dnums,
+                             conv::ConvAlgorithm::kIm2Col,
+                             ActivationFunction::kElu, true, 1e-4f);
+   ExpectFusedMatchesUnfused(input, kernel, {1, 1}, Padding::kSame, dnums,
+                             conv::ConvAlgorithm::kWinogradF2x2,
+                             ActivationFunction::kElu, true, 1e-4f);
+}
+
+void ConvEpilogueTest::BiasOnly()
+{
+   // A zero kernel leaves only the epilogue: relu(bias) in every position.
+   Array4D<float> input(1, 2, 4, 4);
+   input.FillRandom(1.0f, 0.0, 100);
+   Array4D<float> kernel(2, 2, 3, 3, 0.0f);
+   auto result = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+       input, kernel, {1, 1}, Padding::kSame, {1, 1}, {1, 1},
+       ComputationBuilder::CreateDefaultConvDimensionNumbers(),
+       conv::ConvAlgorithm::kIm2Col, {-1.0f, 2.0f}, nullptr,
+       ActivationFunction::kRelu, 1.0f);
+   for (int64 y = 0; y < 4; ++y) {
+      for (int64 x = 0; x < 4; ++x) {
+         ASSERT_EQ((*result)(0, 0, y, x), 0.0f);
+         ASSERT_EQ((*result)(0, 1, y, x), 2.0f);
+      }
+   }
+}
+
+void ConvEpilogueTest::run()
+{
+   AllAlgorithms();
+   AllActivations();
+   GeneralDimensionNumbers();
+   BiasOnly();
+}
+
+}  // namespace
+}  // namespace xla
@@ -0,0 +1,311 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "conv_fft.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "fft.h"
+#include "intra_op_thread_pool.h"
+#include "logging.h"
+
+namespace xla {
+namespace conv {
+namespace {
+
+using fft::Complex;
+
+// Upper bound on the memory held by the filter spectra. PreferFft rejects
+// convolutions whose smallest useful transform would exceed it.
+constexpr int64 kMaxFilterSpectrumBytes = int64{256} << 20;
+
+// Relative cost of one flop in each kernel, measured single-threaded against
+// the packed GEMM behind ConvIm2Col: the transforms run at about a tenth of
+// the GEMM's throughput and the pointwise products at about a fifth.
+constexpr double kGemmFlopCost = 1.0;
+constexpr double kTransformFlopCost = 10.0;
+constexpr double kProductFlopCost = 4.5;
+
+// Cost of writing one patch-matrix element and packing it for the GEMM, and
+// the GEMM's row blocking: output features are computed in groups of this
+// many, so a convolution with fewer features pays for a whole group.
+constexpr double kPatchElementCost = 40.0;
+constexpr int64 kGemmRowBlock = 6;
+
+// How the padded input is cut into blocks, and the transform size per block.
+struct FftTiling {
+  int64 fft_height;
+  int64 fft_width;
+  int64 block_height;
+  int64 block_width;
+  double cost;
+  // Whether the filter spectra fit kMaxFilterSpectrumBytes.
+  bool fits;
+};
+
+// Flops of one two-dimensional real transform.
+double TransformFlops(int64 rows, int64 cols) {
+  const double points = static_cast<double>(rows) * cols;
+  return 2.5 * points * std::log2(std::max(points, 2.0));
+}
+
+// Transform sizes worth trying along one dimension, from blocks about as large
+// as the kernel up to a single block covering the whole padded extent.
+std::vector<int64> CandidateSizes(int64 kernel, int64 extent, bool even) {
+  const int64 largest = fft::GoodFftSize(extent + kernel - 1, even);
+  std::vector<int64> sizes;
+  for (int64 n = fft::GoodFftSize(std::min(2 * kernel, largest), even);
+       n <= largest; n = fft::GoodFftSize(n + 1, even)) {
+    sizes.push_back(n);
+  }
+  return sizes;
+}
+
+// Picks the cheapest tiling whose filter spectra fit the memory budget, or the
+// smallest one if none does.
+FftTiling ChooseTiling(const ConvGeometry& g) {
+  const int64 kernel_height = g.DilatedKernelHeight();
+  const int64 kernel_width = g.DilatedKernelWidth();
+  const int64 extent_height = g.output_height + kernel_height - 1;
+  const int64 extent_width = g.output_width + kernel_width - 1;
+  const double pairs =
+      static_cast<double>(g.input_features) * g.output_features;
+
+  FftTiling best;
+  best.fits = false;
+  best.cost = std::numeric_limits<double>::infinity();
+  for (int64 rows : CandidateSizes(kernel_height, extent_height, false)) {
+    for (int64 cols : CandidateSizes(kernel_width, extent_width, true)) {
+      FftTiling tiling;
+      tiling.fft_height = rows;
+      tiling.fft_width = cols;
+      tiling.block_height = rows - kernel_height + 1;
+      tiling.block_width = cols - kernel_width + 1;
+      const double bins = static_cast<double>(rows) * (cols / 2 + 1);
+      tiling.fits = pairs * bins * sizeof(Complex) <= kMaxFilterSpectrumBytes;
+      const double blocks =
+          static_cast<double>(g.batch) *
+          ((extent_height + tiling.block_height - 1) / tiling.block_height) *
+          ((extent_width + tiling.block_width - 1) / tiling.block_width);
+      const double transforms =
+          pairs + blocks * (g.input_features + g.output_features);
+      tiling.cost =
+          transforms * TransformFlops(rows, cols) * kTransformFlopCost +
+          blocks * pairs * bins * 8 * kProductFlopCost;
+      if ((tiling.fits && !best.fits) ||
+          (tiling.fits == best.fits && tiling.cost < best.cost)) {
+        best = tiling;
+      }
+    }
+  }
+  return best;
+}
+
+// acc[i] += a[i] * b[i] for n complex values.
+void MultiplyAccumulate(const Complex* a, const Complex* b, int64 n,
+                        Complex* acc) {
+  const float* x = reinterpret_cast<const float*>(a);
+  const float* y = reinterpret_cast<const float*>(b);
+  float* z = reinterpret_cast<float*>(acc);
+  for (int64 i = 0; i < n; ++i) {
+    const float xr = x[2 * i];
+    const float xi = x[2 * i + 1];
+    const float yr = y[2 * i];
+    const float yi = y[2 * i + 1];
+    z[2 * i] += xr * yr - xi * yi;
+    z[2 * i + 1] += xr * yi + xi * yr;
+  }
+}
+
+}  // namespace
+
+bool CanUseFft(const ConvGeometry& geometry) {
+  return geometry.stride_y == 1 && geometry.stride_x == 1 &&
+         geometry.lhs_dilation_y == 1 && geometry.lhs_dilation_x == 1 &&
+         geometry.feature_group_count == 1;
+}
+
+double FftConvCost(const ConvGeometry& geometry) {
+  if (!CanUseFft(geometry)) {
+    return std::numeric_limits<double>::infinity();
+  }
+  return ChooseTiling(geometry).cost;
+}
+
+double Im2ColConvCost(const ConvGeometry& g) {
+  const double patch_elements = static_cast<double>(g.batch) *
+                                g.output_height * g.output_width *
+                                g.input_features * g.kernel_height *
+                                g.kernel_width;
+  const int64 padded_features =
+      (g.output_features + kGemmRowBlock - 1) / kGemmRowBlock * kGemmRowBlock;
+  return patch_elements *
+         (2.0 * padded_features * kGemmFlopCost + kPatchElementCost);
+}
+
+bool PreferFft(const ConvGeometry& geometry) {
+  if (!CanUseFft(geometry) || geometry.MultiplyAdds() == 0) {
+    return false;
+  }
+  const FftTiling tiling = ChooseTiling(geometry);
+  return tiling.fits && tiling.cost < Im2ColConvCost(geometry);
+}
+
+// The convolution correlates the padded input with the kernel, which is a
+// linear convolution with the flipped kernel: output[o] = (xp * flipped)[o +
+// kernel - 1]. A block of the padded input starting at s contributes its
+// linear convolution, of length block + kernel - 1 <= fft size, to the outputs
+// o = s + n - (kernel - 1).
+void ConvFft(const ConvGeometry& g, const float* input, const float* filter,
+             float* output) {
+  ConvFft(g, input, filter, ConvEpilogue(), output);
+}
+
+void ConvFft(const ConvGeometry& g, const float* input, const float* filter,
+             const ConvEpilogue& epilogue, float* output) {
+  CHECK(CanUseFft(g));
+  const int64 output_size =
+      g.batch * g.output_features * g.output_height * g.output_width;
+  std::fill(output, output + output_size, 0.0f);
+  if (output_size == 0 || g.input_features == 0) {
+    return;
+  }
+
+  const FftTiling tiling = ChooseTiling(g);
+  const fft::RealFft2DPlan plan(tiling.fft_height, tiling.fft_width);
+  const int64 rows = plan.rows();
+  const int64 cols = plan.cols();
+  const int64 bins = plan.spectrum_size();
+  const int64 transform_cost = static_cast<int64>(TransformFlops(rows, cols));
+  const int64 channels = g.input_features;
+  const int64 features = g.output_features;
+  const int64 kernel_height = g.DilatedKernelHeight();
+  const int64 kernel_width = g.DilatedKernelWidth();
+  const int64 extent_height = g.output_height + kernel_height - 1;
+  const int64 extent_width = g.output_width + kernel_width - 1;
+
+  // Spectra of the dilated, flipped kernels, with the 1 / (rows * cols) of
+  // the inverse transform folded in.
+  std::vector<Complex> filter_spectra(features * channels * bins);
+  const float scale = 1.0f / (rows * cols);
+  ParallelFor(features * channels, transform_cost,
+              [&](int64 first, int64 last) {
+    std::vector<float> plane(rows * cols);
+    for (int64 kc = first; kc < last; ++kc) {
+      std::fill(plane.begin(), plane.end(), 0.0f);
+      const float* taps = filter + kc * g.kernel_height * g.kernel_width;
+      for (int64 ky = 0; ky < g.kernel_height; ++ky) {
+        const int64 y = kernel_height - 1 - ky * g.rhs_dilation_y;
+        for (int64 kx = 0; kx < g.kernel_width; ++kx) {
+          const int64 x = kernel_width - 1 - kx * g.rhs_dilation_x;
+          plane[y * cols + x] = taps[ky * g.kernel_width + kx] * scale;
+        }
+      }
+      plan.Forward(plane.data(), filter_spectra.data() + kc * bins);
+    }
+  });
+
+  const int64 plane_size = g.input_height * g.input_width;
+  const int64 output_plane_size = g.output_height * g.output_width;
+  std::vector<Complex> input_spectra(channels * bins);
+  for (int64 image = 0; image < g.batch; ++image) {
+    for (int64 s_y = 0; s_y < extent_height; s_y += tiling.block_height) {
+      for (int64 s_x = 0; s_x < extent_width; s_x += tiling.block_width) {
+        // Batched forward transforms of the block in every input channel.
+        ParallelFor(channels, transform_cost, [&](int64 first, int64 last) {
+          std::vector<float> plane(rows * cols);
+          const int64 first_x = std::max(s_x, g.pad_left);
+          const int64 last_x =
+              std::min({s_x + tiling.block_width, extent_width,
+                        g.pad_left + g.input_width});
+          for (int64 c = first; c < last; ++c) {
+            std::fill(plane.begin(), plane.end(), 0.0f);
+            const float* src = input + (image * channels + c) * plane_size;
+            for (int64 t_y = 0; t_y < tiling.block_height; ++t_y) {
+              const int64 y = s_y + t_y - g.pad_top;
+              if (s_y + t_y >= extent_height || y < 0 ||
+                  y >= g.input_height) {
+                continue;
+              }
+              for (int64 x = first_x; x < last_x; ++x) {
+                plane[t_y * cols + x - s_x] =
+                    src[y * g.input_width + x - g.pad_left];
+              }
+            }
+            plan.Forward(plane.data(), input_spectra.data() + c * bins);
+          }
+        });
+
+        // Per output feature: sum the products over channels, transform back
+        // and overlap-add into the output.
+        ParallelFor(features, transform_cost + 8 * channels * bins,
+                    [&](int64 first, int64 last) {
+          std::vector<Complex> accumulator(bins);
+          std::vector<float> plane(rows * cols);
+          for (int64 k = first; k < last; ++k) {
+            std::fill(accumulator.begin(), accumulator.end(), Complex());
+            for (int64 c = 0; c < channels; ++c) {
+              MultiplyAccumulate(
+                  filter_spectra.data() + (k * channels + c) * bins,
+                  input_spectra.data() + c * bins, bins, accumulator.data());
+            }
+            plan.Inverse(accumulator.data(), plane.data());
+            float* dst = output + (image * features + k) * output_plane_size;
+            const int64 first_x = std::max<int64>(0, kernel_width - 1 - s_x);
+            const int64 last_x = std::min(
+                tiling.block_width + kernel_width - 1,
+                g.output_width + kernel_width - 1 - s_x);
+            for (int64 n_y = 0; n_y < tiling.block_height + kernel_height - 1;
+                 ++n_y) {
+              const int64 o_y = s_y + n_y - (kernel_height - 1);
+              if (o_y < 0) {
+                continue;
+              }
+              if (o_y >= g.output_height) {
+                break;
+              }
+              const int64 offset =
+                  o_y * g.output_width + s_x - (kernel_width - 1);
+              const float* src_row = plane.data() + n_y * cols;
+              for (int64 n_x = first_x; n_x < last_x; ++n_x) {
+                dst[offset + n_x] += src_row[n_x];
+              }
+            }
+          }
+        });
+      }
+    }
+
+    // Overlap-add leaves an output value final only once every block of the
+    // image is done, so the epilogue runs per image, while the image's
+    // output is still warm.
+    if (!epilogue.IsIdentity()) {
+      ParallelFor(features, 4 * output_plane_size,
+                  [&](int64 first, int64 last) {
+        for (int64 k = first; k < last; ++k) {
+          const int64 offset = (image * features + k) * output_plane_size;
+          ApplyConvEpilogue(epilogue, k, offset, output_plane_size,
+                            output + offset);
+        }
+      });
+    }
+  }
+}
+
+}  // namespace conv
+}  // namespace xla
@@ -0,0 +1,67 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_CONV_FFT_H_
+#define TENSORFLOW_COMPILER_XLA_CONV_FFT_H_
+
+#include "conv_geometry.h"
+#include "types.h"
+
+namespace xla {
+namespace conv {
+
+// Convolution by pointwise products in the frequency domain. The padded input
+// is cut into blocks that are transformed, multiplied with the filter spectra
+// and accumulated into the output by overlap-add, so the transform size is
+// bounded by the block size rather than the image size. All input channels of
+// a block are transformed together and every output feature reuses them, so a
+// block costs input_features + output_features transforms plus
+// input_features * output_features pointwise products, independent of the
+// kernel area.
+//
+// This wins over GEMM once kernels reach about 5x5 to 9x9, depending on the
+// feature counts and image size; for small kernels the transforms dominate.
+
+// Returns whether the FFT kernel can compute the convolution: unit strides,
+// no input dilation and no feature groups. Kernel dilation and both paddings
+// are supported.
+bool CanUseFft(const ConvGeometry& geometry);
+
+// Estimated costs, in comparable units, of computing the convolution with
+// ConvFft and with ConvIm2Col.
+double FftConvCost(const ConvGeometry& geometry);
+double Im2ColConvCost(const ConvGeometry& geometry);
+
+// Returns whether ConvFft is expected to be faster than ConvIm2Col: the
+// convolution satisfies CanUseFft, the filter spectra fit a fixed memory
+// budget and FftConvCost is the lower estimate.
+bool PreferFft(const ConvGeometry& geometry);
+
+// Computes the convolution described by geometry, which must satisfy
+// CanUseFft. All operands are in the canonical layouts of conv_geometry.h.
+// Results match the direct convolution to about 1e-5 relative to the largest
+// output magnitude.
+void ConvFft(const ConvGeometry& geometry, const float* input,
+             const float* filter, float* output);
+
+// As above, with epilogue applied to each image's output as soon as the
+// overlap-add has completed it.
+void ConvFft(const ConvGeometry& geometry, const float* input,
+             const float* filter, const ConvEpilogue& epilogue, float* output);
+
+}  // namespace conv
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_CONV_FFT_H_
@@ -0,0 +1,208 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "conv_fft.h"
+
+#include <memory>
+
+#include "array2d.h"
+#include "array4d.h"
+#include "computation_builder.h"
+#include "reference_util.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+// Tests the FFT convolution against the direct convolution.
+class ConvFftTest /* : public ::testing::Test */
+{
+public:
+
+   ConvFftTest() { run(); }
+
+   void LargeKernelMatchesDirect();
+   void OverlapAddTilesMatchDirect();
+   void DilatedKernelMatchesDirect();
+   void GeneralDimensionsMatchDirect();
+   void CostModelPrefersFftForLargeKernels();
+   void UnsupportedShapesFallBack();
+   void Conv2DMatchesDirectLoop();
+
+   void run();
+};
+
+// Checks the FFT convolution against the direct one under both paddings.
+void ExpectFftMatchesDirect(const Array4D<float>& input,
+                            const Array4D<float>& kernel,
+                            std::pair<int64, int64> rhs_dilation,
+                            const ConvolutionDimensionNumbers& dnums)
+{
+   for (Padding padding : {Padding::kSame, Padding::kValid}) {
+      auto expected = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+          input, kernel, {1, 1}, padding, {1, 1}, rhs_dilation, dnums,
+          conv::ConvAlgorithm::kDirect);
+      auto actual = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+          input, kernel, {1, 1}, padding, {1, 1}, rhs_dilation, dnums,
+          conv::ConvAlgorithm::kFft);
+      ASSERT_TRUE(expected->n1() == actual->n1());
+      ASSERT_TRUE(expected->n2() == actual->n2());
+      ASSERT_TRUE(expected->n3() == actual->n3());
+      ASSERT_TRUE(expected->n4() == actual->n4());
+      ASSERT_TRUE(testing::RelativeMaxError(*expected, *actual) < 1e-5f);
+   }
+}
+
+void ConvFftTest::LargeKernelMatchesDirect()
+{
+   // Odd and even kernel sizes pad asymmetrically under kSame.
+   Array4D<float> input(2, 3, 27, 31);
+   input.FillRandom(1.0f, 0.0, 51);
+   for (int64 size : {15, 16}) {
+      Array4D<float> kernel(4, 3, size, size + 1);
+      kernel.FillRandom(1.0f, 0.0, 52);
+      ExpectFftMatchesDirect(input, kernel, {1, 1},
+                             ComputationBuilder::CreateDefaultConvDimensionNumbers());
+   }
+}
+
+void ConvFftTest::OverlapAddTilesMatchDirect()
+{
+   // A small kernel on a large image makes the tiling pick several blocks in
+   // both dimensions.
+   Array4D<float> input(1, 2, 150, 170);
+   Array4D<float> kernel(3, 2, 5, 5);
+   input.FillRandom(1.0f, 0.0, 53);
+   kernel.FillRandom(1.0f, 0.0, 54);
+   ExpectFftMatchesDirect(input, kernel, {1, 1},
+                          ComputationBuilder::CreateDefaultConvDimensionNumbers());
+}
+
+void ConvFftTest::DilatedKernelMatchesDirect()
+{
+   Array4D<float> input(1, 2, 33, 29);
+   Array4D<float> kernel(2, 2, 5, 4);
+   input.FillRandom(1.0f, 0.0, 55);
+   kernel.FillRandom(1.0f, 0.0, 56);
+   ExpectFftMatchesDirect(input, kernel, {3, 2},
+                          ComputationBuilder::CreateDefaultConvDimensionNumbers());
+}
+
+void ConvFftTest::GeneralDimensionsMatchDirect()
+{
+   // NHWC input, HWIO filter.
+   ConvolutionDimensionNumbers dnums;
+   dnums.set_batch_dimension(0);
+   dnums.add_spatial_dimensions(1);
+   dnums.add_spatial_dimensions(2);
+   dnums.set_feature_dimension(3);
+   dnums.add_kernel_spatial_dimensions(0);
+   dnums.add_kernel_spatial_dimensions(1);
+   dnums.set_kernel_input_feature_dimension(2);
+   dnums.set_kernel_output_feature_dimension(3);
+
+   Array4D<float> input(2, 24, 20, 3);
+   Array4D<float> kernel(11, 9, 3, 5);
+   input.FillRandom(1.0f, 0.0, 57);
+   kernel.FillRandom(1.0f, 0.0, 58);
+   ExpectFftMatchesDirect(input, kernel, {1, 1}, dnums);
+}
+
+void ConvFftTest::CostModelPrefersFftForLargeKernels()
+{
+   const auto dnums = ComputationBuilder::CreateDefaultConvDimensionNumbers();
+   Array4D<float> input(1, 16, 64, 64);
+
+   Array4D<float> small_kernel(16, 16, 3, 3);
+   conv::ConvGeometry geometry = conv::MakeConvGeometry(
+       input, small_kernel, {1, 1}, Padding::kSame, {1, 1}, {1, 1}, dnums);
+   ASSERT_TRUE(!conv::PreferFft(geometry));
+
+   Array4D<float> large_kernel(16, 16, 21, 21);
+   geometry = conv::MakeConvGeometry(input, large_kernel, {1, 1},
+                                     Padding::kSame, {1, 1}, {1, 1}, dnums);
+   ASSERT_TRUE(conv::PreferFft(geometry));
+   ASSERT_TRUE(conv::FftConvCost(geometry) < conv::Im2ColConvCost(geometry));
+
+   // Strided convolutions cannot use the FFT however large the kernel.
+   Array4D<float> strided_input(1, 16, 65, 65);
+   geometry = conv::MakeConvGeometry(strided_input, large_kernel, {2, 2},
+                                     Padding::kValid, {1, 1}, {1, 1}, dnums);
+   ASSERT_TRUE(!conv::CanUseFft(geometry));
+   ASSERT_TRUE(!conv::PreferFft(geometry));
+}
+
+void ConvFftTest::UnsupportedShapesFallBack()
+{
+   Array4D<float> input(1, 2, 20, 20);
+   Array4D<float> kernel(2, 2, 7, 7);
+   input.FillRandom(1.0f, 0.0, 59);
+   kernel.FillRandom(1.0f, 0.0, 60);
+   auto expected = ReferenceUtil::Conv4D(input, kernel, {2, 2}, Padding::kValid,
+                                         conv::ConvAlgorithm::kIm2Col);
+   auto actual = ReferenceUtil::Conv4D(input, kernel, {2, 2}, Padding::kValid,
+                                       conv::ConvAlgorithm::kFft);
+   ASSERT_TRUE(expected->flatten() == actual->flatten());
+}
+
+void ConvFftTest::Conv2DMatchesDirectLoop()
+{
+   // The image filter path: colors as batch, one channel, a large blur.
+   Array4D<float> image(3, 1, 96, 80);
+   image.FillRandom(1.0f, 0.0, 61);
+   Array2D<float> kernel(25, 25);
+   kernel.FillRandom(1.0f, 0.0, 62);
+
+   for (Padding padding : {Padding::kSame, Padding::kValid}) {
+      std::unique_ptr<Array4D<float>> fft_result;
+      ASSERT_TRUE(ReferenceUtil::Conv2DFft(image, kernel, {1, 1}, padding,
+                                           &fft_result));
+      // The double instantiation always runs the direct loop.
+      std::unique_ptr<Array4D<double>> image_double = image.convert<double>();
+      Array2D<double> kernel_double(kernel.height(), kernel.width());
+      for (int64 i = 0; i < kernel.num_elements(); ++i) {
+         kernel_double.data()[i] = kernel.data()[i];
+      }
+      auto expected = ReferenceUtil::Conv2D<double>(*image_double, kernel_double,
+                                                    {1, 1}, padding);
+      auto expected_float = expected->convert<float>();
+      ASSERT_TRUE(
+          testing::RelativeMaxError(*expected_float, *fft_result) < 1e-5f);
+
+      auto result = ReferenceUtil::Conv2D<float>(image, kernel, {1, 1}, padding);
+      ASSERT_TRUE(result->flatten() == fft_result->flatten());
+   }
+
+   // Small kernels stay on the direct loop.
+   Array2D<float> small_kernel(3, 3);
+   std::unique_ptr<Array4D<float>> unused;
+   ASSERT_TRUE(!ReferenceUtil::Conv2DFft(image, small_kernel, {1, 1},
+                                         Padding::kSame, &unused));
+   ASSERT_TRUE(unused == nullptr);
+}
+
+void ConvFftTest::run()
+{
+   LargeKernelMatchesDirect();
+   OverlapAddTilesMatchDirect();
+   DilatedKernelMatchesDirect();
+   GeneralDimensionsMatchDirect();
+   CostModelPrefersFftForLargeKernels();
+   UnsupportedShapesFallBack();
+   Conv2DMatchesDirectLoop();
+}
+
+}  // namespace
+}  // namespace xla
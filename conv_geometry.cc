@@ -0,0 +1,320 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "conv_geometry.h"
+
+#include <algorithm>
+#include <array>
+
+#include "intra_op_thread_pool.h"
+#include "logging.h"
+#include "ptr_util.h"
+#include "simd_kernels.h"
+#include "window_util.h"
+
+namespace xla {
+namespace conv {
+namespace {
+
+// Copies canonical [batch][features][height][width] activations into an
+// array laid out as dnums describes the convolution input.
+std::unique_ptr<Array4D<float>> ActivationsFromCanonical(
+    int64 batch, int64 features, int64 height, int64 width,
+    const std::vector<float>& activations,
+    const ConvolutionDimensionNumbers& dnums) {
+  std::array<int64, 4> dims;
+  dims[dnums.batch_dimension()] = batch;
+  dims[dnums.feature_dimension()] = features;
+  dims[dnums.spatial_dimensions(0)] = height;
+  dims[dnums.spatial_dimensions(1)] = width;
+  auto result = MakeUnique<Array4D<float>>(dims[0], dims[1], dims[2], dims[3]);
+
+  ParallelFor(batch * features, height * width, [&](int64 first, int64 last) {
+    std::array<int64, 4> index;
+    for (int64 bf = first; bf < last; ++bf) {
+      index[dnums.batch_dimension()] = bf / features;
+      index[dnums.feature_dimension()] = bf % features;
+      const float* src = &activations[bf * height * width];
+      for (int64 y = 0; y < height; ++y) {
+        index[dnums.spatial_dimensions(0)] = y;
+        for (int64 x = 0; x < width; ++x) {
+          index[dnums.spatial_dimensions(1)] = x;
+          (*result)(index[0], index[1], index[2], index[3]) = *src++;
+        }
+      }
+    }
+  });
+  return result;
+}
+
+}  // namespace
+
+int64 ConvGeometry::DilatedInputHeight() const {
+  return window_util::DilatedBound(input_height, lhs_dilation_y);
+}
+
+int64 ConvGeometry::DilatedInputWidth() const {
+  return window_util::DilatedBound(input_width, lhs_dilation_x);
+}
+
+int64 ConvGeometry::DilatedKernelHeight() const {
+  return window_util::DilatedBound(kernel_height, rhs_dilation_y);
+}
+
+int64 ConvGeometry::DilatedKernelWidth() const {
+  return window_util::DilatedBound(kernel_width, rhs_dilation_x);
+}
+
+int64 ConvGeometry::MultiplyAdds() const {
+  return batch * output_features * output_height * output_width *
+         (input_features / feature_group_count) * kernel_height * kernel_width;
+}
+
+void ApplyConvEpilogue(const ConvEpilogue& epilogue, int64 feature,
+                       int64 offset, int64 count, float* values) {
+  if (epilogue.bias != nullptr) {
+    simd::AddScalar(epilogue.bias[feature], values, count);
+  }
+  if (epilogue.residual != nullptr) {
+    simd::Add(values, epilogue.residual + offset, values, count);
+  }
+  simd::ActivateAndScale(epilogue.activation, epilogue.scale, values, count);
+}
+
+ConvGeometry MakeConvGeometry(const Array4D<float>& lhs,
+                              const Array4D<float>& rhs,
+                              std::pair<int64, int64> kernel_stride,
+                              Padding padding,
+                              std::pair<int64, int64> lhs_dilation,
+                              std::pair<int64, int64> rhs_dilation,
+                              const ConvolutionDimensionNumbers& dnums,
+                              int64 feature_group_count) {
+  return MakeConvGeometry({{lhs.n1(), lhs.n2(), lhs.n3(), lhs.n4()}},
+                          {{rhs.n1(), rhs.n2(), rhs.n3(), rhs.n4()}},
+                          kernel_stride, padding, lhs_dilation, rhs_dilation,
+                          dnums, feature_group_count);
+}
+
+ConvGeometry MakeConvGeometry(const std::array<int64, 4>& lhs_dimensions,
+                              const std::array<int64, 4>& rhs_dimensions,
+                              std::pair<int64, int64> kernel_stride,
+                              Padding padding,
+                              std::pair<int64, int64> lhs_dilation,
+                              std::pair<int64, int64> rhs_dilation,
+                              const ConvolutionDimensionNumbers& dnums,
+                              int64 feature_group_count) {
+  ConvGeometry geometry;
+  geometry.batch = lhs_dimensions[dnums.batch_dimension()];
+  geometry.input_features = lhs_dimensions[dnums.feature_dimension()];
+  geometry.input_height = lhs_dimensions[dnums.spatial_dimensions(0)];
+  geometry.input_width = lhs_dimensions[dnums.spatial_dimensions(1)];
+  geometry.output_features =
+      rhs_dimensions[dnums.kernel_output_feature_dimension()];
+  geometry.kernel_height = rhs_dimensions[dnums.kernel_spatial_dimensions(0)];
+  geometry.kernel_width = rhs_dimensions[dnums.kernel_spatial_dimensions(1)];
+  CHECK_GE(feature_group_count, 1);
+  CHECK_EQ(geometry.input_features % feature_group_count, 0);
+  CHECK_EQ(geometry.output_features % feature_group_count, 0);
+  CHECK_EQ(rhs_dimensions[dnums.kernel_input_feature_dimension()],
+           geometry.input_features / feature_group_count);
+  geometry.feature_group_count = feature_group_count;
+
+  geometry.stride_y = kernel_stride.first;
+  geometry.stride_x = kernel_stride.second;
+  geometry.lhs_dilation_y = lhs_dilation.first;
+  geometry.lhs_dilation_x = lhs_dilation.second;
+  geometry.rhs_dilation_y = rhs_dilation.first;
+  geometry.rhs_dilation_x = rhs_dilation.second;
+  CHECK_GE(geometry.lhs_dilation_y, 1);
+  CHECK_GE(geometry.lhs_dilation_x, 1);
+  CHECK_GE(geometry.rhs_dilation_y, 1);
+  CHECK_GE(geometry.rhs_dilation_x, 1);
+
+  const int64 iy = geometry.DilatedInputHeight();
+  const int64 ix = geometry.DilatedInputWidth();
+  const int64 ky = geometry.DilatedKernelHeight();
+  const int64 kx = geometry.DilatedKernelWidth();
+  if (padding == Padding::kSame) {
+    // Same padding with kernel striding is rejected, as in the reference
+    // implementation.
+    CHECK_EQ(1, geometry.stride_y);
+    CHECK_EQ(1, geometry.stride_x);
+    geometry.output_height = iy;
+    geometry.output_width = ix;
+    geometry.pad_top = (ky % 2 == 0) ? ky / 2 - 1 : ky / 2;
+    geometry.pad_left = (kx % 2 == 0) ? kx / 2 - 1 : kx / 2;
+  } else {
+    geometry.output_height =
+        window_util::StridedBound(iy, ky, geometry.stride_y);
+    geometry.output_width =
+        window_util::StridedBound(ix, kx, geometry.stride_x);
+    geometry.pad_top = 0;
+    geometry.pad_left = 0;
+  }
+  return geometry;
+}
+
+ConvGeometry MakeConvGeometry(const std::array<int64, 4>& lhs_dimensions,
+                              const std::array<int64, 4>& rhs_dimensions,
+                              std::pair<int64, int64> kernel_stride,
+                              const PaddingConfig& lhs_padding,
+                              std::pair<int64, int64> lhs_dilation,
+                              std::pair<int64, int64> rhs_dilation,
+                              const ConvolutionDimensionNumbers& dnums,
+                              int64 feature_group_count) {
+  CHECK_EQ(lhs_padding.dimensions_size(), 4);
+  for (int64 dimension :
+       {dnums.batch_dimension(), dnums.feature_dimension()}) {
+    const auto& p = lhs_padding.dimensions(static_cast<int>(dimension));
+    CHECK_EQ(p.edge_padding_low(), 0);
+    CHECK_EQ(p.edge_padding_high(), 0);
+    CHECK_EQ(p.interior_padding(), 0);
+  }
+  ConvGeometry geometry = MakeConvGeometry(
+      lhs_dimensions, rhs_dimensions, kernel_stride, Padding::kValid,
+      lhs_dilation, rhs_dilation, dnums, feature_group_count);
+
+  // Dilating the padded input by d puts padded element j at j * d; the input
+  // element e sits at padded index low + e * (interior + 1).
+  const auto fold = [&](int64 spatial, int64 size, int64 stride,
+                        int64 kernel_extent, int64* dilation, int64* pad,
+                        int64* output) {
+    const auto& p = lhs_padding.dimensions(
+        static_cast<int>(dnums.spatial_dimensions(static_cast<int>(spatial))));
+    CHECK_GE(p.edge_padding_low(), 0) << "not implemented";
+    CHECK_GE(p.edge_padding_high(), 0) << "not implemented";
+    CHECK_GE(p.interior_padding(), 0);
+    const int64 padded = p.edge_padding_low() + p.edge_padding_high() + size +
+                         std::max<int64>(size - 1, 0) * p.interior_padding();
+    *pad = p.edge_padding_low() * *dilation;
+    *output = window_util::StridedBound(
+        window_util::DilatedBound(padded, *dilation), kernel_extent, stride);
+    *dilation *= p.interior_padding() + 1;
+  };
+  fold(0, geometry.input_height, geometry.stride_y,
+       geometry.DilatedKernelHeight(), &geometry.lhs_dilation_y,
+       &geometry.pad_top, &geometry.output_height);
+  fold(1, geometry.input_width, geometry.stride_x,
+       geometry.DilatedKernelWidth(), &geometry.lhs_dilation_x,
+       &geometry.pad_left, &geometry.output_width);
+  return geometry;
+}
+
+ConvGeometry FeatureGroupGeometry(const ConvGeometry& geometry) {
+  ConvGeometry group = geometry;
+  group.input_features /= geometry.feature_group_count;
+  group.output_features /= geometry.feature_group_count;
+  group.feature_group_count = 1;
+  return group;
+}
+
+std::vector<float> CanonicalConvInput(const Array4D<float>& lhs,
+                                      const ConvolutionDimensionNumbers& dnums) {
+  const std::array<int64, 4> dims{{lhs.n1(), lhs.n2(), lhs.n3(), lhs.n4()}};
+  const int64 batch = dims[dnums.batch_dimension()];
+  const int64 features = dims[dnums.feature_dimension()];
+  const int64 height = dims[dnums.spatial_dimensions(0)];
+  const int64 width = dims[dnums.spatial_dimensions(1)];
+  std::vector<float> result(batch * features * height * width);
+  ParallelFor(batch * features, height * width, [&](int64 first, int64 last) {
+    std::array<int64, 4> index;
+    for (int64 bf = first; bf < last; ++bf) {
+      index[dnums.batch_dimension()] = bf / features;
+      index[dnums.feature_dimension()] = bf % features;
+      float* dst = &result[bf * height * width];
+      for (int64 y = 0; y < height; ++y) {
+        index[dnums.spatial_dimensions(0)] = y;
+        for (int64 x = 0; x < width; ++x) {
+          index[dnums.spatial_dimensions(1)] = x;
+          *dst++ = lhs(index[0], index[1], index[2], index[3]);
+        }
+      }
+    }
+  });
+  return result;
+}
+
+std::vector<float> CanonicalConvFilter(
+    const Array4D<float>& rhs, const ConvolutionDimensionNumbers& dnums) {
+  const std::array<int64, 4> dims{{rhs.n1(), rhs.n2(), rhs.n3(), rhs.n4()}};
+  const int64 output_features = dims[dnums.kernel_output_feature_dimension()];
+  const int64 input_features = dims[dnums.kernel_input_feature_dimension()];
+  const int64 height = dims[dnums.kernel_spatial_dimensions(0)];
+  const int64 width = dims[dnums.kernel_spatial_dimensions(1)];
+  std::vector<float> result(output_features * input_features * height * width);
+  std::array<int64, 4> index;
+  float* dst = result.data();
+  for (int64 o = 0; o < output_features; ++o) {
+    index[dnums.kernel_output_feature_dimension()] = o;
+    for (int64 i = 0; i < input_features; ++i) {
+      index[dnums.kernel_input_feature_dimension()] = i;
+      for (int64 y = 0; y < height; ++y) {
+        index[dnums.kernel_spatial_dimensions(0)] = y;
+        for (int64 x = 0; x < width; ++x) {
+          index[dnums.kernel_spatial_dimensions(1)] = x;
+          *dst++ = rhs(index[0], index[1], index[2], index[3]);
+        }
+      }
+    }
+  }
+  return result;
+}
+
+std::unique_ptr<Array4D<float>> ConvOutputFromCanonical(
+    const ConvGeometry& geometry, const std::vector<float>& output,
+    const ConvolutionDimensionNumbers& dnums) {
+  return ActivationsFromCanonical(geometry.batch, geometry.output_features,
+                                  geometry.output_height, geometry.output_width,
+                                  output, dnums);
+}
+
+std::unique_ptr<Array4D<float>> ConvInputFromCanonical(
+    const ConvGeometry& geometry, const std::vector<float>& input,
+    const ConvolutionDimensionNumbers& dnums) {
+  return ActivationsFromCanonical(geometry.batch, geometry.input_features,
+                                  geometry.input_height, geometry.input_width,
+                                  input, dnums);
+}
+
+std::unique_ptr<Array4D<float>> ConvFilterFromCanonical(
+    const ConvGeometry& geometry, const std::vector<float>& filter,
+    const ConvolutionDimensionNumbers& dnums) {
+  std::array<int64, 4> dims;
+  dims[dnums.kernel_output_feature_dimension()] = geometry.output_features;
+  dims[dnums.kernel_input_feature_dimension()] = geometry.input_features;
+  dims[dnums.kernel_spatial_dimensions(0)] = geometry.kernel_height;
+  dims[dnums.kernel_spatial_dimensions(1)] = geometry.kernel_width;
+  auto result = MakeUnique<Array4D<float>>(dims[0], dims[1], dims[2], dims[3]);
+
+  std::array<int64, 4> index;
+  const float* src = filter.data();
+  for (int64 o = 0; o < geometry.output_features; ++o) {
+    index[dnums.kernel_output_feature_dimension()] = o;
+    for (int64 i = 0; i < geometry.input_features; ++i) {
+      index[dnums.kernel_input_feature_dimension()] = i;
+      for (int64 y = 0; y < geometry.kernel_height; ++y) {
+        index[dnums.kernel_spatial_dimensions(0)] = y;
+        for (int64 x = 0; x < geometry.kernel_width; ++x) {
+          index[dnums.kernel_spatial_dimensions(1)] = x;
+          (*result)(index[0], index[1], index[2], index[3]) = *src++;
+        }
+      }
+    }
+  }
+  return result;
+}
+
+}  // namespace conv
+}  // namespace xla
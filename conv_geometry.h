@@ -0,0 +1,201 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_CONV_GEOMETRY_H_
+#define TENSORFLOW_COMPILER_XLA_CONV_GEOMETRY_H_
+
+// Shared description of a 2D convolution for the optimized convolution
+// kernels, and conversions between the ConvolutionDimensionNumbers layouts of
+// ReferenceUtil and the canonical layouts the kernels work on:
+//
+//   input:  [batch][input_features][input_height][input_width]
+//   filter: [output_features][input_features / feature_group_count]
+//           [kernel_height][kernel_width]
+//   output: [batch][output_features][output_height][output_width]
+//
+// all dense and row-major.
+
+#include <array>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "activation.h"
+#include "array4d.h"
+#include "padding.h"
+#include "types.h"
+#include "xla_data.pb.h"
+
+namespace xla {
+namespace conv {
+
+// Algorithms that can compute a convolution. kDefault uses kTransposed for
+// dilated inputs and otherwise picks between kIm2Col and kFft with the cost
+// model of conv_fft.h.
+enum class ConvAlgorithm {
+  kDefault,
+  // The scalar seven-deep loop; slow, but the definition of the semantics.
+  kDirect,
+  // Lowering to GEMM over chunks of the patch (im2col) matrix.
+  kIm2Col,
+  // Winograd F(2x2, 3x3) and F(4x4, 3x3). Only for 3x3 filters with unit
+  // strides and no dilation; other convolutions fall back to kIm2Col.
+  kWinogradF2x2,
+  kWinogradF4x4,
+  // Overlap-add FFT convolution, for large kernels. Only for unit strides and
+  // no input dilation; other convolutions fall back to kIm2Col.
+  kFft,
+  // Scatter of the real input elements only, for transposed convolutions
+  // (see conv_transposed.h). Only for dilated inputs; other convolutions fall
+  // back to kIm2Col.
+  kTransposed,
+  // Times the algorithms that can handle the convolution on its first run and
+  // keeps the fastest, remembered per shape and CPU model (see conv_plan.h).
+  kAutotune,
+};
+
+// Sizes of one convolution. Input and kernel sizes are the stored (undilated)
+// sizes; dilation is applied on the fly by the kernels.
+struct ConvGeometry {
+  int64 batch;
+  int64 input_features;
+  int64 input_height;
+  int64 input_width;
+  int64 output_features;
+  int64 kernel_height;
+  int64 kernel_width;
+  int64 output_height;
+  int64 output_width;
+
+  int64 stride_y;
+  int64 stride_x;
+  int64 lhs_dilation_y;
+  int64 lhs_dilation_x;
+  int64 rhs_dilation_y;
+  int64 rhs_dilation_x;
+
+  // Number of zero rows/columns before the first (dilated) input element.
+  int64 pad_top;
+  int64 pad_left;
+
+  // Grouped convolution: the input and output features are split into this
+  // many runs of consecutive features, and output group k only reads input
+  // group k, as if the groups were separate convolutions.
+  int64 feature_group_count = 1;
+
+  // Extents of the input and kernel after dilation.
+  int64 DilatedInputHeight() const;
+  int64 DilatedInputWidth() const;
+  int64 DilatedKernelHeight() const;
+  int64 DilatedKernelWidth() const;
+
+  // Multiply-adds performed by a direct evaluation of the convolution.
+  int64 MultiplyAdds() const;
+};
+
+// Elementwise tail fused into a convolution kernel. Every output value x of
+// output feature f becomes
+//
+//   scale * activation(x + bias[f] + residual)
+//
+// where residual is the element at the same position of a tensor in the
+// canonical output layout. bias and residual may be null.
+struct ConvEpilogue {
+  const float* bias = nullptr;
+  const float* residual = nullptr;
+  ActivationFunction activation = ActivationFunction::kNone;
+  float scale = 1.0f;
+
+  // Whether the epilogue leaves every value unchanged.
+  bool IsIdentity() const {
+    return bias == nullptr && residual == nullptr &&
+           activation == ActivationFunction::kNone && scale == 1.0f;
+  }
+};
+
+// Applies epilogue to count consecutive output values of feature `feature`
+// that start at element `offset` of the canonical output.
+void ApplyConvEpilogue(const ConvEpilogue& epilogue, int64 feature,
+                       int64 offset, int64 count, float* values);
+
+// Computes the geometry of ReferenceUtil::ConvArray4DGeneralDimensionsDilated
+// for the given operands, with the same kSame/kValid output sizes and padding.
+ConvGeometry MakeConvGeometry(const Array4D<float>& lhs,
+                              const Array4D<float>& rhs,
+                              std::pair<int64, int64> kernel_stride,
+                              Padding padding,
+                              std::pair<int64, int64> lhs_dilation,
+                              std::pair<int64, int64> rhs_dilation,
+                              const ConvolutionDimensionNumbers& dnums,
+                              int64 feature_group_count = 1);
+
+// As above, from the dimensions of the operands rather than the operands.
+ConvGeometry MakeConvGeometry(const std::array<int64, 4>& lhs_dimensions,
+                              const std::array<int64, 4>& rhs_dimensions,
+                              std::pair<int64, int64> kernel_stride,
+                              Padding padding,
+                              std::pair<int64, int64> lhs_dilation,
+                              std::pair<int64, int64> rhs_dilation,
+                              const ConvolutionDimensionNumbers& dnums,
+                              int64 feature_group_count = 1);
+
+// As above for the convolution, with kValid padding, of lhs padded with zeros
+// as ReferenceUtil::PadArray4D would pad it with lhs_padding. The padding is
+// folded into the geometry instead of being materialized: edge padding
+// becomes pad_top/pad_left and the rows/columns after the input, interior
+// padding multiplies the input dilation. lhs_padding has one entry per lhs
+// dimension; only the spatial ones may pad, and not negatively.
+ConvGeometry MakeConvGeometry(const std::array<int64, 4>& lhs_dimensions,
+                              const std::array<int64, 4>& rhs_dimensions,
+                              std::pair<int64, int64> kernel_stride,
+                              const PaddingConfig& lhs_padding,
+                              std::pair<int64, int64> lhs_dilation,
+                              std::pair<int64, int64> rhs_dilation,
+                              const ConvolutionDimensionNumbers& dnums,
+                              int64 feature_group_count = 1);
+
+// Returns the ungrouped geometry of a single feature group of geometry.
+ConvGeometry FeatureGroupGeometry(const ConvGeometry& geometry);
+
+// Copies lhs into the canonical input layout.
+std::vector<float> CanonicalConvInput(const Array4D<float>& lhs,
+                                      const ConvolutionDimensionNumbers& dnums);
+
+// Copies rhs into the canonical filter layout.
+std::vector<float> CanonicalConvFilter(
+    const Array4D<float>& rhs, const ConvolutionDimensionNumbers& dnums);
+
+// Copies a canonical output into an array laid out as dnums describes the
+// convolution input.
+std::unique_ptr<Array4D<float>> ConvOutputFromCanonical(
+    const ConvGeometry& geometry, const std::vector<float>& output,
+    const ConvolutionDimensionNumbers& dnums);
+
+// Copies a canonical input, such as an input gradient, into an array laid out
+// as dnums describes the convolution input.
+std::unique_ptr<Array4D<float>> ConvInputFromCanonical(
+    const ConvGeometry& geometry, const std::vector<float>& input,
+    const ConvolutionDimensionNumbers& dnums);
+
+// Copies a canonical filter into an array laid out as dnums describes the
+// convolution filter.
+std::unique_ptr<Array4D<float>> ConvFilterFromCanonical(
+    const ConvGeometry& geometry, const std::vector<float>& filter,
+    const ConvolutionDimensionNumbers& dnums);
+
+}  // namespace conv
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_CONV_GEOMETRY_H_
@@ -0,0 +1,261 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "conv_im2col.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "gemm.h"
+#include "intra_op_thread_pool.h"
+
+namespace xla {
+namespace conv {
+namespace {
+
+// Upper bound on the elements of one patch-matrix chunk (4MB of floats), so
+// the chunk stays cache friendly however large the image is.
+constexpr int64 kPatchBufferElements = 1 << 20;
+
+// Lower bound on the output pixels of one chunk, so that each GEMM is wide
+// enough to amortize packing the filter.
+constexpr int64 kMinChunkPixels = 128;
+
+// The GEMM form of epilogue for the output columns of image `image` that
+// start at first_pixel, for a GEMM whose rows are the output features from
+// first_feature on.
+gemm::Epilogue<float> GemmEpilogue(const ConvGeometry& g,
+                                   const ConvEpilogue& epilogue, int64 image,
+                                   int64 first_feature, int64 first_pixel) {
+  const int64 pixels = g.output_height * g.output_width;
+  gemm::Epilogue<float> result;
+  if (epilogue.bias != nullptr) {
+    result.bias = epilogue.bias + first_feature;
+  }
+  result.bias_per_row = true;
+  if (epilogue.residual != nullptr) {
+    result.residual = epilogue.residual +
+                      (image * g.output_features + first_feature) * pixels +
+                      first_pixel;
+    result.residual_ld = pixels;
+  }
+  result.activation = epilogue.activation;
+  result.scale = epilogue.scale;
+  return result;
+}
+
+template <typename T>
+void Im2ColPatchesImpl(const ConvGeometry& g, const T* image,
+                       int64 first_pixel, int64 last_pixel, T padding,
+                       T* patches) {
+  const int64 chunk = last_pixel - first_pixel;
+  const int64 iy = g.DilatedInputHeight();
+  const int64 ix = g.DilatedInputWidth();
+  T* dst = patches;
+  for (int64 c = 0; c < g.input_features; ++c) {
+    const T* plane = image + c * g.input_height * g.input_width;
+    for (int64 r = 0; r < g.kernel_height; ++r) {
+      for (int64 q = 0; q < g.kernel_width; ++q) {
+        int64 pixel = first_pixel;
+        T* row = dst;
+        while (pixel < last_pixel) {
+          const int64 oy = pixel / g.output_width;
+          const int64 ox_begin = pixel % g.output_width;
+          const int64 count =
+              std::min(g.output_width - ox_begin, last_pixel - pixel);
+          const int64 y = oy * g.stride_y - g.pad_top + r * g.rhs_dilation_y;
+          if (y < 0 || y >= iy || y % g.lhs_dilation_y != 0) {
+            std::fill(row, row + count, padding);
+          } else {
+            const T* src = plane + (y / g.lhs_dilation_y) * g.input_width;
+            int64 x = ox_begin * g.stride_x - g.pad_left + q * g.rhs_dilation_x;
+            if (g.lhs_dilation_x == 1) {
+              for (int64 i = 0; i < count; ++i, x += g.stride_x) {
+                row[i] = (x >= 0 && x < ix) ? src[x] : padding;
+              }
+            } else {
+              for (int64 i = 0; i < count; ++i, x += g.stride_x) {
+                row[i] = (x >= 0 && x < ix && x % g.lhs_dilation_x == 0)
+                             ? src[x / g.lhs_dilation_x]
+                             : padding;
+              }
+            }
+          }
+          row += count;
+          pixel += count;
+        }
+        dst += chunk;
+      }
+    }
+  }
+}
+
+// ConvIm2Col on operands stored as S. The patches are gathered in S too, so
+// the GEMM reads as many bytes as the input holds and widens them to float
+// as it packs.
+template <typename S>
+void ConvIm2ColImpl(const ConvGeometry& g, const S* input, const S* filter,
+                    const ConvEpilogue& epilogue, float* output) {
+  // Every feature group is an independent convolution of `group` with its own
+  // slice of the input, filter and output.
+  const ConvGeometry group = FeatureGroupGeometry(g);
+  const int64 groups = g.feature_group_count;
+  const int64 pixels = g.output_height * g.output_width;
+  const int64 plane_size = g.input_height * g.input_width;
+  const int64 depth = group.input_features * g.kernel_height * g.kernel_width;
+  const int64 image_size = g.input_features * plane_size;
+  const int64 output_image_size = g.output_features * pixels;
+  const int64 group_input_size = group.input_features * plane_size;
+  const int64 group_output_size = group.output_features * pixels;
+  const int64 group_filter_size = group.output_features * depth;
+  if (g.batch == 0 || pixels == 0 || g.output_features == 0) {
+    return;
+  }
+
+  // A 1x1 filter applied without stride, padding or dilation reads every input
+  // pixel exactly once, so the image already is the patch matrix. Padding
+  // after the input only shows as an output larger than the input.
+  if (g.kernel_height == 1 && g.kernel_width == 1 && g.stride_y == 1 &&
+      g.stride_x == 1 && g.lhs_dilation_y == 1 && g.lhs_dilation_x == 1 &&
+      g.pad_top == 0 && g.pad_left == 0 &&
+      g.output_height == g.input_height && g.output_width == g.input_width) {
+    for (int64 b = 0; b < g.batch; ++b) {
+      for (int64 k = 0; k < groups; ++k) {
+        gemm::Gemm(gemm::Transpose::kNoTranspose,
+                   gemm::Transpose::kNoTranspose, group.output_features,
+                   pixels, depth, 1.0f, filter + k * group_filter_size, depth,
+                   input + b * image_size + k * group_input_size, pixels, 0.0f,
+                   output + b * output_image_size + k * group_output_size,
+                   pixels,
+                   GemmEpilogue(g, epilogue, b, k * group.output_features, 0));
+      }
+    }
+    return;
+  }
+
+  const int64 chunk = Im2ColChunkPixels(group);
+  const int64 chunks_per_image = (pixels + chunk - 1) / chunk;
+  const int64 tasks_per_image = groups * chunks_per_image;
+  // Every (image, group, chunk) task writes its own columns of the output, and
+  // the GEMM inside a task runs inline when the tasks themselves are spread
+  // over the pool.
+  ParallelFor(g.batch * tasks_per_image,
+              2 * group.output_features * depth * chunk,
+              [&](int64 first, int64 last) {
+                std::vector<S> patches(depth * chunk);
+                for (int64 task = first; task < last; ++task) {
+                  const int64 b = task / tasks_per_image;
+                  const int64 k = task % tasks_per_image / chunks_per_image;
+                  const int64 first_pixel = (task % chunks_per_image) * chunk;
+                  const int64 last_pixel =
+                      std::min(pixels, first_pixel + chunk);
+                  const int64 width = last_pixel - first_pixel;
+                  Im2ColPatchesImpl(
+                      group, input + b * image_size + k * group_input_size,
+                      first_pixel, last_pixel, S(), patches.data());
+                  gemm::Gemm(
+                      gemm::Transpose::kNoTranspose,
+                      gemm::Transpose::kNoTranspose, group.output_features,
+                      width, depth, 1.0f, filter + k * group_filter_size,
+                      depth, patches.data(), width, 0.0f,
+                      output + b * output_image_size + k * group_output_size +
+                          first_pixel,
+                      pixels,
+                      GemmEpilogue(g, epilogue, b, k * group.output_features,
+                                   first_pixel));
+                }
+              });
+}
+
+}  // namespace
+
+void Im2ColPatches(const ConvGeometry& g, const float* image,
+                   int64 first_pixel, int64 last_pixel, float* patches) {
+  Im2ColPatchesImpl(g, image, first_pixel, last_pixel, 0.0f, patches);
+}
+
+void Im2ColPatches(const ConvGeometry& g, const uint8* image,
+                   int64 first_pixel, int64 last_pixel, uint8 padding,
+                   uint8* patches) {
+  Im2ColPatchesImpl(g, image, first_pixel, last_pixel, padding, patches);
+}
+
+void Col2ImPatches(const ConvGeometry& g, const float* patches,
+                   int64 first_pixel, int64 last_pixel, float* image) {
+  const int64 chunk = last_pixel - first_pixel;
+  const int64 iy = g.DilatedInputHeight();
+  const int64 ix = g.DilatedInputWidth();
+  const float* src = patches;
+  for (int64 c = 0; c < g.input_features; ++c) {
+    float* plane = image + c * g.input_height * g.input_width;
+    for (int64 r = 0; r < g.kernel_height; ++r) {
+      for (int64 q = 0; q < g.kernel_width; ++q) {
+        int64 pixel = first_pixel;
+        const float* row = src;
+        while (pixel < last_pixel) {
+          const int64 oy = pixel / g.output_width;
+          const int64 ox_begin = pixel % g.output_width;
+          const int64 count =
+              std::min(g.output_width - ox_begin, last_pixel - pixel);
+          const int64 y = oy * g.stride_y - g.pad_top + r * g.rhs_dilation_y;
+          if (y >= 0 && y < iy && y % g.lhs_dilation_y == 0) {
+            float* dst = plane + (y / g.lhs_dilation_y) * g.input_width;
+            int64 x = ox_begin * g.stride_x - g.pad_left + q * g.rhs_dilation_x;
+            for (int64 i = 0; i < count; ++i, x += g.stride_x) {
+              if (x >= 0 && x < ix && x % g.lhs_dilation_x == 0) {
+                dst[x / g.lhs_dilation_x] += row[i];
+              }
+            }
+          }
+          row += count;
+          pixel += count;
+        }
+        src += chunk;
+      }
+    }
+  }
+}
+
+int64 Im2ColChunkPixels(const ConvGeometry& g) {
+  const int64 depth = g.input_features / g.feature_group_count *
+                      g.kernel_height * g.kernel_width;
+  return std::min(g.output_height * g.output_width,
+                  std::max(kMinChunkPixels,
+                           kPatchBufferElements / std::max<int64>(depth, 1)));
+}
+
+void ConvIm2Col(const ConvGeometry& g, const float* input, const float* filter,
+                float* output) {
+  ConvIm2Col(g, input, filter, ConvEpilogue(), output);
+}
+
+void ConvIm2Col(const ConvGeometry& g, const float* input, const float* filter,
+                const ConvEpilogue& epilogue, float* output) {
+  ConvIm2ColImpl(g, input, filter, epilogue, output);
+}
+
+void ConvIm2Col(const ConvGeometry& g, const half* input, const half* filter,
+                const ConvEpilogue& epilogue, float* output) {
+  ConvIm2ColImpl(g, input, filter, epilogue, output);
+}
+
+void ConvIm2Col(const ConvGeometry& g, const bfloat16* input,
+                const bfloat16* filter, const ConvEpilogue& epilogue,
+                float* output) {
+  ConvIm2ColImpl(g, input, filter, epilogue, output);
+}
+
+}  // namespace conv
+}  // namespace xla
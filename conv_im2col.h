@@ -0,0 +1,80 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_CONV_IM2COL_H_
+#define TENSORFLOW_COMPILER_XLA_CONV_IM2COL_H_
+
+#include "conv_geometry.h"
+#include "half.h"
+#include "types.h"
+
+namespace xla {
+namespace conv {
+
+// Convolution lowered to GEMM. For every image the filter, viewed as an
+// output_features x (input_features * kernel_height * kernel_width) matrix,
+// multiplies the patch matrix holding one column per output pixel. The patch
+// matrix is only ever materialized for a bounded chunk of output pixels at a
+// time, and 1x1 unstrided, undilated convolutions use the input directly.
+// Grouped convolutions run one such GEMM per feature group, with the groups
+// and chunks of all images spread over the pool together.
+//
+// All operands are in the canonical layouts of conv_geometry.h. Supports every
+// stride, padding, dilation and feature group count that MakeConvGeometry
+// accepts.
+void ConvIm2Col(const ConvGeometry& geometry, const float* input,
+                const float* filter, float* output);
+
+// As above, with epilogue applied by the GEMMs as they store each output tile.
+void ConvIm2Col(const ConvGeometry& geometry, const float* input,
+                const float* filter, const ConvEpilogue& epilogue,
+                float* output);
+
+// As above for input and filter stored in 16 bits. The patch matrix is kept
+// in the input's type and the mixed precision gemm::Gemm accumulates in
+// float32, so the output is float.
+void ConvIm2Col(const ConvGeometry& geometry, const half* input,
+                const half* filter, const ConvEpilogue& epilogue,
+                float* output);
+void ConvIm2Col(const ConvGeometry& geometry, const bfloat16* input,
+                const bfloat16* filter, const ConvEpilogue& epilogue,
+                float* output);
+
+// Writes the patch-matrix columns of output pixels [first_pixel, last_pixel)
+// of one canonical input image, for an ungrouped geometry. Row (c, r, q) of
+// the row-major result holds, for every pixel, the input value multiplied by
+// filter tap (c, r, q), or zero where the tap falls on padding or on a hole
+// introduced by input dilation.
+void Im2ColPatches(const ConvGeometry& geometry, const float* image,
+                   int64 first_pixel, int64 last_pixel, float* patches);
+
+// As above for a quantized image, with padding (normally the zero point)
+// written where the tap falls on padding or a dilation hole.
+void Im2ColPatches(const ConvGeometry& geometry, const uint8* image,
+                   int64 first_pixel, int64 last_pixel, uint8 padding,
+                   uint8* patches);
+
+// The transpose of Im2ColPatches: adds every patch element into the input
+// value it was read from. Elements on padding or dilation holes are dropped.
+void Col2ImPatches(const ConvGeometry& geometry, const float* patches,
+                   int64 first_pixel, int64 last_pixel, float* image);
+
+// Number of output pixels whose patches ConvIm2Col materializes at a time.
+int64 Im2ColChunkPixels(const ConvGeometry& geometry);
+
+}  // namespace conv
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_CONV_IM2COL_H_
@@ -0,0 +1,274 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "conv_im2col.h"
+
+#include <memory>
+#include <vector>
+
+#include "array4d.h"
+#include "computation_builder.h"
+#include "literal_test_util.h"
+#include "literal_util.h"
+#include "reference_util.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+// Tests the im2col convolution path against the direct reference loop.
+class ConvIm2ColTest /* : public ::testing::Test */
+{
+public:
+
+   ConvIm2ColTest() { run(); }
+
+   void StridesAndPadding();
+   void Dilations();
+   void PointwiseFastPath();
+   void PointwiseWithTrailingPadding();
+   void ChunkedPatchMatrix();
+   void GeneralDimensionNumbers();
+   void FeatureGroups();
+
+   void run();
+
+private:
+   void ExpectMatchesDirect(const Array4D<float>& lhs, const Array4D<float>& rhs,
+                            std::pair<int64, int64> stride, Padding padding,
+                            std::pair<int64, int64> lhs_dilation,
+                            std::pair<int64, int64> rhs_dilation,
+                            const ConvolutionDimensionNumbers& dnums);
+};
+
+void ConvIm2ColTest::ExpectMatchesDirect(
+    const Array4D<float>& lhs, const Array4D<float>& rhs,
+    std::pair<int64, int64> stride, Padding padding,
+    std::pair<int64, int64> lhs_dilation, std::pair<int64, int64> rhs_dilation,
+    const ConvolutionDimensionNumbers& dnums)
+{
+   auto expected = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+       lhs, rhs, stride, padding, lhs_dilation, rhs_dilation, dnums,
+       conv::ConvAlgorithm::kDirect);
+   auto actual = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+       lhs, rhs, stride, padding, lhs_dilation, rhs_dilation, dnums,
+       conv::ConvAlgorithm::kIm2Col);
+   LiteralTestUtil::ExpectR4NearArray4D(
+       *expected, *LiteralUtil::CreateR4FromArray4D(*actual), ErrorSpec(1e-4f));
+}
+
+void ConvIm2ColTest::StridesAndPadding()
+{
+   Array4D<float> input(2, 3, 11, 9);
+   Array4D<float> kernel(4, 3, 3, 2);
+   input.FillRandom(1.0f, 0.0, 21);
+   kernel.FillRandom(1.0f, 0.0, 22);
+   const auto dnums = ComputationBuilder::CreateDefaultConvDimensionNumbers();
+   ExpectMatchesDirect(input, kernel, {1, 1}, Padding::kSame, {1, 1}, {1, 1},
+                       dnums);
+   for (auto stride : {std::make_pair<int64, int64>(1, 1),
+                       std::make_pair<int64, int64>(2, 3),
+                       std::make_pair<int64, int64>(3, 1)}) {
+      ExpectMatchesDirect(input, kernel, stride, Padding::kValid, {1, 1},
+                          {1, 1}, dnums);
+   }
+}
+
+void ConvIm2ColTest::Dilations()
+{
+   Array4D<float> input(1, 2, 7, 8);
+   Array4D<float> kernel(3, 2, 3, 3);
+   input.FillRandom(1.0f, 0.0, 23);
+   kernel.FillRandom(1.0f, 0.0, 24);
+   const auto dnums = ComputationBuilder::CreateDefaultConvDimensionNumbers();
+   for (Padding padding : {Padding::kSame, Padding::kValid}) {
+      ExpectMatchesDirect(input, kernel, {1, 1}, padding, {2, 1}, {1, 1},
+                          dnums);
+      ExpectMatchesDirect(input, kernel, {1, 1}, padding, {1, 1}, {2, 3},
+                          dnums);
+      ExpectMatchesDirect(input, kernel, {1, 1}, padding, {3, 2}, {2, 2},
+                          dnums);
+   }
+   ExpectMatchesDirect(input, kernel, {2, 2}, Padding::kValid, {2, 2}, {1, 2},
+                       dnums);
+}
+
+void ConvIm2ColTest::PointwiseFastPath()
+{
+   Array4D<float> input(3, 16, 5, 6);
+   Array4D<float> kernel(8, 16, 1, 1);
+   input.FillRandom(1.0f, 0.0, 25);
+   kernel.FillRandom(1.0f, 0.0, 26);
+   ExpectMatchesDirect(input, kernel, {1, 1}, Padding::kValid, {1, 1}, {1, 1},
+                       ComputationBuilder::CreateDefaultConvDimensionNumbers());
+}
+
+void ConvIm2ColTest::PointwiseWithTrailingPadding()
+{
+   // Padding after the input only shows in the geometry as a larger output, so
+   // the 1x1 convolution must not take the input as its patch matrix.
+   Array4D<float> input(2, 4, 3, 3);
+   Array4D<float> kernel(5, 4, 1, 1);
+   input.FillRandom(1.0f, 0.0, 35);
+   kernel.FillRandom(1.0f, 0.0, 36);
+   Array4D<float> padded(2, 4, 4, 5);
+   padded.Fill(0.0f);
+   input.Each([&](tensorflow::gtl::ArraySlice<int64> i, float* value) {
+      padded(i[0], i[1], i[2], i[3]) = *value;
+   });
+   const auto dnums = ComputationBuilder::CreateDefaultConvDimensionNumbers();
+   auto expected = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+       padded, kernel, {1, 1}, Padding::kValid, {1, 1}, {1, 1}, dnums,
+       conv::ConvAlgorithm::kDirect);
+
+   conv::ConvGeometry geometry = conv::MakeConvGeometry(
+       input, kernel, {1, 1}, Padding::kValid, {1, 1}, {1, 1}, dnums);
+   geometry.output_height = 4;
+   geometry.output_width = 5;
+   const std::vector<float> canonical_input =
+       conv::CanonicalConvInput(input, dnums);
+   const std::vector<float> filter = conv::CanonicalConvFilter(kernel, dnums);
+   std::vector<float> output(2 * 5 * 4 * 5);
+   conv::ConvIm2Col(geometry, canonical_input.data(), filter.data(),
+                    output.data());
+   LiteralTestUtil::ExpectR4NearArray4D(
+       *expected,
+       *LiteralUtil::CreateR4FromArray4D(
+           *conv::ConvOutputFromCanonical(geometry, output, dnums)),
+       ErrorSpec(1e-4f));
+}
+
+void ConvIm2ColTest::ChunkedPatchMatrix()
+{
+   // 64 * 7 * 7 filter taps leave room for fewer output pixels per chunk than
+   // the 70 x 70 image has, so several chunks are needed per image.
+   Array4D<float> input(1, 64, 70, 70);
+   Array4D<float> kernel(5, 64, 7, 7);
+   input.FillRandom(1.0f, 0.0, 27);
+   kernel.FillRandom(0.1f, 0.0, 28);
+   ExpectMatchesDirect(input, kernel, {1, 1}, Padding::kSame, {1, 1}, {1, 1},
+                       ComputationBuilder::CreateDefaultConvDimensionNumbers());
+}
+
+void ConvIm2ColTest::GeneralDimensionNumbers()
+{
+   // NHWC input with an HWIO filter.
+   ConvolutionDimensionNumbers dnums;
+   dnums.set_batch_dimension(0);
+   dnums.add_spatial_dimensions(1);
+   dnums.add_spatial_dimensions(2);
+   dnums.set_feature_dimension(3);
+   dnums.add_kernel_spatial_dimensions(0);
+   dnums.add_kernel_spatial_dimensions(1);
+   dnums.set_kernel_input_feature_dimension(2);
+   dnums.set_kernel_output_feature_dimension(3);
+
+   Array4D<float> input(2, 9, 10, 3);
+   Array4D<float> kernel(3, 2, 3, 5);
+   input.FillRandom(1.0f, 0.0, 29);
+   kernel.FillRandom(1.0f, 0.0, 30);
+   ExpectMatchesDirect(input, kernel, {1, 1}, Padding::kSame, {1, 1}, {1, 1},
+                       dnums);
+   ExpectMatchesDirect(input, kernel, {2, 1}, Padding::kValid, {1, 2}, {2, 1},
+                       dnums);
+}
+
+void ConvIm2ColTest::FeatureGroups()
+{
+   const int64 groups = 3;
+   Array4D<float> input(2, 6, 9, 8);
+   Array4D<float> kernel(9, 2, 3, 3);
+   input.FillRandom(1.0f, 0.0, 31);
+   kernel.FillRandom(1.0f, 0.0, 32);
+   const auto dnums = ComputationBuilder::CreateDefaultConvDimensionNumbers();
+
+   // The grouped direct convolution is the dense convolution of every group.
+   auto grouped = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+       input, kernel, {1, 1}, Padding::kSame, {1, 1}, {1, 1}, dnums, groups,
+       conv::ConvAlgorithm::kDirect);
+   for (int64 k = 0; k < groups; ++k) {
+      Array4D<float> group_input(2, 2, 9, 8);
+      group_input.Each([&](tensorflow::gtl::ArraySlice<int64> i, float* value) {
+         *value = input(i[0], k * 2 + i[1], i[2], i[3]);
+      });
+      Array4D<float> group_kernel(3, 2, 3, 3);
+      group_kernel.Each([&](tensorflow::gtl::ArraySlice<int64> i, float* value) {
+         *value = kernel(k * 3 + i[0], i[1], i[2], i[3]);
+      });
+      auto dense = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+          group_input, group_kernel, {1, 1}, Padding::kSame, {1, 1}, {1, 1},
+          dnums, conv::ConvAlgorithm::kDirect);
+      dense->Each([&](tensorflow::gtl::ArraySlice<int64> i, float* value) {
+         ASSERT_EQ(*value, (*grouped)(i[0], k * 3 + i[1], i[2], i[3]));
+      });
+   }
+
+   // im2col runs one GEMM per group, with a per-group slice of the bias; other
+   // algorithms fall back to it.
+   const std::vector<float> bias = {1, -1, 2, -2, 3, -3, 4, -4, 5};
+   Array4D<float> residual(2, 9, 9, 8);
+   residual.FillRandom(1.0f, 0.0, 33);
+   auto expected = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+       input, kernel, {1, 1}, Padding::kSame, {1, 1}, {1, 1}, dnums,
+       conv::ConvAlgorithm::kDirect, bias, &residual,
+       ActivationFunction::kRelu, 1.0f, groups);
+   for (conv::ConvAlgorithm algorithm :
+        {conv::ConvAlgorithm::kIm2Col, conv::ConvAlgorithm::kWinogradF2x2,
+         conv::ConvAlgorithm::kFft}) {
+      auto actual = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+          input, kernel, {1, 1}, Padding::kSame, {1, 1}, {1, 1}, dnums,
+          algorithm, bias, &residual, ActivationFunction::kRelu, 1.0f, groups);
+      LiteralTestUtil::ExpectR4NearArray4D(
+          *expected, *LiteralUtil::CreateR4FromArray4D(*actual),
+          ErrorSpec(1e-4f));
+   }
+
+   // Strided and pointwise grouped convolutions.
+   auto strided = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+       input, kernel, {2, 2}, Padding::kValid, {1, 1}, {1, 2}, dnums, groups,
+       conv::ConvAlgorithm::kDirect);
+   LiteralTestUtil::ExpectR4NearArray4D(
+       *strided,
+       *LiteralUtil::CreateR4FromArray4D(
+           *ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+               input, kernel, {2, 2}, Padding::kValid, {1, 1}, {1, 2}, dnums,
+               groups, conv::ConvAlgorithm::kIm2Col)),
+       ErrorSpec(1e-4f));
+   Array4D<float> pointwise(6, 3, 1, 1);
+   pointwise.FillRandom(1.0f, 0.0, 34);
+   LiteralTestUtil::ExpectR4NearArray4D(
+       *ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+           input, pointwise, {1, 1}, Padding::kValid, {1, 1}, {1, 1}, dnums, 2,
+           conv::ConvAlgorithm::kDirect),
+       *LiteralUtil::CreateR4FromArray4D(
+           *ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+               input, pointwise, {1, 1}, Padding::kValid, {1, 1}, {1, 1},
+               dnums, 2, conv::ConvAlgorithm::kIm2Col)),
+       ErrorSpec(1e-4f));
+}
+
+void ConvIm2ColTest::run()
+{
+   StridesAndPadding();
+   Dilations();
+   PointwiseFastPath();
+   PointwiseWithTrailingPadding();
+   ChunkedPatchMatrix();
+   GeneralDimensionNumbers();
+   FeatureGroups();
+}
+
+}  // namespace
+}  // namespace xla
@@ -0,0 +1,341 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "conv_plan.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+
+#include "conv_fft.h"
+#include "conv_im2col.h"
+#include "conv_transposed.h"
+#include "conv_winograd.h"
+#include "cpu_info.h"
+#include "intra_op_thread_pool.h"
+#include "logging.h"
+
+namespace xla {
+namespace conv {
+namespace {
+
+// Timed runs of every candidate while tuning; the fastest run counts, so
+// the cold first run of each algorithm does not penalize it.
+constexpr int kTuningRuns = 2;
+
+std::string MakePlanKey(const ConvGeometry& g) {
+  std::string model = tensorflow::port::CPUModelString();
+  if (model.empty()) {
+    model = "unknown";
+  }
+  std::string key =
+      model + "|threads=" + std::to_string(IntraOpThreadCount()) + "|conv=";
+  const char* separator = "";
+  for (int64 value :
+       {g.batch, g.input_features, g.input_height, g.input_width,
+        g.output_features, g.kernel_height, g.kernel_width, g.output_height,
+        g.output_width, g.stride_y, g.stride_x, g.lhs_dilation_y,
+        g.lhs_dilation_x, g.rhs_dilation_y, g.rhs_dilation_x, g.pad_top,
+        g.pad_left, g.feature_group_count}) {
+    key += separator + std::to_string(value);
+    separator = ",";
+  }
+  return key;
+}
+
+bool IsWinograd(ConvAlgorithm algorithm) {
+  return algorithm == ConvAlgorithm::kWinogradF2x2 ||
+         algorithm == ConvAlgorithm::kWinogradF4x4;
+}
+
+// The Winograd transform of filter for algorithm, which must be one of the
+// Winograd algorithms.
+std::unique_ptr<WinogradFilter> MakeWinogradFilter(ConvAlgorithm algorithm,
+                                                   const ConvGeometry& g,
+                                                   const float* filter) {
+  return std::unique_ptr<WinogradFilter>(new WinogradFilter(
+      algorithm == ConvAlgorithm::kWinogradF2x2 ? WinogradTile::kF2x2
+                                                : WinogradTile::kF4x4,
+      g.output_features, g.input_features, filter));
+}
+
+bool CanRun(ConvAlgorithm algorithm, const ConvGeometry& geometry) {
+  switch (algorithm) {
+    case ConvAlgorithm::kIm2Col:
+      return true;
+    case ConvAlgorithm::kFft:
+      return CanUseFft(geometry);
+    case ConvAlgorithm::kWinogradF2x2:
+    case ConvAlgorithm::kWinogradF4x4:
+      return CanUseWinograd(geometry);
+    case ConvAlgorithm::kTransposed:
+      return CanUseTransposed(geometry);
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+const char* ConvAlgorithmName(ConvAlgorithm algorithm) {
+  switch (algorithm) {
+    case ConvAlgorithm::kDefault:
+      return "default";
+    case ConvAlgorithm::kDirect:
+      return "direct";
+    case ConvAlgorithm::kIm2Col:
+      return "im2col";
+    case ConvAlgorithm::kWinogradF2x2:
+      return "winograd_f2x2";
+    case ConvAlgorithm::kWinogradF4x4:
+      return "winograd_f4x4";
+    case ConvAlgorithm::kFft:
+      return "fft";
+    case ConvAlgorithm::kTransposed:
+      return "transposed";
+    case ConvAlgorithm::kAutotune:
+      return "autotune";
+  }
+  return "unknown";
+}
+
+bool ParseConvAlgorithm(const std::string& name, ConvAlgorithm* algorithm) {
+  for (ConvAlgorithm candidate :
+       {ConvAlgorithm::kDefault, ConvAlgorithm::kDirect,
+        ConvAlgorithm::kIm2Col, ConvAlgorithm::kWinogradF2x2,
+        ConvAlgorithm::kWinogradF4x4, ConvAlgorithm::kFft,
+        ConvAlgorithm::kTransposed, ConvAlgorithm::kAutotune}) {
+    if (name == ConvAlgorithmName(candidate)) {
+      *algorithm = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<ConvAlgorithm> CandidateConvAlgorithms(
+    const ConvGeometry& geometry) {
+  std::vector<ConvAlgorithm> candidates;
+  for (ConvAlgorithm algorithm :
+       {ConvAlgorithm::kIm2Col, ConvAlgorithm::kWinogradF2x2,
+        ConvAlgorithm::kWinogradF4x4, ConvAlgorithm::kFft,
+        ConvAlgorithm::kTransposed}) {
+    if (CanRun(algorithm, geometry)) {
+      candidates.push_back(algorithm);
+    }
+  }
+  return candidates;
+}
+
+ConvAlgorithmCache::ConvAlgorithmCache(const std::string& path) : path_(path) {
+  if (path_.empty()) {
+    return;
+  }
+  std::ifstream file(path_.c_str());
+  std::string line;
+  while (std::getline(file, line)) {
+    const size_t tab = line.rfind('\t');
+    ConvAlgorithm algorithm;
+    if (tab == std::string::npos ||
+        !ParseConvAlgorithm(line.substr(tab + 1), &algorithm)) {
+      continue;
+    }
+    entries_[line.substr(0, tab)] = algorithm;
+  }
+}
+
+ConvAlgorithmCache* ConvAlgorithmCache::Global() {
+  static ConvAlgorithmCache* cache = [] {
+    const char* path = std::getenv("XLA_CONV_ALGORITHM_CACHE");
+    return new ConvAlgorithmCache(path == nullptr ? "" : path);
+  }();
+  return cache;
+}
+
+bool ConvAlgorithmCache::Lookup(const std::string& key,
+                                ConvAlgorithm* algorithm) const {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    return false;
+  }
+  *algorithm = it->second;
+  return true;
+}
+
+void ConvAlgorithmCache::Insert(const std::string& key,
+                                ConvAlgorithm algorithm) {
+  std::lock_guard<std::mutex> lock(mu_);
+  entries_[key] = algorithm;
+  if (path_.empty()) {
+    return;
+  }
+  std::ofstream file(path_.c_str(), std::ios::out | std::ios::app);
+  if (!file) {
+    LOG(WARNING) << "Cannot write convolution algorithm cache " << path_;
+    return;
+  }
+  file << key << '\t' << ConvAlgorithmName(algorithm) << '\n';
+}
+
+int64 ConvAlgorithmCache::size() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return entries_.size();
+}
+
+ConvPlan::ConvPlan(const std::array<int64, 4>& lhs_dimensions,
+                   const std::array<int64, 4>& rhs_dimensions,
+                   std::pair<int64, int64> kernel_stride, Padding padding,
+                   std::pair<int64, int64> lhs_dilation,
+                   std::pair<int64, int64> rhs_dilation,
+                   const ConvolutionDimensionNumbers& dnums,
+                   ConvAlgorithm algorithm, ConvAlgorithmCache* cache)
+    : ConvPlan(MakeConvGeometry(lhs_dimensions, rhs_dimensions, kernel_stride,
+                                padding, lhs_dilation, rhs_dilation, dnums),
+               algorithm, cache) {}
+
+ConvPlan::ConvPlan(const ConvGeometry& geometry, ConvAlgorithm algorithm,
+                   ConvAlgorithmCache* cache)
+    : geometry_(geometry),
+      algorithm_(algorithm),
+      cache_(cache),
+      key_(MakePlanKey(geometry)) {
+  CHECK(algorithm_ != ConvAlgorithm::kDirect);
+  if (algorithm_ == ConvAlgorithm::kDefault) {
+    if (CanUseTransposed(geometry_)) {
+      algorithm_ = ConvAlgorithm::kTransposed;
+    } else {
+      algorithm_ =
+          PreferFft(geometry_) ? ConvAlgorithm::kFft : ConvAlgorithm::kIm2Col;
+    }
+  }
+  if (algorithm_ == ConvAlgorithm::kAutotune) {
+    CHECK(cache_ != nullptr);
+    ConvAlgorithm cached;
+    if (cache_->Lookup(key_, &cached) && CanRun(cached, geometry_)) {
+      algorithm_ = cached;
+    }
+  } else if (!CanRun(algorithm_, geometry_)) {
+    algorithm_ = ConvAlgorithm::kIm2Col;
+  }
+}
+
+void ConvPlan::Run(const float* input, const float* filter, float* output) {
+  Run(input, filter, ConvEpilogue(), output);
+}
+
+void ConvPlan::PrepareFilter(const float* filter) {
+  prepared_filter_ = filter;
+  winograd_filter_.reset();
+  if (IsWinograd(algorithm_)) {
+    winograd_filter_ = MakeWinogradFilter(algorithm_, geometry_, filter);
+  }
+}
+
+void ConvPlan::Run(const float* input, const float* filter,
+                   const ConvEpilogue& epilogue, float* output) {
+  if (algorithm_ == ConvAlgorithm::kAutotune) {
+    Tune(input, filter, epilogue, output);
+    return;
+  }
+  if (!IsWinograd(algorithm_)) {
+    RunConvAlgorithm(algorithm_, geometry_, input, filter, epilogue, output);
+    return;
+  }
+  if (filter != prepared_filter_ || winograd_filter_ == nullptr) {
+    PrepareFilter(filter);
+  }
+  ConvWinograd(geometry_, *winograd_filter_, input, epilogue, output);
+}
+
+void ConvPlan::Tune(const float* input, const float* filter,
+                    const ConvEpilogue& epilogue, float* output) {
+  const std::vector<ConvAlgorithm> candidates =
+      CandidateConvAlgorithms(geometry_);
+  ConvAlgorithm best = candidates.front();
+  // The transform of the fastest Winograd candidate, if one is fastest, so
+  // that the plan does not transform the filter again.
+  std::unique_ptr<WinogradFilter> best_winograd;
+  if (candidates.size() > 1) {
+    double best_seconds = std::numeric_limits<double>::infinity();
+    for (ConvAlgorithm candidate : candidates) {
+      // A plan transforms its filter once, so the transform is not timed.
+      std::unique_ptr<WinogradFilter> winograd;
+      if (IsWinograd(candidate)) {
+        winograd = MakeWinogradFilter(candidate, geometry_, filter);
+      }
+      for (int run = 0; run < kTuningRuns; ++run) {
+        const auto start = std::chrono::steady_clock::now();
+        if (winograd != nullptr) {
+          ConvWinograd(geometry_, *winograd, input, epilogue, output);
+        } else {
+          RunConvAlgorithm(candidate, geometry_, input, filter, epilogue,
+                           output);
+        }
+        const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        if (elapsed.count() < best_seconds) {
+          best_seconds = elapsed.count();
+          best = candidate;
+        }
+      }
+      if (best == candidate && winograd != nullptr) {
+        best_winograd = std::move(winograd);
+      }
+    }
+  }
+  algorithm_ = best;
+  cache_->Insert(key_, best);
+  prepared_filter_ = filter;
+  winograd_filter_.reset();
+  if (IsWinograd(best)) {
+    winograd_filter_ = std::move(best_winograd);
+  }
+  // Every candidate computes the same convolution, but leave the result of
+  // the algorithm later runs will use.
+  if (candidates.size() == 1 || best != candidates.back()) {
+    Run(input, filter, epilogue, output);
+  }
+}
+
+void RunConvAlgorithm(ConvAlgorithm algorithm, const ConvGeometry& geometry,
+                      const float* input, const float* filter,
+                      const ConvEpilogue& epilogue, float* output) {
+  CHECK(CanRun(algorithm, geometry)) << ConvAlgorithmName(algorithm);
+  switch (algorithm) {
+    case ConvAlgorithm::kFft:
+      ConvFft(geometry, input, filter, epilogue, output);
+      break;
+    case ConvAlgorithm::kWinogradF2x2:
+    case ConvAlgorithm::kWinogradF4x4: {
+      const WinogradFilter winograd_filter(
+          algorithm == ConvAlgorithm::kWinogradF2x2 ? WinogradTile::kF2x2
+                                                    : WinogradTile::kF4x4,
+          geometry.output_features, geometry.input_features, filter);
+      ConvWinograd(geometry, winograd_filter, input, epilogue, output);
+      break;
+    }
+    case ConvAlgorithm::kTransposed:
+      ConvTransposed(geometry, input, filter, epilogue, output);
+      break;
+    default:
+      ConvIm2Col(geometry, input, filter, epilogue, output);
+      break;
+  }
+}
+
+}  // namespace conv
+}  // namespace xla
@@ -0,0 +1,158 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_CONV_PLAN_H_
+#define TENSORFLOW_COMPILER_XLA_CONV_PLAN_H_
+
+// Reusable convolution plans. A plan fixes the geometry of a convolution once
+// and picks the algorithm that computes it; with ConvAlgorithm::kAutotune the
+// candidates are timed on the first run and the winner is recorded in a
+// ConvAlgorithmCache, keyed by the geometry, the intra-op thread count and the
+// CPU model. A cache backed by a file carries the results over to later
+// processes, which then dispatch without timing anything.
+
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "conv_geometry.h"
+#include "conv_winograd.h"
+#include "padding.h"
+#include "types.h"
+#include "xla_data.pb.h"
+
+namespace xla {
+namespace conv {
+
+// Returns the name of algorithm, e.g. "im2col", as stored in cache files.
+const char* ConvAlgorithmName(ConvAlgorithm algorithm);
+
+// Parses a name returned by ConvAlgorithmName. Returns false for unknown
+// names.
+bool ParseConvAlgorithm(const std::string& name, ConvAlgorithm* algorithm);
+
+// Returns the algorithms able to compute the convolution, kIm2Col first.
+std::vector<ConvAlgorithm> CandidateConvAlgorithms(const ConvGeometry& geometry);
+
+// Tuning results: the fastest algorithm for each plan key. Thread-safe.
+class ConvAlgorithmCache {
+ public:
+  // An in-memory cache.
+  ConvAlgorithmCache() = default;
+
+  // A cache persisted in the text file at path: existing entries are loaded
+  // now, and every Insert appends a line "key<TAB>algorithm", so later lines
+  // win. A missing file is created by the first Insert; unreadable lines are
+  // skipped. An empty path gives an in-memory cache.
+  explicit ConvAlgorithmCache(const std::string& path);
+
+  // The cache ConvPlan uses by default. It is persisted in the file named by
+  // the XLA_CONV_ALGORITHM_CACHE environment variable, or in-memory only if
+  // the variable is unset or empty.
+  static ConvAlgorithmCache* Global();
+
+  // Returns whether key is cached, and its algorithm in *algorithm if so.
+  bool Lookup(const std::string& key, ConvAlgorithm* algorithm) const;
+
+  // Records algorithm for key, replacing any previous entry.
+  void Insert(const std::string& key, ConvAlgorithm algorithm);
+
+  int64 size() const;
+  const std::string& path() const { return path_; }
+
+ private:
+  std::string path_;
+  mutable std::mutex mu_;
+  std::map<std::string, ConvAlgorithm> entries_;
+};
+
+// A convolution specialized to one geometry. Inputs and outputs are in the
+// canonical layouts of conv_geometry.h.
+class ConvPlan {
+ public:
+  // Plans the convolution of ReferenceUtil::ConvArray4DGeneralDimensionsDilated
+  // for operands with the given dimensions.
+  ConvPlan(const std::array<int64, 4>& lhs_dimensions,
+           const std::array<int64, 4>& rhs_dimensions,
+           std::pair<int64, int64> kernel_stride, Padding padding,
+           std::pair<int64, int64> lhs_dilation,
+           std::pair<int64, int64> rhs_dilation,
+           const ConvolutionDimensionNumbers& dnums,
+           ConvAlgorithm algorithm = ConvAlgorithm::kAutotune,
+           ConvAlgorithmCache* cache = ConvAlgorithmCache::Global());
+
+  // Plans a convolution of the given geometry. kDefault is resolved as
+  // described in conv_geometry.h, and an algorithm that cannot handle the
+  // geometry becomes kIm2Col. kAutotune is resolved from cache, or by the
+  // first Run if cache has no entry for key(). kDirect, the scalar
+  // definition in ReferenceUtil, cannot be planned.
+  explicit ConvPlan(const ConvGeometry& geometry,
+                    ConvAlgorithm algorithm = ConvAlgorithm::kAutotune,
+                    ConvAlgorithmCache* cache = ConvAlgorithmCache::Global());
+
+  const ConvGeometry& geometry() const { return geometry_; }
+
+  // The algorithm Run uses; kAutotune until the plan has been tuned.
+  ConvAlgorithm algorithm() const { return algorithm_; }
+
+  // The cache key of the plan: the CPU model, the intra-op thread count and
+  // every field of the geometry.
+  const std::string& key() const { return key_; }
+
+  // Transforms filter into the form the plan's algorithm computes with and
+  // keeps it: the Winograd algorithms keep the filter in the Winograd
+  // domain, the others read it as is and keep nothing. Run reuses the
+  // transform for as long as it is passed the same filter pointer, so call
+  // this again after changing the weights behind that pointer. Optional: Run
+  // prepares a filter pointer it has not seen before.
+  void PrepareFilter(const float* filter);
+
+  // Computes the convolution with epilogue applied to the output. An untuned
+  // kAutotune plan first runs every candidate algorithm on these operands,
+  // keeps the fastest and records it in the cache; output then holds the
+  // fastest algorithm's result. Only the per-call work is timed: filter
+  // transforms are built before the timed runs. Not thread-safe until the
+  // plan is tuned and its filter prepared.
+  void Run(const float* input, const float* filter,
+           const ConvEpilogue& epilogue, float* output);
+  void Run(const float* input, const float* filter, float* output);
+
+ private:
+  void Tune(const float* input, const float* filter,
+            const ConvEpilogue& epilogue, float* output);
+
+  ConvGeometry geometry_;
+  ConvAlgorithm algorithm_;
+  ConvAlgorithmCache* cache_;
+  std::string key_;
+  // The filter PrepareFilter last transformed, and its Winograd transform
+  // for the Winograd algorithms (null otherwise).
+  const float* prepared_filter_ = nullptr;
+  std::unique_ptr<WinogradFilter> winograd_filter_;
+};
+
+// Runs algorithm, which must be able to compute the convolution, directly.
+void RunConvAlgorithm(ConvAlgorithm algorithm, const ConvGeometry& geometry,
+                      const float* input, const float* filter,
+                      const ConvEpilogue& epilogue, float* output);
+
+}  // namespace conv
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_CONV_PLAN_H_
@@ -0,0 +1,276 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "conv_plan.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+
+#include "array4d.h"
+#include "computation_builder.h"
+#include "reference_util.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+// Tests algorithm selection and caching of convolution plans.
+class ConvPlanTest /* : public ::testing::Test */
+{
+public:
+
+   ConvPlanTest() { run(); }
+
+   void AlgorithmNamesRoundTrip();
+   void CandidatesFollowGeometry();
+   void FixedAlgorithmsResolve();
+   void AutotunedPlanMatchesDirect();
+   void TunedPlanIsCached();
+   void WinogradFilterIsPrepared();
+   void CacheFilePersistsResults();
+
+   void run();
+};
+
+// Unit strides use kSame padding, which MakeConvGeometry only accepts for
+// them; other strides use kValid.
+conv::ConvGeometry Geometry(std::pair<int64, int64> stride, int64 kernel_size)
+{
+   return conv::MakeConvGeometry(
+       {{2, 3, 18, 17}}, {{4, 3, kernel_size, kernel_size}}, stride,
+       stride.first == 1 ? Padding::kSame : Padding::kValid, {1, 1}, {1, 1},
+       ComputationBuilder::CreateDefaultConvDimensionNumbers());
+}
+
+void ConvPlanTest::AlgorithmNamesRoundTrip()
+{
+   for (conv::ConvAlgorithm algorithm :
+        {conv::ConvAlgorithm::kDefault, conv::ConvAlgorithm::kDirect,
+         conv::ConvAlgorithm::kIm2Col, conv::ConvAlgorithm::kWinogradF2x2,
+         conv::ConvAlgorithm::kWinogradF4x4, conv::ConvAlgorithm::kFft,
+         conv::ConvAlgorithm::kTransposed, conv::ConvAlgorithm::kAutotune}) {
+      conv::ConvAlgorithm parsed;
+      ASSERT_TRUE(conv::ParseConvAlgorithm(conv::ConvAlgorithmName(algorithm),
+                                           &parsed));
+      ASSERT_TRUE(parsed == algorithm);
+   }
+   conv::ConvAlgorithm parsed;
+   ASSERT_TRUE(!conv::ParseConvAlgorithm("gemm", &parsed));
+}
+
+void ConvPlanTest::CandidatesFollowGeometry()
+{
+   std::vector<conv::ConvAlgorithm> candidates =
+       conv::CandidateConvAlgorithms(Geometry({1, 1}, 3));
+   ASSERT_EQ(candidates.size(), 4);
+   ASSERT_TRUE(candidates[0] == conv::ConvAlgorithm::kIm2Col);
+
+   candidates = conv::CandidateConvAlgorithms(Geometry({1, 1}, 5));
+   ASSERT_EQ(candidates.size(), 2);
+   ASSERT_TRUE(candidates[1] == conv::ConvAlgorithm::kFft);
+
+   candidates = conv::CandidateConvAlgorithms(Geometry({2, 2}, 3));
+   ASSERT_EQ(candidates.size(), 1);
+   ASSERT_TRUE(candidates[0] == conv::ConvAlgorithm::kIm2Col);
+}
+
+void ConvPlanTest::FixedAlgorithmsResolve()
+{
+   conv::ConvAlgorithmCache cache;
+   conv::ConvPlan winograd(Geometry({1, 1}, 3),
+                           conv::ConvAlgorithm::kWinogradF2x2, &cache);
+   ASSERT_TRUE(winograd.algorithm() == conv::ConvAlgorithm::kWinogradF2x2);
+
+   // Strided convolutions cannot use Winograd.
+   conv::ConvPlan strided(Geometry({2, 2}, 3),
+                          conv::ConvAlgorithm::kWinogradF2x2, &cache);
+   ASSERT_TRUE(strided.algorithm() == conv::ConvAlgorithm::kIm2Col);
+
+   conv::ConvPlan by_cost_model(Geometry({1, 1}, 3),
+                                conv::ConvAlgorithm::kDefault, &cache);
+   ASSERT_TRUE(by_cost_model.algorithm() == conv::ConvAlgorithm::kIm2Col);
+   ASSERT_EQ(cache.size(), 0);
+}
+
+void ConvPlanTest::AutotunedPlanMatchesDirect()
+{
+   Array4D<float> input(2, 3, 18, 17);
+   input.FillRandom(1.0f, 0.0, 81);
+   for (int64 kernel_size : {3, 5}) {
+      Array4D<float> kernel(4, 3, kernel_size, kernel_size);
+      kernel.FillRandom(1.0f, 0.0, 82);
+      for (int64 stride : {1, 2}) {
+         auto expected = ReferenceUtil::Conv4D(input, kernel, {stride, stride},
+                                               Padding::kValid,
+                                               conv::ConvAlgorithm::kDirect);
+         // The first call tunes, the second dispatches from the cache.
+         for (int i = 0; i < 2; ++i) {
+            auto actual = ReferenceUtil::Conv4D(
+                input, kernel, {stride, stride}, Padding::kValid,
+                conv::ConvAlgorithm::kAutotune);
+            ASSERT_EQ(expected->num_elements(), actual->num_elements());
+            for (int64 j = 0; j < expected->num_elements(); ++j) {
+               ASSERT_TRUE(std::abs(expected->flatten()[j] -
+                                    actual->flatten()[j]) < 1e-4f);
+            }
+         }
+      }
+   }
+}
+
+void ConvPlanTest::TunedPlanIsCached()
+{
+   conv::ConvAlgorithmCache cache;
+   const conv::ConvGeometry geometry = Geometry({1, 1}, 3);
+   std::vector<float> input(geometry.batch * geometry.input_features *
+                            geometry.input_height * geometry.input_width);
+   std::vector<float> filter(geometry.output_features *
+                             geometry.input_features * 9);
+   std::vector<float> output(geometry.batch * geometry.output_features *
+                             geometry.output_height * geometry.output_width);
+   for (size_t i = 0; i < input.size(); ++i) {
+      input[i] = std::sin(0.1f * i);
+   }
+   for (size_t i = 0; i < filter.size(); ++i) {
+      filter[i] = std::cos(0.3f * i);
+   }
+
+   conv::ConvPlan plan(geometry, conv::ConvAlgorithm::kAutotune, &cache);
+   ASSERT_TRUE(plan.algorithm() == conv::ConvAlgorithm::kAutotune);
+   plan.Run(input.data(), filter.data(), output.data());
+   ASSERT_TRUE(plan.algorithm() != conv::ConvAlgorithm::kAutotune);
+   ASSERT_EQ(cache.size(), 1);
+
+   // The winner's result is left in the output.
+   std::vector<float> expected(output.size());
+   conv::RunConvAlgorithm(plan.algorithm(), geometry, input.data(),
+                          filter.data(), conv::ConvEpilogue(),
+                          expected.data());
+   ASSERT_TRUE(expected == output);
+
+   // A second plan of the same geometry is tuned from the start.
+   conv::ConvPlan again(geometry, conv::ConvAlgorithm::kAutotune, &cache);
+   ASSERT_TRUE(again.key() == plan.key());
+   ASSERT_TRUE(again.algorithm() == plan.algorithm());
+
+   // Other geometries are not.
+   conv::ConvPlan other(Geometry({1, 1}, 5), conv::ConvAlgorithm::kAutotune,
+                        &cache);
+   ASSERT_TRUE(other.key() != plan.key());
+   ASSERT_TRUE(other.algorithm() == conv::ConvAlgorithm::kAutotune);
+}
+
+void ConvPlanTest::WinogradFilterIsPrepared()
+{
+   const conv::ConvGeometry geometry = Geometry({1, 1}, 3);
+   std::vector<float> input(geometry.batch * geometry.input_features *
+                            geometry.input_height * geometry.input_width);
+   std::vector<float> filter(geometry.output_features *
+                             geometry.input_features * 9);
+   for (size_t i = 0; i < input.size(); ++i) {
+      input[i] = std::sin(0.1f * i);
+   }
+   for (size_t i = 0; i < filter.size(); ++i) {
+      filter[i] = std::cos(0.3f * i);
+   }
+   const size_t output_size = geometry.batch * geometry.output_features *
+                              geometry.output_height * geometry.output_width;
+   auto run_directly = [&](const std::vector<float>& weights) {
+      std::vector<float> output(output_size);
+      conv::RunConvAlgorithm(conv::ConvAlgorithm::kWinogradF4x4, geometry,
+                             input.data(), weights.data(),
+                             conv::ConvEpilogue(), output.data());
+      return output;
+   };
+   const std::vector<float> original = run_directly(filter);
+
+   conv::ConvPlan plan(geometry, conv::ConvAlgorithm::kWinogradF4x4);
+   std::vector<float> output(output_size);
+   plan.Run(input.data(), filter.data(), output.data());
+   ASSERT_TRUE(output == original);
+
+   // The transform is kept for the filter pointer: changing the weights
+   // behind it takes effect only once the filter is prepared again.
+   for (float& weight : filter) {
+      weight *= 2.0f;
+   }
+   plan.Run(input.data(), filter.data(), output.data());
+   ASSERT_TRUE(output == original);
+   plan.PrepareFilter(filter.data());
+   plan.Run(input.data(), filter.data(), output.data());
+   ASSERT_TRUE(output == run_directly(filter));
+
+   // Another filter is prepared by Run itself.
+   std::vector<float> other = filter;
+   other[0] += 1.0f;
+   plan.Run(input.data(), other.data(), output.data());
+   ASSERT_TRUE(output == run_directly(other));
+}
+
+void ConvPlanTest::CacheFilePersistsResults()
+{
+   const char* path = "conv_plan_test_cache.txt";
+   std::remove(path);
+   const conv::ConvGeometry geometry = Geometry({1, 1}, 3);
+   const conv::ConvGeometry strided = Geometry({2, 2}, 3);
+   std::string key;
+   std::string strided_key;
+   {
+      conv::ConvAlgorithmCache cache(path);
+      ASSERT_EQ(cache.size(), 0);
+      key = conv::ConvPlan(geometry, conv::ConvAlgorithm::kAutotune, &cache)
+                .key();
+      strided_key =
+          conv::ConvPlan(strided, conv::ConvAlgorithm::kAutotune, &cache).key();
+      cache.Insert(key, conv::ConvAlgorithm::kIm2Col);
+      cache.Insert(key, conv::ConvAlgorithm::kWinogradF4x4);
+      // Not usable for the strided geometry.
+      cache.Insert(strided_key, conv::ConvAlgorithm::kFft);
+   }
+   {
+      std::ofstream file(path, std::ios::out | std::ios::app);
+      file << "not an entry\n" << key << "\tbogus\n";
+   }
+
+   // A new cache, as in a later process, sees the last valid entries.
+   conv::ConvAlgorithmCache cache(path);
+   ASSERT_EQ(cache.size(), 2);
+   conv::ConvAlgorithm algorithm;
+   ASSERT_TRUE(cache.Lookup(key, &algorithm));
+   ASSERT_TRUE(algorithm == conv::ConvAlgorithm::kWinogradF4x4);
+
+   conv::ConvPlan plan(geometry, conv::ConvAlgorithm::kAutotune, &cache);
+   ASSERT_TRUE(plan.algorithm() == conv::ConvAlgorithm::kWinogradF4x4);
+   conv::ConvPlan retune(strided, conv::ConvAlgorithm::kAutotune, &cache);
+   ASSERT_TRUE(retune.algorithm() == conv::ConvAlgorithm::kAutotune);
+   std::remove(path);
+}
+
+void ConvPlanTest::run()
+{
+   AlgorithmNamesRoundTrip();
+   CandidatesFollowGeometry();
+   FixedAlgorithmsResolve();
+   AutotunedPlanMatchesDirect();
+   TunedPlanIsCached();
+   WinogradFilterIsPrepared();
+   CacheFilePersistsResults();
+}
+
+}  // namespace
+}  // namespace xla
@@ -0,0 +1,101 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "conv_quantized.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "conv_im2col.h"
+#include "intra_op_thread_pool.h"
+#include "logging.h"
+
+namespace xla {
+namespace conv {
+namespace {
+
+template <typename T>
+void QuantizedConvImpl(const ConvGeometry& g, const uint8* input,
+                       const quant::QuantizationParams& input_params,
+                       const quant::QuantizedFilter& filter,
+                       const quant::OutputStage& stage, T* output) {
+  CHECK_EQ(g.feature_group_count, 1);
+  CHECK_EQ(filter.output_features, g.output_features);
+  CHECK_EQ(filter.input_features, g.input_features);
+  CHECK_EQ(filter.kernel_height, g.kernel_height);
+  CHECK_EQ(filter.kernel_width, g.kernel_width);
+  CHECK_GE(input_params.zero_point, quant::kUint8Min);
+  CHECK_LE(input_params.zero_point, quant::kUint8Max);
+  const int64 pixels = g.output_height * g.output_width;
+  const int64 depth = g.input_features * g.kernel_height * g.kernel_width;
+  const int64 image_size = g.input_features * g.input_height * g.input_width;
+  const int64 output_image_size = g.output_features * pixels;
+  if (g.batch == 0 || pixels == 0 || g.output_features == 0) {
+    return;
+  }
+
+  // As in ConvIm2Col, a 1x1 unstrided, unpadded filter reads the image as
+  // its own patch matrix; padding after the image enlarges the output.
+  if (g.kernel_height == 1 && g.kernel_width == 1 && g.stride_y == 1 &&
+      g.stride_x == 1 && g.lhs_dilation_y == 1 && g.lhs_dilation_x == 1 &&
+      g.pad_top == 0 && g.pad_left == 0 &&
+      g.output_height == g.input_height && g.output_width == g.input_width) {
+    for (int64 b = 0; b < g.batch; ++b) {
+      quant::QuantizedGemm(filter.weights, pixels, input + b * image_size,
+                           pixels, input_params, stage,
+                           output + b * output_image_size, pixels);
+    }
+    return;
+  }
+
+  const uint8 padding = static_cast<uint8>(input_params.zero_point);
+  const int64 chunk = Im2ColChunkPixels(g);
+  const int64 chunks_per_image = (pixels + chunk - 1) / chunk;
+  ParallelFor(g.batch * chunks_per_image, 2 * g.output_features * depth * chunk,
+              [&](int64 first, int64 last) {
+    std::vector<uint8> patches(depth * chunk);
+    for (int64 task = first; task < last; ++task) {
+      const int64 b = task / chunks_per_image;
+      const int64 first_pixel = task % chunks_per_image * chunk;
+      const int64 last_pixel = std::min(pixels, first_pixel + chunk);
+      const int64 width = last_pixel - first_pixel;
+      Im2ColPatches(g, input + b * image_size, first_pixel, last_pixel,
+                    padding, patches.data());
+      quant::QuantizedGemm(filter.weights, width, patches.data(), width,
+                           input_params, stage,
+                           output + b * output_image_size + first_pixel,
+                           pixels);
+    }
+  });
+}
+
+}  // namespace
+
+void QuantizedConv(const ConvGeometry& g, const uint8* input,
+                   const quant::QuantizationParams& input_params,
+                   const quant::QuantizedFilter& filter,
+                   const quant::OutputStage& stage, float* output) {
+  QuantizedConvImpl(g, input, input_params, filter, stage, output);
+}
+
+void QuantizedConv(const ConvGeometry& g, const uint8* input,
+                   const quant::QuantizationParams& input_params,
+                   const quant::QuantizedFilter& filter,
+                   const quant::OutputStage& stage, uint8* output) {
+  QuantizedConvImpl(g, input, input_params, filter, stage, output);
+}
+
+}  // namespace conv
+}  // namespace xla
@@ -0,0 +1,54 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_CONV_QUANTIZED_H_
+#define TENSORFLOW_COMPILER_XLA_CONV_QUANTIZED_H_
+
+#include "conv_geometry.h"
+#include "qgemm.h"
+#include "quantization.h"
+#include "types.h"
+
+namespace xla {
+namespace conv {
+
+// 8-bit convolution: a uint8 input quantized with input_params convolved
+// with an int8 filter, lowered like ConvIm2Col onto quant::QuantizedGemm over
+// chunks of the uint8 patch matrix. Padding and dilation holes read as the
+// input zero point, i.e. as real zeros. Products are accumulated exactly in
+// int32 and each output value is produced by stage, with one bias per output
+// feature.
+//
+// Operands are in the canonical layouts of conv_geometry.h; filter must
+// match geometry and its depth (input_features * kernel_height *
+// kernel_width) must not exceed quant::kMaxGemmDepth.
+
+// Stores the real results.
+void QuantizedConv(const ConvGeometry& geometry, const uint8* input,
+                   const quant::QuantizationParams& input_params,
+                   const quant::QuantizedFilter& filter,
+                   const quant::OutputStage& stage, float* output);
+
+// Stores the results requantized with stage.output, so the output can feed
+// the next quantized layer directly.
+void QuantizedConv(const ConvGeometry& geometry, const uint8* input,
+                   const quant::QuantizationParams& input_params,
+                   const quant::QuantizedFilter& filter,
+                   const quant::OutputStage& stage, uint8* output);
+
+}  // namespace conv
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_CONV_QUANTIZED_H_
@@ -0,0 +1,236 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "conv_quantized.h"
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "array4d.h"
+#include "computation_builder.h"
+#include "literal_test_util.h"
+#include "literal_util.h"
+#include "reference_util.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+// The quantized convolution computes, up to float rounding, the convolution
+// of the dequantized operands; the tests compare it with the direct float
+// convolution of those, and with the unquantized convolution within the
+// quantization error.
+class ConvQuantizedTest /* : public ::testing::Test */
+{
+public:
+
+   ConvQuantizedTest() { run(); }
+
+   void MatchesDequantizedConv();
+   void PaddingIsRealZero();
+   void PointwiseWithTrailingPadding();
+   void RequantizedChain();
+
+   void run();
+};
+
+Array4D<float> DequantizedFilter(const quant::QuantizedFilter& filter)
+{
+   Array4D<float> result(filter.output_features, filter.input_features,
+                         filter.kernel_height, filter.kernel_width);
+   result.flatten() = quant::DequantizeWeights(filter.weights);
+   return result;
+}
+
+Array4D<float> Dequantized(const Array4D<float>& input,
+                           const quant::QuantizationParams& params)
+{
+   std::vector<uint8> quantized(input.num_elements());
+   quant::Quantize(input.data(), input.num_elements(), params,
+                   quantized.data());
+   Array4D<float> result(input.n1(), input.n2(), input.n3(), input.n4());
+   quant::Dequantize(quantized.data(), quantized.size(), params,
+                     result.flatten().data());
+   return result;
+}
+
+void ExpectQuantizedConv(int64 batch, int64 features, int64 height,
+                         int64 width, int64 output_features, int64 kernel,
+                         std::pair<int64, int64> stride, Padding padding,
+                         quant::Granularity granularity, bool symmetric)
+{
+   Array4D<float> input(batch, features, height, width);
+   Array4D<float> filter(output_features, features, kernel, kernel);
+   input.FillRandom(1.0f, 0.5, 91);
+   filter.FillRandom(0.5f, 0.0, 92);
+
+   quant::RangeObserver observer;
+   observer.Observe(input);
+   const quant::QuantizationParams input_params = observer.Params();
+   const quant::QuantizedFilter quantized_filter =
+       quant::QuantizeFilter(filter, granularity, symmetric);
+
+   auto actual = ReferenceUtil::QuantizedConvArray4D(
+       input, input_params, quantized_filter, stride, padding);
+   auto expected = ReferenceUtil::Conv4D(
+       Dequantized(input, input_params), DequantizedFilter(quantized_filter),
+       stride, padding, conv::ConvAlgorithm::kDirect);
+   LiteralTestUtil::ExpectR4NearArray4D(
+       *expected, *LiteralUtil::CreateR4FromArray4D(*actual), ErrorSpec(1e-3));
+
+   // Outputs reach about 20; a few 8-bit steps of error are expected.
+   auto exact = ReferenceUtil::Conv4D(input, filter, stride, padding,
+                                      conv::ConvAlgorithm::kDirect);
+   LiteralTestUtil::ExpectR4NearArray4D(
+       *exact, *LiteralUtil::CreateR4FromArray4D(*actual), ErrorSpec(0.3));
+}
+
+void ConvQuantizedTest::MatchesDequantizedConv()
+{
+   for (bool symmetric : {true, false}) {
+      ExpectQuantizedConv(2, 3, 9, 11, 5, 3, {1, 1}, Padding::kSame,
+                          quant::Granularity::kPerChannel, symmetric);
+      ExpectQuantizedConv(1, 4, 12, 10, 7, 3, {2, 2}, Padding::kValid,
+                          quant::Granularity::kPerTensor, symmetric);
+   }
+   // The 1x1 path that skips im2col.
+   ExpectQuantizedConv(2, 16, 6, 7, 9, 1, {1, 1}, Padding::kValid,
+                       quant::Granularity::kPerChannel, true);
+   // Enough features and pixels for several register tiles.
+   ExpectQuantizedConv(1, 8, 20, 20, 40, 3, {1, 1}, Padding::kSame,
+                       quant::Granularity::kPerChannel, true);
+}
+
+void ConvQuantizedTest::PaddingIsRealZero()
+{
+   // All-positive input: the zero point is 0 and every padded tap must read
+   // as zero, not as the smallest input value.
+   Array4D<float> input(1, 1, 3, 3);
+   input.FillWithYX(Array2D<float>(
+       {{1.0f, 2.0f, 3.0f}, {4.0f, 5.0f, 6.0f}, {7.0f, 8.0f, 9.0f}}));
+   Array4D<float> filter(1, 1, 3, 3, 1.0f);
+   quant::QuantizationParams params =
+       quant::ChooseQuantizationParams(-9.0f, 9.0f, 0, 255);
+   auto actual = ReferenceUtil::QuantizedConvArray4D(
+       input, params,
+       quant::QuantizeFilter(filter, quant::Granularity::kPerTensor),
+       {1, 1}, Padding::kSame);
+   Array4D<float> expected(1, 1, 3, 3);
+   expected.FillWithYX(Array2D<float>(
+       {{12.0f, 21.0f, 16.0f}, {27.0f, 45.0f, 33.0f}, {24.0f, 39.0f, 28.0f}}));
+   LiteralTestUtil::ExpectR4NearArray4D(
+       expected, *LiteralUtil::CreateR4FromArray4D(*actual),
+       ErrorSpec(0.5, 0.02));
+}
+
+void ConvQuantizedTest::PointwiseWithTrailingPadding()
+{
+   // A 1x1 filter over an image padded only after it: the geometry has a
+   // larger output than input, which the image alone does not cover.
+   Array4D<float> input(2, 5, 3, 3);
+   Array4D<float> filter(4, 5, 1, 1);
+   input.FillRandom(1.0f, 0.5, 95);
+   filter.FillRandom(0.5f, 0.0, 96);
+
+   quant::RangeObserver observer;
+   observer.Observe(input);
+   const quant::QuantizationParams input_params = observer.Params();
+   const quant::QuantizedFilter quantized_filter =
+       quant::QuantizeFilter(filter, quant::Granularity::kPerChannel);
+   const auto dnums = ComputationBuilder::CreateDefaultConvDimensionNumbers();
+   conv::ConvGeometry geometry = conv::MakeConvGeometry(
+       input, filter, {1, 1}, Padding::kValid, {1, 1}, {1, 1}, dnums);
+   geometry.output_height = 4;
+   geometry.output_width = 5;
+   std::vector<uint8> quantized_input(input.num_elements());
+   quant::Quantize(input.data(), input.num_elements(), input_params,
+                   quantized_input.data());
+   std::vector<float> output(2 * 4 * 4 * 5);
+   conv::QuantizedConv(geometry, quantized_input.data(), input_params,
+                       quantized_filter, quant::OutputStage(), output.data());
+
+   Array4D<float> dequantized = Dequantized(input, input_params);
+   Array4D<float> padded(2, 5, 4, 5);
+   padded.Fill(0.0f);
+   dequantized.Each([&](tensorflow::gtl::ArraySlice<int64> i, float* value) {
+      padded(i[0], i[1], i[2], i[3]) = *value;
+   });
+   auto expected = ReferenceUtil::Conv4D(
+       padded, DequantizedFilter(quantized_filter), {1, 1}, Padding::kValid,
+       conv::ConvAlgorithm::kDirect);
+   LiteralTestUtil::ExpectR4NearArray4D(
+       *expected,
+       *LiteralUtil::CreateR4FromArray4D(
+           *conv::ConvOutputFromCanonical(geometry, output, dnums)),
+       ErrorSpec(1e-3));
+}
+
+void ConvQuantizedTest::RequantizedChain()
+{
+   // uint8 output with a fused bias and relu, fed back as the input of the
+   // next layer without leaving the quantized domain.
+   Array4D<float> input(1, 4, 8, 8);
+   Array4D<float> filter(6, 4, 3, 3);
+   input.FillRandom(1.0f, 0.0, 93);
+   filter.FillRandom(0.5f, 0.0, 94);
+   std::vector<float> bias = {0.1f, -0.2f, 0.3f, 0.0f, -0.5f, 0.25f};
+
+   quant::RangeObserver observer;
+   observer.Observe(input);
+   const quant::QuantizationParams input_params = observer.Params();
+   const quant::QuantizedFilter quantized_filter =
+       quant::QuantizeFilter(filter, quant::Granularity::kPerChannel);
+   const conv::ConvGeometry geometry = conv::MakeConvGeometry(
+       input, filter, {1, 1}, Padding::kSame, {1, 1}, {1, 1},
+       ComputationBuilder::CreateDefaultConvDimensionNumbers());
+   std::vector<uint8> quantized_input(input.num_elements());
+   quant::Quantize(input.data(), input.num_elements(), input_params,
+                   quantized_input.data());
+
+   quant::OutputStage stage;
+   stage.bias = bias.data();
+   stage.activation = ActivationFunction::kRelu;
+   const int64 output_size = 6 * 8 * 8;
+   std::vector<float> real(output_size);
+   conv::QuantizedConv(geometry, quantized_input.data(), input_params,
+                       quantized_filter, stage, real.data());
+   quant::RangeObserver output_observer;
+   output_observer.Observe(real.data(), real.size());
+   stage.output = output_observer.Params();
+   ASSERT_EQ(stage.output.zero_point, 0);
+
+   std::vector<uint8> requantized(output_size);
+   conv::QuantizedConv(geometry, quantized_input.data(), input_params,
+                       quantized_filter, stage, requantized.data());
+   for (int64 i = 0; i < output_size; ++i) {
+      ASSERT_TRUE(real[i] >= 0.0f);
+      const float restored =
+          stage.output.scale * (requantized[i] - stage.output.zero_point);
+      ASSERT_TRUE(std::abs(restored - real[i]) <=
+                  0.5f * stage.output.scale + 1e-5f);
+   }
+}
+
+void ConvQuantizedTest::run()
+{
+   MatchesDequantizedConv();
+   PaddingIsRealZero();
+   PointwiseWithTrailingPadding();
+   RequantizedChain();
+}
+
+}  // namespace
+}  // namespace xla
@@ -0,0 +1,187 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "conv_separable.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "gemm.h"
+#include "intra_op_thread_pool.h"
+#include "kernel_registry.h"
+#include "logging.h"
+
+namespace xla {
+namespace conv {
+namespace {
+
+// Budget, in floats, for the depthwise result of one band of output rows
+// (256KB), so that it is still in cache when the pointwise GEMM reads it.
+constexpr int64 kBandElements = 1 << 16;
+
+void CheckDepthwiseGeometry(const ConvGeometry& g, int64 depth_multiplier) {
+  CHECK_GE(depth_multiplier, 1);
+  CHECK_EQ(g.feature_group_count, 1);
+  CHECK_EQ(g.output_features, g.input_features * depth_multiplier);
+  CHECK_EQ(g.lhs_dilation_y, 1);
+  CHECK_EQ(g.lhs_dilation_x, 1);
+}
+
+// Computes output rows [first_row, last_row) of one depthwise feature: plane
+// is its input feature and taps its kernel. For every tap the valid output
+// columns are computed up front, so the inner loop is a branch-free axpy.
+XLA_ALWAYS_INLINE void DepthwiseRows(const ConvGeometry& g,
+                                     const float* plane, const float* taps,
+                                     int64 first_row, int64 last_row,
+                                     float* output) {
+  const int64 width = g.output_width;
+  std::fill(output, output + (last_row - first_row) * width, 0.0f);
+  for (int64 oy = first_row; oy < last_row; ++oy) {
+    float* dst = output + (oy - first_row) * width;
+    for (int64 ky = 0; ky < g.kernel_height; ++ky) {
+      const int64 y = oy * g.stride_y - g.pad_top + ky * g.rhs_dilation_y;
+      if (y < 0 || y >= g.input_height) {
+        continue;
+      }
+      const float* src = plane + y * g.input_width;
+      for (int64 kx = 0; kx < g.kernel_width; ++kx) {
+        const float weight = taps[ky * g.kernel_width + kx];
+        // Output column ox reads input column ox * stride_x + x0.
+        const int64 x0 = kx * g.rhs_dilation_x - g.pad_left;
+        const int64 first_x = x0 >= 0 ? 0 : (-x0 + g.stride_x - 1) / g.stride_x;
+        const int64 last_x =
+            g.input_width <= x0
+                ? 0
+                : std::min(width, (g.input_width - x0 + g.stride_x - 1) /
+                                      g.stride_x);
+        if (g.stride_x == 1) {
+          for (int64 ox = first_x; ox < last_x; ++ox) {
+            dst[ox] += weight * src[ox + x0];
+          }
+        } else {
+          for (int64 ox = first_x; ox < last_x; ++ox) {
+            dst[ox] += weight * src[ox * g.stride_x + x0];
+          }
+        }
+      }
+    }
+  }
+}
+
+using DepthwiseRowsFn = void (*)(const ConvGeometry& g, const float* plane,
+                                const float* taps, int64 first_row,
+                                int64 last_row, float* output);
+
+void DepthwiseRowsBaseline(const ConvGeometry& g, const float* plane,
+                           const float* taps, int64 first_row, int64 last_row,
+                           float* output) {
+  DepthwiseRows(g, plane, taps, first_row, last_row, output);
+}
+
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+XLA_TARGET_AVX2 void DepthwiseRowsAvx2(const ConvGeometry& g,
+                                       const float* plane, const float* taps,
+                                       int64 first_row, int64 last_row,
+                                       float* output) {
+  DepthwiseRows(g, plane, taps, first_row, last_row, output);
+}
+#endif  // XLA_HAS_TARGET_ATTRIBUTES
+
+const KernelRegistry<DepthwiseRowsFn>& DepthwiseRowsKernels() {
+  static const KernelRegistry<DepthwiseRowsFn>* registry = [] {
+    auto* kernels = new KernelRegistry<DepthwiseRowsFn>(DepthwiseRowsBaseline);
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+    kernels->Register(Isa::kAvx2, DepthwiseRowsAvx2);
+#endif
+    return kernels;
+  }();
+  return *registry;
+}
+
+}  // namespace
+
+void DepthwiseConv(const ConvGeometry& g, int64 depth_multiplier,
+                   const float* input, const float* depthwise_filter,
+                   float* output) {
+  CheckDepthwiseGeometry(g, depth_multiplier);
+  const int64 plane_size = g.input_height * g.input_width;
+  const int64 output_plane_size = g.output_height * g.output_width;
+  const int64 kernel_size = g.kernel_height * g.kernel_width;
+  const DepthwiseRowsFn depthwise_rows = DepthwiseRowsKernels().Get();
+  ParallelFor(g.batch * g.output_features, 2 * output_plane_size * kernel_size,
+              [&](int64 first, int64 last) {
+    for (int64 i = first; i < last; ++i) {
+      const int64 b = i / g.output_features;
+      const int64 c = i % g.output_features / depth_multiplier;
+      const int64 d = i % depth_multiplier;
+      depthwise_rows(
+          g, input + (b * g.input_features + c) * plane_size,
+          depthwise_filter + (d * g.input_features + c) * kernel_size, 0,
+          g.output_height, output + i * output_plane_size);
+    }
+  });
+}
+
+void SeparableConv(const ConvGeometry& g, int64 depth_multiplier,
+                   const float* input, const float* depthwise_filter,
+                   int64 output_features, const float* pointwise_filter,
+                   float* output) {
+  CheckDepthwiseGeometry(g, depth_multiplier);
+  const int64 features = g.output_features;
+  const int64 pixels = g.output_height * g.output_width;
+  if (g.batch == 0 || pixels == 0 || output_features == 0) {
+    return;
+  }
+  const int64 plane_size = g.input_height * g.input_width;
+  const int64 kernel_size = g.kernel_height * g.kernel_width;
+  const int64 band_rows = std::min(
+      g.output_height,
+      std::max<int64>(1, kBandElements /
+                             std::max<int64>(features * g.output_width, 1)));
+  const int64 bands_per_image = (g.output_height + band_rows - 1) / band_rows;
+  const DepthwiseRowsFn depthwise_rows = DepthwiseRowsKernels().Get();
+
+  // Every (image, band) task writes its own rows of the output.
+  ParallelFor(g.batch * bands_per_image,
+              2 * band_rows * g.output_width * features *
+                  (kernel_size + output_features),
+              [&](int64 first, int64 last) {
+    std::vector<float> band(features * band_rows * g.output_width);
+    for (int64 task = first; task < last; ++task) {
+      const int64 b = task / bands_per_image;
+      const int64 first_row = task % bands_per_image * band_rows;
+      const int64 last_row = std::min(g.output_height, first_row + band_rows);
+      const int64 band_pixels = (last_row - first_row) * g.output_width;
+      for (int64 f = 0; f < features; ++f) {
+        const int64 c = f / depth_multiplier;
+        const int64 d = f % depth_multiplier;
+        depthwise_rows(
+            g, input + (b * g.input_features + c) * plane_size,
+            depthwise_filter + (d * g.input_features + c) * kernel_size,
+            first_row, last_row, band.data() + f * band_pixels);
+      }
+      gemm::Gemm<float>(gemm::Transpose::kNoTranspose,
+                        gemm::Transpose::kNoTranspose, output_features,
+                        band_pixels, features, 1.0f, pointwise_filter,
+                        features, band.data(), band_pixels, 0.0f,
+                        output + b * output_features * pixels +
+                            first_row * g.output_width,
+                        pixels);
+    }
+  });
+}
+
+}  // namespace conv
+}  // namespace xla
@@ -0,0 +1,57 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_CONV_SEPARABLE_H_
+#define TENSORFLOW_COMPILER_XLA_CONV_SEPARABLE_H_
+
+#include "conv_geometry.h"
+#include "types.h"
+
+namespace xla {
+namespace conv {
+
+// Depthwise and separable convolutions. A depthwise convolution filters every
+// input feature c on its own with depth_multiplier kernels, producing features
+// c * depth_multiplier + d; a separable convolution follows it with a 1x1
+// (pointwise) convolution that mixes those features. Computing the two stages
+// separately costs kernel_area + output_features multiply-adds per depthwise
+// feature and pixel, instead of kernel_area * output_features for the dense
+// convolution with the combined weights.
+//
+// In both functions geometry describes the depthwise stage:
+// geometry.output_features must be input_features * depth_multiplier, and
+// the depthwise filter is a dense row-major
+// [depth_multiplier][input_features][kernel_height][kernel_width] array.
+// Input and output use the canonical layouts of conv_geometry.h. Strides,
+// padding and kernel dilation are supported; input dilation is not.
+
+// Computes the depthwise convolution alone.
+void DepthwiseConv(const ConvGeometry& geometry, int64 depth_multiplier,
+                   const float* input, const float* depthwise_filter,
+                   float* output);
+
+// Computes the depthwise convolution followed by the pointwise one, whose
+// filter is a row-major [output_features][geometry.output_features] matrix.
+// The two stages are fused over bands of output rows, so the depthwise result
+// is never materialized for a whole image.
+void SeparableConv(const ConvGeometry& geometry, int64 depth_multiplier,
+                   const float* input, const float* depthwise_filter,
+                   int64 output_features, const float* pointwise_filter,
+                   float* output);
+
+}  // namespace conv
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_CONV_SEPARABLE_H_
@@ -0,0 +1,153 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "conv_separable.h"
+
+#include <memory>
+
+#include "array4d.h"
+#include "computation_builder.h"
+#include "literal_test_util.h"
+#include "literal_util.h"
+#include "reference_util.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+// Tests the depthwise and separable kernels against dense convolutions with
+// equivalent weights.
+class ConvSeparableTest /* : public ::testing::Test */
+{
+public:
+
+   ConvSeparableTest() { run(); }
+
+   void SeparableMatchesCombinedWeights();
+   void StridedSeparableMatchesCombinedWeights();
+   void ManyFeaturesSpanSeveralBands();
+   void DepthwiseMatchesPerChannelConv();
+
+   void run();
+};
+
+// The dense equivalent of a separable convolution: the depthwise and
+// pointwise weights folded into one [out][in][ky][kx] filter.
+std::unique_ptr<Array4D<float>> CombinedWeightsConv(
+    const Array4D<float>& input, const Array4D<float>& depthwise_weights,
+    const Array4D<float>& pointwise_weights,
+    std::pair<int64, int64> kernel_stride, Padding padding)
+{
+   const int64 depth_multiplier = depthwise_weights.planes();
+   Array4D<float> weights(pointwise_weights.planes(), input.depth(),
+                          depthwise_weights.height(), depthwise_weights.width());
+   weights.Each([&](tensorflow::gtl::ArraySlice<int64> indices, float* value) {
+      *value = 0.0f;
+      for (int64 d = 0; d < depth_multiplier; ++d) {
+         *value += depthwise_weights(d, indices[1], indices[2], indices[3]) *
+                   pointwise_weights(indices[0],
+                                     indices[1] * depth_multiplier + d, 0, 0);
+      }
+   });
+   return ReferenceUtil::Conv4D(input, weights, kernel_stride, padding,
+                                conv::ConvAlgorithm::kDirect);
+}
+
+void ExpectSeparableMatches(int64 batch, int64 features, int64 height,
+                            int64 width, int64 depth_multiplier,
+                            int64 output_features, int64 kernel_size,
+                            std::pair<int64, int64> kernel_stride,
+                            Padding padding)
+{
+   Array4D<float> input(batch, features, height, width);
+   Array4D<float> depthwise(depth_multiplier, features, kernel_size,
+                            kernel_size);
+   Array4D<float> pointwise(output_features, features * depth_multiplier, 1, 1);
+   input.FillRandom(1.0f, 0.0, 71);
+   depthwise.FillRandom(1.0f, 0.0, 72);
+   pointwise.FillRandom(1.0f, 0.0, 73);
+
+   auto expected = CombinedWeightsConv(input, depthwise, pointwise,
+                                       kernel_stride, padding);
+   auto actual = ReferenceUtil::SeparableConvArray4D(
+       input, depthwise, pointwise, kernel_stride, padding);
+   LiteralTestUtil::ExpectR4NearArray4D(
+       *expected, *LiteralUtil::CreateR4FromArray4D(*actual), ErrorSpec(1e-4));
+}
+
+void ConvSeparableTest::SeparableMatchesCombinedWeights()
+{
+   for (int64 depth_multiplier : {1, 2, 3}) {
+      ExpectSeparableMatches(2, 4, 9, 11, depth_multiplier, 5, 3, {1, 1},
+                             Padding::kSame);
+      ExpectSeparableMatches(2, 4, 9, 11, depth_multiplier, 5, 4, {1, 1},
+                             Padding::kSame);
+      ExpectSeparableMatches(1, 3, 8, 7, depth_multiplier, 6, 3, {1, 1},
+                             Padding::kValid);
+   }
+}
+
+void ConvSeparableTest::StridedSeparableMatchesCombinedWeights()
+{
+   ExpectSeparableMatches(2, 3, 13, 12, 2, 4, 3, {2, 2}, Padding::kValid);
+   ExpectSeparableMatches(1, 2, 10, 15, 1, 3, 5, {3, 2}, Padding::kValid);
+}
+
+void ConvSeparableTest::ManyFeaturesSpanSeveralBands()
+{
+   // 64 depthwise features of 40-pixel rows leave room for a few rows per
+   // band, so the output is assembled from several fused bands.
+   ExpectSeparableMatches(1, 32, 40, 40, 2, 16, 3, {1, 1}, Padding::kSame);
+}
+
+void ConvSeparableTest::DepthwiseMatchesPerChannelConv()
+{
+   const int64 depth_multiplier = 2;
+   Array4D<float> input(2, 3, 10, 9);
+   Array4D<float> depthwise(depth_multiplier, 3, 3, 3);
+   input.FillRandom(1.0f, 0.0, 74);
+   depthwise.FillRandom(1.0f, 0.0, 75);
+
+   // A dense filter that is zero between different input features.
+   Array4D<float> dense(3 * depth_multiplier, 3, 3, 3);
+   dense.Each([&](tensorflow::gtl::ArraySlice<int64> indices, float* value) {
+      const int64 c = indices[0] / depth_multiplier;
+      const int64 d = indices[0] % depth_multiplier;
+      *value = indices[1] == c ? depthwise(d, c, indices[2], indices[3]) : 0.0f;
+   });
+   auto expected = ReferenceUtil::Conv4D(input, dense, {1, 1}, Padding::kSame,
+                                         conv::ConvAlgorithm::kDirect);
+
+   conv::ConvGeometry geometry = conv::MakeConvGeometry(
+       input, depthwise, {1, 1}, Padding::kSame, {1, 1}, {1, 1},
+       ComputationBuilder::CreateDefaultConvDimensionNumbers());
+   geometry.output_features = 3 * depth_multiplier;
+   Array4D<float> actual(2, 3 * depth_multiplier, 10, 9);
+   conv::DepthwiseConv(geometry, depth_multiplier, input.data(),
+                       depthwise.data(), actual.flatten().data());
+   LiteralTestUtil::ExpectR4NearArray4D(
+       *expected, *LiteralUtil::CreateR4FromArray4D(actual), ErrorSpec(1e-5));
+}
+
+void ConvSeparableTest::run()
+{
+   SeparableMatchesCombinedWeights();
+   StridedSeparableMatchesCombinedWeights();
+   ManyFeaturesSpanSeveralBands();
+   DepthwiseMatchesPerChannelConv();
+}
+
+}  // namespace
+}  // namespace xla
@@ -0,0 +1,187 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "conv_transposed.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "gemm.h"
+#include "intra_op_thread_pool.h"
+#include "kernel_registry.h"
+#include "logging.h"
+
+namespace xla {
+namespace conv {
+namespace {
+
+// Budget, in floats, for the columns of one band of input rows (4MB).
+constexpr int64 kColumnBufferElements = 1 << 20;
+
+// Adds the columns of one output feature, for input rows [first_row,
+// last_row), into its output plane. columns holds one row of
+// (last_row - first_row) * input_width values per filter tap.
+XLA_ALWAYS_INLINE void ScatterColumns(const ConvGeometry& g,
+                                      const float* columns, int64 first_row,
+                                      int64 last_row, float* output) {
+  const int64 width = (last_row - first_row) * g.input_width;
+  for (int64 r = 0; r < g.kernel_height; ++r) {
+    for (int64 q = 0; q < g.kernel_width; ++q) {
+      const float* src = columns + (r * g.kernel_width + q) * width;
+      // Input column ix lands on dilated column ix * lhs_dilation_x, which
+      // tap q reads for output column (ix * lhs_dilation_x + x0) / stride_x.
+      const int64 x0 = g.pad_left - q * g.rhs_dilation_x;
+      const int64 dx = g.lhs_dilation_x;
+      const int64 first_x = x0 >= 0 ? 0 : (-x0 + dx - 1) / dx;
+      const int64 last_x =
+          g.output_width * g.stride_x <= x0
+              ? 0
+              : std::min(g.input_width,
+                         (g.output_width * g.stride_x - x0 + dx - 1) / dx);
+      for (int64 iy = first_row; iy < last_row; ++iy) {
+        const int64 y = iy * g.lhs_dilation_y + g.pad_top - r * g.rhs_dilation_y;
+        if (y < 0 || y % g.stride_y != 0 || y / g.stride_y >= g.output_height) {
+          continue;
+        }
+        const float* row = src + (iy - first_row) * g.input_width;
+        float* dst = output + y / g.stride_y * g.output_width;
+        if (g.stride_x == 1) {
+          for (int64 ix = first_x; ix < last_x; ++ix) {
+            dst[ix * dx + x0] += row[ix];
+          }
+        } else {
+          for (int64 ix = first_x; ix < last_x; ++ix) {
+            const int64 x = ix * dx + x0;
+            if (x % g.stride_x == 0) {
+              dst[x / g.stride_x] += row[ix];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+using ScatterColumnsFn = void (*)(const ConvGeometry& g, const float* columns,
+                                  int64 first_row, int64 last_row,
+                                  float* output);
+
+void ScatterColumnsBaseline(const ConvGeometry& g, const float* columns,
+                            int64 first_row, int64 last_row, float* output) {
+  ScatterColumns(g, columns, first_row, last_row, output);
+}
+
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+XLA_TARGET_AVX2 void ScatterColumnsAvx2(const ConvGeometry& g,
+                                        const float* columns, int64 first_row,
+                                        int64 last_row, float* output) {
+  ScatterColumns(g, columns, first_row, last_row, output);
+}
+#endif  // XLA_HAS_TARGET_ATTRIBUTES
+
+const KernelRegistry<ScatterColumnsFn>& ScatterColumnsKernels() {
+  static const KernelRegistry<ScatterColumnsFn>* registry = [] {
+    auto* kernels =
+        new KernelRegistry<ScatterColumnsFn>(ScatterColumnsBaseline);
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+    kernels->Register(Isa::kAvx2, ScatterColumnsAvx2);
+#endif
+    return kernels;
+  }();
+  return *registry;
+}
+
+}  // namespace
+
+bool CanUseTransposed(const ConvGeometry& g) {
+  return (g.lhs_dilation_y > 1 || g.lhs_dilation_x > 1) &&
+         g.feature_group_count == 1;
+}
+
+void ConvTransposed(const ConvGeometry& g, const float* input,
+                    const float* filter, float* output) {
+  ConvTransposed(g, input, filter, ConvEpilogue(), output);
+}
+
+void ConvTransposed(const ConvGeometry& g, const float* input,
+                    const float* filter, const ConvEpilogue& epilogue,
+                    float* output) {
+  CHECK_EQ(g.feature_group_count, 1);
+  const int64 taps = g.kernel_height * g.kernel_width;
+  const int64 rows = g.output_features * taps;
+  const int64 plane_size = g.input_height * g.input_width;
+  const int64 output_plane_size = g.output_height * g.output_width;
+  const int64 output_image_size = g.output_features * output_plane_size;
+  if (g.batch == 0 || output_image_size == 0) {
+    return;
+  }
+  std::fill(output, output + g.batch * output_image_size, 0.0f);
+  // Without input elements there is nothing to scatter.
+  const int64 input_rows =
+      plane_size > 0 && g.input_features > 0 ? g.input_height : 0;
+
+  // The filter as a (feature, tap) x input_features matrix.
+  std::vector<float> filter_by_tap(rows * g.input_features);
+  for (int64 f = 0; f < g.output_features; ++f) {
+    for (int64 c = 0; c < g.input_features; ++c) {
+      for (int64 t = 0; t < taps; ++t) {
+        filter_by_tap[(f * taps + t) * g.input_features + c] =
+            filter[(f * g.input_features + c) * taps + t];
+      }
+    }
+  }
+
+  const int64 band_rows = std::min(
+      std::max<int64>(g.input_height, 1),
+      std::max<int64>(1, kColumnBufferElements /
+                             std::max<int64>(rows * g.input_width, 1)));
+  std::vector<float> columns(rows * band_rows * g.input_width);
+  const ScatterColumnsFn scatter_columns = ScatterColumnsKernels().Get();
+  for (int64 b = 0; b < g.batch; ++b) {
+    float* image = output + b * output_image_size;
+    for (int64 first_row = 0; first_row < input_rows; first_row += band_rows) {
+      const int64 last_row = std::min(input_rows, first_row + band_rows);
+      const int64 width = (last_row - first_row) * g.input_width;
+      gemm::Gemm<float>(gemm::Transpose::kNoTranspose,
+                        gemm::Transpose::kNoTranspose, rows, width,
+                        g.input_features, 1.0f, filter_by_tap.data(),
+                        g.input_features,
+                        input + b * g.input_features * plane_size +
+                            first_row * g.input_width,
+                        plane_size, 0.0f, columns.data(), width);
+      // Every output feature scatters into its own plane.
+      ParallelFor(g.output_features, 2 * taps * width,
+                  [&](int64 first, int64 last) {
+        for (int64 f = first; f < last; ++f) {
+          scatter_columns(g, columns.data() + f * taps * width, first_row,
+                          last_row, image + f * output_plane_size);
+        }
+      });
+    }
+    if (!epilogue.IsIdentity()) {
+      ParallelFor(g.output_features, 4 * output_plane_size,
+                  [&](int64 first, int64 last) {
+        for (int64 f = first; f < last; ++f) {
+          ApplyConvEpilogue(epilogue, f,
+                            b * output_image_size + f * output_plane_size,
+                            output_plane_size, image + f * output_plane_size);
+        }
+      });
+    }
+  }
+}
+
+}  // namespace conv
+}  // namespace xla
@@ -0,0 +1,61 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_CONV_TRANSPOSED_H_
+#define TENSORFLOW_COMPILER_XLA_CONV_TRANSPOSED_H_
+
+#include "conv_geometry.h"
+#include "types.h"
+
+namespace xla {
+namespace conv {
+
+// Transposed (fractionally strided) convolution, i.e. a convolution whose
+// input is dilated. Lowered directly, most taps of such a convolution fall on
+// dilation holes: with an input dilation of 2 in both dimensions three in
+// four multiply-adds, in the direct loop and in the im2col patch matrix
+// alike, are against zeros.
+//
+// This kernel instead multiplies every real input pixel by every filter tap
+// with one GEMM,
+//
+//   columns ((output_features * kernel_height * kernel_width) x pixels) =
+//       filter^T (per tap) * input (input_features x pixels)
+//
+// and scatters (col2im) each column entry into the output element that tap
+// contributes to, so no work is spent on holes. The sums are the same as
+// those of the dilated convolution, accumulated in a different order.
+
+// Returns whether ConvTransposed avoids work: the input is dilated in at
+// least one dimension. ConvTransposed itself accepts every ungrouped
+// geometry.
+bool CanUseTransposed(const ConvGeometry& geometry);
+
+// Computes the convolution described by geometry. All operands are in the
+// canonical layouts of conv_geometry.h. Supports every stride, padding and
+// dilation that MakeConvGeometry accepts, without feature groups.
+void ConvTransposed(const ConvGeometry& geometry, const float* input,
+                    const float* filter, float* output);
+
+// As above, with epilogue applied to each image's output once all of its
+// contributions have been scattered.
+void ConvTransposed(const ConvGeometry& geometry, const float* input,
+                    const float* filter, const ConvEpilogue& epilogue,
+                    float* output);
+
+}  // namespace conv
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_CONV_TRANSPOSED_H_
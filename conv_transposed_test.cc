@@ -0,0 +1,190 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "conv_transposed.h"
+
+#include <memory>
+
+#include "array4d.h"
+#include "computation_builder.h"
+#include "reference_util.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+// Tests the transposed convolution against the direct dilated convolution.
+class ConvTransposedTest /* : public ::testing::Test */
+{
+public:
+
+   ConvTransposedTest() { run(); }
+
+   void UpsamplingMatchesDirect();
+   void StridedAndDilatedKernelsMatchDirect();
+   void GeneralDimensionsMatchDirect();
+   void EpilogueMatchesDirect();
+   void DefaultUsesTransposed();
+   void UndilatedInputFallsBack();
+
+   void run();
+};
+
+// Checks the transposed convolution against the direct one, under kSame only
+// for unit strides.
+void ExpectTransposedMatchesDirect(const Array4D<float>& input,
+                                   const Array4D<float>& kernel,
+                                   std::pair<int64, int64> stride,
+                                   std::pair<int64, int64> lhs_dilation,
+                                   std::pair<int64, int64> rhs_dilation,
+                                   const ConvolutionDimensionNumbers& dnums)
+{
+   for (Padding padding : {Padding::kSame, Padding::kValid}) {
+      // kSame is only defined for unit strides.
+      if (padding == Padding::kSame && (stride.first != 1 || stride.second != 1)) {
+         continue;
+      }
+      auto expected = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+          input, kernel, stride, padding, lhs_dilation, rhs_dilation, dnums,
+          conv::ConvAlgorithm::kDirect);
+      auto actual = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+          input, kernel, stride, padding, lhs_dilation, rhs_dilation, dnums,
+          conv::ConvAlgorithm::kTransposed);
+      ASSERT_TRUE(expected->n1() == actual->n1());
+      ASSERT_TRUE(expected->n2() == actual->n2());
+      ASSERT_TRUE(expected->n3() == actual->n3());
+      ASSERT_TRUE(expected->n4() == actual->n4());
+      ASSERT_TRUE(testing::RelativeMaxError(*expected, *actual) < 1e-5f);
+   }
+}
+
+void ConvTransposedTest::UpsamplingMatchesDirect()
+{
+   // The usual 2x and 3x upsampling layers, with odd and even kernels.
+   Array4D<float> input(2, 3, 9, 11);
+   input.FillRandom(1.0f, 0.0, 91);
+   for (int64 size : {2, 3, 4}) {
+      Array4D<float> kernel(5, 3, size, size);
+      kernel.FillRandom(1.0f, 0.0, 92);
+      ExpectTransposedMatchesDirect(
+          input, kernel, {1, 1}, {2, 2}, {1, 1},
+          ComputationBuilder::CreateDefaultConvDimensionNumbers());
+      ExpectTransposedMatchesDirect(
+          input, kernel, {1, 1}, {3, 2}, {1, 1},
+          ComputationBuilder::CreateDefaultConvDimensionNumbers());
+   }
+}
+
+void ConvTransposedTest::StridedAndDilatedKernelsMatchDirect()
+{
+   Array4D<float> input(1, 2, 13, 10);
+   Array4D<float> kernel(3, 2, 3, 4);
+   input.FillRandom(1.0f, 0.0, 93);
+   kernel.FillRandom(1.0f, 0.0, 94);
+   const auto dnums = ComputationBuilder::CreateDefaultConvDimensionNumbers();
+   ExpectTransposedMatchesDirect(input, kernel, {2, 3}, {2, 2}, {1, 1}, dnums);
+   ExpectTransposedMatchesDirect(input, kernel, {1, 1}, {2, 3}, {2, 1}, dnums);
+   ExpectTransposedMatchesDirect(input, kernel, {3, 1}, {1, 2}, {1, 2}, dnums);
+}
+
+void ConvTransposedTest::GeneralDimensionsMatchDirect()
+{
+   // NHWC input, HWIO filter.
+   ConvolutionDimensionNumbers dnums;
+   dnums.set_batch_dimension(0);
+   dnums.add_spatial_dimensions(1);
+   dnums.add_spatial_dimensions(2);
+   dnums.set_feature_dimension(3);
+   dnums.add_kernel_spatial_dimensions(0);
+   dnums.add_kernel_spatial_dimensions(1);
+   dnums.set_kernel_input_feature_dimension(2);
+   dnums.set_kernel_output_feature_dimension(3);
+
+   Array4D<float> input(2, 7, 8, 4);
+   Array4D<float> kernel(4, 4, 4, 6);
+   input.FillRandom(1.0f, 0.0, 95);
+   kernel.FillRandom(1.0f, 0.0, 96);
+   ExpectTransposedMatchesDirect(input, kernel, {1, 1}, {2, 2}, {1, 1}, dnums);
+}
+
+void ConvTransposedTest::EpilogueMatchesDirect()
+{
+   Array4D<float> input(2, 3, 6, 5);
+   Array4D<float> kernel(4, 3, 4, 4);
+   input.FillRandom(1.0f, 0.0, 97);
+   kernel.FillRandom(1.0f, 0.0, 98);
+   const auto dnums = ComputationBuilder::CreateDefaultConvDimensionNumbers();
+   const std::vector<float> bias = {0.5f, -1.0f, 0.25f, 2.0f};
+   Array4D<float> residual(2, 4, 11, 9);
+   residual.FillRandom(1.0f, 0.0, 99);
+   auto expected = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+       input, kernel, {1, 1}, Padding::kSame, {2, 2}, {1, 1}, dnums,
+       conv::ConvAlgorithm::kDirect, bias, &residual, ActivationFunction::kRelu,
+       0.5f);
+   auto actual = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+       input, kernel, {1, 1}, Padding::kSame, {2, 2}, {1, 1}, dnums,
+       conv::ConvAlgorithm::kTransposed, bias, &residual,
+       ActivationFunction::kRelu, 0.5f);
+   ASSERT_EQ(expected->num_elements(), actual->num_elements());
+   ASSERT_TRUE(testing::RelativeMaxError(*expected, *actual) < 1e-5f);
+}
+
+void ConvTransposedTest::DefaultUsesTransposed()
+{
+   Array4D<float> input(1, 4, 8, 8);
+   Array4D<float> kernel(2, 4, 3, 3);
+   input.FillRandom(1.0f, 0.0, 100);
+   kernel.FillRandom(1.0f, 0.0, 101);
+   const auto dnums = ComputationBuilder::CreateDefaultConvDimensionNumbers();
+   const conv::ConvGeometry geometry = conv::MakeConvGeometry(
+       input, kernel, {1, 1}, Padding::kSame, {2, 2}, {1, 1}, dnums);
+   ASSERT_TRUE(conv::CanUseTransposed(geometry));
+
+   auto by_default = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+       input, kernel, {1, 1}, Padding::kSame, {2, 2}, {1, 1}, dnums);
+   auto transposed = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+       input, kernel, {1, 1}, Padding::kSame, {2, 2}, {1, 1}, dnums,
+       conv::ConvAlgorithm::kTransposed);
+   ASSERT_TRUE(by_default->flatten() == transposed->flatten());
+}
+
+void ConvTransposedTest::UndilatedInputFallsBack()
+{
+   Array4D<float> input(1, 2, 10, 10);
+   Array4D<float> kernel(2, 2, 3, 3);
+   input.FillRandom(1.0f, 0.0, 102);
+   kernel.FillRandom(1.0f, 0.0, 103);
+   ASSERT_TRUE(!conv::CanUseTransposed(conv::MakeConvGeometry(
+       input, kernel, {2, 2}, Padding::kValid, {1, 1}, {1, 1},
+       ComputationBuilder::CreateDefaultConvDimensionNumbers())));
+   auto expected = ReferenceUtil::Conv4D(input, kernel, {2, 2}, Padding::kValid,
+                                         conv::ConvAlgorithm::kIm2Col);
+   auto actual = ReferenceUtil::Conv4D(input, kernel, {2, 2}, Padding::kValid,
+                                       conv::ConvAlgorithm::kTransposed);
+   ASSERT_TRUE(expected->flatten() == actual->flatten());
+}
+
+void ConvTransposedTest::run()
+{
+   UpsamplingMatchesDirect();
+   StridedAndDilatedKernelsMatchDirect();
+   GeneralDimensionsMatchDirect();
+   EpilogueMatchesDirect();
+   DefaultUsesTransposed();
+   UndilatedInputFallsBack();
+}
+
+}  // namespace
+}  // namespace xla
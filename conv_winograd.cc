@@ -0,0 +1,297 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "conv_winograd.h"
+
+#include <algorithm>
+
+#include "gemm.h"
+#include "intra_op_thread_pool.h"
+#include "logging.h"
+
+namespace xla {
+namespace conv {
+namespace {
+
+// Transform matrices of F(M x M, 3 x 3) in the notation of Lavin & Gray,
+// "Fast Algorithms for Convolutional Neural Networks": Y = At [(G g Gt) .
+// (Bt d B)] A.
+template <int M>
+struct WinogradMatrices;
+
+template <>
+struct WinogradMatrices<2> {
+  static constexpr int kAlpha = 4;
+  static const float kBt[4][4];
+  static const float kG[4][3];
+  static const float kAt[2][4];
+};
+
+const float WinogradMatrices<2>::kBt[4][4] = {
+    {1, 0, -1, 0}, {0, 1, 1, 0}, {0, -1, 1, 0}, {0, 1, 0, -1}};
+const float WinogradMatrices<2>::kG[4][3] = {
+    {1, 0, 0}, {0.5f, 0.5f, 0.5f}, {0.5f, -0.5f, 0.5f}, {0, 0, 1}};
+const float WinogradMatrices<2>::kAt[2][4] = {{1, 1, 1, 0}, {0, 1, -1, -1}};
+
+template <>
+struct WinogradMatrices<4> {
+  static constexpr int kAlpha = 6;
+  static const float kBt[6][6];
+  static const float kG[6][3];
+  static const float kAt[4][6];
+};
+
+const float WinogradMatrices<4>::kBt[6][6] = {
+    {4, 0, -5, 0, 1, 0},  {0, -4, -4, 1, 1, 0}, {0, 4, -4, -1, 1, 0},
+    {0, -2, -1, 2, 1, 0}, {0, 2, -1, -2, 1, 0}, {0, 4, 0, -5, 0, 1}};
+const float WinogradMatrices<4>::kG[6][3] = {
+    {1.0f / 4, 0, 0},
+    {-1.0f / 6, -1.0f / 6, -1.0f / 6},
+    {-1.0f / 6, 1.0f / 6, -1.0f / 6},
+    {1.0f / 24, 1.0f / 12, 1.0f / 6},
+    {1.0f / 24, -1.0f / 12, 1.0f / 6},
+    {0, 0, 1}};
+const float WinogradMatrices<4>::kAt[4][6] = {{1, 1, 1, 1, 1, 0},
+                                              {0, 1, -1, 2, -2, 0},
+                                              {0, 1, 1, 4, 4, 0},
+                                              {0, 1, -1, 8, -8, 1}};
+
+// Budget, in floats, for the transformed input and output of one chunk of
+// tiles.
+constexpr int64 kChunkBufferElements = 1 << 20;
+
+// Lower bound on the tiles of one chunk, so that the batched GEMMs stay wide.
+constexpr int64 kMinChunkTiles = 32;
+
+template <int M>
+void TransformFilter(int64 output_features, int64 input_features,
+                     const float* filter, float* transformed) {
+  using W = WinogradMatrices<M>;
+  constexpr int kAlpha = W::kAlpha;
+  const int64 matrix_size = output_features * input_features;
+  for (int64 k = 0; k < output_features; ++k) {
+    for (int64 c = 0; c < input_features; ++c) {
+      const float* g = filter + (k * input_features + c) * 9;
+      float tmp[kAlpha][3];
+      for (int i = 0; i < kAlpha; ++i) {
+        for (int j = 0; j < 3; ++j) {
+          tmp[i][j] = W::kG[i][0] * g[0 * 3 + j] + W::kG[i][1] * g[1 * 3 + j] +
+                      W::kG[i][2] * g[2 * 3 + j];
+        }
+      }
+      for (int i = 0; i < kAlpha; ++i) {
+        for (int j = 0; j < kAlpha; ++j) {
+          transformed[(i * kAlpha + j) * matrix_size + k * input_features + c] =
+              tmp[i][0] * W::kG[j][0] + tmp[i][1] * W::kG[j][1] +
+              tmp[i][2] * W::kG[j][2];
+        }
+      }
+    }
+  }
+}
+
+// Runs the tiles [first_tile, last_tile) of the convolution. Tiles are
+// numbered image by image, row by row. The epilogue is applied to each row of
+// an output tile as it leaves the output transform.
+template <int M>
+void ConvTiles(const ConvGeometry& g, const float* transformed_filter,
+               const ConvEpilogue& epilogue, const float* input,
+               float* output, int64 first_tile, int64 last_tile, float* v,
+               float* m) {
+  using W = WinogradMatrices<M>;
+  constexpr int kAlpha = W::kAlpha;
+  const int64 tiles_y = (g.output_height + M - 1) / M;
+  const int64 tiles_x = (g.output_width + M - 1) / M;
+  const int64 tiles = last_tile - first_tile;
+  const int64 channels = g.input_features;
+  const int64 features = g.output_features;
+  const int64 plane = g.input_height * g.input_width;
+  const int64 output_plane = g.output_height * g.output_width;
+  const bool has_epilogue = !epilogue.IsIdentity();
+
+  // Input transform: v[xi][c][t] = (Bt d B)[xi] for channel c of tile t.
+  ParallelFor(channels, tiles * kAlpha * kAlpha * kAlpha * 2,
+              [&](int64 first, int64 last) {
+    for (int64 c = first; c < last; ++c) {
+      for (int64 t = 0; t < tiles; ++t) {
+        const int64 tile = first_tile + t;
+        const int64 image = tile / (tiles_y * tiles_x);
+        const int64 y0 = (tile / tiles_x) % tiles_y * M - g.pad_top;
+        const int64 x0 = tile % tiles_x * M - g.pad_left;
+        const float* src = input + (image * channels + c) * plane;
+        float d[kAlpha][kAlpha];
+        for (int i = 0; i < kAlpha; ++i) {
+          const int64 y = y0 + i;
+          for (int j = 0; j < kAlpha; ++j) {
+            const int64 x = x0 + j;
+            d[i][j] = (y >= 0 && y < g.input_height && x >= 0 &&
+                       x < g.input_width)
+                          ? src[y * g.input_width + x]
+                          : 0.0f;
+          }
+        }
+        float tmp[kAlpha][kAlpha];
+        for (int i = 0; i < kAlpha; ++i) {
+          for (int j = 0; j < kAlpha; ++j) {
+            float sum = 0.0f;
+            for (int k = 0; k < kAlpha; ++k) {
+              sum += W::kBt[i][k] * d[k][j];
+            }
+            tmp[i][j] = sum;
+          }
+        }
+        for (int i = 0; i < kAlpha; ++i) {
+          for (int j = 0; j < kAlpha; ++j) {
+            float sum = 0.0f;
+            for (int k = 0; k < kAlpha; ++k) {
+              sum += tmp[i][k] * W::kBt[j][k];
+            }
+            v[((i * kAlpha + j) * channels + c) * tiles + t] = sum;
+          }
+        }
+      }
+    }
+  });
+
+  // One GEMM per position of the transformed tile:
+  // m[xi] (features x tiles) = u[xi] (features x channels) * v[xi].
+  for (int xi = 0; xi < kAlpha * kAlpha; ++xi) {
+    gemm::Gemm<float>(gemm::Transpose::kNoTranspose,
+                      gemm::Transpose::kNoTranspose, features, tiles, channels,
+                      1.0f, transformed_filter + xi * features * channels,
+                      channels, v + xi * channels * tiles, tiles, 0.0f,
+                      m + xi * features * tiles, tiles);
+  }
+
+  // Output transform: Y = At m A, cropped at the bottom and right edges.
+  ParallelFor(features, tiles * kAlpha * kAlpha * M * 2,
+              [&](int64 first, int64 last) {
+    for (int64 k = first; k < last; ++k) {
+      for (int64 t = 0; t < tiles; ++t) {
+        const int64 tile = first_tile + t;
+        const int64 image = tile / (tiles_y * tiles_x);
+        const int64 y0 = (tile / tiles_x) % tiles_y * M;
+        const int64 x0 = tile % tiles_x * M;
+        float tmp[M][kAlpha];
+        for (int i = 0; i < M; ++i) {
+          for (int j = 0; j < kAlpha; ++j) {
+            float sum = 0.0f;
+            for (int r = 0; r < kAlpha; ++r) {
+              sum += W::kAt[i][r] * m[((r * kAlpha + j) * features + k) * tiles + t];
+            }
+            tmp[i][j] = sum;
+          }
+        }
+        const int64 plane_offset = (image * features + k) * output_plane;
+        const int64 width = std::min<int64>(M, g.output_width - x0);
+        for (int i = 0; i < M && y0 + i < g.output_height; ++i) {
+          float row[M];
+          for (int j = 0; j < width; ++j) {
+            float sum = 0.0f;
+            for (int r = 0; r < kAlpha; ++r) {
+              sum += tmp[i][r] * W::kAt[j][r];
+            }
+            row[j] = sum;
+          }
+          const int64 offset = plane_offset + (y0 + i) * g.output_width + x0;
+          if (has_epilogue) {
+            ApplyConvEpilogue(epilogue, k, offset, width, row);
+          }
+          std::copy(row, row + width, output + offset);
+        }
+      }
+    }
+  });
+}
+
+template <int M>
+void ConvWinogradImpl(const ConvGeometry& g, const WinogradFilter& filter,
+                      const ConvEpilogue& epilogue, const float* input,
+                      float* output) {
+  constexpr int kAlpha = WinogradMatrices<M>::kAlpha;
+  const int64 tiles_y = (g.output_height + M - 1) / M;
+  const int64 tiles_x = (g.output_width + M - 1) / M;
+  const int64 total_tiles = g.batch * tiles_y * tiles_x;
+  if (total_tiles == 0 || g.output_features == 0) {
+    return;
+  }
+  const int64 per_tile =
+      kAlpha * kAlpha * (g.input_features + g.output_features);
+  const int64 chunk = std::min(
+      total_tiles, std::max(kMinChunkTiles, kChunkBufferElements / per_tile));
+  const int64 chunks = (total_tiles + chunk - 1) / chunk;
+  ParallelFor(chunks,
+              2 * kAlpha * kAlpha * g.input_features * g.output_features * chunk,
+              [&](int64 first, int64 last) {
+                std::vector<float> v(kAlpha * kAlpha * g.input_features * chunk);
+                std::vector<float> m(kAlpha * kAlpha * g.output_features * chunk);
+                for (int64 c = first; c < last; ++c) {
+                  const int64 first_tile = c * chunk;
+                  ConvTiles<M>(g, filter.transformed().data(), epilogue,
+                               input, output, first_tile,
+                               std::min(total_tiles, first_tile + chunk),
+                               v.data(), m.data());
+                }
+              });
+}
+
+}  // namespace
+
+bool CanUseWinograd(const ConvGeometry& geometry) {
+  return geometry.kernel_height == 3 && geometry.kernel_width == 3 &&
+         geometry.stride_y == 1 && geometry.stride_x == 1 &&
+         geometry.lhs_dilation_y == 1 && geometry.lhs_dilation_x == 1 &&
+         geometry.rhs_dilation_y == 1 && geometry.rhs_dilation_x == 1 &&
+         geometry.feature_group_count == 1;
+}
+
+WinogradFilter::WinogradFilter(WinogradTile tile, int64 output_features,
+                               int64 input_features, const float* filter)
+    : tile_(tile),
+      output_features_(output_features),
+      input_features_(input_features) {
+  if (tile == WinogradTile::kF2x2) {
+    constexpr int kAlpha = WinogradMatrices<2>::kAlpha;
+    transformed_.resize(kAlpha * kAlpha * output_features * input_features);
+    TransformFilter<2>(output_features, input_features, filter,
+                       transformed_.data());
+  } else {
+    constexpr int kAlpha = WinogradMatrices<4>::kAlpha;
+    transformed_.resize(kAlpha * kAlpha * output_features * input_features);
+    TransformFilter<4>(output_features, input_features, filter,
+                       transformed_.data());
+  }
+}
+
+void ConvWinograd(const ConvGeometry& geometry, const WinogradFilter& filter,
+                  const float* input, float* output) {
+  ConvWinograd(geometry, filter, input, ConvEpilogue(), output);
+}
+
+void ConvWinograd(const ConvGeometry& geometry, const WinogradFilter& filter,
+                  const float* input, const ConvEpilogue& epilogue,
+                  float* output) {
+  CHECK(CanUseWinograd(geometry));
+  CHECK_EQ(geometry.output_features, filter.output_features());
+  CHECK_EQ(geometry.input_features, filter.input_features());
+  if (filter.tile() == WinogradTile::kF2x2) {
+    ConvWinogradImpl<2>(geometry, filter, epilogue, input, output);
+  } else {
+    ConvWinogradImpl<4>(geometry, filter, epilogue, input, output);
+  }
+}
+
+}  // namespace conv
+}  // namespace xla
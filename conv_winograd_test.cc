@@ -0,0 +1,133 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "conv_winograd.h"
+
+#include <memory>
+
+#include "array4d.h"
+#include "computation_builder.h"
+#include "reference_util.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+// Tests the Winograd kernels against the direct convolution, within the
+// tolerances documented in conv_winograd.h.
+class ConvWinogradTest /* : public ::testing::Test */
+{
+public:
+
+   ConvWinogradTest() { run(); }
+
+   void F2x2MatchesDirect();
+   void F4x4MatchesDirect();
+   void UnsupportedShapesFallBack();
+   void PretransformedFilterIsReusable();
+
+   void run();
+};
+
+// Checks algorithm against the direct convolution under both paddings, with
+// tolerance relative to the largest output.
+void ExpectWinogradMatchesDirect(conv::ConvAlgorithm algorithm, float tolerance)
+{
+   // Odd spatial sizes leave partial tiles at the bottom and right edges.
+   Array4D<float> input(2, 16, 13, 11);
+   Array4D<float> kernel(24, 16, 3, 3);
+   input.FillRandom(1.0f, 0.0, 41);
+   kernel.FillRandom(1.0f, 0.0, 42);
+   for (Padding padding : {Padding::kSame, Padding::kValid}) {
+      auto expected = ReferenceUtil::Conv4D(input, kernel, {1, 1}, padding,
+                                            conv::ConvAlgorithm::kDirect);
+      auto actual = ReferenceUtil::Conv4D(input, kernel, {1, 1}, padding,
+                                          algorithm);
+      ASSERT_TRUE(expected->n3() == actual->n3());
+      ASSERT_TRUE(expected->n4() == actual->n4());
+      ASSERT_TRUE(testing::RelativeMaxError(*expected, *actual) < tolerance);
+   }
+}
+
+void ConvWinogradTest::F2x2MatchesDirect()
+{
+   ExpectWinogradMatchesDirect(conv::ConvAlgorithm::kWinogradF2x2, 1e-5f);
+}
+
+void ConvWinogradTest::F4x4MatchesDirect()
+{
+   ExpectWinogradMatchesDirect(conv::ConvAlgorithm::kWinogradF4x4, 1e-4f);
+}
+
+void ConvWinogradTest::UnsupportedShapesFallBack()
+{
+   Array4D<float> input(1, 3, 9, 9);
+   Array4D<float> kernel(2, 3, 3, 3);
+   input.FillRandom(1.0f, 0.0, 43);
+   kernel.FillRandom(1.0f, 0.0, 44);
+   // Strided: Winograd cannot run it, so the result is the im2col one.
+   auto expected = ReferenceUtil::Conv4D(input, kernel, {2, 2}, Padding::kValid,
+                                         conv::ConvAlgorithm::kIm2Col);
+   auto actual = ReferenceUtil::Conv4D(input, kernel, {2, 2}, Padding::kValid,
+                                       conv::ConvAlgorithm::kWinogradF4x4);
+   ASSERT_TRUE(expected->flatten() == actual->flatten());
+
+   Array4D<float> kernel5x5(2, 3, 5, 5);
+   kernel5x5.FillRandom(1.0f, 0.0, 45);
+   expected = ReferenceUtil::Conv4D(input, kernel5x5, {1, 1}, Padding::kSame,
+                                    conv::ConvAlgorithm::kIm2Col);
+   actual = ReferenceUtil::Conv4D(input, kernel5x5, {1, 1}, Padding::kSame,
+                                  conv::ConvAlgorithm::kWinogradF2x2);
+   ASSERT_TRUE(expected->flatten() == actual->flatten());
+}
+
+void ConvWinogradTest::PretransformedFilterIsReusable()
+{
+   Array4D<float> kernel(8, 4, 3, 3);
+   kernel.FillRandom(1.0f, 0.0, 46);
+   const auto dnums = ComputationBuilder::CreateDefaultConvDimensionNumbers();
+   const std::vector<float> canonical_filter =
+       conv::CanonicalConvFilter(kernel, dnums);
+   const conv::WinogradFilter filter(conv::WinogradTile::kF4x4, 8, 4,
+                                     canonical_filter.data());
+
+   for (int seed : {47, 48}) {
+      Array4D<float> input(1, 4, 10, 12);
+      input.FillRandom(1.0f, 0.0, seed);
+      const conv::ConvGeometry geometry = conv::MakeConvGeometry(
+          input, kernel, {1, 1}, Padding::kSame, {1, 1}, {1, 1}, dnums);
+      ASSERT_TRUE(conv::CanUseWinograd(geometry));
+      std::vector<float> output(8 * 10 * 12);
+      conv::ConvWinograd(geometry, filter,
+                         conv::CanonicalConvInput(input, dnums).data(),
+                         output.data());
+
+      auto expected = ReferenceUtil::Conv4D(input, kernel, {1, 1},
+                                            Padding::kSame,
+                                            conv::ConvAlgorithm::kWinogradF4x4);
+      ASSERT_TRUE(expected->flatten() == output);
+   }
+}
+
+void ConvWinogradTest::run()
+{
+   F2x2MatchesDirect();
+   F4x4MatchesDirect();
+   UnsupportedShapesFallBack();
+   PretransformedFilterIsReusable();
+}
+
+}  // namespace
+}  // namespace xla
@@ -0,0 +1,196 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "cpu_info.h"
+
+#include "integral_types.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define PLATFORM_IS_X86
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define PLATFORM_IS_X86
+#endif
+
+#if defined(__linux__) && (defined(__aarch64__) || defined(__arm__))
+#include <sys/auxv.h>
+#define PLATFORM_HAS_HWCAP
+#endif
+
+namespace tensorflow {
+namespace port {
+namespace {
+
+#ifdef PLATFORM_IS_X86
+// Runs cpuid for leaf and subleaf into regs = {eax, ebx, ecx, edx}.
+void GetCpuid(uint32 leaf, uint32 subleaf, uint32 regs[4]) {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuidex(info, leaf, subleaf);
+  for (int i = 0; i < 4; ++i) {
+    regs[i] = static_cast<uint32>(info[i]);
+  }
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Returns the register state the operating system saves on context switches
+// (XCR0); only valid when cpuid reports OSXSAVE.
+uint64 GetXcr0() {
+#ifdef _MSC_VER
+  return _xgetbv(0);
+#else
+  uint32 eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (static_cast<uint64>(edx) << 32) | eax;
+#endif
+}
+#endif  // PLATFORM_IS_X86
+
+class CPUIDInfo {
+ public:
+  CPUIDInfo() : features_(0) {
+#ifdef PLATFORM_IS_X86
+    uint32 regs[4];
+    GetCpuid(0, 0, regs);
+    const uint32 max_leaf = regs[0];
+    vendor_.append(reinterpret_cast<const char*>(&regs[1]), 4);
+    vendor_.append(reinterpret_cast<const char*>(&regs[3]), 4);
+    vendor_.append(reinterpret_cast<const char*>(&regs[2]), 4);
+    model_ = BrandString();
+    if (max_leaf < 1) {
+      return;
+    }
+
+    GetCpuid(1, 0, regs);
+    if (model_.empty()) {
+      // No brand string: fall back to the family, model and stepping.
+      const uint32 eax = regs[0];
+      const uint32 family = ((eax >> 8) & 0xf) + ((eax >> 20) & 0xff);
+      const uint32 model = ((eax >> 4) & 0xf) | ((eax >> 12) & 0xf0);
+      model_ = vendor_ + " family " + std::to_string(family) + " model " +
+               std::to_string(model) + " stepping " +
+               std::to_string(eax & 0xf);
+    }
+    const uint32 ecx = regs[2];
+    const uint32 edx = regs[3];
+    Set(SSE, edx & (1u << 25));
+    Set(SSE2, edx & (1u << 26));
+    Set(SSE3, ecx & (1u << 0));
+    Set(SSSE3, ecx & (1u << 9));
+    Set(SSE4_1, ecx & (1u << 19));
+    Set(SSE4_2, ecx & (1u << 20));
+    Set(POPCNT, ecx & (1u << 23));
+
+    // The ymm and zmm registers are only usable if the OS saves them.
+    const uint64 xcr0 = (ecx & (1u << 27)) ? GetXcr0() : 0;
+    const bool os_avx = (xcr0 & 0x6) == 0x6;
+    const bool os_avx512 = (xcr0 & 0xe6) == 0xe6;
+    Set(AVX, os_avx && (ecx & (1u << 28)));
+    Set(FMA, os_avx && (ecx & (1u << 12)));
+    Set(F16C, os_avx && (ecx & (1u << 29)));
+    if (max_leaf < 7) {
+      return;
+    }
+
+    GetCpuid(7, 0, regs);
+    const uint32 ebx7 = regs[1];
+    const uint32 ecx7 = regs[2];
+    const uint32 max_subleaf = regs[0];
+    Set(AVX2, os_avx && (ebx7 & (1u << 5)));
+    Set(AVX512F, os_avx512 && (ebx7 & (1u << 16)));
+    Set(AVX512DQ, os_avx512 && (ebx7 & (1u << 17)));
+    Set(AVX512CD, os_avx512 && (ebx7 & (1u << 28)));
+    Set(AVX512BW, os_avx512 && (ebx7 & (1u << 30)));
+    Set(AVX512VL, os_avx512 && (ebx7 & (1u << 31)));
+    Set(AVX512_VNNI, os_avx512 && (ecx7 & (1u << 11)));
+    if (max_subleaf >= 1) {
+      GetCpuid(7, 1, regs);
+      Set(AVX512_BF16, os_avx512 && (regs[0] & (1u << 5)));
+    }
+#endif  // PLATFORM_IS_X86
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+    Set(NEON, true);
+#endif
+#ifdef PLATFORM_HAS_HWCAP
+    const unsigned long hwcap = getauxval(AT_HWCAP);
+#if defined(__aarch64__)
+    Set(ARM_FP16, hwcap & (1ul << 10));     // HWCAP_ASIMDHP
+    Set(ARM_DOTPROD, hwcap & (1ul << 20));  // HWCAP_ASIMDDP
+#else
+    Set(NEON, hwcap & (1ul << 12));  // HWCAP_NEON
+#endif
+#endif  // PLATFORM_HAS_HWCAP
+  }
+
+  bool Has(CPUFeature feature) const { return (features_ >> feature) & 1; }
+
+  const std::string& vendor() const { return vendor_; }
+  const std::string& model() const { return model_; }
+
+ private:
+#ifdef PLATFORM_IS_X86
+  // Returns the 48-character brand string of the extended cpuid leaves without
+  // its padding, or an empty string if the CPU does not report one.
+  static std::string BrandString() {
+    uint32 regs[4];
+    GetCpuid(0x80000000u, 0, regs);
+    if (regs[0] < 0x80000004u) {
+      return std::string();
+    }
+    std::string brand;
+    for (uint32 leaf = 0x80000002u; leaf <= 0x80000004u; ++leaf) {
+      GetCpuid(leaf, 0, regs);
+      brand.append(reinterpret_cast<const char*>(regs), sizeof(regs));
+    }
+    // The string is nul-terminated within the 48 bytes.
+    brand = brand.c_str();
+    const size_t first = brand.find_first_not_of(' ');
+    if (first == std::string::npos) {
+      return std::string();
+    }
+    return brand.substr(first, brand.find_last_not_of(' ') - first + 1);
+  }
+#endif  // PLATFORM_IS_X86
+
+  void Set(CPUFeature feature, bool present) {
+    if (present) {
+      features_ |= uint64{1} << feature;
+    }
+  }
+
+  uint64 features_;
+  std::string vendor_;
+  std::string model_;
+};
+
+const CPUIDInfo& GetCPUIDInfo() {
+  static const CPUIDInfo* info = new CPUIDInfo;
+  return *info;
+}
+
+}  // namespace
+
+bool TestCPUFeature(CPUFeature feature) { return GetCPUIDInfo().Has(feature); }
+
+std::string CPUVendorIDString() { return GetCPUIDInfo().vendor(); }
+
+std::string CPUModelString() { return GetCPUIDInfo().model(); }
+
+}  // namespace port
+}  // namespace tensorflow
@@ -29,6 +29,49 @@ namespace port {
 // TODO(jeff,sanjay): Make portable
 constexpr bool kLittleEndian = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
 
+// Instruction set extensions that kernels may be specialized for. Features
+// of other architectures are reported as absent.
+enum CPUFeature {
+  // x86, from cpuid. The AVX and AVX-512 features are only reported when the
+  // operating system also saves the corresponding register state.
+  SSE = 0,
+  SSE2 = 1,
+  SSE3 = 2,
+  SSSE3 = 3,
+  SSE4_1 = 4,
+  SSE4_2 = 5,
+  POPCNT = 6,
+  AVX = 7,
+  AVX2 = 8,
+  FMA = 9,
+  F16C = 10,
+  AVX512F = 11,
+  AVX512CD = 12,
+  AVX512VL = 13,
+  AVX512BW = 14,
+  AVX512DQ = 15,
+  AVX512_VNNI = 16,
+  AVX512_BF16 = 17,
+
+  // ARM, from the ELF hwcaps on Linux. NEON is always present on AArch64.
+  NEON = 32,
+  ARM_FP16 = 33,
+  ARM_DOTPROD = 34,
+};
+
+// Returns true if the CPU running this process supports feature. The probe
+// runs once, on the first call.
+bool TestCPUFeature(CPUFeature feature);
+
+// Returns the cpuid vendor string, e.g. "GenuineIntel", or an empty string
+// on other architectures.
+std::string CPUVendorIDString();
+
+// Returns a string that identifies the CPU model, e.g. the cpuid brand string
+// "Intel(R) Xeon(R) Gold 6148 CPU @ 2.40GHz", or an empty string on other
+// architectures. Suitable as a key for per-machine tuning results.
+std::string CPUModelString();
+
 }  // namespace port
 }  // namespace tensorflow
 
@@ -0,0 +1,324 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "fft.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "logging.h"
+
+namespace xla {
+namespace fft {
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+// exp(-2 pi i k / n), computed in double so large sizes keep full precision.
+Complex Twiddle(int64 k, int64 n) {
+  const double angle = -2.0 * kPi * static_cast<double>(k) / n;
+  return Complex(static_cast<float>(std::cos(angle)),
+                 static_cast<float>(std::sin(angle)));
+}
+
+// Multiplies by -i (forward) or +i (inverse).
+Complex RotateQuarter(const Complex& value, bool inverse) {
+  return inverse ? Complex(-value.imag(), value.real())
+                 : Complex(value.imag(), -value.real());
+}
+
+}  // namespace
+
+int64 GoodFftSize(int64 n, bool even) {
+  CHECK_GE(n, 1);
+  for (int64 size = n;; ++size) {
+    if (even && size % 2 != 0) {
+      continue;
+    }
+    int64 remainder = size;
+    for (int64 factor : {2, 3, 5}) {
+      while (remainder % factor == 0) {
+        remainder /= factor;
+      }
+    }
+    if (remainder == 1) {
+      return size;
+    }
+  }
+}
+
+ComplexFftPlan::ComplexFftPlan(int64 size) : size_(size) {
+  CHECK_GE(size, 1);
+  int64 remaining = size;
+  int64 radix = 4;
+  while (remaining > 1) {
+    while (remaining % radix != 0) {
+      switch (radix) {
+        case 4:
+          radix = 2;
+          break;
+        case 2:
+          radix = 3;
+          break;
+        default:
+          radix += 2;
+          break;
+      }
+      if (radix * radix > remaining) {
+        radix = remaining;
+      }
+    }
+    remaining /= radix;
+    factors_.push_back(radix);
+    factors_.push_back(remaining);
+  }
+  if (factors_.empty()) {
+    factors_ = {1, 1};
+  }
+  twiddles_.resize(size);
+  inverse_twiddles_.resize(size);
+  for (int64 i = 0; i < size; ++i) {
+    twiddles_[i] = Twiddle(i, size);
+    inverse_twiddles_[i] = std::conj(twiddles_[i]);
+  }
+}
+
+void ComplexFftPlan::Forward(const Complex* in, Complex* out) const {
+  CHECK(in != out);
+  Work(out, in, 1, factors_.data(), twiddles_.data(), /*inverse=*/false);
+}
+
+void ComplexFftPlan::Inverse(const Complex* in, Complex* out) const {
+  CHECK(in != out);
+  Work(out, in, 1, factors_.data(), inverse_twiddles_.data(),
+       /*inverse=*/true);
+}
+
+// Decimation in time: the p interleaved subsequences of length m are
+// transformed recursively into consecutive blocks of out, then combined with
+// one radix-p butterfly per output index. The radix 3 and 5 butterflies follow
+// KISS FFT.
+void ComplexFftPlan::Work(Complex* out, const Complex* in, int64 fstride,
+                          const int64* factors, const Complex* twiddles,
+                          bool inverse) const {
+  const int64 p = factors[0];
+  const int64 m = factors[1];
+  if (m == 1) {
+    for (int64 j = 0; j < p; ++j) {
+      out[j] = in[j * fstride];
+    }
+  } else {
+    for (int64 j = 0; j < p; ++j) {
+      Work(out + j * m, in + j * fstride, fstride * p, factors + 2, twiddles,
+           inverse);
+    }
+  }
+
+  switch (p) {
+    case 1:
+      break;
+    case 2:
+      for (int64 k = 0; k < m; ++k) {
+        const Complex t = Multiply(out[k + m], twiddles[k * fstride]);
+        out[k + m] = out[k] - t;
+        out[k] += t;
+      }
+      break;
+    case 3: {
+      const float sin_third = twiddles[fstride * m].imag();
+      for (int64 k = 0; k < m; ++k) {
+        const Complex s1 = Multiply(out[k + m], twiddles[k * fstride]);
+        const Complex s2 = Multiply(out[k + 2 * m], twiddles[2 * k * fstride]);
+        const Complex sum = s1 + s2;
+        const Complex difference = (s1 - s2) * sin_third;
+        const Complex center = out[k] - sum * 0.5f;
+        out[k] += sum;
+        out[k + m] = Complex(center.real() - difference.imag(),
+                             center.imag() + difference.real());
+        out[k + 2 * m] = Complex(center.real() + difference.imag(),
+                                 center.imag() - difference.real());
+      }
+      break;
+    }
+    case 4:
+      for (int64 k = 0; k < m; ++k) {
+        const Complex s0 = Multiply(out[k + m], twiddles[k * fstride]);
+        const Complex s1 = Multiply(out[k + 2 * m], twiddles[2 * k * fstride]);
+        const Complex s2 = Multiply(out[k + 3 * m], twiddles[3 * k * fstride]);
+        const Complex s5 = out[k] - s1;
+        const Complex s4 = RotateQuarter(s0 - s2, inverse);
+        const Complex s3 = s0 + s2;
+        const Complex s6 = out[k] + s1;
+        out[k] = s6 + s3;
+        out[k + 2 * m] = s6 - s3;
+        out[k + m] = s5 + s4;
+        out[k + 3 * m] = s5 - s4;
+      }
+      break;
+    case 5: {
+      const Complex ya = twiddles[fstride * m];
+      const Complex yb = twiddles[2 * fstride * m];
+      for (int64 k = 0; k < m; ++k) {
+        const Complex s0 = out[k];
+        const Complex s1 = Multiply(out[k + m], twiddles[k * fstride]);
+        const Complex s2 = Multiply(out[k + 2 * m], twiddles[2 * k * fstride]);
+        const Complex s3 = Multiply(out[k + 3 * m], twiddles[3 * k * fstride]);
+        const Complex s4 = Multiply(out[k + 4 * m], twiddles[4 * k * fstride]);
+        const Complex s7 = s1 + s4;
+        const Complex s10 = s1 - s4;
+        const Complex s8 = s2 + s3;
+        const Complex s9 = s2 - s3;
+        out[k] = s0 + s7 + s8;
+        const Complex s5 = s0 + s7 * ya.real() + s8 * yb.real();
+        const Complex s6(s10.imag() * ya.imag() + s9.imag() * yb.imag(),
+                         -s10.real() * ya.imag() - s9.real() * yb.imag());
+        out[k + m] = s5 - s6;
+        out[k + 4 * m] = s5 + s6;
+        const Complex s11 = s0 + s7 * yb.real() + s8 * ya.real();
+        const Complex s12(-s10.imag() * yb.imag() + s9.imag() * ya.imag(),
+                          s10.real() * yb.imag() - s9.real() * ya.imag());
+        out[k + 2 * m] = s11 + s12;
+        out[k + 3 * m] = s11 - s12;
+      }
+      break;
+    }
+    default: {
+      // Generic radix-p DFT of each strided group.
+      std::vector<Complex> scratch(p);
+      for (int64 u = 0; u < m; ++u) {
+        for (int64 q = 0; q < p; ++q) {
+          scratch[q] = out[u + q * m];
+        }
+        for (int64 q = 0; q < p; ++q) {
+          const int64 k = u + q * m;
+          int64 twiddle_index = 0;
+          Complex sum = scratch[0];
+          for (int64 j = 1; j < p; ++j) {
+            twiddle_index += fstride * k;
+            twiddle_index %= size_;
+            sum += Multiply(scratch[j], twiddles[twiddle_index]);
+          }
+          out[k] = sum;
+        }
+      }
+      break;
+    }
+  }
+}
+
+RealFftPlan::RealFftPlan(int64 size) : size_(size), half_(size / 2) {
+  CHECK_GE(size, 2);
+  CHECK_EQ(size % 2, 0);
+  twiddles_.resize(size / 2 + 1);
+  for (int64 k = 0; k <= size / 2; ++k) {
+    twiddles_[k] = Twiddle(k, size);
+  }
+}
+
+// The even and odd samples are packed as the real and imaginary parts of one
+// complex signal z, and its transform Z is split into the even and odd
+// spectra E and O using the conjugate symmetry of real spectra:
+//   E[k] = (Z[k] + conj(Z[h - k])) / 2,  O[k] = (Z[k] - conj(Z[h - k])) / 2i,
+//   X[k] = E[k] + exp(-2 pi i k / n) O[k].
+// Bins k and h - k only depend on Z[k] and Z[h - k], so the split runs in
+// place.
+void RealFftPlan::Forward(const float* in, Complex* out) const {
+  const int64 h = size_ / 2;
+  half_.Forward(reinterpret_cast<const Complex*>(in), out);
+  const Complex z0 = out[0];
+  out[0] = Complex(z0.real() + z0.imag(), 0.0f);
+  out[h] = Complex(z0.real() - z0.imag(), 0.0f);
+  const auto split = [](const Complex& z, const Complex& z_mirror,
+                        const Complex& twiddle) {
+    const Complex even = 0.5f * (z + z_mirror);
+    const Complex odd = Multiply(Complex(0.0f, -0.5f), z - z_mirror);
+    return even + Multiply(twiddle, odd);
+  };
+  for (int64 k = 1; 2 * k <= h; ++k) {
+    const Complex z = out[k];
+    const Complex z_mirror = out[h - k];
+    out[k] = split(z, std::conj(z_mirror), twiddles_[k]);
+    out[h - k] = split(z_mirror, std::conj(z), twiddles_[h - k]);
+  }
+}
+
+// Inverts the split above: 2 Z[k] = 2 E[k] + 2i O[k], whose half-size inverse
+// transform is size * x with the even and odd samples interleaved.
+void RealFftPlan::Inverse(const Complex* in, float* out) const {
+  const int64 h = size_ / 2;
+  // Plans are shared between threads, so the scratch is per thread.
+  static thread_local std::vector<Complex> packed;
+  packed.resize(std::max<size_t>(packed.size(), h));
+  for (int64 k = 0; k < h; ++k) {
+    const Complex x = in[k];
+    const Complex x_mirror = std::conj(in[h - k]);
+    const Complex even = x + x_mirror;
+    const Complex odd =
+        Multiply(x - x_mirror, std::conj(twiddles_[k]));
+    packed[k] = even + Complex(-odd.imag(), odd.real());
+  }
+  half_.Inverse(packed.data(), reinterpret_cast<Complex*>(out));
+}
+
+RealFft2DPlan::RealFft2DPlan(int64 rows, int64 cols)
+    : rows_(rows), cols_(cols), row_plan_(cols), column_plan_(rows) {}
+
+void RealFft2DPlan::Forward(const float* in, Complex* out) const {
+  for (int64 r = 0; r < rows_; ++r) {
+    row_plan_.Forward(in + r * cols_, out + r * spectrum_cols());
+  }
+  TransformColumns(out, /*inverse=*/false);
+}
+
+void RealFft2DPlan::Inverse(Complex* in, float* out) const {
+  TransformColumns(in, /*inverse=*/true);
+  for (int64 r = 0; r < rows_; ++r) {
+    row_plan_.Inverse(in + r * spectrum_cols(), out + r * cols_);
+  }
+}
+
+// Columns are gathered a few at a time so that every row access reads whole
+// cache lines, instead of striding through the spectrum once per column.
+void RealFft2DPlan::TransformColumns(Complex* data, bool inverse) const {
+  constexpr int64 kColumnBlock = 8;
+  const int64 stride = spectrum_cols();
+  std::vector<Complex> columns(kColumnBlock * rows_);
+  std::vector<Complex> transformed(rows_);
+  for (int64 c0 = 0; c0 < stride; c0 += kColumnBlock) {
+    const int64 width = std::min(kColumnBlock, stride - c0);
+    for (int64 r = 0; r < rows_; ++r) {
+      for (int64 j = 0; j < width; ++j) {
+        columns[j * rows_ + r] = data[r * stride + c0 + j];
+      }
+    }
+    for (int64 j = 0; j < width; ++j) {
+      Complex* column = columns.data() + j * rows_;
+      if (inverse) {
+        column_plan_.Inverse(column, transformed.data());
+      } else {
+        column_plan_.Forward(column, transformed.data());
+      }
+      std::copy(transformed.begin(), transformed.end(), column);
+    }
+    for (int64 r = 0; r < rows_; ++r) {
+      for (int64 j = 0; j < width; ++j) {
+        data[r * stride + c0 + j] = columns[j * rows_ + r];
+      }
+    }
+  }
+}
+
+}  // namespace fft
+}  // namespace xla
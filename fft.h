@@ -0,0 +1,119 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_FFT_H_
+#define TENSORFLOW_COMPILER_XLA_FFT_H_
+
+// Mixed-radix fast Fourier transforms. Sizes are factored into radix-4, 2, 3
+// and 5 butterflies, with a generic butterfly for any remaining prime factor,
+// so every size is supported; sizes returned by GoodFftSize are the fast ones.
+//
+// All transforms are unnormalized: Inverse(Forward(x)) == size * x.
+
+#include <complex>
+#include <vector>
+
+#include "types.h"
+
+namespace xla {
+namespace fft {
+
+typedef std::complex<float> Complex;
+
+// Complex product without the C99 Annex G inf/nan recovery that operator*
+// compiles to, which would otherwise dominate the transforms.
+inline Complex Multiply(const Complex& a, const Complex& b) {
+  return Complex(a.real() * b.real() - a.imag() * b.imag(),
+                 a.real() * b.imag() + a.imag() * b.real());
+}
+
+// Returns the smallest size >= n whose only prime factors are 2, 3 and 5.
+// When even is true the result is also a multiple of 2.
+int64 GoodFftSize(int64 n, bool even = false);
+
+// A one-dimensional complex transform of a fixed size. Plans are immutable
+// after construction and may be shared between threads.
+class ComplexFftPlan {
+ public:
+  explicit ComplexFftPlan(int64 size);
+
+  int64 size() const { return size_; }
+
+  // Transforms in[0, size) into out[0, size). in and out must not alias.
+  void Forward(const Complex* in, Complex* out) const;
+  void Inverse(const Complex* in, Complex* out) const;
+
+ private:
+  void Work(Complex* out, const Complex* in, int64 fstride,
+            const int64* factors, const Complex* twiddles, bool inverse) const;
+
+  int64 size_;
+  // (radix, remaining length) pairs, outermost first.
+  std::vector<int64> factors_;
+  // exp(-2 pi i k / size) and its conjugate for k in [0, size).
+  std::vector<Complex> twiddles_;
+  std::vector<Complex> inverse_twiddles_;
+};
+
+// A one-dimensional transform of real data of a fixed even size, computed
+// with a complex transform of half the size. The spectrum of a real signal is
+// conjugate symmetric, so only its size / 2 + 1 leading bins are stored.
+class RealFftPlan {
+ public:
+  explicit RealFftPlan(int64 size);
+
+  int64 size() const { return size_; }
+  int64 spectrum_size() const { return size_ / 2 + 1; }
+
+  // Transforms in[0, size) into out[0, spectrum_size()).
+  void Forward(const float* in, Complex* out) const;
+  // Transforms in[0, spectrum_size()) into out[0, size).
+  void Inverse(const Complex* in, float* out) const;
+
+ private:
+  int64 size_;
+  ComplexFftPlan half_;
+  // exp(-2 pi i k / size) for k in [0, size / 2].
+  std::vector<Complex> twiddles_;
+};
+
+// A two-dimensional transform of row-major rows x cols real planes; cols must
+// be even. The spectrum is rows x (cols / 2 + 1), row-major.
+class RealFft2DPlan {
+ public:
+  RealFft2DPlan(int64 rows, int64 cols);
+
+  int64 rows() const { return rows_; }
+  int64 cols() const { return cols_; }
+  int64 spectrum_cols() const { return row_plan_.spectrum_size(); }
+  int64 spectrum_size() const { return rows_ * spectrum_cols(); }
+
+  void Forward(const float* in, Complex* out) const;
+  // Overwrites in with intermediate results.
+  void Inverse(Complex* in, float* out) const;
+
+ private:
+  void TransformColumns(Complex* data, bool inverse) const;
+
+  int64 rows_;
+  int64 cols_;
+  RealFftPlan row_plan_;
+  ComplexFftPlan column_plan_;
+};
+
+}  // namespace fft
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_FFT_H_
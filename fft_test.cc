@@ -0,0 +1,181 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "fft.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+using fft::Complex;
+
+// Tests the transforms against a naive DFT evaluated in double precision.
+class FftTest /* : public ::testing::Test */
+{
+public:
+
+   FftTest() { run(); }
+
+   void GoodSizes();
+   void ComplexMatchesNaiveDft();
+   void RealMatchesNaiveDft();
+   void RealRoundTrip();
+   void Real2DRoundTrip();
+
+   void run();
+};
+
+std::vector<std::complex<double>> NaiveDft(const std::vector<Complex>& in,
+                                           bool inverse)
+{
+   const int64 n = in.size();
+   const double sign = inverse ? 1.0 : -1.0;
+   std::vector<std::complex<double>> out(n);
+   for (int64 k = 0; k < n; ++k) {
+      for (int64 j = 0; j < n; ++j) {
+         const double angle = sign * 2.0 * M_PI * ((j * k) % n) / n;
+         out[k] += std::complex<double>(in[j]) *
+                   std::complex<double>(std::cos(angle), std::sin(angle));
+      }
+   }
+   return out;
+}
+
+std::vector<float> RandomSignal(int64 size, int seed)
+{
+   std::mt19937 generator(seed);
+   std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+   std::vector<float> signal(size);
+   for (float& value : signal) {
+      value = distribution(generator);
+   }
+   return signal;
+}
+
+// Returns max |expected - actual| / max(1, max |expected|).
+double RelativeMaxError(const std::vector<std::complex<double>>& expected,
+                        const Complex* actual)
+{
+   double max_error = 0.0;
+   double max_value = 1.0;
+   for (size_t i = 0; i < expected.size(); ++i) {
+      max_error = std::max(
+          max_error, std::abs(expected[i] - std::complex<double>(actual[i])));
+      max_value = std::max(max_value, std::abs(expected[i]));
+   }
+   return max_error / max_value;
+}
+
+void FftTest::GoodSizes()
+{
+   ASSERT_EQ(fft::GoodFftSize(1), 1);
+   ASSERT_EQ(fft::GoodFftSize(7), 8);
+   ASSERT_EQ(fft::GoodFftSize(11), 12);
+   ASSERT_EQ(fft::GoodFftSize(97), 100);
+   ASSERT_EQ(fft::GoodFftSize(9, /*even=*/true), 10);
+   ASSERT_EQ(fft::GoodFftSize(15, /*even=*/true), 16);
+}
+
+void FftTest::ComplexMatchesNaiveDft()
+{
+   // Pure radix-4, mixed 2/3/5 and prime sizes.
+   for (int64 size : {1, 2, 3, 4, 5, 7, 8, 12, 30, 64, 97, 120, 256}) {
+      const std::vector<float> re = RandomSignal(size, 1);
+      const std::vector<float> im = RandomSignal(size, 2);
+      std::vector<Complex> in(size);
+      for (int64 i = 0; i < size; ++i) {
+         in[i] = Complex(re[i], im[i]);
+      }
+      const fft::ComplexFftPlan plan(size);
+      std::vector<Complex> out(size);
+      plan.Forward(in.data(), out.data());
+      ASSERT_TRUE(RelativeMaxError(NaiveDft(in, false), out.data()) < 1e-5);
+      plan.Inverse(in.data(), out.data());
+      ASSERT_TRUE(RelativeMaxError(NaiveDft(in, true), out.data()) < 1e-5);
+   }
+}
+
+void FftTest::RealMatchesNaiveDft()
+{
+   for (int64 size : {2, 4, 6, 10, 14, 64, 90, 194}) {
+      const std::vector<float> signal = RandomSignal(size, 3);
+      const std::vector<Complex> in(signal.begin(), signal.end());
+      std::vector<std::complex<double>> expected = NaiveDft(in, false);
+      expected.resize(size / 2 + 1);
+
+      const fft::RealFftPlan plan(size);
+      ASSERT_EQ(plan.spectrum_size(), size / 2 + 1);
+      std::vector<Complex> out(plan.spectrum_size());
+      plan.Forward(signal.data(), out.data());
+      ASSERT_TRUE(RelativeMaxError(expected, out.data()) < 1e-5);
+   }
+}
+
+void FftTest::RealRoundTrip()
+{
+   for (int64 size : {2, 8, 18, 50, 128}) {
+      const std::vector<float> signal = RandomSignal(size, 4);
+      const fft::RealFftPlan plan(size);
+      std::vector<Complex> spectrum(plan.spectrum_size());
+      std::vector<float> back(size);
+      plan.Forward(signal.data(), spectrum.data());
+      plan.Inverse(spectrum.data(), back.data());
+      for (int64 i = 0; i < size; ++i) {
+         ASSERT_TRUE(std::abs(back[i] / size - signal[i]) < 1e-5f);
+      }
+   }
+}
+
+void FftTest::Real2DRoundTrip()
+{
+   const int64 rows = 15;
+   const int64 cols = 24;
+   const std::vector<float> signal = RandomSignal(rows * cols, 5);
+   const fft::RealFft2DPlan plan(rows, cols);
+   ASSERT_EQ(plan.spectrum_size(), rows * (cols / 2 + 1));
+   std::vector<Complex> spectrum(plan.spectrum_size());
+   plan.Forward(signal.data(), spectrum.data());
+
+   // The DC bin is the sum of all samples.
+   double sum = 0.0;
+   for (float value : signal) {
+      sum += value;
+   }
+   ASSERT_TRUE(std::abs(spectrum[0].real() - sum) < 1e-4);
+
+   std::vector<float> back(rows * cols);
+   plan.Inverse(spectrum.data(), back.data());
+   for (int64 i = 0; i < rows * cols; ++i) {
+      ASSERT_TRUE(std::abs(back[i] / (rows * cols) - signal[i]) < 1e-5f);
+   }
+}
+
+void FftTest::run()
+{
+   GoodSizes();
+   ComplexMatchesNaiveDft();
+   RealMatchesNaiveDft();
+   RealRoundTrip();
+   Real2DRoundTrip();
+}
+
+}  // namespace
+}  // namespace xla
@@ -0,0 +1,616 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "gemm.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "intra_op_thread_pool.h"
+#include "kernel_registry.h"
+#include "logging.h"
+#include "simd_kernels.h"
+
+namespace xla {
+namespace gemm {
+namespace {
+
+// Register tile and cache block sizes per element type. The register tile is
+// chosen so that the mr x nr accumulators plus one row of B and a broadcast A
+// value fit in the 16 vector registers of the baseline x86-64/NEON targets.
+template <typename T>
+struct KernelTraits;
+
+template <>
+struct KernelTraits<float> {
+  static constexpr int kMr = 6;
+  static constexpr int kNr = 8;
+  static constexpr int64 kMc = 120;
+  static constexpr int64 kKc = 256;
+  static constexpr int64 kNc = 2048;
+};
+
+template <>
+struct KernelTraits<double> {
+  static constexpr int kMr = 6;
+  static constexpr int kNr = 4;
+  static constexpr int64 kMc = 96;
+  static constexpr int64 kKc = 256;
+  static constexpr int64 kNc = 1024;
+};
+
+// Problems with fewer multiply-adds than this skip packing entirely; the copy
+// overhead would dominate for them.
+constexpr int64 kSmallGemmFlops = 16 * 16 * 16;
+
+// Width of the output tiles distributed over the intra-op thread pool. A
+// multiple of every kNr, and small enough that the kc x kTileCols slice of the
+// packed B panel stays in L2 next to the packed A block.
+constexpr int64 kTileCols = 256;
+
+int64 RoundUp(int64 value, int64 multiple) {
+  return (value + multiple - 1) / multiple * multiple;
+}
+
+// ActivateAndScale of activation.h, on the vector kernels for float.
+template <typename T>
+void ActivateAndScaleRow(ActivationFunction activation, T scale, T* values,
+                         int64 count) {
+  ActivateAndScale(activation, scale, values, count);
+}
+
+void ActivateAndScaleRow(ActivationFunction activation, float scale,
+                         float* values, int64 count) {
+  simd::ActivateAndScale(activation, scale, values, count);
+}
+
+// Applies epilogue to the count finished values of row `row` of C that start
+// at column `col`.
+template <typename T>
+void ApplyEpilogue(const Epilogue<T>& epilogue, int64 row, int64 col,
+                   int64 count, T* values) {
+  if (epilogue.bias != nullptr) {
+    if (epilogue.bias_per_row) {
+      const T bias = epilogue.bias[row];
+      for (int64 j = 0; j < count; ++j) {
+        values[j] += bias;
+      }
+    } else {
+      const T* bias = epilogue.bias + col;
+      for (int64 j = 0; j < count; ++j) {
+        values[j] += bias[j];
+      }
+    }
+  }
+  if (epilogue.residual != nullptr) {
+    const T* residual = epilogue.residual + row * epilogue.residual_ld + col;
+    for (int64 j = 0; j < count; ++j) {
+      values[j] += residual[j];
+    }
+  }
+  ActivateAndScaleRow(epilogue.activation, epilogue.scale, values, count);
+}
+
+// Computes the mr x nr tile
+//
+//   C = alpha * A * B + beta * C
+//
+// from a packed kc x MR sliver of A and a packed kc x NR sliver of B. The
+// accumulators live in a fixed-size local array so the compiler can keep them
+// in registers and vectorize along NR. A non-null epilogue is applied to the
+// accumulators before they are stored; (row, col) is the position of the
+// tile in the whole of C.
+template <typename T, int MR, int NR>
+XLA_ALWAYS_INLINE void MicroKernel(int64 kc, const T* __restrict a,
+                                   const T* __restrict b, T alpha, T beta,
+                                   T* c, int64 ldc, int64 mr, int64 nr,
+                                   const Epilogue<T>* epilogue, int64 row,
+                                   int64 col) {
+  T acc[MR][NR] = {};
+  for (int64 p = 0; p < kc; ++p) {
+    for (int i = 0; i < MR; ++i) {
+      const T a_value = a[i];
+      for (int j = 0; j < NR; ++j) {
+        acc[i][j] += a_value * b[j];
+      }
+    }
+    a += MR;
+    b += NR;
+  }
+
+  if (epilogue != nullptr) {
+    for (int64 i = 0; i < mr; ++i) {
+      for (int j = 0; j < NR; ++j) {
+        acc[i][j] *= alpha;
+      }
+      if (beta != T(0)) {
+        for (int64 j = 0; j < nr; ++j) {
+          acc[i][j] += beta * c[i * ldc + j];
+        }
+      }
+      ApplyEpilogue(*epilogue, row + i, col, nr, acc[i]);
+      for (int64 j = 0; j < nr; ++j) {
+        c[i * ldc + j] = acc[i][j];
+      }
+    }
+    return;
+  }
+
+  if (mr == MR && nr == NR) {
+    if (beta == T(0)) {
+      for (int i = 0; i < MR; ++i) {
+        for (int j = 0; j < NR; ++j) {
+          c[i * ldc + j] = alpha * acc[i][j];
+        }
+      }
+    } else {
+      for (int i = 0; i < MR; ++i) {
+        for (int j = 0; j < NR; ++j) {
+          c[i * ldc + j] = alpha * acc[i][j] + beta * c[i * ldc + j];
+        }
+      }
+    }
+    return;
+  }
+
+  // Partial tile at the bottom or right edge of C.
+  for (int64 i = 0; i < mr; ++i) {
+    for (int64 j = 0; j < nr; ++j) {
+      c[i * ldc + j] = (beta == T(0))
+                           ? alpha * acc[i][j]
+                           : alpha * acc[i][j] + beta * c[i * ldc + j];
+    }
+  }
+}
+
+// Packs the mc x kc block of op(A) starting at (row, col) into MR-row
+// micro-panels: panel r holds rows [r*MR, r*MR + MR) stored column by column.
+// Rows past mc are zero-filled so the micro-kernel never branches on them.
+// A may be stored in a narrower type S, which is widened to T here.
+template <typename T, int MR, typename S>
+void PackA(Transpose transpose, const S* a, int64 lda, int64 row, int64 col,
+           int64 mc, int64 kc, T* packed) {
+  for (int64 ir = 0; ir < mc; ir += MR) {
+    const int64 rows = std::min<int64>(MR, mc - ir);
+    T* dst = packed + ir * kc;
+    if (transpose == Transpose::kNoTranspose) {
+      for (int64 i = 0; i < rows; ++i) {
+        const S* src = a + (row + ir + i) * lda + col;
+        for (int64 p = 0; p < kc; ++p) {
+          dst[p * MR + i] = static_cast<T>(src[p]);
+        }
+      }
+    } else {
+      for (int64 p = 0; p < kc; ++p) {
+        const S* src = a + (col + p) * lda + row + ir;
+        for (int64 i = 0; i < rows; ++i) {
+          dst[p * MR + i] = static_cast<T>(src[i]);
+        }
+      }
+    }
+    for (int64 i = rows; i < MR; ++i) {
+      for (int64 p = 0; p < kc; ++p) {
+        dst[p * MR + i] = T(0);
+      }
+    }
+  }
+}
+
+// Packs the kc x nc panel of op(B) starting at (row, col) into NR-column
+// micro-panels: panel s holds columns [s*NR, s*NR + NR) stored row by row.
+// Columns past nc are zero-filled. B, like A, is widened from S to T.
+template <typename T, int NR, typename S>
+void PackB(Transpose transpose, const S* b, int64 ldb, int64 row, int64 col,
+           int64 kc, int64 nc, T* packed) {
+  for (int64 jr = 0; jr < nc; jr += NR) {
+    const int64 cols = std::min<int64>(NR, nc - jr);
+    T* dst = packed + jr * kc;
+    if (transpose == Transpose::kNoTranspose) {
+      for (int64 p = 0; p < kc; ++p) {
+        const S* src = b + (row + p) * ldb + col + jr;
+        for (int64 j = 0; j < cols; ++j) {
+          dst[p * NR + j] = static_cast<T>(src[j]);
+        }
+        for (int64 j = cols; j < NR; ++j) {
+          dst[p * NR + j] = T(0);
+        }
+      }
+    } else {
+      for (int64 j = 0; j < cols; ++j) {
+        const S* src = b + (col + jr + j) * ldb + row;
+        for (int64 p = 0; p < kc; ++p) {
+          dst[p * NR + j] = static_cast<T>(src[p]);
+        }
+      }
+      for (int64 j = cols; j < NR; ++j) {
+        for (int64 p = 0; p < kc; ++p) {
+          dst[p * NR + j] = T(0);
+        }
+      }
+    }
+  }
+}
+
+// Multiplies a packed mc x kc block of A by a packed kc x nc panel of B into
+// the mc x nc block of C at c, which is at (row, col) in the whole of C.
+template <typename T>
+XLA_ALWAYS_INLINE void MacroKernel(int64 mc, int64 nc, int64 kc, T alpha,
+                                   const T* packed_a, const T* packed_b,
+                                   T beta, T* c, int64 ldc,
+                                   const Epilogue<T>* epilogue, int64 row,
+                                   int64 col) {
+  constexpr int MR = KernelTraits<T>::kMr;
+  constexpr int NR = KernelTraits<T>::kNr;
+  for (int64 jr = 0; jr < nc; jr += NR) {
+    const int64 nr = std::min<int64>(NR, nc - jr);
+    for (int64 ir = 0; ir < mc; ir += MR) {
+      const int64 mr = std::min<int64>(MR, mc - ir);
+      MicroKernel<T, MR, NR>(kc, packed_a + ir * kc, packed_b + jr * kc, alpha,
+                             beta, c + ir * ldc + jr, ldc, mr, nr, epilogue,
+                             row + ir, col + jr);
+    }
+  }
+}
+
+template <typename T>
+using MacroKernelFn = void (*)(int64 mc, int64 nc, int64 kc, T alpha,
+                               const T* packed_a, const T* packed_b, T beta,
+                               T* c, int64 ldc, const Epilogue<T>* epilogue,
+                               int64 row, int64 col);
+
+// The instruction set variants of MacroKernel. It and MicroKernel are always
+// inlined, so each variant's inner loops are vectorized for its own target.
+// There is no AVX-512 variant: with the 6 x 8 and 6 x 4 register tiles it
+// measures the same as AVX2.
+template <typename T>
+void MacroKernelBaseline(int64 mc, int64 nc, int64 kc, T alpha,
+                         const T* packed_a, const T* packed_b, T beta, T* c,
+                         int64 ldc, const Epilogue<T>* epilogue, int64 row,
+                         int64 col) {
+  MacroKernel<T>(mc, nc, kc, alpha, packed_a, packed_b, beta, c, ldc,
+                 epilogue, row, col);
+}
+
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+template <typename T>
+XLA_TARGET_AVX2 void MacroKernelAvx2(int64 mc, int64 nc, int64 kc, T alpha,
+                                     const T* packed_a, const T* packed_b,
+                                     T beta, T* c, int64 ldc,
+                                     const Epilogue<T>* epilogue, int64 row,
+                                     int64 col) {
+  MacroKernel<T>(mc, nc, kc, alpha, packed_a, packed_b, beta, c, ldc,
+                 epilogue, row, col);
+}
+#endif  // XLA_HAS_TARGET_ATTRIBUTES
+
+template <typename T>
+const KernelRegistry<MacroKernelFn<T>>& MacroKernels() {
+  static const KernelRegistry<MacroKernelFn<T>>* registry = [] {
+    auto* kernels =
+        new KernelRegistry<MacroKernelFn<T>>(MacroKernelBaseline<T>);
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+    kernels->Register(Isa::kAvx2, MacroKernelAvx2<T>);
+#endif
+    return kernels;
+  }();
+  return *registry;
+}
+
+// Unpacked path for tiny problems, where packing costs more than it saves.
+// row is scratch space for n accumulators.
+template <typename T, typename S>
+void SmallGemm(Transpose transpose_a, Transpose transpose_b, int64 m, int64 n,
+               int64 k, T alpha, const S* a, int64 lda, const S* b, int64 ldb,
+               T beta, T* c, int64 ldc, const Epilogue<T>* epilogue, T* row) {
+  const int64 a_row_stride = transpose_a == Transpose::kNoTranspose ? lda : 1;
+  const int64 a_col_stride = transpose_a == Transpose::kNoTranspose ? 1 : lda;
+  const int64 b_row_stride = transpose_b == Transpose::kNoTranspose ? ldb : 1;
+  const int64 b_col_stride = transpose_b == Transpose::kNoTranspose ? 1 : ldb;
+  for (int64 i = 0; i < m; ++i) {
+    std::fill(row, row + n, T(0));
+    for (int64 p = 0; p < k; ++p) {
+      const T a_value = static_cast<T>(a[i * a_row_stride + p * a_col_stride]);
+      const S* b_row = b + p * b_row_stride;
+      for (int64 j = 0; j < n; ++j) {
+        row[j] += a_value * static_cast<T>(b_row[j * b_col_stride]);
+      }
+    }
+    T* c_row = c + i * ldc;
+    if (epilogue != nullptr) {
+      for (int64 j = 0; j < n; ++j) {
+        row[j] = (beta == T(0)) ? alpha * row[j]
+                                : alpha * row[j] + beta * c_row[j];
+      }
+      ApplyEpilogue(*epilogue, i, 0, n, row);
+      std::copy(row, row + n, c_row);
+      continue;
+    }
+    for (int64 j = 0; j < n; ++j) {
+      c_row[j] = (beta == T(0)) ? alpha * row[j]
+                                : alpha * row[j] + beta * c_row[j];
+    }
+  }
+}
+
+// Scales the m x n matrix C by beta, treating beta == 0 as an assignment so
+// uninitialized (possibly NaN) storage is overwritten.
+template <typename T>
+void ScaleC(int64 m, int64 n, T beta, T* c, int64 ldc) {
+  for (int64 i = 0; i < m; ++i) {
+    for (int64 j = 0; j < n; ++j) {
+      c[i * ldc + j] = (beta == T(0)) ? T(0) : beta * c[i * ldc + j];
+    }
+  }
+}
+
+// Packed panel of op(B) shared by the tiles of one GEMM. BatchedGemm keeps
+// one per task and reuses it for every matrix of its run; it only grows. The
+// blocks of op(A) are packed by each tile task into a buffer of its thread.
+template <typename T>
+struct Workspace {
+  std::vector<T> packed_b;
+};
+
+// Operands are stored as S and computed on as T.
+template <typename T, typename S>
+void GemmWithWorkspace(Transpose transpose_a, Transpose transpose_b, int64 m,
+                       int64 n, int64 k, T alpha, const S* a, int64 lda,
+                       const S* b, int64 ldb, T beta, T* c, int64 ldc,
+                       const Epilogue<T>* epilogue, Workspace<T>* workspace) {
+  if (m == 0 || n == 0) {
+    return;
+  }
+  if (k == 0 || alpha == T(0)) {
+    ScaleC(m, n, beta, c, ldc);
+    if (epilogue != nullptr) {
+      for (int64 i = 0; i < m; ++i) {
+        ApplyEpilogue(*epilogue, i, 0, n, c + i * ldc);
+      }
+    }
+    return;
+  }
+  std::vector<T>& packed_b = workspace->packed_b;
+  if (m * n * k <= kSmallGemmFlops) {
+    if (packed_b.size() < static_cast<size_t>(n)) {
+      packed_b.resize(n);
+    }
+    SmallGemm(transpose_a, transpose_b, m, n, k, alpha, a, lda, b, ldb, beta,
+              c, ldc, epilogue, packed_b.data());
+    return;
+  }
+
+  constexpr int MR = KernelTraits<T>::kMr;
+  constexpr int NR = KernelTraits<T>::kNr;
+  const int64 mc_max = std::min<int64>(KernelTraits<T>::kMc, RoundUp(m, MR));
+  const int64 kc_max = std::min<int64>(KernelTraits<T>::kKc, k);
+  const int64 nc_max = std::min<int64>(KernelTraits<T>::kNc, RoundUp(n, NR));
+  if (packed_b.size() < static_cast<size_t>(kc_max * nc_max)) {
+    packed_b.resize(kc_max * nc_max);
+  }
+
+  const MacroKernelFn<T> macro_kernel = MacroKernels<T>().Get();
+  const int64 m_tiles = (m + mc_max - 1) / mc_max;
+  for (int64 jc = 0; jc < n; jc += nc_max) {
+    const int64 nc = std::min(nc_max, n - jc);
+    const int64 b_panels = (nc + NR - 1) / NR;
+    const int64 n_tiles = (nc + kTileCols - 1) / kTileCols;
+    for (int64 pc = 0; pc < k; pc += kc_max) {
+      const int64 kc = std::min(kc_max, k - pc);
+      // Only the first pass over k applies the caller's beta; later passes
+      // accumulate into the partial result, and only the last one finishes
+      // it with the epilogue.
+      const T beta_pass = (pc == 0) ? beta : T(1);
+      const Epilogue<T>* epilogue_pass = (pc + kc == k) ? epilogue : nullptr;
+      ParallelFor(b_panels, kc * NR, [&](int64 first, int64 last) {
+        PackB<T, NR>(transpose_b, b, ldb, pc, jc + first * NR, kc,
+                     std::min(nc, last * NR) - first * NR,
+                     packed_b.data() + first * NR * kc);
+      });
+      // Each mc_max x kTileCols tile of C is written by exactly one task and
+      // the k dimension is never split, so every element is accumulated in
+      // the same order whatever the thread count. Tiles run row block by row
+      // block, so a task packs the mc x kc block of op(A) it needs only when
+      // it moves on to the next one, and the packed A never exceeds kMc x kKc
+      // per thread however tall the GEMM is.
+      ParallelFor(m_tiles * n_tiles, 2 * mc_max * kTileCols * kc,
+                  [&](int64 first, int64 last) {
+                    static thread_local std::vector<T> packed_a;
+                    if (packed_a.size() < static_cast<size_t>(mc_max * kc)) {
+                      packed_a.resize(mc_max * kc);
+                    }
+                    int64 packed_ic = -1;
+                    for (int64 tile = first; tile < last; ++tile) {
+                      const int64 ic = (tile / n_tiles) * mc_max;
+                      const int64 jr = (tile % n_tiles) * kTileCols;
+                      const int64 mc = std::min(mc_max, m - ic);
+                      if (ic != packed_ic) {
+                        PackA<T, MR>(transpose_a, a, lda, ic, pc, mc, kc,
+                                     packed_a.data());
+                        packed_ic = ic;
+                      }
+                      macro_kernel(mc, std::min(kTileCols, nc - jr), kc,
+                                   alpha, packed_a.data(),
+                                   packed_b.data() + jr * kc, beta_pass,
+                                   c + ic * ldc + jc + jr, ldc, epilogue_pass,
+                                   ic, jc + jr);
+                    }
+                  });
+    }
+  }
+}
+
+}  // namespace
+
+template <typename T>
+BlockingParams GetBlockingParams() {
+  BlockingParams params;
+  params.mr = KernelTraits<T>::kMr;
+  params.nr = KernelTraits<T>::kNr;
+  params.mc = KernelTraits<T>::kMc;
+  params.kc = KernelTraits<T>::kKc;
+  params.nc = KernelTraits<T>::kNc;
+  return params;
+}
+
+template <typename T>
+void Gemm(Transpose transpose_a, Transpose transpose_b, int64 m, int64 n,
+          int64 k, T alpha, const T* a, int64 lda, const T* b, int64 ldb,
+          T beta, T* c, int64 ldc) {
+  CHECK_GE(m, 0);
+  CHECK_GE(n, 0);
+  CHECK_GE(k, 0);
+  Workspace<T> workspace;
+  GemmWithWorkspace<T>(transpose_a, transpose_b, m, n, k, alpha, a, lda, b,
+                       ldb, beta, c, ldc, nullptr, &workspace);
+}
+
+template <typename T>
+void Gemm(Transpose transpose_a, Transpose transpose_b, int64 m, int64 n,
+          int64 k, T alpha, const T* a, int64 lda, const T* b, int64 ldb,
+          T beta, T* c, int64 ldc, const Epilogue<T>& epilogue) {
+  CHECK_GE(m, 0);
+  CHECK_GE(n, 0);
+  CHECK_GE(k, 0);
+  const bool identity = epilogue.bias == nullptr &&
+                        epilogue.residual == nullptr &&
+                        epilogue.activation == ActivationFunction::kNone &&
+                        epilogue.scale == T(1);
+  Workspace<T> workspace;
+  GemmWithWorkspace<T>(transpose_a, transpose_b, m, n, k, alpha, a, lda, b,
+                       ldb, beta, c, ldc, identity ? nullptr : &epilogue,
+                       &workspace);
+}
+
+namespace {
+
+template <typename S>
+void MixedPrecisionGemm(Transpose transpose_a, Transpose transpose_b, int64 m,
+                        int64 n, int64 k, float alpha, const S* a, int64 lda,
+                        const S* b, int64 ldb, float beta, float* c,
+                        int64 ldc, const Epilogue<float>* epilogue) {
+  CHECK_GE(m, 0);
+  CHECK_GE(n, 0);
+  CHECK_GE(k, 0);
+  Workspace<float> workspace;
+  GemmWithWorkspace<float>(transpose_a, transpose_b, m, n, k, alpha, a, lda, b,
+                           ldb, beta, c, ldc, epilogue, &workspace);
+}
+
+}  // namespace
+
+void Gemm(Transpose transpose_a, Transpose transpose_b, int64 m, int64 n,
+          int64 k, float alpha, const half* a, int64 lda, const half* b,
+          int64 ldb, float beta, float* c, int64 ldc) {
+  MixedPrecisionGemm(transpose_a, transpose_b, m, n, k, alpha, a, lda, b, ldb,
+                     beta, c, ldc, nullptr);
+}
+
+void Gemm(Transpose transpose_a, Transpose transpose_b, int64 m, int64 n,
+          int64 k, float alpha, const half* a, int64 lda, const half* b,
+          int64 ldb, float beta, float* c, int64 ldc,
+          const Epilogue<float>& epilogue) {
+  MixedPrecisionGemm(transpose_a, transpose_b, m, n, k, alpha, a, lda, b, ldb,
+                     beta, c, ldc, &epilogue);
+}
+
+void Gemm(Transpose transpose_a, Transpose transpose_b, int64 m, int64 n,
+          int64 k, float alpha, const bfloat16* a, int64 lda,
+          const bfloat16* b, int64 ldb, float beta, float* c, int64 ldc) {
+  MixedPrecisionGemm(transpose_a, transpose_b, m, n, k, alpha, a, lda, b, ldb,
+                     beta, c, ldc, nullptr);
+}
+
+void Gemm(Transpose transpose_a, Transpose transpose_b, int64 m, int64 n,
+          int64 k, float alpha, const bfloat16* a, int64 lda,
+          const bfloat16* b, int64 ldb, float beta, float* c, int64 ldc,
+          const Epilogue<float>& epilogue) {
+  MixedPrecisionGemm(transpose_a, transpose_b, m, n, k, alpha, a, lda, b, ldb,
+                     beta, c, ldc, &epilogue);
+}
+
+template <typename T>
+void BatchedGemm(Transpose transpose_a, Transpose transpose_b, int64 m,
+                 int64 n, int64 k, T alpha, const T* a, int64 lda,
+                 int64 stride_a, const T* b, int64 ldb, int64 stride_b,
+                 T beta, T* c, int64 ldc, int64 stride_c, int64 batch) {
+  CHECK_GE(m, 0);
+  CHECK_GE(n, 0);
+  CHECK_GE(k, 0);
+  CHECK_GE(batch, 0);
+  if (batch == 0 || m == 0 || n == 0) {
+    return;
+  }
+  CHECK(batch == 1 || stride_c != 0);
+
+  // With a broadcast B, consecutive row-major A_i and C_i are the rows of one
+  // tall GEMM, which packs B once instead of once per matrix.
+  if (stride_b == 0 && transpose_a == Transpose::kNoTranspose &&
+      stride_a == m * lda && stride_c == m * ldc) {
+    Gemm<T>(transpose_a, transpose_b, batch * m, n, k, alpha, a, lda, b, ldb,
+            beta, c, ldc);
+    return;
+  }
+
+  if (batch < IntraOpThreadCount()) {
+    Workspace<T> workspace;
+    for (int64 i = 0; i < batch; ++i) {
+      GemmWithWorkspace<T>(transpose_a, transpose_b, m, n, k, alpha,
+                           a + i * stride_a, lda, b + i * stride_b, ldb, beta,
+                           c + i * stride_c, ldc, nullptr, &workspace);
+    }
+    return;
+  }
+
+  // Every task owns whole matrices, so the GEMMs inside run on its thread and
+  // the result does not depend on the thread count.
+  ParallelFor(batch, 2 * m * n * std::max<int64>(k, 1),
+              [&](int64 first, int64 last) {
+                Workspace<T> workspace;
+                for (int64 i = first; i < last; ++i) {
+                  GemmWithWorkspace<T>(transpose_a, transpose_b, m, n, k,
+                                       alpha, a + i * stride_a, lda,
+                                       b + i * stride_b, ldb, beta,
+                                       c + i * stride_c, ldc, nullptr,
+                                       &workspace);
+                }
+              });
+}
+
+template BlockingParams GetBlockingParams<float>();
+template BlockingParams GetBlockingParams<double>();
+
+template void Gemm<float>(Transpose, Transpose, int64, int64, int64, float,
+                          const float*, int64, const float*, int64, float,
+                          float*, int64);
+template void Gemm<double>(Transpose, Transpose, int64, int64, int64, double,
+                           const double*, int64, const double*, int64, double,
+                           double*, int64);
+template void Gemm<float>(Transpose, Transpose, int64, int64, int64, float,
+                          const float*, int64, const float*, int64, float,
+                          float*, int64, const Epilogue<float>&);
+template void Gemm<double>(Transpose, Transpose, int64, int64, int64, double,
+                           const double*, int64, const double*, int64, double,
+                           double*, int64, const Epilogue<double>&);
+template void BatchedGemm<float>(Transpose, Transpose, int64, int64, int64,
+                                 float, const float*, int64, int64,
+                                 const float*, int64, int64, float, float*,
+                                 int64, int64, int64);
+template void BatchedGemm<double>(Transpose, Transpose, int64, int64, int64,
+                                  double, const double*, int64, int64,
+                                  const double*, int64, int64, double,
+                                  double*, int64, int64, int64);
+
+}  // namespace gemm
+}  // namespace xla
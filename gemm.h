@@ -0,0 +1,141 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_GEMM_H_
+#define TENSORFLOW_COMPILER_XLA_GEMM_H_
+
+#include <type_traits>
+
+#include "activation.h"
+#include "half.h"
+#include "types.h"
+
+namespace xla {
+namespace gemm {
+
+// Whether a GEMM operand is used as stored or transposed.
+enum class Transpose {
+  kNoTranspose,
+  kTranspose,
+};
+
+// Cache blocking of the GEMM engine. The micro-kernel computes an mr x nr tile
+// of C in registers; op(A) is packed in mc x kc blocks sized for L2, op(B) in
+// kc x nc panels sized for L3, and each kc x nr sliver of a packed B panel is
+// meant to stay resident in L1 while the micro-kernel sweeps over the A block.
+struct BlockingParams {
+  int64 mr;
+  int64 nr;
+  int64 mc;
+  int64 kc;
+  int64 nc;
+};
+
+// Element types for which the packed GEMM engine is instantiated.
+template <typename T>
+struct IsGemmType : std::false_type {};
+template <>
+struct IsGemmType<float> : std::true_type {};
+template <>
+struct IsGemmType<double> : std::true_type {};
+
+// General matrix multiply over row-major storage:
+//
+//   C = alpha * op(A) * op(B) + beta * C
+//
+// op(A) is m x k, op(B) is k x n and C is m x n. lda, ldb and ldc are the row
+// strides of A, B and C as stored (i.e. before op is applied). When beta is
+// zero C is never read, so it may be uninitialized.
+//
+// Output tiles are spread over the intra-op thread pool. The k dimension is
+// never split between threads, so the result does not depend on the thread
+// count.
+//
+// Only instantiated for the types accepted by IsGemmType.
+template <typename T>
+void Gemm(Transpose transpose_a, Transpose transpose_b, int64 m, int64 n,
+          int64 k, T alpha, const T* a, int64 lda, const T* b, int64 ldb,
+          T beta, T* c, int64 ldc);
+
+// Strided batched GEMM: for every i in [0, batch),
+//
+//   C_i = alpha * op(A_i) * op(B_i) + beta * C_i
+//
+// where A_i = a + i * stride_a, B_i = b + i * stride_b and
+// C_i = c + i * stride_c. A stride of zero broadcasts one A or B matrix to the
+// whole batch; the C matrices must not overlap.
+//
+// The batch is scheduled as a single job: each thread of the intra-op pool
+// multiplies a contiguous run of matrices and reuses its packing buffers
+// between them. Batches shorter than the thread count run one matrix at a
+// time, each spread over the pool as in Gemm.
+template <typename T>
+void BatchedGemm(Transpose transpose_a, Transpose transpose_b, int64 m,
+                 int64 n, int64 k, T alpha, const T* a, int64 lda,
+                 int64 stride_a, const T* b, int64 ldb, int64 stride_b,
+                 T beta, T* c, int64 ldc, int64 stride_c, int64 batch);
+
+// Elementwise tail fused into Gemm. Every element x of the m x n product
+// alpha * op(A) * op(B) + beta * C is stored as
+//
+//   C(i, j) = scale * activation(x + bias + residual(i, j))
+//
+// while its output tile is still in registers, instead of in separate passes
+// over C. bias holds one value per row of C when bias_per_row is set and one
+// per column otherwise; residual is an m x n matrix with row stride
+// residual_ld that must not overlap C. Both may be null.
+template <typename T>
+struct Epilogue {
+  const T* bias = nullptr;
+  bool bias_per_row = false;
+  const T* residual = nullptr;
+  int64 residual_ld = 0;
+  ActivationFunction activation = ActivationFunction::kNone;
+  T scale = T(1);
+};
+
+// As Gemm above, followed by epilogue.
+template <typename T>
+void Gemm(Transpose transpose_a, Transpose transpose_b, int64 m, int64 n,
+          int64 k, T alpha, const T* a, int64 lda, const T* b, int64 ldb,
+          T beta, T* c, int64 ldc, const Epilogue<T>& epilogue);
+
+// Mixed precision forms of Gemm: A and B are stored as half or bfloat16 and
+// widened to float while they are packed, so the micro-kernels, accumulation
+// and C are float32 as in Gemm<float>. The result is that of Gemm<float> on
+// the widened operands, at half the memory traffic for A and B.
+void Gemm(Transpose transpose_a, Transpose transpose_b, int64 m, int64 n,
+          int64 k, float alpha, const half* a, int64 lda, const half* b,
+          int64 ldb, float beta, float* c, int64 ldc);
+void Gemm(Transpose transpose_a, Transpose transpose_b, int64 m, int64 n,
+          int64 k, float alpha, const half* a, int64 lda, const half* b,
+          int64 ldb, float beta, float* c, int64 ldc,
+          const Epilogue<float>& epilogue);
+void Gemm(Transpose transpose_a, Transpose transpose_b, int64 m, int64 n,
+          int64 k, float alpha, const bfloat16* a, int64 lda,
+          const bfloat16* b, int64 ldb, float beta, float* c, int64 ldc);
+void Gemm(Transpose transpose_a, Transpose transpose_b, int64 m, int64 n,
+          int64 k, float alpha, const bfloat16* a, int64 lda,
+          const bfloat16* b, int64 ldb, float beta, float* c, int64 ldc,
+          const Epilogue<float>& epilogue);
+
+// Returns the blocking parameters used by Gemm<T>.
+template <typename T>
+BlockingParams GetBlockingParams();
+
+}  // namespace gemm
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_GEMM_H_
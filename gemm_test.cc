@@ -0,0 +1,469 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "gemm.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#include "array2d.h"
+#include "array3d.h"
+#include "array4d.h"
+#include "intra_op_thread_pool.h"
+#include "kernel_registry.h"
+#include "literal_test_util.h"
+#include "literal_util.h"
+#include "ptr_util.h"
+#include "reference_util.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+// Tests the packed GEMM engine against a straightforward triple loop.
+class GemmTest /* : public ::testing::Test */
+{
+public:
+
+   GemmTest() { run(); }
+
+   void SmallMatmul();
+   void BlockedMatmulAllTransposes();
+   void AlphaBeta();
+   void ZeroK();
+   void DoubleMatmul();
+   void MatrixMulTransposedOperands();
+   void ReferenceMatmulMatchesGemm();
+   void BatchedGemmStrides();
+   void BatchedGemmBroadcast();
+   void Array3DMatrixMul();
+   void Array4DMatrixMulBroadcast();
+   void FusedEpilogue();
+   void FusedDenseLayer();
+   void EveryIsaVariant();
+
+   void run();
+};
+
+template <typename T>
+std::unique_ptr<Array2D<T>> NaiveMatmul(const Array2D<T>& lhs, bool transpose_lhs,
+                                        const Array2D<T>& rhs, bool transpose_rhs)
+{
+   const int64 m = transpose_lhs ? lhs.n2() : lhs.n1();
+   const int64 k = transpose_lhs ? lhs.n1() : lhs.n2();
+   const int64 n = transpose_rhs ? rhs.n1() : rhs.n2();
+   auto result = MakeUnique<Array2D<T>>(m, n);
+   for (int64 i = 0; i < m; ++i) {
+      for (int64 j = 0; j < n; ++j) {
+         double acc = 0.0;
+         for (int64 r = 0; r < k; ++r) {
+            acc += (transpose_lhs ? lhs(r, i) : lhs(i, r)) *
+                   (transpose_rhs ? rhs(j, r) : rhs(r, j));
+         }
+         (*result)(i, j) = static_cast<T>(acc);
+      }
+   }
+   return result;
+}
+
+// Runs BatchedGemm on batch matrices stored with padding between them, or a
+// single broadcast matrix when the corresponding flag is set, and compares
+// every C_i with the naive product of its operands.
+void ExpectBatchedGemm(bool transpose_lhs, bool transpose_rhs, int64 m,
+                       int64 n, int64 k, bool broadcast_lhs,
+                       bool broadcast_rhs, int64 batch)
+{
+   const int64 lhs_rows = transpose_lhs ? k : m;
+   const int64 lhs_cols = transpose_lhs ? m : k;
+   const int64 rhs_rows = transpose_rhs ? n : k;
+   const int64 rhs_cols = transpose_rhs ? k : n;
+   const int64 stride_a = broadcast_lhs ? 0 : lhs_rows * lhs_cols + 3;
+   const int64 stride_b = broadcast_rhs ? 0 : rhs_rows * rhs_cols + 5;
+   const int64 stride_c = m * n + 7;
+
+   Array2D<float> a(1, stride_a * (batch - 1) + lhs_rows * lhs_cols);
+   Array2D<float> b(1, stride_b * (batch - 1) + rhs_rows * rhs_cols);
+   Array2D<float> c(1, stride_c * batch);
+   a.FillRandom(1.0f, 0.0, 10);
+   b.FillRandom(1.0f, 0.0, 11);
+   gemm::BatchedGemm<float>(
+       transpose_lhs ? gemm::Transpose::kTranspose : gemm::Transpose::kNoTranspose,
+       transpose_rhs ? gemm::Transpose::kTranspose : gemm::Transpose::kNoTranspose,
+       m, n, k, 1.0f, a.data(), lhs_cols, stride_a, b.data(), rhs_cols,
+       stride_b, 0.0f, c.data(), n, stride_c, batch);
+
+   for (int64 i = 0; i < batch; ++i) {
+      Array2D<float> lhs(lhs_rows, lhs_cols);
+      Array2D<float> rhs(rhs_rows, rhs_cols);
+      Array2D<float> actual(m, n);
+      std::copy(a.data() + i * stride_a, a.data() + i * stride_a + lhs_rows * lhs_cols,
+                lhs.data());
+      std::copy(b.data() + i * stride_b, b.data() + i * stride_b + rhs_rows * rhs_cols,
+                rhs.data());
+      std::copy(c.data() + i * stride_c, c.data() + i * stride_c + m * n,
+                actual.data());
+      auto expected = NaiveMatmul(lhs, transpose_lhs, rhs, transpose_rhs);
+      LiteralTestUtil::ExpectR2NearArray2D(
+          *expected, *LiteralUtil::CreateR2FromArray2D(actual), ErrorSpec(1e-3f));
+   }
+}
+
+void GemmTest::SmallMatmul()
+{
+   Array2D<float> lhs({{1.f, 2.f, 3.f}, {4.f, 5.f, 6.f}});
+   Array2D<float> rhs({{7.f, 8.f}, {9.f, 10.f}, {11.f, 12.f}});
+   auto result = MakeMatrixMul(lhs, rhs);
+   auto result_literal = LiteralUtil::CreateR2FromArray2D(*result);
+   LiteralTestUtil::ExpectR2Near<float>({{58.f, 64.f}, {139.f, 154.f}},
+                                        *result_literal, ErrorSpec(0.0001f));
+}
+
+void GemmTest::BlockedMatmulAllTransposes()
+{
+   // Sizes straddle the register tile and the cache blocks so every edge case
+   // of the packing code is exercised.
+   const int64 m = 131;
+   const int64 n = 67;
+   const int64 k = 300;
+   for (int transpose_lhs = 0; transpose_lhs < 2; ++transpose_lhs) {
+      for (int transpose_rhs = 0; transpose_rhs < 2; ++transpose_rhs) {
+         Array2D<float> lhs(transpose_lhs ? k : m, transpose_lhs ? m : k);
+         Array2D<float> rhs(transpose_rhs ? n : k, transpose_rhs ? k : n);
+         lhs.FillRandom(1.0f, 0.0, 1);
+         rhs.FillRandom(1.0f, 0.0, 2);
+
+         auto expected = NaiveMatmul(lhs, transpose_lhs != 0, rhs, transpose_rhs != 0);
+         auto actual = MakeMatrixMul(
+             lhs, transpose_lhs ? gemm::Transpose::kTranspose : gemm::Transpose::kNoTranspose,
+             rhs, transpose_rhs ? gemm::Transpose::kTranspose : gemm::Transpose::kNoTranspose);
+
+         LiteralTestUtil::ExpectR2NearArray2D(
+             *expected, *LiteralUtil::CreateR2FromArray2D(*actual), ErrorSpec(1e-3f));
+      }
+   }
+}
+
+void GemmTest::AlphaBeta()
+{
+   const int64 m = 40;
+   const int64 n = 50;
+   const int64 k = 60;
+   Array2D<float> lhs(m, k);
+   Array2D<float> rhs(k, n);
+   Array2D<float> c(m, n);
+   lhs.FillRandom(1.0f, 0.0, 3);
+   rhs.FillRandom(1.0f, 0.0, 4);
+   c.FillRandom(1.0f, 0.0, 5);
+
+   auto product = NaiveMatmul(lhs, false, rhs, false);
+   Array2D<float> expected(m, n);
+   for (int64 i = 0; i < m; ++i) {
+      for (int64 j = 0; j < n; ++j) {
+         expected(i, j) = 2.0f * (*product)(i, j) - 0.5f * c(i, j);
+      }
+   }
+
+   gemm::Gemm<float>(gemm::Transpose::kNoTranspose, gemm::Transpose::kNoTranspose,
+                     m, n, k, 2.0f, lhs.data(), k, rhs.data(), n, -0.5f,
+                     c.data(), n);
+   LiteralTestUtil::ExpectR2NearArray2D(
+       expected, *LiteralUtil::CreateR2FromArray2D(c), ErrorSpec(1e-3f));
+}
+
+void GemmTest::ZeroK()
+{
+   Array2D<float> c(3, 4, 2.0f);
+   gemm::Gemm<float>(gemm::Transpose::kNoTranspose, gemm::Transpose::kNoTranspose,
+                     3, 4, 0, 1.0f, nullptr, 0, nullptr, 4, 3.0f, c.data(), 4);
+   LiteralTestUtil::ExpectR2NearArray2D(
+       Array2D<float>(3, 4, 6.0f), *LiteralUtil::CreateR2FromArray2D(c),
+       ErrorSpec(0.0f));
+}
+
+void GemmTest::DoubleMatmul()
+{
+   Array2D<double> lhs(97, 250);
+   Array2D<double> rhs(250, 33);
+   lhs.FillRandom(1.0, 0.0, 6);
+   rhs.FillRandom(1.0, 0.0, 7);
+   auto expected = NaiveMatmul(lhs, false, rhs, false);
+   auto actual = ReferenceUtil::MatmulArray2D(lhs, rhs);
+   LiteralTestUtil::ExpectR2NearArray2D(
+       *expected, *LiteralUtil::CreateR2FromArray2D(*actual), ErrorSpec(1e-9f));
+}
+
+void GemmTest::MatrixMulTransposedOperands()
+{
+   Array2D<float> a({{1.f, 2.f}, {3.f, 4.f}, {5.f, 6.f}});
+   // a^T * a
+   auto result = MakeMatrixMul(a, gemm::Transpose::kTranspose, a,
+                               gemm::Transpose::kNoTranspose);
+   auto expected = MakeMatrixMul(*Transpose(a), a);
+   LiteralTestUtil::ExpectR2NearArray2D(
+       *expected, *LiteralUtil::CreateR2FromArray2D(*result), ErrorSpec(0.0001f));
+}
+
+void GemmTest::ReferenceMatmulMatchesGemm()
+{
+   Array2D<float> lhs(70, 90);
+   Array2D<float> rhs(90, 110);
+   lhs.FillRandom(1.0f, 0.0, 8);
+   rhs.FillRandom(1.0f, 0.0, 9);
+   auto expected = NaiveMatmul(lhs, false, rhs, false);
+   auto actual = ReferenceUtil::MatmulArray2D(lhs, rhs);
+   LiteralTestUtil::ExpectR2NearArray2D(
+       *expected, *LiteralUtil::CreateR2FromArray2D(*actual), ErrorSpec(1e-3f));
+}
+
+void GemmTest::BatchedGemmStrides()
+{
+   // One thread schedules the batch as a single job; with more threads than
+   // matrices every matrix is spread over the pool instead. The two shapes
+   // take the unpacked and the packed path.
+   for (int threads : {1, 8}) {
+      SetIntraOpThreadCount(threads);
+      for (int transpose_lhs = 0; transpose_lhs < 2; ++transpose_lhs) {
+         for (int transpose_rhs = 0; transpose_rhs < 2; ++transpose_rhs) {
+            ExpectBatchedGemm(transpose_lhs != 0, transpose_rhs != 0, 7, 9, 5,
+                              false, false, 5);
+            ExpectBatchedGemm(transpose_lhs != 0, transpose_rhs != 0, 31, 20,
+                              45, false, false, 5);
+         }
+      }
+   }
+   SetIntraOpThreadCount(0);
+}
+
+void GemmTest::BatchedGemmBroadcast()
+{
+   for (int transpose_lhs = 0; transpose_lhs < 2; ++transpose_lhs) {
+      ExpectBatchedGemm(transpose_lhs != 0, false, 31, 20, 45, true, false, 6);
+      ExpectBatchedGemm(transpose_lhs != 0, false, 31, 20, 45, false, true, 6);
+      ExpectBatchedGemm(transpose_lhs != 0, true, 31, 20, 45, true, true, 6);
+   }
+
+   // A broadcast rhs with dense, unpadded lhs and result is one tall GEMM.
+   Array3D<float> lhs(6, 31, 45);
+   Array2D<float> rhs(45, 20);
+   lhs.FillRandom(1.0f, 0.0, 12);
+   rhs.FillRandom(1.0f, 0.0, 13);
+   Array3D<float> result(6, 31, 20);
+   gemm::BatchedGemm<float>(gemm::Transpose::kNoTranspose,
+                            gemm::Transpose::kNoTranspose, 31, 20, 45, 1.0f,
+                            lhs.data(), 45, 31 * 45, rhs.data(), 20, 0, 0.0f,
+                            result.flatten().data(), 20, 31 * 20, 6);
+   for (int64 d = 0; d < 6; ++d) {
+      Array2D<float> lhs_d(31, 45);
+      std::copy(lhs.data() + d * 31 * 45, lhs.data() + (d + 1) * 31 * 45,
+                lhs_d.data());
+      auto expected = NaiveMatmul(lhs_d, false, rhs, false);
+      for (int64 i = 0; i < 31; ++i) {
+         for (int64 j = 0; j < 20; ++j) {
+            ASSERT_TRUE(std::abs(result(d, i, j) - (*expected)(i, j)) < 1e-3f);
+         }
+      }
+   }
+}
+
+void GemmTest::Array3DMatrixMul()
+{
+   Array3D<double> lhs(4, 3, 5);
+   Array3D<double> rhs(4, 5, 2);
+   lhs.FillRandom(1.0, 0.0, 14);
+   rhs.FillRandom(1.0, 0.0, 15);
+   auto result = MakeMatrixMul(lhs, rhs);
+   ASSERT_EQ(result->n1(), 4);
+   ASSERT_EQ(result->n2(), 3);
+   ASSERT_EQ(result->n3(), 2);
+   for (int64 d = 0; d < 4; ++d) {
+      for (int64 i = 0; i < 3; ++i) {
+         for (int64 j = 0; j < 2; ++j) {
+            double expected = 0.0;
+            for (int64 r = 0; r < 5; ++r) {
+               expected += lhs(d, i, r) * rhs(d, r, j);
+            }
+            ASSERT_TRUE(std::abs((*result)(d, i, j) - expected) < 1e-12);
+         }
+      }
+   }
+
+   // Integer matrices take the generic path; rhs of depth 1 is broadcast.
+   Array3D<int> int_lhs(2, 2, 2);
+   int_lhs.FillIota(1);
+   Array3D<int> int_rhs(1, 2, 2);
+   int_rhs.FillIota(1);
+   auto int_result = MakeMatrixMul(int_lhs, int_rhs);
+   ASSERT_EQ(int_result->n1(), 2);
+   ASSERT_EQ((*int_result)(0, 0, 0), 7);
+   ASSERT_EQ((*int_result)(0, 1, 1), 22);
+   ASSERT_EQ((*int_result)(1, 0, 0), 23);
+   ASSERT_EQ((*int_result)(1, 1, 1), 46);
+}
+
+void GemmTest::Array4DMatrixMulBroadcast()
+{
+   // Every combination of broadcasting the two leading dimensions of rhs.
+   Array4D<float> lhs(3, 4, 6, 7);
+   lhs.FillRandom(1.0f, 0.0, 16);
+   for (int64 rhs_batch : {1, 3}) {
+      for (int64 rhs_depth : {1, 4}) {
+         Array4D<float> rhs(rhs_batch, rhs_depth, 7, 5);
+         rhs.FillRandom(1.0f, 0.0, 17);
+         auto result = MakeMatrixMul(lhs, rhs);
+         ASSERT_EQ(result->n1(), 3);
+         ASSERT_EQ(result->n2(), 4);
+         for (int64 b = 0; b < 3; ++b) {
+            for (int64 d = 0; d < 4; ++d) {
+               for (int64 i = 0; i < 6; ++i) {
+                  for (int64 j = 0; j < 5; ++j) {
+                     float expected = 0.0f;
+                     for (int64 r = 0; r < 7; ++r) {
+                        expected += lhs(b, d, i, r) *
+                                    rhs(rhs_batch == 1 ? 0 : b,
+                                        rhs_depth == 1 ? 0 : d, r, j);
+                     }
+                     ASSERT_TRUE(std::abs((*result)(b, d, i, j) - expected) < 1e-4f);
+                  }
+               }
+            }
+         }
+      }
+   }
+}
+
+// Runs C = A * B + 0.5 * C with epilogue fused and compares it with
+// the same epilogue applied to the naive product in a separate pass.
+void ExpectEpilogue(int64 m, int64 n, int64 k, bool bias_per_row,
+                    ActivationFunction activation, float scale)
+{
+   Array2D<float> lhs(m, k);
+   Array2D<float> rhs(k, n);
+   Array2D<float> c(m, n);
+   Array2D<float> residual(m, n);
+   std::vector<float> bias(bias_per_row ? m : n);
+   lhs.FillRandom(1.0f, 0.0, 18);
+   rhs.FillRandom(1.0f, 0.0, 19);
+   c.FillRandom(1.0f, 0.0, 20);
+   residual.FillRandom(1.0f, 0.0, 21);
+   for (size_t i = 0; i < bias.size(); ++i) {
+      bias[i] = 0.25f * static_cast<float>(i % 7) - 0.5f;
+   }
+
+   auto product = NaiveMatmul(lhs, false, rhs, false);
+   Array2D<float> expected(m, n);
+   for (int64 i = 0; i < m; ++i) {
+      for (int64 j = 0; j < n; ++j) {
+         const float x = (*product)(i, j) + 0.5f * c(i, j) +
+                         bias[bias_per_row ? i : j] + residual(i, j);
+         expected(i, j) = scale * Activate(activation, x);
+      }
+   }
+
+   gemm::Epilogue<float> epilogue;
+   epilogue.bias = bias.data();
+   epilogue.bias_per_row = bias_per_row;
+   epilogue.residual = residual.data();
+   epilogue.residual_ld = n;
+   epilogue.activation = activation;
+   epilogue.scale = scale;
+   gemm::Gemm<float>(gemm::Transpose::kNoTranspose, gemm::Transpose::kNoTranspose,
+                     m, n, k, 1.0f, lhs.data(), k, rhs.data(), n, 0.5f,
+                     c.data(), n, epilogue);
+   LiteralTestUtil::ExpectR2NearArray2D(
+       expected, *LiteralUtil::CreateR2FromArray2D(c), ErrorSpec(1e-3f));
+}
+
+void GemmTest::FusedEpilogue()
+{
+   // The shapes take the unpacked path, one pass over k, and two passes over
+   // k (where only the last may apply the epilogue); k == 0 reduces to the
+   // epilogue of beta * C.
+   for (ActivationFunction activation :
+        {ActivationFunction::kNone, ActivationFunction::kRelu,
+         ActivationFunction::kElu, ActivationFunction::kTanh,
+         ActivationFunction::kSigmoid}) {
+      for (bool bias_per_row : {false, true}) {
+         ExpectEpilogue(5, 7, 3, bias_per_row, activation, 1.0f);
+         ExpectEpilogue(37, 29, 40, bias_per_row, activation, 2.0f);
+         ExpectEpilogue(19, 45, 300, bias_per_row, activation, 0.5f);
+         ExpectEpilogue(4, 6, 0, bias_per_row, activation, 1.0f);
+      }
+   }
+}
+
+void GemmTest::FusedDenseLayer()
+{
+   Array2D<float> x(33, 50);
+   Array2D<float> w(50, 20);
+   Array2D<float> shortcut(33, 20);
+   x.FillRandom(1.0f, 0.0, 22);
+   w.FillRandom(1.0f, 0.0, 23);
+   shortcut.FillRandom(1.0f, 0.0, 24);
+   std::vector<float> bias(20);
+   for (int64 j = 0; j < 20; ++j) {
+      bias[j] = 0.1f * j - 1.0f;
+   }
+
+   auto expected = ReferenceUtil::MatmulArray2D(x, w);
+   for (int64 i = 0; i < 33; ++i) {
+      for (int64 j = 0; j < 20; ++j) {
+         const float y = (*expected)(i, j) + bias[j] + shortcut(i, j);
+         (*expected)(i, j) = y > 0.0f ? y : 0.0f;
+      }
+   }
+   auto actual = ReferenceUtil::MatmulArray2D(x, w, bias, &shortcut,
+                                              ActivationFunction::kRelu, 1.0f);
+   LiteralTestUtil::ExpectR2NearArray2D(
+       *expected, *LiteralUtil::CreateR2FromArray2D(*actual), ErrorSpec(1e-4f));
+}
+
+void GemmTest::EveryIsaVariant()
+{
+   // Runs the blocked cases once per instruction set the host supports, so
+   // the baseline kernels are covered on hosts that dispatch to AVX2.
+   for (int i = 0; i < kNumIsas; ++i) {
+      const Isa isa = static_cast<Isa>(i);
+      if (!IsaSupported(isa)) {
+         continue;
+      }
+      SetMaxIsa(isa);
+      BlockedMatmulAllTransposes();
+      DoubleMatmul();
+      FusedEpilogue();
+   }
+   SetMaxIsa(static_cast<Isa>(kNumIsas - 1));
+}
+
+void GemmTest::run()
+{
+   SmallMatmul();
+   BlockedMatmulAllTransposes();
+   AlphaBeta();
+   ZeroK();
+   DoubleMatmul();
+   MatrixMulTransposedOperands();
+   ReferenceMatmulMatchesGemm();
+   BatchedGemmStrides();
+   BatchedGemmBroadcast();
+   Array3DMatrixMul();
+   Array4DMatrixMulBroadcast();
+   FusedEpilogue();
+   FusedDenseLayer();
+   EveryIsaVariant();
+}
+
+}  // namespace
+}  // namespace xla
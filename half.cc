@@ -0,0 +1,203 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "half.h"
+
+#include <cstring>
+
+#include "cpu_info.h"
+#include "kernel_registry.h"
+
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+#include <immintrin.h>
+#define XLA_TARGET_AVX2_F16C __attribute__((target("avx2,fma,f16c")))
+#endif
+
+namespace xla {
+namespace {
+
+// The conversions work on the bit patterns of the 16-bit types.
+struct ConversionKernels {
+  void (*half_to_float)(const uint16* in, float* out, int64 n);
+  void (*float_to_half)(const float* in, uint16* out, int64 n);
+  void (*bfloat16_to_float)(const uint16* in, float* out, int64 n);
+  void (*float_to_bfloat16)(const float* in, uint16* out, int64 n);
+};
+
+void HalfToFloatScalar(const uint16* in, float* out, int64 n) {
+  for (int64 i = 0; i < n; ++i) {
+    out[i] = internal::HalfBitsToFloat(in[i]);
+  }
+}
+
+void FloatToHalfScalar(const float* in, uint16* out, int64 n) {
+  for (int64 i = 0; i < n; ++i) {
+    out[i] = internal::FloatToHalfBits(in[i]);
+  }
+}
+
+// The bfloat16 loops are branch free, so the compiler vectorizes them for
+// whichever target they are inlined into.
+XLA_ALWAYS_INLINE void Bfloat16ToFloatLoop(const uint16* in, float* out,
+                                           int64 n) {
+  for (int64 i = 0; i < n; ++i) {
+    const uint32 bits = static_cast<uint32>(in[i]) << 16;
+    std::memcpy(out + i, &bits, sizeof(bits));
+  }
+}
+
+XLA_ALWAYS_INLINE void FloatToBfloat16Loop(const float* in, uint16* out,
+                                           int64 n) {
+  for (int64 i = 0; i < n; ++i) {
+    uint32 f;
+    std::memcpy(&f, in + i, sizeof(f));
+    const uint32 rounded = (f + 0x7fffu + ((f >> 16) & 1)) >> 16;
+    const uint32 quiet_nan = (f >> 16) | 0x40u;
+    out[i] = static_cast<uint16>((f & 0x7fffffffu) > 0x7f800000u ? quiet_nan
+                                                                  : rounded);
+  }
+}
+
+void Bfloat16ToFloatBaseline(const uint16* in, float* out, int64 n) {
+  Bfloat16ToFloatLoop(in, out, n);
+}
+
+void FloatToBfloat16Baseline(const float* in, uint16* out, int64 n) {
+  FloatToBfloat16Loop(in, out, n);
+}
+
+const ConversionKernels kBaselineKernels = {
+    HalfToFloatScalar, FloatToHalfScalar, Bfloat16ToFloatBaseline,
+    FloatToBfloat16Baseline};
+
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+XLA_TARGET_AVX2_F16C void HalfToFloatAvx2(const uint16* in, float* out,
+                                          int64 n) {
+  int64 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m128i h =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+  }
+  HalfToFloatScalar(in + i, out + i, n - i);
+}
+
+XLA_TARGET_AVX2_F16C void FloatToHalfAvx2(const float* in, uint16* out,
+                                          int64 n) {
+  int64 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + i),
+                                      _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), h);
+  }
+  FloatToHalfScalar(in + i, out + i, n - i);
+}
+
+XLA_TARGET_AVX2 void Bfloat16ToFloatAvx2(const uint16* in, float* out,
+                                         int64 n) {
+  Bfloat16ToFloatLoop(in, out, n);
+}
+
+XLA_TARGET_AVX2 void FloatToBfloat16Avx2(const float* in, uint16* out,
+                                         int64 n) {
+  FloatToBfloat16Loop(in, out, n);
+}
+
+// GCC 12 before 12.3 warns about the placeholder operands of its AVX-512
+// conversion intrinsics (GCC bug 105593).
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+XLA_TARGET_AVX512 void HalfToFloatAvx512(const uint16* in, float* out,
+                                         int64 n) {
+  int64 i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m256i h =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+    _mm512_storeu_ps(out + i, _mm512_cvtph_ps(h));
+  }
+  HalfToFloatScalar(in + i, out + i, n - i);
+}
+
+XLA_TARGET_AVX512 void FloatToHalfAvx512(const float* in, uint16* out,
+                                         int64 n) {
+  int64 i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(in + i),
+                                      _MM_FROUND_TO_NEAREST_INT);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), h);
+  }
+  FloatToHalfScalar(in + i, out + i, n - i);
+}
+
+XLA_TARGET_AVX512 void Bfloat16ToFloatAvx512(const uint16* in, float* out,
+                                             int64 n) {
+  Bfloat16ToFloatLoop(in, out, n);
+}
+
+XLA_TARGET_AVX512 void FloatToBfloat16Avx512(const float* in, uint16* out,
+                                             int64 n) {
+  FloatToBfloat16Loop(in, out, n);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+const ConversionKernels kAvx2Kernels = {HalfToFloatAvx2, FloatToHalfAvx2,
+                                        Bfloat16ToFloatAvx2,
+                                        FloatToBfloat16Avx2};
+const ConversionKernels kAvx512Kernels = {
+    HalfToFloatAvx512, FloatToHalfAvx512, Bfloat16ToFloatAvx512,
+    FloatToBfloat16Avx512};
+#endif  // XLA_HAS_TARGET_ATTRIBUTES
+
+// Every AVX2 host so far also has F16C, but it is a separate feature bit.
+const ConversionKernels& Kernels() {
+  static const KernelRegistry<const ConversionKernels*>* registry = [] {
+    auto* kernels =
+        new KernelRegistry<const ConversionKernels*>(&kBaselineKernels);
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+    if (tensorflow::port::TestCPUFeature(tensorflow::port::CPUFeature::F16C)) {
+      kernels->Register(Isa::kAvx2, &kAvx2Kernels);
+    }
+    kernels->Register(Isa::kAvx512, &kAvx512Kernels);
+#endif
+    return kernels;
+  }();
+  return *registry->Get();
+}
+
+}  // namespace
+
+void ConvertToFloat(const half* in, float* out, int64 n) {
+  Kernels().half_to_float(reinterpret_cast<const uint16*>(in), out, n);
+}
+
+void ConvertToFloat(const bfloat16* in, float* out, int64 n) {
+  Kernels().bfloat16_to_float(reinterpret_cast<const uint16*>(in), out,
+                               n);
+}
+
+void ConvertFromFloat(const float* in, half* out, int64 n) {
+  Kernels().float_to_half(in, reinterpret_cast<uint16*>(out), n);
+}
+
+void ConvertFromFloat(const float* in, bfloat16* out, int64 n) {
+  Kernels().float_to_bfloat16(in, reinterpret_cast<uint16*>(out), n);
+}
+
+}  // namespace xla
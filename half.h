@@ -0,0 +1,140 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_HALF_H_
+#define TENSORFLOW_COMPILER_XLA_HALF_H_
+
+// 16-bit floating point storage types. half is IEEE 754 binary16 (F16) and
+// bfloat16 the upper half of a float32 (BF16): the same exponent range with
+// only 8 bits of precision. Both are storage formats; arithmetic converts to
+// float, so kernels reading them accumulate in float32. Conversions from
+// float round to nearest even, and NaNs stay NaNs.
+
+#include <cstring>
+
+#include "types.h"
+
+namespace xla {
+
+namespace internal {
+
+inline uint32 FloatToBits(float value) {
+  uint32 bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+inline float BitsToFloat(uint32 bits) {
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+inline uint16 FloatToHalfBits(float value) {
+  uint32 f = FloatToBits(value);
+  const uint32 sign = f & 0x80000000u;
+  f ^= sign;
+  uint32 h;
+  if (f >= 0x47800000u) {
+    // At least 2^16, infinity or NaN.
+    h = f > 0x7f800000u ? 0x7e00u : 0x7c00u;
+  } else if (f < 0x38800000u) {
+    // Below 2^-14: a subnormal half. Adding 0.5 lines the half's mantissa up
+    // with the low bits of the float's, and the addition rounds it.
+    h = FloatToBits(BitsToFloat(f) + 0.5f) - 0x3f000000u;
+  } else {
+    // Rebias the exponent and round the 13 dropped mantissa bits.
+    const uint32 odd = (f >> 13) & 1;
+    f += 0xc8000fffu + odd;
+    h = f >> 13;
+  }
+  return static_cast<uint16>(h | (sign >> 16));
+}
+
+inline float HalfBitsToFloat(uint16 h) {
+  const uint32 shifted_exponent = 0x7c00u << 13;
+  uint32 f = (h & 0x7fffu) << 13;
+  const uint32 exponent = f & shifted_exponent;
+  f += (127 - 15) << 23;
+  if (exponent == shifted_exponent) {
+    // Infinity or NaN.
+    f += (128 - 16) << 23;
+  } else if (exponent == 0) {
+    // Zero or subnormal: renormalize through a float subtraction.
+    f = FloatToBits(BitsToFloat(f + (1 << 23)) - BitsToFloat(113u << 23));
+  }
+  return BitsToFloat(f | (static_cast<uint32>(h & 0x8000u) << 16));
+}
+
+inline uint16 FloatToBfloat16Bits(float value) {
+  const uint32 f = FloatToBits(value);
+  if ((f & 0x7fffffffu) > 0x7f800000u) {
+    // Keep NaNs quiet even if their payload is in the dropped bits.
+    return static_cast<uint16>((f >> 16) | 0x40u);
+  }
+  return static_cast<uint16>((f + 0x7fffu + ((f >> 16) & 1)) >> 16);
+}
+
+inline float Bfloat16BitsToFloat(uint16 b) {
+  return BitsToFloat(static_cast<uint32>(b) << 16);
+}
+
+}  // namespace internal
+
+struct half {
+  half() : bits(0) {}
+  explicit half(float value) : bits(internal::FloatToHalfBits(value)) {}
+
+  operator float() const { return internal::HalfBitsToFloat(bits); }
+
+  static half FromBits(uint16 bits) {
+    half result;
+    result.bits = bits;
+    return result;
+  }
+
+  uint16 bits;
+};
+
+struct bfloat16 {
+  bfloat16() : bits(0) {}
+  explicit bfloat16(float value)
+      : bits(internal::FloatToBfloat16Bits(value)) {}
+
+  operator float() const { return internal::Bfloat16BitsToFloat(bits); }
+
+  static bfloat16 FromBits(uint16 bits) {
+    bfloat16 result;
+    result.bits = bits;
+    return result;
+  }
+
+  uint16 bits;
+};
+
+static_assert(sizeof(half) == 2, "half must be 16 bits");
+static_assert(sizeof(bfloat16) == 2, "bfloat16 must be 16 bits");
+
+// Bulk conversions of n values between float and the 16-bit types, with the
+// same results as the scalar conversions above. They run on F16C or AVX-512
+// where the host has them; see kernel_registry.h.
+void ConvertToFloat(const half* in, float* out, int64 n);
+void ConvertToFloat(const bfloat16* in, float* out, int64 n);
+void ConvertFromFloat(const float* in, half* out, int64 n);
+void ConvertFromFloat(const float* in, bfloat16* out, int64 n);
+
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_HALF_H_
@@ -0,0 +1,358 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "half.h"
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "array4d.h"
+#include "gemm.h"
+#include "kernel_registry.h"
+#include "literal_test_util.h"
+#include "literal_util.h"
+#include "reference_util.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+class HalfTest /* : public ::testing::Test */
+{
+public:
+
+   HalfTest() { run(); }
+
+   void HalfScalarConversions();
+   void Bfloat16ScalarConversions();
+   void BulkMatchesScalar();
+   void Literals();
+   void Arrays();
+   void MixedPrecisionGemm();
+   void MixedPrecisionConv();
+
+   void run();
+};
+
+// n values spread over several binades, with both signs, plus the special
+// values at the front.
+std::vector<float> Values(int64 n, int seed)
+{
+   std::vector<float> values(n);
+   const float specials[] = {0.0f, -0.0f, 1.0f, 65504.0f, 65520.0f, 1e6f,
+                             5.9604645e-8f, 1e-9f,
+                             std::numeric_limits<float>::infinity(),
+                             -std::numeric_limits<float>::infinity(),
+                             std::numeric_limits<float>::quiet_NaN()};
+   for (int64 i = 0; i < n; ++i) {
+      if (i < 11) {
+         values[i] = specials[i];
+         continue;
+      }
+      const int64 r = (i * 7919 + seed * 104729) % 100003;
+      const float mantissa = 1.0f + static_cast<float>(r % 1000) / 1000.0f;
+      const int exponent = static_cast<int>(r % 41) - 26;
+      values[i] = std::ldexp(r % 2 ? -mantissa : mantissa, exponent);
+   }
+   return values;
+}
+
+void HalfTest::HalfScalarConversions()
+{
+   ASSERT_EQ(half(1.0f).bits, 0x3c00);
+   ASSERT_EQ(half(-2.0f).bits, 0xc000);
+   ASSERT_EQ(half(65504.0f).bits, 0x7bff);
+   // The largest half is 65504; from 65520 up values round to infinity.
+   ASSERT_EQ(half(65519.0f).bits, 0x7bff);
+   ASSERT_EQ(half(65520.0f).bits, 0x7c00);
+   ASSERT_EQ(half(-1e9f).bits, 0xfc00);
+   // Smallest subnormal, and a value that rounds down to zero.
+   ASSERT_EQ(half(std::ldexp(1.0f, -24)).bits, 0x0001);
+   ASSERT_EQ(half(std::ldexp(1.0f, -26)).bits, 0x0000);
+   // Ties round to even.
+   ASSERT_EQ(half(1.0f + std::ldexp(1.0f, -11)).bits, 0x3c00);
+   ASSERT_EQ(half(1.0f + 3 * std::ldexp(1.0f, -11)).bits, 0x3c02);
+   ASSERT_TRUE(std::isnan(static_cast<float>(
+       half(std::numeric_limits<float>::quiet_NaN()))));
+
+   // Every half converts to float and back unchanged.
+   for (uint32 bits = 0; bits < 0x10000; ++bits) {
+      const half value = half::FromBits(static_cast<uint16>(bits));
+      const float widened = value;
+      if (std::isnan(widened)) {
+         ASSERT_TRUE((bits & 0x7c00) == 0x7c00 && (bits & 0x3ff) != 0);
+         continue;
+      }
+      ASSERT_EQ(half(widened).bits, bits);
+   }
+   ASSERT_EQ(static_cast<float>(half::FromBits(0x0001)),
+             std::ldexp(1.0f, -24));
+   ASSERT_EQ(static_cast<float>(half::FromBits(0x7c00)),
+             std::numeric_limits<float>::infinity());
+}
+
+void HalfTest::Bfloat16ScalarConversions()
+{
+   ASSERT_EQ(bfloat16(1.0f).bits, 0x3f80);
+   ASSERT_EQ(bfloat16(-2.0f).bits, 0xc000);
+   ASSERT_EQ(bfloat16(1.0f + std::ldexp(1.0f, -8)).bits, 0x3f80);
+   ASSERT_EQ(bfloat16(1.0f + 3 * std::ldexp(1.0f, -8)).bits, 0x3f82);
+   ASSERT_EQ(bfloat16(std::numeric_limits<float>::max()).bits, 0x7f80);
+   // A NaN whose payload is only in the dropped bits stays a NaN.
+   uint32 nan_bits = 0x7f800001;
+   float nan;
+   std::memcpy(&nan, &nan_bits, sizeof(nan));
+   ASSERT_TRUE(std::isnan(static_cast<float>(bfloat16(nan))));
+
+   for (uint32 bits = 0; bits < 0x10000; ++bits) {
+      const bfloat16 value = bfloat16::FromBits(static_cast<uint16>(bits));
+      const float widened = value;
+      if (std::isnan(widened)) {
+         continue;
+      }
+      ASSERT_EQ(bfloat16(widened).bits, bits);
+   }
+}
+
+void HalfTest::BulkMatchesScalar()
+{
+   const std::vector<float> values = Values(1000, 1);
+   for (int isa = 0; isa < kNumIsas; ++isa) {
+      SetMaxIsa(static_cast<Isa>(isa));
+      for (int64 n : {0, 1, 7, 8, 15, 16, 17, 37, 1000}) {
+         std::vector<half> halves(n);
+         std::vector<bfloat16> bfloats(n);
+         std::vector<float> from_half(n);
+         std::vector<float> from_bfloat(n);
+         ConvertFromFloat(values.data(), halves.data(), n);
+         ConvertFromFloat(values.data(), bfloats.data(), n);
+         ConvertToFloat(halves.data(), from_half.data(), n);
+         ConvertToFloat(bfloats.data(), from_bfloat.data(), n);
+         for (int64 i = 0; i < n; ++i) {
+            const half h(values[i]);
+            const bfloat16 b(values[i]);
+            if (std::isnan(values[i])) {
+               ASSERT_TRUE(std::isnan(from_half[i]));
+               ASSERT_TRUE(std::isnan(from_bfloat[i]));
+               continue;
+            }
+            ASSERT_EQ(halves[i].bits, h.bits);
+            ASSERT_EQ(bfloats[i].bits, b.bits);
+            ASSERT_EQ(from_half[i], static_cast<float>(h));
+            ASSERT_EQ(from_bfloat[i], static_cast<float>(b));
+         }
+      }
+   }
+   SetMaxIsa(static_cast<Isa>(kNumIsas - 1));
+}
+
+void HalfTest::Literals()
+{
+   auto literal = LiteralUtil::CreateR2<half>(
+       {{half(1.0f), half(-2.5f)}, {half(0.0f), half(65504.0f)}});
+   ASSERT_TRUE(literal->shape().element_type() == F16);
+   ASSERT_TRUE(LiteralUtil::ValidateLiteral(*literal).ok());
+   ASSERT_EQ(static_cast<float>(LiteralUtil::Get<half>(*literal, {0, 1})),
+             -2.5f);
+   ASSERT_EQ(static_cast<float>(LiteralUtil::Get<half>(*literal, {1, 1})),
+             65504.0f);
+   ASSERT_TRUE(LiteralUtil::IsZero(*literal, {1, 0}));
+   ASSERT_EQ(LiteralUtil::GetAsString(*literal, {0, 1}), "-2.5");
+
+   LiteralUtil::Set<half>(literal.get(), {1, 0}, half(0.25f));
+   ASSERT_EQ(static_cast<float>(LiteralUtil::Get<half>(*literal, {1, 0})),
+             0.25f);
+
+   // Bulk conversions to and from F32.
+   auto widened = LiteralUtil::Convert<half, float>(*literal);
+   ASSERT_TRUE(widened->shape().element_type() == F32);
+   LiteralTestUtil::ExpectEqual(
+       *LiteralUtil::CreateR2<float>({{1.0f, -2.5f}, {0.25f, 65504.0f}}),
+       *widened);
+   ASSERT_TRUE(LiteralUtil::Equal(
+       *LiteralUtil::Convert<float, half>(*widened), *literal));
+
+   auto bfloats = LiteralUtil::Convert<float, bfloat16>(
+       *LiteralUtil::CreateR1<float>({1.0f, 3.0f, -0.5f}));
+   ASSERT_TRUE(bfloats->shape().element_type() == BF16);
+   ASSERT_EQ(LiteralUtil::Get<bfloat16>(*bfloats, {1}).bits, 0x4040);
+   LiteralTestUtil::ExpectEqual(
+       *LiteralUtil::CreateR1<float>({1.0f, 3.0f, -0.5f}),
+       *LiteralUtil::Convert<bfloat16, float>(*bfloats));
+
+   for (PrimitiveType type : {F16, BF16}) {
+      ASSERT_TRUE(LiteralUtil::IsAllFloat(LiteralUtil::Zero(type), 0.0f));
+      ASSERT_TRUE(LiteralUtil::IsAll(LiteralUtil::One(type), 1));
+      ASSERT_TRUE(LiteralUtil::IsAllFloat(
+          LiteralUtil::MaxValue(type), std::numeric_limits<float>::infinity()));
+      ASSERT_EQ(primitive_util::BitWidth(type), 16);
+      ASSERT_TRUE(primitive_util::IsFloatingPointType(type));
+   }
+
+   Literal filled;
+   LiteralUtil::PopulateWithValue(bfloat16(7.0f), {2, 3}, &filled);
+   ASSERT_TRUE(LiteralUtil::IsAllFloat(filled, 7.0f));
+}
+
+void HalfTest::Arrays()
+{
+   Array4D<float> values(2, 3, 4, 5);
+   values.FillRandom(4.0f);
+   const std::unique_ptr<Array4D<half>> halves = values.convert<half>();
+   const std::unique_ptr<Array4D<float>> widened = halves->convert<float>();
+   values.Each([&](tensorflow::gtl::ArraySlice<int64> i, float* value) {
+      const float narrowed = (*widened)(i[0], i[1], i[2], i[3]);
+      ASSERT_EQ(narrowed, static_cast<float>(half(*value)));
+   });
+
+   auto literal = LiteralUtil::CreateR4FromArray4D(*halves);
+   ASSERT_TRUE(literal->shape().element_type() == F16);
+   ASSERT_EQ(LiteralUtil::Get<half>(*literal, {1, 2, 3, 4}).bits,
+             (*halves)(1, 2, 3, 4).bits);
+}
+
+// The mixed precision GEMM equals the float GEMM of the widened operands:
+// both pack the same floats and run the same micro-kernels.
+template <typename S>
+void ExpectWidenedGemm(gemm::Transpose transpose_a,
+                       gemm::Transpose transpose_b, int64 m, int64 n, int64 k,
+                       bool with_epilogue)
+{
+   const std::vector<float> a_values = Values(m * k, 2);
+   const std::vector<float> b_values = Values(k * n, 3);
+   std::vector<S> a(m * k);
+   std::vector<S> b(k * n);
+   ConvertFromFloat(a_values.data(), a.data(), m * k);
+   ConvertFromFloat(b_values.data(), b.data(), k * n);
+   std::vector<float> a_widened(m * k);
+   std::vector<float> b_widened(k * n);
+   ConvertToFloat(a.data(), a_widened.data(), m * k);
+   ConvertToFloat(b.data(), b_widened.data(), k * n);
+   // The specials at the front of Values would make the products non-finite.
+   for (int64 i = 0; i < 11; ++i) {
+      a_widened[i % (m * k)] = 0.0f;
+      b_widened[i % (k * n)] = 0.0f;
+   }
+   ConvertFromFloat(a_widened.data(), a.data(), m * k);
+   ConvertFromFloat(b_widened.data(), b.data(), k * n);
+
+   const int64 lda =
+       transpose_a == gemm::Transpose::kNoTranspose ? k : m;
+   const int64 ldb =
+       transpose_b == gemm::Transpose::kNoTranspose ? n : k;
+   std::vector<float> bias(m);
+   for (int64 i = 0; i < m; ++i) {
+      bias[i] = 0.5f - static_cast<float>(i % 3);
+   }
+   gemm::Epilogue<float> epilogue;
+   epilogue.bias = bias.data();
+   epilogue.bias_per_row = true;
+   epilogue.activation = ActivationFunction::kRelu;
+
+   std::vector<float> expected(m * n, 1.0f);
+   std::vector<float> actual(m * n, 1.0f);
+   if (with_epilogue) {
+      gemm::Gemm<float>(transpose_a, transpose_b, m, n, k, 0.5f,
+                        a_widened.data(), lda, b_widened.data(), ldb, 2.0f,
+                        expected.data(), n, epilogue);
+      gemm::Gemm(transpose_a, transpose_b, m, n, k, 0.5f, a.data(), lda,
+                 b.data(), ldb, 2.0f, actual.data(), n, epilogue);
+   } else {
+      gemm::Gemm<float>(transpose_a, transpose_b, m, n, k, 0.5f,
+                        a_widened.data(), lda, b_widened.data(), ldb, 2.0f,
+                        expected.data(), n);
+      gemm::Gemm(transpose_a, transpose_b, m, n, k, 0.5f, a.data(), lda,
+                 b.data(), ldb, 2.0f, actual.data(), n);
+   }
+   for (int64 i = 0; i < m * n; ++i) {
+      ASSERT_EQ(actual[i], expected[i]);
+   }
+}
+
+void HalfTest::MixedPrecisionGemm()
+{
+   const gemm::Transpose kN = gemm::Transpose::kNoTranspose;
+   const gemm::Transpose kT = gemm::Transpose::kTranspose;
+   for (int isa = 0; isa < kNumIsas; ++isa) {
+      SetMaxIsa(static_cast<Isa>(isa));
+      // Small enough for the unpacked path, then several blocks of every
+      // dimension.
+      ExpectWidenedGemm<half>(kN, kN, 5, 7, 3, false);
+      ExpectWidenedGemm<half>(kN, kN, 131, 300, 270, false);
+      ExpectWidenedGemm<half>(kT, kT, 67, 45, 300, true);
+      ExpectWidenedGemm<bfloat16>(kN, kT, 5, 7, 3, true);
+      ExpectWidenedGemm<bfloat16>(kT, kN, 131, 300, 270, false);
+   }
+   SetMaxIsa(static_cast<Isa>(kNumIsas - 1));
+}
+
+template <typename S>
+void ExpectWidenedConv(std::pair<int64, int64> stride, Padding padding)
+{
+   Array4D<float> input(2, 3, 11, 9);
+   input.FillRandom(1.0f);
+   Array4D<float> filter(4, 3, 3, 3);
+   filter.FillRandom(1.0f, 0.0f, 7);
+   const std::unique_ptr<Array4D<S>> narrow_input = input.convert<S>();
+   const std::unique_ptr<Array4D<S>> narrow_filter = filter.convert<S>();
+
+   const std::unique_ptr<Array4D<float>> expected = ReferenceUtil::Conv4D(
+       *narrow_input->template convert<float>(),
+       *narrow_filter->template convert<float>(), stride, padding,
+       conv::ConvAlgorithm::kIm2Col);
+   const std::unique_ptr<Array4D<float>> actual =
+       ReferenceUtil::Conv4D(*narrow_input, *narrow_filter, stride, padding);
+   LiteralTestUtil::ExpectR4NearArray4D(
+       *expected, *LiteralUtil::CreateR4FromArray4D(*actual), ErrorSpec(1e-6));
+}
+
+void HalfTest::MixedPrecisionConv()
+{
+   ExpectWidenedConv<half>({1, 1}, Padding::kSame);
+   ExpectWidenedConv<half>({2, 1}, Padding::kValid);
+   ExpectWidenedConv<bfloat16>({1, 2}, Padding::kValid);
+   ExpectWidenedConv<bfloat16>({1, 1}, Padding::kSame);
+
+   // 1x1 filters use the input as the patch matrix.
+   Array4D<float> input(1, 8, 6, 6);
+   input.FillRandom(1.0f);
+   Array4D<float> filter(5, 8, 1, 1);
+   filter.FillRandom(1.0f, 0.0f, 3);
+   const auto narrow_input = input.convert<half>();
+   const auto narrow_filter = filter.convert<half>();
+   LiteralTestUtil::ExpectR4NearArray4D(
+       *ReferenceUtil::Conv4D(*narrow_input->convert<float>(),
+                              *narrow_filter->convert<float>(), {1, 1},
+                              Padding::kValid, conv::ConvAlgorithm::kIm2Col),
+       *LiteralUtil::CreateR4FromArray4D(*ReferenceUtil::Conv4D(
+           *narrow_input, *narrow_filter, {1, 1}, Padding::kValid)),
+       ErrorSpec(1e-6));
+}
+
+void HalfTest::run()
+{
+   HalfScalarConversions();
+   Bfloat16ScalarConversions();
+   BulkMatchesScalar();
+   Literals();
+   Arrays();
+   MixedPrecisionGemm();
+   MixedPrecisionConv();
+}
+
+}  // namespace
+}  // namespace xla
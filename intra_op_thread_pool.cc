@@ -0,0 +1,113 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "intra_op_thread_pool.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "logging.h"
+#include "threadpool.h"
+
+namespace xla {
+namespace {
+
+// Work units smaller than this many scalar operations are not worth handing
+// to another thread.
+constexpr int64 kMinCostPerBlock = 10000;
+
+// Blocks handed out per participating thread. More than one lets the work
+// stealing in ThreadPool::ParallelFor even out blocks of unequal cost.
+constexpr int64 kBlocksPerThread = 4;
+
+int DefaultThreadCount() {
+  const unsigned int cores = std::thread::hardware_concurrency();
+  return cores == 0 ? 1 : static_cast<int>(cores);
+}
+
+struct IntraOpPool {
+  std::mutex mu;
+  int num_threads = 0;
+  // Holds num_threads - 1 workers, since the calling thread participates.
+  // Null when num_threads is 1.
+  std::shared_ptr<tensorflow::thread::ThreadPool> pool;
+};
+
+IntraOpPool* GetIntraOpPool() {
+  static IntraOpPool* intra_op_pool = new IntraOpPool;
+  return intra_op_pool;
+}
+
+void ResetPoolLocked(IntraOpPool* intra_op_pool, int num_threads) {
+  intra_op_pool->num_threads = num_threads;
+  intra_op_pool->pool.reset();
+  if (num_threads > 1) {
+    intra_op_pool->pool = std::make_shared<tensorflow::thread::ThreadPool>(
+        "xla_intra_op", num_threads - 1);
+  }
+}
+
+// Returns the current pool (possibly null) and its thread count, creating the
+// default pool on first use.
+std::shared_ptr<tensorflow::thread::ThreadPool> CurrentPool(int* num_threads) {
+  IntraOpPool* intra_op_pool = GetIntraOpPool();
+  std::lock_guard<std::mutex> lock(intra_op_pool->mu);
+  if (intra_op_pool->num_threads == 0) {
+    ResetPoolLocked(intra_op_pool, DefaultThreadCount());
+  }
+  *num_threads = intra_op_pool->num_threads;
+  return intra_op_pool->pool;
+}
+
+}  // namespace
+
+void SetIntraOpThreadCount(int num_threads) {
+  IntraOpPool* intra_op_pool = GetIntraOpPool();
+  std::lock_guard<std::mutex> lock(intra_op_pool->mu);
+  ResetPoolLocked(intra_op_pool,
+                  num_threads > 0 ? num_threads : DefaultThreadCount());
+}
+
+int IntraOpThreadCount() {
+  int num_threads;
+  CurrentPool(&num_threads);
+  return num_threads;
+}
+
+void ParallelFor(int64 total, int64 cost_per_unit,
+                 const std::function<void(int64, int64)>& fn) {
+  CHECK_GE(total, 0);
+  if (total == 0) {
+    return;
+  }
+  int num_threads;
+  std::shared_ptr<tensorflow::thread::ThreadPool> pool =
+      CurrentPool(&num_threads);
+  const int64 cost = std::max<int64>(cost_per_unit, 1);
+  if (pool == nullptr || total * cost < 2 * kMinCostPerBlock) {
+    fn(0, total);
+    return;
+  }
+
+  const int64 min_block = (kMinCostPerBlock + cost - 1) / cost;
+  const int64 max_blocks = num_threads * kBlocksPerThread;
+  const int64 block_size =
+      std::max(min_block, (total + max_blocks - 1) / max_blocks);
+  pool->ParallelFor(total, block_size, fn);
+}
+
+}  // namespace xla
@@ -0,0 +1,82 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_INTRA_OP_THREAD_POOL_H_
+#define TENSORFLOW_COMPILER_XLA_INTRA_OP_THREAD_POOL_H_
+
+// Library-wide intra-op parallelism. All ReferenceUtil kernels split their
+// work through ParallelFor below, so a single setting controls how many cores
+// one op may use.
+
+#include <functional>
+#include <vector>
+
+#include "types.h"
+
+namespace xla {
+
+// Sets the number of threads, including the calling thread, that a single op
+// may use. A value <= 0 restores the default, one thread per hardware core.
+// Must not be called concurrently with running ops.
+void SetIntraOpThreadCount(int num_threads);
+
+// Returns the number of threads, including the calling thread, that a single
+// op may use.
+int IntraOpThreadCount();
+
+// Runs fn(first, last) over disjoint sub-ranges covering [0, total) on the
+// intra-op pool and returns when all of them are done. cost_per_unit is a
+// rough count of scalar operations per unit of work; it decides how many
+// units are grouped together, so cheap loops stay on the calling thread.
+//
+// fn must only write state owned by its own sub-range; the partitioning then
+// has no effect on the results.
+void ParallelFor(int64 total, int64 cost_per_unit,
+                 const std::function<void(int64, int64)>& fn);
+
+// Reduces [0, total) by splitting it into fixed blocks of block_size units,
+// evaluating block_fn(first, last) for each block in parallel and folding the
+// per-block partials into init with combine, in block order.
+//
+// The block boundaries depend only on total and block_size, never on the
+// thread count, so the result is bit-identical for any IntraOpThreadCount().
+template <typename T, typename BlockFn, typename CombineFn>
+T ParallelReduce(int64 total, int64 block_size, int64 cost_per_unit, T init,
+                 BlockFn&& block_fn, CombineFn&& combine) {
+  if (total <= 0) {
+    return init;
+  }
+  const int64 num_blocks = (total + block_size - 1) / block_size;
+  std::vector<T> partials(num_blocks);
+  ParallelFor(num_blocks, block_size * cost_per_unit,
+              [&](int64 first_block, int64 last_block) {
+                for (int64 b = first_block; b < last_block; ++b) {
+                  const int64 first = b * block_size;
+                  const int64 last = first + block_size < total
+                                         ? first + block_size
+                                         : total;
+                  partials[b] = block_fn(first, last);
+                }
+              });
+  T result = init;
+  for (int64 b = 0; b < num_blocks; ++b) {
+    result = combine(result, partials[b]);
+  }
+  return result;
+}
+
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_INTRA_OP_THREAD_POOL_H_
@@ -0,0 +1,262 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+
+#include "keras_model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <vector>
+
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+// Checks the keras tensor operations and layers that run on the vector
+// kernels against scalar loops.
+class KerasLayersTest /* : public ::testing::Test */
+{
+public:
+
+   KerasLayersTest() { run(); }
+
+   void TensorElementwise();
+   void TensorDot();
+   void ReluActivation();
+   void FoldBatchNormalization();
+   void PrunedDense();
+
+   void run();
+};
+
+Tensor Values(int rows, int columns, float seed)
+{
+   Tensor t(rows, columns);
+   for (size_t i = 0; i < t.data_.size(); ++i) {
+      t.data_[i] = std::sin(seed + 0.7f * i);
+   }
+   return t;
+}
+
+void WriteUnsignedInt(std::ofstream* file, unsigned int i)
+{
+   file->write(reinterpret_cast<const char*>(&i), sizeof(unsigned int));
+}
+
+void WriteFloats(std::ofstream* file, unsigned int n, float seed)
+{
+   for (unsigned int i = 0; i < n; ++i) {
+      float f = std::sin(seed + 0.7f * i);
+      file->write(reinterpret_cast<const char*>(&f), sizeof(float));
+   }
+}
+
+void WriteBatchNormalization(std::ofstream* file, unsigned int features,
+                             float seed)
+{
+   WriteUnsignedInt(file, KerasModel::kBatchNormalization);
+   WriteUnsignedInt(file, features);
+   float epsilon = 1e-3f;
+   file->write(reinterpret_cast<const char*>(&epsilon), sizeof(float));
+   WriteFloats(file, features, seed);         // gamma
+   WriteFloats(file, features, seed + 1.0f);  // beta
+   WriteFloats(file, features, seed + 2.0f);  // moving mean
+   for (unsigned int i = 0; i < features; ++i) {
+      float variance = 0.5f + 0.25f * i;
+      file->write(reinterpret_cast<const char*>(&variance), sizeof(float));
+   }
+}
+
+void KerasLayersTest::TensorElementwise()
+{
+   // 37 elements leave a partial vector at the end.
+   Tensor a = Values(1, 37, 0.1f);
+   Tensor b = Values(1, 37, 0.2f);
+   Tensor sum = a + b;
+   Tensor product = a.Multiply(b);
+   ASSERT_TRUE(sum.dims_ == a.dims_);
+   ASSERT_TRUE(product.dims_ == a.dims_);
+   for (size_t i = 0; i < a.data_.size(); ++i) {
+      ASSERT_EQ(sum.data_[i], a.data_[i] + b.data_[i]);
+      ASSERT_EQ(product.data_[i], a.data_[i] * b.data_[i]);
+   }
+}
+
+void KerasLayersTest::TensorDot()
+{
+   const int m = 5, k = 19, n = 7;
+   Tensor a = Values(m, k, 0.3f);
+   Tensor b = Values(k, n, 0.4f);
+   Tensor c = a.Dot(b);
+   ASSERT_TRUE(c.dims_ == std::vector<int>({m, n}));
+   for (int i = 0; i < m; ++i) {
+      for (int j = 0; j < n; ++j) {
+         float expected = 0.0f;
+         for (int p = 0; p < k; ++p) {
+            expected += a(i, p) * b(p, j);
+         }
+         ASSERT_TRUE(std::abs(c(i, j) - expected) <= 1e-5f);
+      }
+   }
+
+   Tensor column(2, 1), row(1, 2);
+   column.data_ = {1.0f, 2.0f};
+   row.data_ = {2.0f, 5.0f};
+   ASSERT_TRUE(column.Dot(row).data_ ==
+               std::vector<float>({2.0f, 5.0f, 4.0f, 10.0f}));
+}
+
+void KerasLayersTest::ReluActivation()
+{
+   const char* filename = "test_relu_activation.model";
+   {
+      std::ofstream file(filename, std::ios::binary);
+      WriteUnsignedInt(&file, 1);
+      WriteUnsignedInt(&file, KerasModel::kActivation);
+      WriteUnsignedInt(&file, KerasLayerActivation::kRelu);
+   }
+
+   Tensor in = Values(3, 11, 0.5f);
+   KerasModel model;
+   ASSERT_TRUE(model.LoadModel(filename));
+   Tensor out;
+   ASSERT_TRUE(model.Apply(&in, &out));
+   ASSERT_TRUE(out.dims_ == in.dims_);
+   for (size_t i = 0; i < in.data_.size(); ++i) {
+      ASSERT_EQ(out.data_[i], std::max(in.data_[i], 0.0f));
+   }
+}
+
+void KerasLayersTest::FoldBatchNormalization()
+{
+   // conv(3 -> 2, 3x3) -> bn -> relu -> flatten -> dense(32 -> 5) -> bn -> bn
+   const char* filename = "test_batchnorm_fold.model";
+   {
+      std::ofstream file(filename, std::ios::binary);
+      WriteUnsignedInt(&file, 7);
+
+      WriteUnsignedInt(&file, KerasModel::kConvolution2d);
+      WriteUnsignedInt(&file, 2);
+      WriteUnsignedInt(&file, 3);
+      WriteUnsignedInt(&file, 3);
+      WriteUnsignedInt(&file, 3);
+      WriteUnsignedInt(&file, 2);
+      WriteFloats(&file, 2 * 3 * 3 * 3, 0.1f);
+      WriteFloats(&file, 2, 0.2f);
+      WriteUnsignedInt(&file, KerasLayerActivation::kLinear);
+
+      WriteBatchNormalization(&file, 2, 0.3f);
+
+      WriteUnsignedInt(&file, KerasModel::kActivation);
+      WriteUnsignedInt(&file, KerasLayerActivation::kRelu);
+
+      WriteUnsignedInt(&file, KerasModel::kFlatten);
+
+      WriteUnsignedInt(&file, KerasModel::kDense);
+      WriteUnsignedInt(&file, 32);
+      WriteUnsignedInt(&file, 5);
+      WriteUnsignedInt(&file, 5);
+      WriteFloats(&file, 32 * 5, 0.4f);
+      WriteFloats(&file, 5, 0.5f);
+      WriteUnsignedInt(&file, KerasLayerActivation::kLinear);
+
+      WriteBatchNormalization(&file, 5, 0.6f);
+      WriteBatchNormalization(&file, 5, 0.7f);
+   }
+
+   Tensor in(3, 6, 6);
+   for (size_t i = 0; i < in.data_.size(); ++i) {
+      in.data_[i] = std::cos(0.3f * i);
+   }
+
+   KerasModel model;
+   ASSERT_TRUE(model.LoadModel(filename));
+   Tensor expected;
+   ASSERT_TRUE(model.Apply(&in, &expected));
+
+   KerasModel folded;
+   ASSERT_TRUE(folded.LoadModel(filename));
+   KerasModel::FoldReport report;
+   ASSERT_TRUE(folded.FoldBatchNormalization(in.dims_, &report));
+   ASSERT_EQ(report.layers_folded, 3);
+   ASSERT_EQ(report.flops_removed, 2 * (2 * 4 * 4 + 5 + 5));
+   ASSERT_EQ(report.bytes_removed,
+             4 * (2 * (2 * 4 * 4 + 5 + 5) + 4 * (2 + 5 + 5)));
+
+   Tensor actual;
+   ASSERT_TRUE(folded.Apply(&in, &actual));
+   ASSERT_TRUE(actual.dims_ == expected.dims_);
+   for (size_t i = 0; i < expected.data_.size(); ++i) {
+      ASSERT_TRUE(std::abs(actual.data_[i] - expected.data_[i]) <= 1e-4f);
+   }
+}
+
+void KerasLayersTest::PrunedDense()
+{
+   // dense(40 -> 12) with four in five weights pruned to zero.
+   const unsigned int inputs = 40;
+   const unsigned int outputs = 12;
+   std::vector<float> weights(inputs * outputs);
+   for (size_t i = 0; i < weights.size(); ++i) {
+      weights[i] = i % 5 == 0 ? std::sin(0.9f * i) : 0.0f;
+   }
+   const char* filename = "test_pruned_dense.model";
+   {
+      std::ofstream file(filename, std::ios::binary);
+      WriteUnsignedInt(&file, 1);
+      WriteUnsignedInt(&file, KerasModel::kDense);
+      WriteUnsignedInt(&file, inputs);
+      WriteUnsignedInt(&file, outputs);
+      WriteUnsignedInt(&file, outputs);
+      file.write(reinterpret_cast<const char*>(weights.data()),
+                 weights.size() * sizeof(float));
+      WriteFloats(&file, outputs, 0.5f);
+      WriteUnsignedInt(&file, KerasLayerActivation::kLinear);
+   }
+
+   // Zero inputs are skipped by the sparse path, so include some.
+   Tensor in(inputs);
+   for (unsigned int i = 0; i < inputs; ++i) {
+      in.data_[i] = i % 3 == 0 ? 0.0f : std::cos(0.3f * i);
+   }
+
+   KerasModel model;
+   ASSERT_TRUE(model.LoadModel(filename));
+   Tensor out;
+   ASSERT_TRUE(model.Apply(&in, &out));
+   ASSERT_TRUE(out.dims_ == std::vector<int>({static_cast<int>(outputs)}));
+
+   for (unsigned int j = 0; j < outputs; ++j) {
+      float expected = std::sin(0.5f + 0.7f * j);
+      for (unsigned int i = 0; i < inputs; ++i) {
+         expected += in.data_[i] * weights[i * outputs + j];
+      }
+      ASSERT_TRUE(std::abs(out.data_[j] - expected) <= 1e-5f);
+   }
+}
+
+void KerasLayersTest::run()
+{
+   TensorElementwise();
+   TensorDot();
+   ReluActivation();
+   FoldBatchNormalization();
+   PrunedDense();
+}
+
+}  // namespace
+}  // namespace xla
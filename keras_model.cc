@@ -8,10 +8,13 @@
 
 #include <cmath>
 #include <fstream>
+#include <functional>
 #include <limits>
 #include <stdio.h>
 #include <utility>
 
+#include "simd_kernels.h"
+
 bool ReadUnsignedInt(std::ifstream* file, unsigned int* i) {
     KASSERT(file, "Invalid file stream");
     KASSERT(i, "Invalid pointer");
@@ -86,46 +89,27 @@ bool KerasLayerActivation::Apply(Tensor* in, Tensor* out) {
     case kLinear:
         break;
     case kRelu:
-        for (size_t i = 0; i < out->data_.size(); i++) {
-            if (out->data_[i] < 0.0f) {
-                out->data_[i] = 0.0f;
-            }
-        }
+        xla::simd::ActivateAndScale(xla::ActivationFunction::kRelu, 1.0f,
+                                    out->data_.data(), out->data_.size());
         break;
     case kSoftPlus:
-        for (size_t i = 0; i < out->data_.size(); i++) {
-            out->data_[i] = std::log(1.0f + std::exp(out->data_[i]));
-        }
+        xla::simd::Softplus(out->data_.data(), out->data_.data(),
+                            out->data_.size());
         break;
     case kHardSigmoid:
+        // Piecewise linear: min and max vectorize where branches do not.
         for (size_t i = 0; i < out->data_.size(); i++) {
             float x = (out->data_[i] * 0.2f) + 0.5f;
-
-            if (x <= 0) {
-                out->data_[i] = 0.0f;
-            } else if (x >= 1) {
-                out->data_[i] = 1.0f;
-            } else {
-                out->data_[i] = x;
-            }
+            out->data_[i] = std::min(std::max(x, 0.0f), 1.0f);
         }
         break;
     case kSigmoid:
-        for (size_t i = 0; i < out->data_.size(); i++) {
-            float& x = out->data_[i];
-
-            if (x >= 0) {
-                out->data_[i] = 1.0f / (1.0f + std::exp(-x));
-            } else {
-                float z = std::exp(x);
-                out->data_[i] = z / (1.0f + z);
-            }
-        }
+        xla::simd::Sigmoid(out->data_.data(), out->data_.data(),
+                           out->data_.size());
         break;
     case kTanh:
-        for (size_t i = 0; i < out->data_.size(); i++) {
-            out->data_[i] = std::tanh(out->data_[i]);
-        }
+        xla::simd::Tanh(out->data_.data(), out->data_.data(),
+                        out->data_.size());
         break;
     default:
         break;
@@ -134,6 +118,74 @@ bool KerasLayerActivation::Apply(Tensor* in, Tensor* out) {
     return true;
 }
 
+// Layout: features, epsilon, then gamma, beta, moving mean and moving
+// variance with one float per feature each.
+bool KerasLayerBatchNormalization::LoadLayer(std::ifstream* file) {
+    KASSERT(file, "Invalid file stream");
+
+    unsigned int features = 0;
+    KASSERT(ReadUnsignedInt(file, &features), "Expected features");
+    KASSERT(features > 0, "Invalid features");
+
+    KASSERT(ReadFloat(file, &epsilon_), "Expected epsilon");
+    KASSERT(epsilon_ >= 0.0f, "Invalid epsilon");
+
+    gamma_.Resize(features);
+    KASSERT(ReadFloats(file, gamma_.data_.data(), features), "Expected gamma");
+
+    beta_.Resize(features);
+    KASSERT(ReadFloats(file, beta_.data_.data(), features), "Expected beta");
+
+    moving_mean_.Resize(features);
+    KASSERT(ReadFloats(file, moving_mean_.data_.data(), features),
+            "Expected moving mean");
+
+    moving_variance_.Resize(features);
+    KASSERT(ReadFloats(file, moving_variance_.data_.data(), features),
+            "Expected moving variance");
+
+    return true;
+}
+
+void KerasLayerBatchNormalization::GetAffine(std::vector<float>* scale,
+                                             std::vector<float>* shift) const {
+    scale->resize(gamma_.data_.size());
+    shift->resize(gamma_.data_.size());
+
+    for (size_t i = 0; i < gamma_.data_.size(); i++) {
+        (*scale)[i] =
+            gamma_.data_[i] / std::sqrt(moving_variance_.data_[i] + epsilon_);
+        (*shift)[i] = beta_.data_[i] - moving_mean_.data_[i] * (*scale)[i];
+    }
+}
+
+bool KerasLayerBatchNormalization::Apply(Tensor* in, Tensor* out) {
+    KASSERT(in, "Invalid input");
+    KASSERT(out, "Invalid output");
+    KASSERT(in->dims_.size() > 0, "Invalid input dimensions");
+
+    const int features = gamma_.dims_[0];
+    const bool channels_first = in->dims_.size() == 3;
+    const int feature_dim = channels_first ? 0 : in->dims_.size() - 1;
+    KASSERT(in->dims_[feature_dim] == features, "Expected %d features, got %d",
+            features, in->dims_[feature_dim]);
+
+    std::vector<float> scale;
+    std::vector<float> shift;
+    GetAffine(&scale, &shift);
+
+    *out = *in;
+
+    // Consecutive values sharing a feature.
+    const size_t run = channels_first ? out->data_.size() / features : 1;
+    for (size_t i = 0; i < out->data_.size(); i++) {
+        const int feature = (i / run) % features;
+        out->data_[i] = out->data_[i] * scale[feature] + shift[feature];
+    }
+
+    return true;
+}
+
 bool KerasLayerDense::LoadLayer(std::ifstream* file) {
     KASSERT(file, "Invalid file stream");
 
@@ -160,9 +212,22 @@ bool KerasLayerDense::LoadLayer(std::ifstream* file) {
 
     KASSERT(activation_.LoadLayer(file), "Failed to load activation");
 
+    UpdateSparseWeights();
+
     return true;
 }
 
+void KerasLayerDense::UpdateSparseWeights() {
+    // weights_ is inputs x outputs, so each compressed row holds the
+    // outputs one input contributes to.
+    sparse_weights_ = xla::sparse::CsrFromDense(
+        weights_.data_.data(), weights_.dims_[0], weights_.dims_[1],
+        weights_.dims_[1]);
+    if (sparse_weights_.density() > kMaxSparseDensity) {
+        sparse_weights_ = xla::sparse::CsrMatrix();
+    }
+}
+
 bool KerasLayerDense::Apply(Tensor* in, Tensor* out) {
     KASSERT(in, "Invalid input");
     KASSERT(out, "Invalid output");
@@ -175,9 +240,15 @@ bool KerasLayerDense::Apply(Tensor* in, Tensor* out) {
 
     Tensor tmp(weights_.dims_[1]);
 
-    for (int i = 0; i < weights_.dims_[0]; i++) {
-        for (int j = 0; j < weights_.dims_[1]; j++) {
-            tmp(j) += (*in)(i)*weights_(i, j);
+    if (sparse()) {
+        xla::sparse::DenseSparseMatMul(1, in->data_.data(), weights_.dims_[0],
+                                       sparse_weights_, tmp.data_.data(),
+                                       weights_.dims_[1]);
+    } else {
+        for (int i = 0; i < weights_.dims_[0]; i++) {
+            for (int j = 0; j < weights_.dims_[1]; j++) {
+                tmp(j) += (*in)(i)*weights_(i, j);
+            }
         }
     }
 
@@ -190,6 +261,32 @@ bool KerasLayerDense::Apply(Tensor* in, Tensor* out) {
     return true;
 }
 
+bool KerasLayerDense::FoldBatchNormalization(
+    const KerasLayerBatchNormalization& bn) {
+    if (activation_.activation_type() != KerasLayerActivation::kLinear ||
+        bn.features() != weights_.dims_[1]) {
+        return false;
+    }
+
+    std::vector<float> scale;
+    std::vector<float> shift;
+    bn.GetAffine(&scale, &shift);
+
+    for (int i = 0; i < weights_.dims_[0]; i++) {
+        for (int j = 0; j < weights_.dims_[1]; j++) {
+            weights_(i, j) *= scale[j];
+        }
+    }
+
+    for (int i = 0; i < biases_.dims_[0]; i++) {
+        biases_(i) = biases_(i) * scale[i] + shift[i];
+    }
+
+    UpdateSparseWeights();
+
+    return true;
+}
+
 bool KerasLayerConvolution2d::LoadLayer(std::ifstream* file) {
     KASSERT(file, "Invalid file stream");
 
@@ -276,6 +373,30 @@ bool KerasLayerConvolution2d::Apply(Tensor* in, Tensor* out) {
     return true;
 }
 
+bool KerasLayerConvolution2d::FoldBatchNormalization(
+    const KerasLayerBatchNormalization& bn) {
+    if (activation_.activation_type() != KerasLayerActivation::kLinear ||
+        bn.features() != weights_.dims_[0]) {
+        return false;
+    }
+
+    std::vector<float> scale;
+    std::vector<float> shift;
+    bn.GetAffine(&scale, &shift);
+
+    // Every kernel produces one output feature.
+    const size_t kernel_size = weights_.data_.size() / weights_.dims_[0];
+    for (size_t i = 0; i < weights_.data_.size(); i++) {
+        weights_.data_[i] *= scale[i / kernel_size];
+    }
+
+    for (int i = 0; i < biases_.dims_[0]; i++) {
+        biases_(i) = biases_(i) * scale[i] + shift[i];
+    }
+
+    return true;
+}
+
 bool KerasLayerFlatten::LoadLayer(std::ifstream* file) {
     KASSERT(file, "Invalid file stream");
     return true;
@@ -305,9 +426,12 @@ bool KerasLayerElu::Apply(Tensor* in, Tensor* out) {
 
     *out = *in;
 
+    // exp(x) - 1 for the negative values, then the scale by alpha.
+    xla::simd::ActivateAndScale(xla::ActivationFunction::kElu, 1.0f,
+                                out->data_.data(), out->data_.size());
     for (size_t i = 0; i < out->data_.size(); i++) {
-        if (out->data_[i] < 0.0) {
-            out->data_[i] = alpha_ * (exp(out->data_[i]) - 1.0f);
+        if (out->data_[i] < 0.0f) {
+            out->data_[i] *= alpha_;
         }
     }
 
@@ -648,6 +772,9 @@ bool KerasModel::LoadModel(const std::string& filename) {
         case kEmbedding:
             layer = new KerasLayerEmbedding();
             break;
+        case kBatchNormalization:
+            layer = new KerasLayerBatchNormalization();
+            break;
         default:
             break;
         }
@@ -685,3 +812,68 @@ bool KerasModel::Apply(Tensor* in, Tensor* out) {
 
     return true;
 }
+
+bool KerasModel::FoldBatchNormalization(const std::vector<int>& input_dims,
+                                        FoldReport* report) {
+    // Number of values reaching each layer, measured on a zero input.
+    std::vector<long long> input_sizes(layers_.size(), 0);
+    if (report) {
+        *report = FoldReport();
+
+        Tensor temp_in, temp_out;
+        temp_in.dims_ = input_dims;
+        temp_in.data_.resize(std::accumulate(input_dims.begin(),
+                                             input_dims.end(), 1,
+                                             std::multiplies<int>()));
+
+        for (unsigned int i = 0; i < layers_.size(); i++) {
+            input_sizes[i] = temp_in.data_.size();
+
+            KASSERT(layers_[i]->Apply(&temp_in, &temp_out),
+                    "Failed to apply layer %d", i);
+
+            temp_in = temp_out;
+        }
+    }
+
+    std::vector<KerasLayer*> layers;
+
+    for (unsigned int i = 0; i < layers_.size(); i++) {
+        KerasLayerBatchNormalization* bn =
+            dynamic_cast<KerasLayerBatchNormalization*>(layers_[i]);
+
+        // Folding into layers.back() rather than layers_[i - 1] also folds
+        // a chain of batch normalizations one after another.
+        bool folded = false;
+        if (bn && !layers.empty()) {
+            if (KerasLayerDense* dense =
+                    dynamic_cast<KerasLayerDense*>(layers.back())) {
+                folded = dense->FoldBatchNormalization(*bn);
+            } else if (KerasLayerConvolution2d* conv =
+                           dynamic_cast<KerasLayerConvolution2d*>(
+                               layers.back())) {
+                folded = conv->FoldBatchNormalization(*bn);
+            }
+        }
+
+        if (!folded) {
+            layers.push_back(layers_[i]);
+            continue;
+        }
+
+        if (report) {
+            // One multiply-add per value, which is read and written once,
+            // plus the four parameters of every feature.
+            report->layers_folded++;
+            report->flops_removed += 2 * input_sizes[i];
+            report->bytes_removed +=
+                (2 * input_sizes[i] + 4LL * bn->features()) * sizeof(float);
+        }
+
+        delete bn;
+    }
+
+    layers_.swap(layers);
+
+    return true;
+}
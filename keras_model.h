@@ -13,7 +13,10 @@
 #include <numeric>
 #include <string>
 #include <vector>
-#include <iterator>  // std::back_inserter
+
+#include "gemm.h"
+#include "simd_kernels.h"
+#include "sparse_matrix.h"
 
 #define KASSERT(x, ...)                                                        \
     if (!(x)) {                                                                \
@@ -160,11 +163,9 @@ class Tensor {
 
         Tensor result;
         result.dims_ = dims_;
-        result.data_.reserve(data_.size());
-
-        std::transform(data_.begin(), data_.end(), other.data_.begin(),
-                       std::back_inserter(result.data_),
-                       [](float x, float y) { return x + y; });
+        result.data_.resize(data_.size());
+        xla::simd::Add(data_.data(), other.data_.data(), result.data_.data(),
+                       data_.size());
 
         return result;
     }
@@ -175,11 +176,9 @@ class Tensor {
 
         Tensor result;
         result.dims_ = dims_;
-        result.data_.reserve(data_.size());
-
-        std::transform(data_.begin(), data_.end(), other.data_.begin(),
-                       std::back_inserter(result.data_),
-                       [](float x, float y) { return x * y; });
+        result.data_.resize(data_.size());
+        xla::simd::Multiply(data_.data(), other.data_.data(),
+                            result.data_.data(), data_.size());
 
         return result;
     }
@@ -192,13 +191,11 @@ class Tensor {
 
         Tensor tmp(dims_[0], other.dims_[1]);
 
-        for (int i = 0; i < dims_[0]; i++) {
-            for (int j = 0; j < other.dims_[1]; j++) {
-                for (int k = 0; k < dims_[1]; k++) {
-                    tmp(i, j) += (*this)(i, k) * other(k, j);
-                }
-            }
-        }
+        xla::gemm::Gemm<float>(xla::gemm::Transpose::kNoTranspose,
+                               xla::gemm::Transpose::kNoTranspose, dims_[0],
+                               other.dims_[1], dims_[1], 1.0f, data_.data(),
+                               dims_[1], other.data_.data(), other.dims_[1],
+                               0.0f, tmp.data_.data(), other.dims_[1]);
 
         return tmp;
     }
@@ -297,10 +294,38 @@ class KerasLayerActivation : public KerasLayer {
 
     virtual bool Apply(Tensor* in, Tensor* out);
 
+    ActivationType activation_type() const { return activation_type_; }
+
   private:
     ActivationType activation_type_;
 };
 
+// Batch normalization with the moving statistics collected in training, i.e.
+// a per-feature affine transform. Features are the first dimension of a
+// convolution output (features, rows, cols) and the last dimension otherwise.
+class KerasLayerBatchNormalization : public KerasLayer {
+  public:
+    KerasLayerBatchNormalization() : epsilon_(1e-3f) {}
+
+    virtual ~KerasLayerBatchNormalization() {}
+
+    virtual bool LoadLayer(std::ifstream* file);
+
+    virtual bool Apply(Tensor* in, Tensor* out);
+
+    // Collapses the layer into out = in * scale + shift for every feature.
+    void GetAffine(std::vector<float>* scale, std::vector<float>* shift) const;
+
+    int features() const { return gamma_.dims_[0]; }
+
+  private:
+    float epsilon_;
+    Tensor gamma_;
+    Tensor beta_;
+    Tensor moving_mean_;
+    Tensor moving_variance_;
+};
+
 class KerasLayerDense : public KerasLayer {
   public:
     KerasLayerDense() {}
@@ -311,9 +336,26 @@ class KerasLayerDense : public KerasLayer {
 
     virtual bool Apply(Tensor* in, Tensor* out);
 
+    // Rewrites the weights and biases so that Apply also computes bn. Returns
+    // false, leaving the layer untouched, if the activation is not linear or
+    // bn has a different number of features.
+    bool FoldBatchNormalization(const KerasLayerBatchNormalization& bn);
+
+    // Whether Apply runs on a compressed copy of the weights. Pruned layers
+    // with at most kMaxSparseDensity non-zero weights do, so their cost
+    // follows the number of non-zeros (and of non-zero inputs).
+    bool sparse() const { return sparse_weights_.rows > 0; }
+
+    static constexpr double kMaxSparseDensity = 0.3;
+
   private:
+    // Rebuilds sparse_weights_ from weights_, or clears it if the weights are
+    // too dense.
+    void UpdateSparseWeights();
+
     Tensor weights_;
     Tensor biases_;
+    xla::sparse::CsrMatrix sparse_weights_;
 
     KerasLayerActivation activation_;
 };
@@ -328,6 +370,9 @@ class KerasLayerConvolution2d : public KerasLayer {
 
     virtual bool Apply(Tensor* in, Tensor* out);
 
+    // See KerasLayerDense::FoldBatchNormalization.
+    bool FoldBatchNormalization(const KerasLayerBatchNormalization& bn);
+
   private:
     Tensor weights_;
     Tensor biases_;
@@ -432,7 +477,17 @@ class KerasModel {
         kActivation = 5,
         kMaxPooling2D = 6,
         kLSTM = 7,
-        kEmbedding = 8
+        kEmbedding = 8,
+        kBatchNormalization = 9
+    };
+
+    // Work removed from every Apply call by FoldBatchNormalization.
+    struct FoldReport {
+        FoldReport() : layers_folded(0), flops_removed(0), bytes_removed(0) {}
+
+        int layers_folded;
+        long long flops_removed;
+        long long bytes_removed;
     };
 
     KerasModel() {}
@@ -447,6 +502,15 @@ class KerasModel {
 
     virtual bool Apply(Tensor* in, Tensor* out);
 
+    // Inference-time graph rewrite, run once after LoadModel: every batch
+    // normalization that directly follows a dense or convolution layer with a
+    // linear activation is folded into that layer's weights and biases and
+    // removed from the model. If report is given, the model is first run on
+    // a zero input of input_dims to measure the tensors the removed layers
+    // would have read and written.
+    bool FoldBatchNormalization(const std::vector<int>& input_dims,
+                                FoldReport* report);
+
   private:
     std::vector<KerasLayer*> layers_;
 };
@@ -0,0 +1,87 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "kernel_registry.h"
+
+#include <atomic>
+
+#include "cpu_info.h"
+
+namespace xla {
+namespace {
+
+using tensorflow::port::TestCPUFeature;
+using tensorflow::port::CPUFeature;
+
+bool ProbeIsa(Isa isa) {
+  switch (isa) {
+    case Isa::kBaseline:
+      return true;
+    case Isa::kAvx2:
+      return TestCPUFeature(CPUFeature::AVX2) &&
+             TestCPUFeature(CPUFeature::FMA);
+    case Isa::kAvx512:
+      return TestCPUFeature(CPUFeature::AVX512F) &&
+             TestCPUFeature(CPUFeature::AVX512VL) &&
+             TestCPUFeature(CPUFeature::AVX512BW) &&
+             TestCPUFeature(CPUFeature::AVX512DQ);
+    case Isa::kNeon:
+      return TestCPUFeature(CPUFeature::NEON);
+  }
+  return false;
+}
+
+struct IsaTable {
+  IsaTable() {
+    for (int i = 0; i < kNumIsas; ++i) {
+      supported[i] = ProbeIsa(static_cast<Isa>(i));
+    }
+  }
+
+  bool supported[kNumIsas];
+};
+
+std::atomic<int> max_isa(kNumIsas - 1);
+
+}  // namespace
+
+const char* IsaName(Isa isa) {
+  switch (isa) {
+    case Isa::kBaseline:
+      return "baseline";
+    case Isa::kAvx2:
+      return "avx2";
+    case Isa::kAvx512:
+      return "avx512";
+    case Isa::kNeon:
+      return "neon";
+  }
+  return "unknown";
+}
+
+bool IsaSupported(Isa isa) {
+  static const IsaTable* table = new IsaTable;
+  return table->supported[static_cast<int>(isa)];
+}
+
+void SetMaxIsa(Isa isa) {
+  max_isa.store(static_cast<int>(isa), std::memory_order_relaxed);
+}
+
+Isa MaxIsa() {
+  return static_cast<Isa>(max_isa.load(std::memory_order_relaxed));
+}
+
+}  // namespace xla
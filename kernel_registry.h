@@ -0,0 +1,122 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_KERNEL_REGISTRY_H_
+#define TENSORFLOW_COMPILER_XLA_KERNEL_REGISTRY_H_
+
+// Runtime instruction set dispatch. Hot kernels are compiled several times,
+// each variant for one instruction set, and the best variant the host
+// supports is picked when the kernel runs, so a single binary built for the
+// baseline target still uses AVX2 or AVX-512 where they exist.
+
+#include "types.h"
+
+// XLA_TARGET_AVX2 and XLA_TARGET_AVX512 mark a function to be compiled for
+// that instruction set regardless of the target of the rest of the binary.
+// Inline callees are compiled for it too once inlined, so a variant is
+// usually a thin wrapper around an always-inline template; see gemm.cc.
+// XLA_HAS_TARGET_ATTRIBUTES is defined only where such variants can be
+// built.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define XLA_HAS_TARGET_ATTRIBUTES 1
+#define XLA_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define XLA_TARGET_AVX512 \
+  __attribute__((target("avx512f,avx512vl,avx512bw,avx512dq,avx2,fma")))
+#define XLA_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define XLA_ALWAYS_INLINE inline
+#endif
+
+namespace xla {
+
+// Instruction sets a kernel variant may be compiled for. Within one
+// architecture, later values are preferred.
+enum class Isa {
+  // The target the library is built for; always available.
+  kBaseline,
+  // AVX2 and FMA.
+  kAvx2,
+  // AVX-512 F, VL, BW and DQ.
+  kAvx512,
+  // Advanced SIMD on ARM.
+  kNeon,
+};
+
+constexpr int kNumIsas = 4;
+
+// Returns a short lowercase name for isa, e.g. "avx2".
+const char* IsaName(Isa isa);
+
+// Returns true if the host can run code compiled for isa. The CPU is probed
+// once.
+bool IsaSupported(Isa isa);
+
+// Caps the instruction sets that KernelRegistry::Get may pick, e.g. to
+// compare variants or to reproduce results of older hosts. The default is
+// no cap. Must not be called concurrently with running ops.
+void SetMaxIsa(Isa isa);
+
+// Returns the current cap.
+Isa MaxIsa();
+
+// The variants of one kernel, a function pointer type Fn. Registries are
+// meant to be function-local statics filled in once:
+//
+//   const KernelRegistry<AxpyFn>& AxpyKernels() {
+//     static const KernelRegistry<AxpyFn>* registry =
+//         &(new KernelRegistry<AxpyFn>(AxpyBaseline))
+//              ->Register(Isa::kAvx2, AxpyAvx2);
+//     return *registry;
+//   }
+//
+// after which AxpyKernels().Get() is a cheap lookup.
+template <typename Fn>
+class KernelRegistry {
+ public:
+  explicit KernelRegistry(Fn baseline) : variants_() {
+    variants_[static_cast<int>(Isa::kBaseline)] = baseline;
+  }
+
+  KernelRegistry& Register(Isa isa, Fn variant) {
+    variants_[static_cast<int>(isa)] = variant;
+    return *this;
+  }
+
+  // Returns the variant for the most preferred instruction set that is
+  // registered, supported by the host and not above max_isa.
+  Fn Select(Isa max_isa) const {
+    for (int i = static_cast<int>(max_isa); i > 0; --i) {
+      if (variants_[i] != nullptr && IsaSupported(static_cast<Isa>(i))) {
+        return variants_[i];
+      }
+    }
+    return variants_[0];
+  }
+
+  // Returns the variant for the host, within MaxIsa().
+  Fn Get() const { return Select(MaxIsa()); }
+
+  // Returns true if a variant is registered for isa.
+  bool Has(Isa isa) const {
+    return variants_[static_cast<int>(isa)] != nullptr;
+  }
+
+ private:
+  Fn variants_[kNumIsas];
+};
+
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_KERNEL_REGISTRY_H_
@@ -0,0 +1,128 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "kernel_registry.h"
+
+#include "cpu_info.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+using tensorflow::port::CPUFeature;
+using tensorflow::port::TestCPUFeature;
+
+class KernelRegistryTest /* : public ::testing::Test */
+{
+public:
+
+   KernelRegistryTest() { run(); }
+
+   void FeaturesAreConsistent();
+   void SelectsBestSupportedVariant();
+   void MaxIsaCapsSelection();
+   void FallsBackToBaseline();
+
+   void run();
+};
+
+using TagFn = int (*)();
+
+int BaselineTag() { return 0; }
+int Avx2Tag() { return 1; }
+int Avx512Tag() { return 2; }
+int NeonTag() { return 3; }
+
+KernelRegistry<TagFn> AllVariants()
+{
+   KernelRegistry<TagFn> registry(BaselineTag);
+   registry.Register(Isa::kAvx2, Avx2Tag)
+       .Register(Isa::kAvx512, Avx512Tag)
+       .Register(Isa::kNeon, NeonTag);
+   return registry;
+}
+
+void KernelRegistryTest::FeaturesAreConsistent()
+{
+   // Every extension implies the ones it is built on.
+   if (TestCPUFeature(CPUFeature::AVX2)) {
+      ASSERT_TRUE(TestCPUFeature(CPUFeature::AVX));
+   }
+   if (TestCPUFeature(CPUFeature::AVX)) {
+      ASSERT_TRUE(TestCPUFeature(CPUFeature::SSE4_2));
+   }
+   if (TestCPUFeature(CPUFeature::AVX512VL)) {
+      ASSERT_TRUE(TestCPUFeature(CPUFeature::AVX512F));
+   }
+   if (IsaSupported(Isa::kAvx512)) {
+      ASSERT_TRUE(IsaSupported(Isa::kAvx2));
+   }
+   ASSERT_TRUE(IsaSupported(Isa::kBaseline));
+   ASSERT_TRUE(!(IsaSupported(Isa::kAvx2) && IsaSupported(Isa::kNeon)));
+   if (IsaSupported(Isa::kAvx2)) {
+      ASSERT_TRUE(!tensorflow::port::CPUVendorIDString().empty());
+   }
+}
+
+void KernelRegistryTest::SelectsBestSupportedVariant()
+{
+   const KernelRegistry<TagFn> registry = AllVariants();
+   int expected = 0;
+   for (int i = 1; i < kNumIsas; ++i) {
+      if (IsaSupported(static_cast<Isa>(i))) {
+         expected = i;
+      }
+   }
+   ASSERT_EQ(registry.Select(Isa::kNeon)(), expected);
+   ASSERT_EQ(registry.Get()(), expected);
+}
+
+void KernelRegistryTest::MaxIsaCapsSelection()
+{
+   const KernelRegistry<TagFn> registry = AllVariants();
+   const int avx2_or_baseline = IsaSupported(Isa::kAvx2) ? 1 : 0;
+   ASSERT_EQ(registry.Select(Isa::kBaseline)(), 0);
+   ASSERT_EQ(registry.Select(Isa::kAvx2)(), avx2_or_baseline);
+
+   SetMaxIsa(Isa::kBaseline);
+   ASSERT_TRUE(MaxIsa() == Isa::kBaseline);
+   ASSERT_EQ(registry.Get()(), 0);
+   SetMaxIsa(Isa::kNeon);
+}
+
+void KernelRegistryTest::FallsBackToBaseline()
+{
+   // Without an AVX-512 variant an AVX-512 host uses the AVX2 one.
+   KernelRegistry<TagFn> registry(BaselineTag);
+   registry.Register(Isa::kAvx2, Avx2Tag);
+   ASSERT_TRUE(registry.Has(Isa::kAvx2));
+   ASSERT_TRUE(!registry.Has(Isa::kAvx512));
+   const int avx2_or_baseline = IsaSupported(Isa::kAvx2) ? 1 : 0;
+   ASSERT_EQ(registry.Select(Isa::kAvx512)(), avx2_or_baseline);
+
+   const KernelRegistry<TagFn> baseline_only(BaselineTag);
+   ASSERT_EQ(baseline_only.Get()(), 0);
+}
+
+void KernelRegistryTest::run()
+{
+   FeaturesAreConsistent();
+   SelectsBestSupportedVariant();
+   MaxIsaCapsSelection();
+   FallsBackToBaseline();
+}
+
+}  // namespace
+}  // namespace xla
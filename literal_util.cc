@@ -21,7 +21,9 @@ limitations under the License.
 #include <vector>
 
 #include "index_util.h"
+#include "layout_util.h"
 #include "shape_util.h"
+#include "transpose.h"
 #include "types.h"
 #include "util.h"
 #include "errors.h"
@@ -59,7 +61,9 @@ namespace xla {
     case U16:
       LOG(FATAL) << "u16/s16 literals not yet implemented";
     case F16:
-      LOG(FATAL) << "f16 literals not yet implemented";
+      return *LiteralUtil::CreateR0<half>(half(0.0f));
+    case BF16:
+      return *LiteralUtil::CreateR0<bfloat16>(bfloat16(0.0f));
     case TUPLE:
       LOG(FATAL) << "tuple element type cannot take on value of 0";
     case OPAQUE:
@@ -96,7 +100,9 @@ namespace xla {
     case U16:
       LOG(FATAL) << "u16/s16 literals not yet implemented";
     case F16:
-      LOG(FATAL) << "f16 literals not yet implemented";
+      return *LiteralUtil::CreateR0<half>(half(1.0f));
+    case BF16:
+      return *LiteralUtil::CreateR0<bfloat16>(bfloat16(1.0f));
     case TUPLE:
       LOG(FATAL) << "tuple element type cannot take on value of 1";
     case OPAQUE:
@@ -135,7 +141,11 @@ namespace xla {
     case U16:
       LOG(FATAL) << "u16/s16 literals not yet implemented";
     case F16:
-      LOG(FATAL) << "f16 literals not yet implemented";
+      return *LiteralUtil::CreateR0<half>(
+          half(-std::numeric_limits<float>::infinity()));
+    case BF16:
+      return *LiteralUtil::CreateR0<bfloat16>(
+          bfloat16(-std::numeric_limits<float>::infinity()));
     case TUPLE:
       LOG(FATAL) << "tuple element type has no minimum value";
     case OPAQUE:
@@ -174,7 +184,11 @@ namespace xla {
     case U16:
       LOG(FATAL) << "u16/s16 literals not yet implemented";
     case F16:
-      LOG(FATAL) << "f16 literals not yet implemented";
+      return *LiteralUtil::CreateR0<half>(
+          half(std::numeric_limits<float>::infinity()));
+    case BF16:
+      return *LiteralUtil::CreateR0<bfloat16>(
+          bfloat16(std::numeric_limits<float>::infinity()));
     case TUPLE:
       LOG(FATAL) << "tuple element type has no maximum value";
     case OPAQUE:
@@ -296,26 +310,41 @@ namespace xla {
   }
   const auto result_shape = ShapeUtil::MakeShape(
       original.shape().element_type(), new_dimension_sizes);
-  std::unique_ptr<Literal> result = CloneToUnique(original);
+  auto result = MakeUnique<Literal>();
   *result->mutable_shape() = result_shape;
-  const PrimitiveType primitive_type = original.shape().element_type();
-  std::vector<int64> new_indices(ShapeUtil::Rank(original.shape()));
-  switch (primitive_type) {
-    case F32:
-      LiteralUtil::EachCell<float>(
-          original,
-          [&](tensorflow::gtl::ArraySlice<int64> indices, float value) {
-            for (size_t i = 0; i < permutation.size(); ++i) {
-              new_indices[i] = indices[permutation[i]];
-            }
-            LiteralUtil::Set<float>(result.get(), new_indices, value);
-          });
-      return result;
-    default:
-       LOG(FATAL) << "not yet implemented: ";
-                 //<< PrimitiveType_Name(primitive_type);
-       return result; // line fix warning build
+  const int64 num_elements = ShapeUtil::ElementsIn(result_shape);
+  Reserve(num_elements, result.get());
+  if (num_elements == 0) {
+    return result;
+  }
+
+  // The result has the default layout. The original is permuted from its
+  // physical (layout) order: physical dimension q is logical dimension
+  // Major(layout, q), so result dimension i is physical dimension
+  // physical[permutation[i]].
+  const Layout layout = LayoutUtil::HasLayout(original.shape())
+                            ? original.shape().layout()
+                            : LayoutUtil::GetDefaultLayoutForShape(
+                                  original.shape());
+  const int64 rank = ShapeUtil::Rank(original.shape());
+  std::vector<int64> physical_dimensions(rank);
+  std::vector<int64> physical(rank);
+  for (int64 q = 0; q < rank; ++q) {
+    const int64 logical = LayoutUtil::Major(layout, q);
+    physical_dimensions[q] =
+        original.shape().dimensions(static_cast<int>(logical));
+    physical[logical] = q;
+  }
+  std::vector<int64> physical_permutation(rank);
+  for (int64 i = 0; i < rank; ++i) {
+    physical_permutation[i] = physical[permutation[i]];
   }
+  TransposeDimensions(
+      InternalData(original),
+      ShapeUtil::ByteSizeOfPrimitiveType(original.shape().element_type()),
+      physical_dimensions, physical_permutation,
+      MutableInternalData(result.get()));
+  return result;
 }
 
 /* static */ std::unique_ptr<Literal> LiteralUtil::Slice(
@@ -409,6 +438,12 @@ namespace xla {
       return tensorflow::strings::StrCat(Get<uint32>(literal, multi_index));
     case U64:
       return tensorflow::strings::StrCat(Get<uint64>(literal, multi_index));
+    case F16:
+      return tensorflow::strings::StrCat(
+          static_cast<float>(Get<half>(literal, multi_index)));
+    case BF16:
+      return tensorflow::strings::StrCat(
+          static_cast<float>(Get<bfloat16>(literal, multi_index)));
     case F32:
     //  //return tensorflow::strings::StrCat(Get<float>(literal, multi_index));
     //   // overhead float->double
@@ -559,6 +594,8 @@ namespace xla {
     case PRED:
       return reinterpret_cast<const void*>(literal.preds().data());
     case U8:
+    case F16:
+    case BF16:
       return reinterpret_cast<const void*>(literal.u8s().data());
     case S32:
       return reinterpret_cast<const void*>(literal.s32s().data());
@@ -600,6 +637,10 @@ namespace xla {
       // access methods are somewhat different from the others.
       literal->mutable_u8s()->resize(num_elements, 0);
       break;
+    case F16:
+    case BF16:
+      literal->mutable_u8s()->resize(num_elements * 2, 0);
+      break;
     case S32:
       GetMutableRepeatedField<int32>(literal)->Resize(num, 
          /*value=*/0);
@@ -644,6 +685,10 @@ namespace xla {
     case U8:
       actual = literal.u8s().size();
       break;
+    case F16:
+    case BF16:
+      actual = literal.u8s().size() / 2;
+      break;
     case S32:
       actual = literal.s32s_size();
       break;
@@ -780,6 +825,10 @@ bool EqualElements(const Literal& literal1, const Literal& literal2,
         return EqualElements<uint32>(literal1, literal2, 0, &multi_index);
       case U64:
         return EqualElements<uint64>(literal1, literal2, 0, &multi_index);
+      case F16:
+        return EqualElements<half>(literal1, literal2, 0, &multi_index);
+      case BF16:
+        return EqualElements<bfloat16>(literal1, literal2, 0, &multi_index);
       case F32:
         return EqualElements<float>(literal1, literal2, 0, &multi_index);
       case F64:
@@ -893,6 +942,24 @@ LiteralUtil::GetMutableRepeatedField<double>(Literal* literal) {
   return literal->mutable_f64s();
 }
 
+template <>
+/* static */ tensorflow::gtl::ArraySlice<half>
+LiteralUtil::GetArraySlice<half>(const Literal& literal) {
+  CHECK(literal.shape().element_type() == F16);
+  return tensorflow::gtl::ArraySlice<half>(
+      reinterpret_cast<const half*>(literal.u8s().data()),
+      literal.u8s().size() / sizeof(half));
+}
+
+template <>
+/* static */ tensorflow::gtl::ArraySlice<bfloat16>
+LiteralUtil::GetArraySlice<bfloat16>(const Literal& literal) {
+  CHECK(literal.shape().element_type() == BF16);
+  return tensorflow::gtl::ArraySlice<bfloat16>(
+      reinterpret_cast<const bfloat16*>(literal.u8s().data()),
+      literal.u8s().size() / sizeof(bfloat16));
+}
+
 template <typename NativeT>
 static bool AllElementsEqualValue(const Literal& literal, NativeT value) {
   for (int64 i = 0; i < ShapeUtil::ElementsIn(literal.shape()); ++i) {
@@ -928,6 +995,11 @@ static bool AllElementsEqualValue(const Literal& literal, NativeT value) {
       return AllElementsEqualValue<int32>(literal, value);
     case S64:
       return AllElementsEqualValue<int64>(literal, value);
+    case F16:
+      return AllElementsEqualValue<half>(literal, static_cast<half>(value));
+    case BF16:
+      return AllElementsEqualValue<bfloat16>(literal,
+                                             static_cast<bfloat16>(value));
     case F32:
       return AllElementsEqualValue<float>(literal, value);
     case F64:
@@ -947,6 +1019,10 @@ static bool AllElementsEqualValue(const Literal& literal, NativeT value) {
 
 /* static */ bool LiteralUtil::IsAllFloat(const Literal& literal, float value) {
   switch (literal.shape().element_type()) {
+    case F16:
+      return AllElementsEqualValue<half>(literal, half(value));
+    case BF16:
+      return AllElementsEqualValue<bfloat16>(literal, bfloat16(value));
     case F32:
       return AllElementsEqualValue<float>(literal, value);
     case F64:
@@ -971,6 +1047,10 @@ static bool AllElementsEqualValue(const Literal& literal, NativeT value) {
       return Get<int32>(literal, indices) == 0;
     case S64:
       return Get<int64>(literal, indices) == 0;
+    case F16:
+      return Get<half>(literal, indices) == 0.0f;
+    case BF16:
+      return Get<bfloat16>(literal, indices) == 0.0f;
     case F32:
       return Get<float>(literal, indices) == 0.0f;
     case F64:
@@ -1033,4 +1113,123 @@ void LiteralUtil::Resize(int64 num_elements, uint64 value, Literal* literal)
   repeated_field->Resize(static_cast<int>(num_elements), value);
 }
 
+namespace {
+
+// The elements of an F16 or BF16 literal, whose u8s bytes must already be
+// sized for them.
+template <typename NativeT>
+NativeT* MutableSixteenBitData(Literal* literal) {
+  return reinterpret_cast<NativeT*>(&(*literal->mutable_u8s())[0]);
+}
+
+template <typename NativeT>
+void PopulateSixteenBitWithValue(NativeT value,
+                                 tensorflow::gtl::ArraySlice<int64> dimensions,
+                                 Literal* literal) {
+  *literal->mutable_shape() = ShapeUtil::MakeShape(
+      primitive_util::NativeToPrimitiveType<NativeT>(), dimensions);
+  const int64 num_elements = ShapeUtil::ElementsIn(literal->shape());
+  LiteralUtil::Reserve(num_elements, literal);
+  if (num_elements > 0) {
+    NativeT* data = MutableSixteenBitData<NativeT>(literal);
+    std::fill(data, data + num_elements, value);
+  }
+}
+
+// Converts between F32 and F16 or BF16 literals of the same shape; values are
+// the elements of literal. The layout is kept, so the elements stay in the
+// same order.
+template <typename NativeDestT>
+std::unique_ptr<Literal> ConvertFromF32(const Literal& literal,
+                                        const float* values) {
+  auto result = MakeUnique<Literal>();
+  *result->mutable_shape() = literal.shape();
+  result->mutable_shape()->set_element_type(
+      primitive_util::NativeToPrimitiveType<NativeDestT>());
+  const int64 num_elements = ShapeUtil::ElementsIn(literal.shape());
+  LiteralUtil::Reserve(num_elements, result.get());
+  if (num_elements > 0) {
+    ConvertFromFloat(values, MutableSixteenBitData<NativeDestT>(result.get()),
+                     num_elements);
+  }
+  return result;
+}
+
+template <typename NativeSrcT>
+std::unique_ptr<Literal> ConvertToF32(const Literal& literal,
+                                      const NativeSrcT* values) {
+  auto result = MakeUnique<Literal>();
+  *result->mutable_shape() = literal.shape();
+  result->mutable_shape()->set_element_type(F32);
+  const int64 num_elements = ShapeUtil::ElementsIn(literal.shape());
+  LiteralUtil::Reserve(num_elements, result.get());
+  if (num_elements > 0) {
+    ConvertToFloat(values, result->mutable_f32s()->mutable_data(),
+                   num_elements);
+  }
+  return result;
+}
+
+}  // namespace
+
+template <>
+/* static */ void LiteralUtil::PopulateWithValue(
+    half value, tensorflow::gtl::ArraySlice<int64> dimensions,
+    Literal* literal) {
+  PopulateSixteenBitWithValue(value, dimensions, literal);
+}
+
+template <>
+/* static */ void LiteralUtil::PopulateWithValue(
+    bfloat16 value, tensorflow::gtl::ArraySlice<int64> dimensions,
+    Literal* literal) {
+  PopulateSixteenBitWithValue(value, dimensions, literal);
+}
+
+template <> /* static */
+void LiteralUtil::Resize(int64 num_elements, half value, Literal* literal)
+{
+  CHECK(literal->shape().element_type() == F16);
+  CHECK_EQ(ShapeUtil::ElementsIn(literal->shape()), num_elements);
+  literal->mutable_u8s()->resize(num_elements * sizeof(half));
+  std::fill(MutableSixteenBitData<half>(literal),
+            MutableSixteenBitData<half>(literal) + num_elements, value);
+}
+
+template <> /* static */
+void LiteralUtil::Resize(int64 num_elements, bfloat16 value, Literal* literal)
+{
+  CHECK(literal->shape().element_type() == BF16);
+  CHECK_EQ(ShapeUtil::ElementsIn(literal->shape()), num_elements);
+  literal->mutable_u8s()->resize(num_elements * sizeof(bfloat16));
+  std::fill(MutableSixteenBitData<bfloat16>(literal),
+            MutableSixteenBitData<bfloat16>(literal) + num_elements, value);
+}
+
+template <>
+/* static */ std::unique_ptr<Literal> LiteralUtil::Convert<float, half>(
+    const Literal& literal) {
+  return ConvertFromF32<half>(literal,
+                              GetArraySlice<float>(literal).data());
+}
+
+template <>
+/* static */ std::unique_ptr<Literal> LiteralUtil::Convert<half, float>(
+    const Literal& literal) {
+  return ConvertToF32(literal, GetArraySlice<half>(literal).data());
+}
+
+template <>
+/* static */ std::unique_ptr<Literal> LiteralUtil::Convert<float, bfloat16>(
+    const Literal& literal) {
+  return ConvertFromF32<bfloat16>(literal,
+                                  GetArraySlice<float>(literal).data());
+}
+
+template <>
+/* static */ std::unique_ptr<Literal> LiteralUtil::Convert<bfloat16, float>(
+    const Literal& literal) {
+  return ConvertToF32(literal, GetArraySlice<bfloat16>(literal).data());
+}
+
 }  // namespace xla
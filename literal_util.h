@@ -18,6 +18,7 @@ limitations under the License.
 #ifndef TENSORFLOW_COMPILER_XLA_LITERAL_UTIL_H_
 #define TENSORFLOW_COMPILER_XLA_LITERAL_UTIL_H_
 
+#include <cstring>
 #include <functional>
 #include <initializer_list>
 #include <memory>
@@ -28,6 +29,7 @@ limitations under the License.
 #include "array2d.h"
 #include "array3d.h"
 #include "array4d.h"
+#include "half.h"
 #include "index_util.h"
 #include "layout_util.h"
 #include "primitive_util.h"
@@ -71,7 +73,9 @@ namespace xla {
 // templated by native (host) type which corresponds to a unique XLA
 // PrimitiveType. See ComputationBuilder for details.  Not all primitive types
 // defined in xla_data.proto have a corresponding native type or even have a
-// storage location in the Literal proto yet (for example, primitive type F16).
+// storage location in the Literal proto yet (for example, primitive type U16).
+// F16 and BF16 literals, whose native types are in half.h, keep the bit
+// patterns of their elements in the u8s bytes, two bytes per element.
 class LiteralUtil {
  public:
   // Create new literal of a given rank. To minimize ambiguity (for users and
@@ -163,7 +167,8 @@ class LiteralUtil {
   static std::unique_ptr<Literal> Replicate(const Literal& input, int64 times);
 
   // Create a literal by converting each element in an original literal to a new
-  // type.
+  // type. Conversions between float and half or bfloat16 run on the bulk
+  // converters of half.h.
   template <typename NativeSrcT, typename NativeDestT>
   static std::unique_ptr<Literal> Convert(const Literal& literal);
 
@@ -483,6 +488,16 @@ template <>
 /* static */ tensorflow::protobuf::RepeatedField<double>*
 LiteralUtil::GetMutableRepeatedField<double>(Literal* literal);
 
+// F16 and BF16 elements live in the u8s bytes, so they have an ArraySlice
+// view but no repeated field.
+template <>
+/* static */ tensorflow::gtl::ArraySlice<half>
+LiteralUtil::GetArraySlice<half>(const Literal& literal);
+
+template <>
+/* static */ tensorflow::gtl::ArraySlice<bfloat16>
+LiteralUtil::GetArraySlice<bfloat16>(const Literal& literal);
+
 template <typename NativeT>
 /* static */ std::unique_ptr<Literal> LiteralUtil::CreateR0(NativeT value) {
   auto literal = MakeUnique<Literal>();
@@ -735,6 +750,26 @@ template <>
   return Set<uint8>(literal, multi_index, value);
 }
 
+template <>
+/* static */ inline void LiteralUtil::Set(
+    Literal* literal, tensorflow::gtl::ArraySlice<int64> multi_index,
+    half value) {
+  CHECK(literal->shape().element_type() == F16);
+  int64 linear_index = LinearIndex(*literal, multi_index);
+  std::memcpy(&(*literal->mutable_u8s())[linear_index * sizeof(half)],
+              &value.bits, sizeof(half));
+}
+
+template <>
+/* static */ inline void LiteralUtil::Set(
+    Literal* literal, tensorflow::gtl::ArraySlice<int64> multi_index,
+    bfloat16 value) {
+  CHECK(literal->shape().element_type() == BF16);
+  int64 linear_index = LinearIndex(*literal, multi_index);
+  std::memcpy(&(*literal->mutable_u8s())[linear_index * sizeof(bfloat16)],
+              &value.bits, sizeof(bfloat16));
+}
+
 template <>
 /* static */ inline void LiteralUtil::Set(
     Literal* literal, tensorflow::gtl::ArraySlice<int64> multi_index,
@@ -801,6 +836,24 @@ template <>
   literal->mutable_u8s()->push_back(value);
 }
 
+template <>
+/* static */ inline void LiteralUtil::PopulateR0<half>(half value,
+                                                       Literal* literal) {
+  *literal->mutable_shape() =
+      ShapeUtil::MakeShape(primitive_util::NativeToPrimitiveType<half>(), {});
+  literal->mutable_u8s()->append(reinterpret_cast<const char*>(&value.bits),
+                                 sizeof(half));
+}
+
+template <>
+/* static */ inline void LiteralUtil::PopulateR0<bfloat16>(bfloat16 value,
+                                                           Literal* literal) {
+  *literal->mutable_shape() = ShapeUtil::MakeShape(
+      primitive_util::NativeToPrimitiveType<bfloat16>(), {});
+  literal->mutable_u8s()->append(reinterpret_cast<const char*>(&value.bits),
+                                 sizeof(bfloat16));
+}
+
 template <>
 /* static */ inline void LiteralUtil::PopulateR0<uint64>(uint64 value,
                                                          Literal* literal) {
@@ -986,6 +1039,16 @@ template <>
     uint64 value, tensorflow::gtl::ArraySlice<int64> dimensions,
     Literal* literal);
 
+template <>
+/* static */ void LiteralUtil::PopulateWithValue(
+    half value, tensorflow::gtl::ArraySlice<int64> dimensions,
+    Literal* literal);
+
+template <>
+/* static */ void LiteralUtil::PopulateWithValue(
+    bfloat16 value, tensorflow::gtl::ArraySlice<int64> dimensions,
+    Literal* literal);
+
 template <typename NativeSrcT, typename NativeDestT>
 /* static */ std::unique_ptr<Literal> LiteralUtil::Convert(
     const Literal& literal) {
@@ -1005,6 +1068,22 @@ template <typename NativeSrcT, typename NativeDestT>
   return result_literal;
 }
 
+template <>
+/* static */ std::unique_ptr<Literal> LiteralUtil::Convert<float, half>(
+    const Literal& literal);
+
+template <>
+/* static */ std::unique_ptr<Literal> LiteralUtil::Convert<half, float>(
+    const Literal& literal);
+
+template <>
+/* static */ std::unique_ptr<Literal> LiteralUtil::Convert<float, bfloat16>(
+    const Literal& literal);
+
+template <>
+/* static */ std::unique_ptr<Literal> LiteralUtil::Convert<bfloat16, float>(
+    const Literal& literal);
+
 template <typename NativeT>
 /* static */ void LiteralUtil::Resize(int64 num_elements, NativeT value,
                                       Literal* literal) {
@@ -1022,6 +1101,14 @@ template <>
 /* static */ void LiteralUtil::Resize(int64 num_elements, uint64 value,
                                       Literal* literal);
 
+template <>
+/* static */ void LiteralUtil::Resize(int64 num_elements, half value,
+                                      Literal* literal);
+
+template <>
+/* static */ void LiteralUtil::Resize(int64 num_elements, bfloat16 value,
+                                      Literal* literal);
+
 template <typename NativeT>
 /* static */ std::unique_ptr<Literal>
 LiteralUtil::CreateFullWithMonotonicDim0MajorLayout(
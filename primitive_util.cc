@@ -68,6 +68,16 @@ PrimitiveType NativeToPrimitiveType<int64>() {
 }
 
 // Floating point
+template <>
+PrimitiveType NativeToPrimitiveType<half>() {
+  return F16;
+}
+
+template <>
+PrimitiveType NativeToPrimitiveType<bfloat16>() {
+  return BF16;
+}
+
 template <>
 PrimitiveType NativeToPrimitiveType<float>() {
   return F32;
@@ -79,7 +89,7 @@ PrimitiveType NativeToPrimitiveType<double>() {
 }
 
 bool IsFloatingPointType(PrimitiveType type) {
-  return type == F16 || type == F32 || type == F64;
+  return type == F16 || type == BF16 || type == F32 || type == F64;
 }
 
 bool IsSignedIntegralType(PrimitiveType type) {
@@ -106,6 +116,7 @@ int BitWidth(PrimitiveType type) {
     case S16:
     case U16:
     case F16:
+    case BF16:
       return 16;
 
     case U32:
@@ -20,6 +20,7 @@ limitations under the License.
 
 #include <type_traits>
 
+#include "half.h"
 #include "types.h"
 #include "xla_data.pb.h"
 
@@ -72,6 +73,10 @@ PrimitiveType NativeToPrimitiveType<int64>();
 
 // Floating point
 template <>
+PrimitiveType NativeToPrimitiveType<half>();
+template <>
+PrimitiveType NativeToPrimitiveType<bfloat16>();
+template <>
 PrimitiveType NativeToPrimitiveType<float>();
 template <>
 PrimitiveType NativeToPrimitiveType<double>();
@@ -143,6 +148,14 @@ struct PrimitiveTypeToNative<S64> {
 
 // Floating point
 template <>
+struct PrimitiveTypeToNative<F16> {
+  using type = half;
+};
+template <>
+struct PrimitiveTypeToNative<BF16> {
+  using type = bfloat16;
+};
+template <>
 struct PrimitiveTypeToNative<F32> {
   using type = float;
 };
@@ -0,0 +1,421 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "qgemm.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "cpu_info.h"
+#include "intra_op_thread_pool.h"
+#include "kernel_registry.h"
+#include "logging.h"
+#include "simd_kernels.h"
+
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+#include <immintrin.h>
+#define XLA_TARGET_AVX512_VNNI                                        \
+  __attribute__((target("avx512f,avx512vl,avx512bw,avx512dq,avx512vnni," \
+                        "avx2,fma")))
+#endif
+
+// The accumulators of the intrinsic micro-kernels only stay in registers if
+// the loop over the rows of the tile is unrolled, which GCC does not do on
+// its own at -O2.
+#if defined(__GNUC__) && !defined(__clang__)
+#define XLA_UNROLL _Pragma("GCC unroll 8")
+#else
+#define XLA_UNROLL
+#endif
+
+namespace xla {
+namespace quant {
+namespace {
+
+// The packed operands interleave groups of four consecutive k values, the
+// unit of the 8-bit dot product instructions:
+//
+//   A panel (mr rows):    [k / 4][mr][4] int8
+//   B panel (nr columns): [k / 4][nr][4] uint8
+//
+// k is zero-padded to a multiple of four, and panels to mr rows or nr
+// columns. The micro-kernel adds the four products of every group into one
+// int32 accumulator. Zero points are not applied while packing: padding the
+// raw values with zero adds nothing to the raw products or to the row and
+// column sums the corrections are computed from.
+constexpr int64 kGroup = 4;
+
+// Largest register tile of any variant.
+constexpr int64 kMaxMr = 8;
+constexpr int64 kMaxNr = 32;
+
+// Rows and columns of C computed by one task, and columns of B packed at a
+// time. k is not blocked: even at kMaxGemmDepth a packed A panel is 64KB.
+constexpr int64 kTileRows = 96;
+constexpr int64 kTileCols = 256;
+constexpr int64 kNc = 1024;
+
+// Computes the mr x nr tile of raw int32 dot products of a packed A panel and
+// a packed B panel over k4 groups, stored row-major with row stride nr.
+using MicroKernelFn = void (*)(int64 k4, const int8* a, const uint8* b,
+                               int32* acc);
+
+struct MicroKernel {
+  int64 mr;
+  int64 nr;
+  MicroKernelFn fn;
+};
+
+template <int MR, int NR>
+XLA_ALWAYS_INLINE void GenericMicroKernel(int64 k4, const int8* __restrict a,
+                                          const uint8* __restrict b,
+                                          int32* acc) {
+  int32 sums[MR][NR] = {};
+  for (int64 p = 0; p < k4; ++p) {
+    for (int i = 0; i < MR; ++i) {
+      for (int j = 0; j < NR; ++j) {
+        int32 dot = 0;
+        for (int t = 0; t < kGroup; ++t) {
+          dot += static_cast<int32>(a[i * kGroup + t]) * b[j * kGroup + t];
+        }
+        sums[i][j] += dot;
+      }
+    }
+    a += MR * kGroup;
+    b += NR * kGroup;
+  }
+  for (int i = 0; i < MR; ++i) {
+    std::copy(sums[i], sums[i] + NR, acc + i * NR);
+  }
+}
+
+void MicroKernelBaseline(int64 k4, const int8* a, const uint8* b,
+                         int32* acc) {
+  GenericMicroKernel<4, 8>(k4, a, b, acc);
+}
+
+const MicroKernel kBaselineKernel = {4, 8, MicroKernelBaseline};
+
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+// AVX2 has no unsigned-by-signed byte product that cannot saturate
+// (vpmaddubsw sums two products into 16 bits), so both operands are widened
+// to 16 bits and multiplied with vpmaddwd. Each 8 x 4 byte group of B becomes
+// two vectors of four columns; the pairs of partial sums they produce are
+// folded together once at the end. A is widened in chunks into a local
+// buffer, so each 4-value group can be broadcast with a single load.
+constexpr int kAvx2Mr = 4;
+constexpr int kAvx2Nr = 8;
+constexpr int64 kAvx2Chunk = 64;
+
+XLA_TARGET_AVX2 void MicroKernelAvx2(int64 k4, const int8* a, const uint8* b,
+                                     int32* acc) {
+  alignas(32) int16 wide_a[kAvx2Chunk * kAvx2Mr * kGroup];
+  __m256i sums[kAvx2Mr][2];
+  for (int i = 0; i < kAvx2Mr; ++i) {
+    sums[i][0] = _mm256_setzero_si256();
+    sums[i][1] = _mm256_setzero_si256();
+  }
+  for (int64 p0 = 0; p0 < k4; p0 += kAvx2Chunk) {
+    const int64 groups = std::min(kAvx2Chunk, k4 - p0);
+    const int64 bytes = groups * kAvx2Mr * kGroup;
+    int64 x = 0;
+    for (; x + 16 <= bytes; x += 16) {
+      _mm256_store_si256(
+          reinterpret_cast<__m256i*>(wide_a + x),
+          _mm256_cvtepi8_epi16(
+              _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x))));
+    }
+    for (; x < bytes; ++x) {
+      wide_a[x] = a[x];
+    }
+    for (int64 p = 0; p < groups; ++p) {
+      const __m256i b_low = _mm256_cvtepu8_epi16(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(b)));
+      const __m256i b_high = _mm256_cvtepu8_epi16(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 16)));
+      const int16* group = wide_a + p * kAvx2Mr * kGroup;
+      XLA_UNROLL
+      for (int i = 0; i < kAvx2Mr; ++i) {
+        int64 a_group;
+        std::memcpy(&a_group, group + i * kGroup, sizeof(a_group));
+        const __m256i a_value = _mm256_set1_epi64x(a_group);
+        sums[i][0] =
+            _mm256_add_epi32(sums[i][0], _mm256_madd_epi16(b_low, a_value));
+        sums[i][1] =
+            _mm256_add_epi32(sums[i][1], _mm256_madd_epi16(b_high, a_value));
+      }
+      b += kAvx2Nr * kGroup;
+    }
+    a += bytes;
+  }
+  // sums[i][0] holds the two partial sums of columns 0, 1 | 2, 3 and
+  // sums[i][1] those of columns 4, 5 | 6, 7; hadd yields 0 1 4 5 | 2 3 6 7.
+  for (int i = 0; i < kAvx2Mr; ++i) {
+    const __m256i row = _mm256_permute4x64_epi64(
+        _mm256_hadd_epi32(sums[i][0], sums[i][1]), 0xD8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i * kAvx2Nr), row);
+  }
+}
+
+const MicroKernel kAvx2Kernel = {kAvx2Mr, kAvx2Nr, MicroKernelAvx2};
+
+// AVX-512 VNNI multiplies unsigned by signed bytes and adds each group of
+// four products straight into an int32 lane (vpdpbusd): one instruction per
+// 16 columns of a row, four times the multiply-adds of a float FMA.
+constexpr int kVnniMr = 8;
+constexpr int kVnniNr = 32;
+
+XLA_TARGET_AVX512_VNNI void MicroKernelAvx512Vnni(int64 k4, const int8* a,
+                                                  const uint8* b,
+                                                  int32* acc) {
+  __m512i sums[kVnniMr][2];
+  for (int i = 0; i < kVnniMr; ++i) {
+    sums[i][0] = _mm512_setzero_si512();
+    sums[i][1] = _mm512_setzero_si512();
+  }
+  for (int64 p = 0; p < k4; ++p) {
+    const __m512i b_low = _mm512_loadu_si512(b);
+    const __m512i b_high = _mm512_loadu_si512(b + 64);
+    XLA_UNROLL
+    for (int i = 0; i < kVnniMr; ++i) {
+      int32 a_group;
+      std::memcpy(&a_group, a + i * kGroup, sizeof(a_group));
+      const __m512i a_value = _mm512_set1_epi32(a_group);
+      sums[i][0] = _mm512_dpbusd_epi32(sums[i][0], b_low, a_value);
+      sums[i][1] = _mm512_dpbusd_epi32(sums[i][1], b_high, a_value);
+    }
+    a += kVnniMr * kGroup;
+    b += kVnniNr * kGroup;
+  }
+  for (int i = 0; i < kVnniMr; ++i) {
+    _mm512_storeu_si512(acc + i * kVnniNr, sums[i][0]);
+    _mm512_storeu_si512(acc + i * kVnniNr + 16, sums[i][1]);
+  }
+}
+
+const MicroKernel kAvx512VnniKernel = {kVnniMr, kVnniNr,
+                                       MicroKernelAvx512Vnni};
+#endif  // XLA_HAS_TARGET_ATTRIBUTES
+
+// AVX-512 hosts without VNNI use the AVX2 kernel.
+const KernelRegistry<const MicroKernel*>& MicroKernels() {
+  static const KernelRegistry<const MicroKernel*>* registry = [] {
+    auto* kernels = new KernelRegistry<const MicroKernel*>(&kBaselineKernel);
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+    kernels->Register(Isa::kAvx2, &kAvx2Kernel);
+    if (tensorflow::port::TestCPUFeature(
+            tensorflow::port::CPUFeature::AVX512_VNNI)) {
+      kernels->Register(Isa::kAvx512, &kAvx512VnniKernel);
+    }
+#endif
+    return kernels;
+  }();
+  return *registry;
+}
+
+int64 RoundUp(int64 value, int64 multiple) {
+  return (value + multiple - 1) / multiple * multiple;
+}
+
+// Packs rows [row, row + mr) of a into one A panel.
+void PackA(const QuantizedWeights& a, int64 row, int64 mr, int8* packed) {
+  const int64 k4 = RoundUp(a.cols, kGroup) / kGroup;
+  std::fill(packed, packed + k4 * mr * kGroup, 0);
+  const int64 rows = std::min(mr, a.rows - row);
+  for (int64 i = 0; i < rows; ++i) {
+    const int8* src = a.values.data() + (row + i) * a.cols;
+    for (int64 p = 0; p < a.cols; ++p) {
+      packed[(p / kGroup * mr + i) * kGroup + p % kGroup] = src[p];
+    }
+  }
+}
+
+// Packs columns [col, col + cols) of the k x n matrix b into one B panel.
+void PackB(const uint8* b, int64 ldb, int64 k, int64 col, int64 cols,
+           int64 nr, uint8* packed) {
+  const int64 k4 = RoundUp(k, kGroup) / kGroup;
+  std::fill(packed, packed + k4 * nr * kGroup, 0);
+  for (int64 p = 0; p < k; ++p) {
+    const uint8* src = b + p * ldb + col;
+    uint8* dst = packed + p / kGroup * nr * kGroup + p % kGroup;
+    for (int64 j = 0; j < cols; ++j) {
+      dst[j * kGroup] = src[j];
+    }
+  }
+}
+
+// What the corrected accumulators of one row are turned into.
+struct Output {
+  const QuantizedWeights* a;
+  const QuantizationParams* b_params;
+  const OutputStage* stage;
+};
+
+void StoreRow(const Output&, int64, const int32* acc, int64 count,
+              int32* dst) {
+  std::copy(acc, acc + count, dst);
+}
+
+void StoreRow(const Output& output, int64 row, const int32* acc, int64 count,
+              float* dst) {
+  const float multiplier =
+      output.a->params[row].scale * output.b_params->scale;
+  const float bias =
+      output.stage->bias == nullptr ? 0.0f : output.stage->bias[row];
+  for (int64 j = 0; j < count; ++j) {
+    dst[j] = multiplier * static_cast<float>(acc[j]) + bias;
+  }
+  simd::ActivateAndScale(output.stage->activation, 1.0f, dst, count);
+}
+
+void StoreRow(const Output& output, int64 row, const int32* acc, int64 count,
+              uint8* dst) {
+  float values[kMaxNr];
+  StoreRow(output, row, acc, count, values);
+  // Clamping first makes the value non-negative, so adding one half and
+  // truncating rounds it; unlike std::round in Quantize this vectorizes.
+  const float inverse_scale = 1.0f / output.stage->output.scale;
+  const float zero_point = static_cast<float>(output.stage->output.zero_point);
+  for (int64 j = 0; j < count; ++j) {
+    const float q = std::min(
+        std::max(values[j] * inverse_scale + zero_point, 0.0f), 255.0f);
+    dst[j] = static_cast<uint8>(q + 0.5f);
+  }
+}
+
+template <typename T>
+void QuantizedGemmImpl(const QuantizedWeights& a, int64 n, const uint8* b,
+                       int64 ldb, const QuantizationParams& b_params,
+                       const OutputStage& stage, T* c, int64 ldc) {
+  const int64 m = a.rows;
+  const int64 k = a.cols;
+  CHECK_GE(n, 0);
+  CHECK_LE(k, kMaxGemmDepth);
+  CHECK_EQ(static_cast<int64>(a.values.size()), m * k);
+  CHECK_EQ(static_cast<int64>(a.params.size()), m);
+  CHECK_EQ(static_cast<int64>(a.row_sums.size()), m);
+  if (m == 0 || n == 0) {
+    return;
+  }
+
+  const MicroKernel& kernel = *MicroKernels().Get();
+  const int64 mr = kernel.mr;
+  const int64 nr = kernel.nr;
+  const int64 k4 = RoundUp(k, kGroup) / kGroup;
+  const int64 panel_a = k4 * mr * kGroup;
+  const int64 panel_b = k4 * nr * kGroup;
+  const int64 a_panels = (m + mr - 1) / mr;
+  std::vector<int8> packed_a(a_panels * panel_a);
+  ParallelFor(a_panels, panel_a, [&](int64 first, int64 last) {
+    for (int64 r = first; r < last; ++r) {
+      PackA(a, r * mr, mr, packed_a.data() + r * panel_a);
+    }
+  });
+
+  // The zero point terms of acc(i, j); the column sums of B are only needed
+  // for asymmetric weights.
+  bool asymmetric = false;
+  for (const QuantizationParams& params : a.params) {
+    asymmetric = asymmetric || params.zero_point != 0;
+  }
+  const int32 zb = b_params.zero_point;
+
+  const int64 nc_max = std::min(kNc, RoundUp(n, nr));
+  const int64 tile_rows = RoundUp(kTileRows, mr);
+  const int64 tile_cols = RoundUp(kTileCols, nr);
+  const int64 m_tiles = (m + tile_rows - 1) / tile_rows;
+  std::vector<uint8> packed_b(nc_max * k4 * kGroup);
+  std::vector<int32> col_sums(asymmetric ? nc_max : 0);
+  const Output output = {&a, &b_params, &stage};
+  for (int64 jc = 0; jc < n; jc += nc_max) {
+    const int64 nc = std::min(nc_max, n - jc);
+    const int64 b_panels = (nc + nr - 1) / nr;
+    ParallelFor(b_panels, panel_b, [&](int64 first, int64 last) {
+      for (int64 s = first; s < last; ++s) {
+        PackB(b, ldb, k, jc + s * nr, std::min(nr, nc - s * nr), nr,
+              packed_b.data() + s * panel_b);
+      }
+    });
+    if (asymmetric) {
+      std::fill(col_sums.begin(), col_sums.end(), 0);
+      for (int64 p = 0; p < k; ++p) {
+        const uint8* src = b + p * ldb + jc;
+        for (int64 j = 0; j < nc; ++j) {
+          col_sums[j] += src[j];
+        }
+      }
+    }
+
+    const int64 n_tiles = (nc + tile_cols - 1) / tile_cols;
+    ParallelFor(m_tiles * n_tiles, 2 * tile_rows * tile_cols * k,
+                [&](int64 first, int64 last) {
+      int32 acc[kMaxMr * kMaxNr];
+      for (int64 tile = first; tile < last; ++tile) {
+        const int64 ic = tile / n_tiles * tile_rows;
+        const int64 jt = tile % n_tiles * tile_cols;
+        const int64 row_end = std::min(m, ic + tile_rows);
+        const int64 col_end = std::min(nc, jt + tile_cols);
+        for (int64 jr = jt; jr < col_end; jr += nr) {
+          const int64 cols = std::min(nr, col_end - jr);
+          for (int64 ir = ic; ir < row_end; ir += mr) {
+            kernel.fn(k4, packed_a.data() + ir / mr * panel_a,
+                      packed_b.data() + jr / nr * panel_b, acc);
+            const int64 rows = std::min(mr, row_end - ir);
+            for (int64 i = 0; i < rows; ++i) {
+              const int64 row = ir + i;
+              const int32 za = a.params[row].zero_point;
+              int32* values = acc + i * nr;
+              const int32 offset = k * za * zb - zb * a.row_sums[row];
+              for (int64 j = 0; j < cols; ++j) {
+                values[j] += offset;
+              }
+              if (za != 0) {
+                for (int64 j = 0; j < cols; ++j) {
+                  values[j] -= za * col_sums[jr + j];
+                }
+              }
+              StoreRow(output, row, values, cols, c + row * ldc + jc + jr);
+            }
+          }
+        }
+      }
+    });
+  }
+}
+
+}  // namespace
+
+void QuantizedGemm(const QuantizedWeights& a, int64 n, const uint8* b,
+                   int64 ldb, const QuantizationParams& b_params, int32* c,
+                   int64 ldc) {
+  QuantizedGemmImpl(a, n, b, ldb, b_params, OutputStage(), c, ldc);
+}
+
+void QuantizedGemm(const QuantizedWeights& a, int64 n, const uint8* b,
+                   int64 ldb, const QuantizationParams& b_params,
+                   const OutputStage& stage, float* c, int64 ldc) {
+  QuantizedGemmImpl(a, n, b, ldb, b_params, stage, c, ldc);
+}
+
+void QuantizedGemm(const QuantizedWeights& a, int64 n, const uint8* b,
+                   int64 ldb, const QuantizationParams& b_params,
+                   const OutputStage& stage, uint8* c, int64 ldc) {
+  QuantizedGemmImpl(a, n, b, ldb, b_params, stage, c, ldc);
+}
+
+}  // namespace quant
+}  // namespace xla
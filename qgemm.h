@@ -0,0 +1,73 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_QGEMM_H_
+#define TENSORFLOW_COMPILER_XLA_QGEMM_H_
+
+#include "activation.h"
+#include "quantization.h"
+#include "types.h"
+
+namespace xla {
+namespace quant {
+
+// Largest depth QuantizedGemm accepts: every product of two zero-point
+// adjusted 8-bit values fits in 17 bits, so 2^15 of them cannot overflow the
+// int32 accumulators.
+constexpr int64 kMaxGemmDepth = 1 << 15;
+
+// Requantization epilogue of QuantizedGemm. The int32 accumulator acc(i, j)
+// of output row i is turned back into the real value
+//
+//   x = a.params[i].scale * b_params.scale * acc(i, j) + bias[i]
+//
+// and activation(x) is stored as a float, or quantized with output for uint8
+// results. bias holds one real value per row and may be null.
+struct OutputStage {
+  const float* bias = nullptr;
+  ActivationFunction activation = ActivationFunction::kNone;
+  QuantizationParams output;
+};
+
+// Integer matrix multiply of the m x k int8 weights a (m = a.rows,
+// k = a.cols) by the k x n uint8 matrix b, stored row-major with row stride
+// ldb and quantized with b_params. Products are accumulated exactly in int32:
+//
+//   acc(i, j) = sum_p (A(i, p) - a.params[i].zero_point) *
+//                     (B(p, j) - b_params.zero_point)
+//
+// Like gemm::Gemm, output tiles are spread over the intra-op thread pool and
+// the result does not depend on the thread count. k must not exceed
+// kMaxGemmDepth.
+
+// Stores acc itself in the m x n matrix c with row stride ldc.
+void QuantizedGemm(const QuantizedWeights& a, int64 n, const uint8* b,
+                   int64 ldb, const QuantizationParams& b_params, int32* c,
+                   int64 ldc);
+
+// Stores the real results of stage.
+void QuantizedGemm(const QuantizedWeights& a, int64 n, const uint8* b,
+                   int64 ldb, const QuantizationParams& b_params,
+                   const OutputStage& stage, float* c, int64 ldc);
+
+// Stores the results of stage requantized with stage.output.
+void QuantizedGemm(const QuantizedWeights& a, int64 n, const uint8* b,
+                   int64 ldb, const QuantizationParams& b_params,
+                   const OutputStage& stage, uint8* c, int64 ldc);
+
+}  // namespace quant
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_QGEMM_H_
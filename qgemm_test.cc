@@ -0,0 +1,273 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "qgemm.h"
+
+#include <cmath>
+#include <vector>
+
+#include "kernel_registry.h"
+#include "quantization.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+using quant::QuantizationParams;
+using quant::QuantizedWeights;
+
+class QGemmTest /* : public ::testing::Test */
+{
+public:
+
+   QGemmTest() { run(); }
+
+   void ChooseParams();
+   void QuantizeRoundTrip();
+   void ObserverTracksRange();
+   void WeightsPerChannel();
+   void ExactAccumulators();
+   void RequantizedOutput();
+   void EveryIsaVariant();
+
+   void run();
+};
+
+std::vector<float> Values(int64 n, int seed, float low, float high)
+{
+   std::vector<float> values(n);
+   for (int64 i = 0; i < n; ++i) {
+      const float t = static_cast<float>((i * 7919 + seed * 104729) % 1000) /
+                      999.0f;
+      values[i] = low + t * (high - low);
+   }
+   return values;
+}
+
+std::vector<uint8> Bytes(int64 n, int seed)
+{
+   std::vector<uint8> values(n);
+   for (int64 i = 0; i < n; ++i) {
+      values[i] = static_cast<uint8>((i * 151 + seed * 37) % 256);
+   }
+   return values;
+}
+
+void QGemmTest::ChooseParams()
+{
+   const QuantizationParams params =
+       quant::ChooseQuantizationParams(-1.0f, 3.0f, 0, 255);
+   ASSERT_TRUE(std::abs(params.scale - 4.0f / 255.0f) < 1e-7f);
+   ASSERT_EQ(params.zero_point, 64);
+
+   // The range is widened to contain zero.
+   const QuantizationParams positive =
+       quant::ChooseQuantizationParams(2.0f, 4.0f, 0, 255);
+   ASSERT_EQ(positive.zero_point, 0);
+   ASSERT_TRUE(std::abs(positive.scale - 4.0f / 255.0f) < 1e-7f);
+
+   const QuantizationParams symmetric =
+       quant::ChooseSymmetricParams(-0.5f, 2.54f);
+   ASSERT_EQ(symmetric.zero_point, 0);
+   ASSERT_TRUE(std::abs(symmetric.scale - 0.02f) < 1e-7f);
+
+   const QuantizationParams degenerate =
+       quant::ChooseQuantizationParams(0.0f, 0.0f, 0, 255);
+   ASSERT_EQ(degenerate.scale, 1.0f);
+   ASSERT_EQ(degenerate.zero_point, 0);
+}
+
+void QGemmTest::QuantizeRoundTrip()
+{
+   const std::vector<float> values = Values(300, 1, -2.0f, 5.0f);
+   const QuantizationParams params =
+       quant::ChooseQuantizationParams(-2.0f, 5.0f, 0, 255);
+   std::vector<uint8> quantized(values.size());
+   quant::Quantize(values.data(), values.size(), params, quantized.data());
+   std::vector<float> restored(values.size());
+   quant::Dequantize(quantized.data(), quantized.size(), params,
+                     restored.data());
+   for (size_t i = 0; i < values.size(); ++i) {
+      ASSERT_TRUE(std::abs(values[i] - restored[i]) <=
+                  0.5f * params.scale + 1e-6f);
+   }
+
+   // Out of range values saturate.
+   const float outside[] = {-10.0f, 10.0f};
+   uint8 clamped[2];
+   quant::Quantize(outside, 2, params, clamped);
+   ASSERT_EQ(clamped[0], 0);
+   ASSERT_EQ(clamped[1], 255);
+}
+
+void QGemmTest::ObserverTracksRange()
+{
+   quant::RangeObserver observer;
+   ASSERT_TRUE(observer.empty());
+   Array4D<float> first(1, 2, 3, 4);
+   first.FillWithMultiples(0.5f);
+   observer.Observe(first);
+   Array4D<float> second(1, 1, 2, 2);
+   second.FillWithMultiples(-1.0f);
+   observer.Observe(second);
+   ASSERT_TRUE(!observer.empty());
+   ASSERT_EQ(observer.min(), -3.0f);
+   ASSERT_EQ(observer.max(), 11.5f);
+   const QuantizationParams params = observer.Params();
+   ASSERT_TRUE(std::abs(params.scale - 14.5f / 255.0f) < 1e-6f);
+   ASSERT_EQ(params.zero_point, 53);
+}
+
+void QGemmTest::WeightsPerChannel()
+{
+   // Rows of very different magnitude: per-channel scales keep the small row
+   // accurate, a per-tensor scale does not.
+   std::vector<float> weights = Values(2 * 50, 2, -1.0f, 1.0f);
+   for (int64 j = 0; j < 50; ++j) {
+      weights[j] *= 100.0f;
+   }
+   const QuantizedWeights per_channel = quant::QuantizeWeights(
+       weights.data(), 2, 50, quant::Granularity::kPerChannel);
+   const QuantizedWeights per_tensor = quant::QuantizeWeights(
+       weights.data(), 2, 50, quant::Granularity::kPerTensor);
+   ASSERT_EQ(per_channel.values.size(), 100);
+   ASSERT_TRUE(per_channel.params[0].scale > 50.0f * per_channel.params[1].scale);
+   ASSERT_EQ(per_tensor.params[0].scale, per_tensor.params[1].scale);
+
+   const std::vector<float> channel = quant::DequantizeWeights(per_channel);
+   const std::vector<float> tensor = quant::DequantizeWeights(per_tensor);
+   double channel_error = 0.0, tensor_error = 0.0;
+   for (int64 j = 50; j < 100; ++j) {
+      channel_error += std::abs(channel[j] - weights[j]);
+      tensor_error += std::abs(tensor[j] - weights[j]);
+   }
+   ASSERT_TRUE(channel_error * 10.0 < tensor_error);
+
+   int32 sum = 0;
+   for (int64 j = 0; j < 50; ++j) {
+      sum += per_channel.values[50 + j];
+   }
+   ASSERT_EQ(per_channel.row_sums[1], sum);
+
+   // Asymmetric weights use the whole int8 range.
+   const std::vector<float> shifted = Values(64, 3, 1.0f, 3.0f);
+   const QuantizedWeights asymmetric = quant::QuantizeWeights(
+       shifted.data(), 1, 64, quant::Granularity::kPerChannel, false);
+   ASSERT_EQ(asymmetric.params[0].zero_point, -128);
+}
+
+// Checks every accumulator of QuantizedGemm against the definition.
+void ExpectExactGemm(int64 m, int64 n, int64 k, bool symmetric, int32 zb)
+{
+   const std::vector<float> weights = Values(m * k, 4, -0.7f, 1.3f);
+   const QuantizedWeights a = quant::QuantizeWeights(
+       weights.data(), m, k, quant::Granularity::kPerChannel, symmetric);
+   // Padded rows, to cover ldb != n.
+   const int64 ldb = n + 3;
+   const std::vector<uint8> b = Bytes(k * ldb, 5);
+   QuantizationParams b_params;
+   b_params.scale = 0.05f;
+   b_params.zero_point = zb;
+
+   std::vector<int32> c(m * n);
+   quant::QuantizedGemm(a, n, b.data(), ldb, b_params, c.data(), n);
+   for (int64 i = 0; i < m; ++i) {
+      for (int64 j = 0; j < n; ++j) {
+         int32 expected = 0;
+         for (int64 p = 0; p < k; ++p) {
+            expected += (a.values[i * k + p] - a.params[i].zero_point) *
+                        (b[p * ldb + j] - zb);
+         }
+         ASSERT_EQ(c[i * n + j], expected);
+      }
+   }
+}
+
+void QGemmTest::ExactAccumulators()
+{
+   ExpectExactGemm(1, 1, 1, true, 0);
+   ExpectExactGemm(7, 13, 5, true, 128);
+   ExpectExactGemm(9, 33, 19, false, 7);
+   ExpectExactGemm(17, 70, 300, true, 255);
+   ExpectExactGemm(100, 300, 67, false, 128);
+   ExpectExactGemm(5, 4, 0, true, 10);
+   // Depth beyond one widening chunk of the AVX2 kernel.
+   ExpectExactGemm(6, 8, 1031, false, 200);
+}
+
+void QGemmTest::RequantizedOutput()
+{
+   const int64 m = 11, n = 37, k = 29;
+   const std::vector<float> weights = Values(m * k, 6, -1.0f, 1.0f);
+   const QuantizedWeights a = quant::QuantizeWeights(
+       weights.data(), m, k, quant::Granularity::kPerChannel);
+   const std::vector<uint8> b = Bytes(k * n, 7);
+   QuantizationParams b_params;
+   b_params.scale = 0.02f;
+   b_params.zero_point = 100;
+   const std::vector<float> bias = Values(m, 8, -1.0f, 1.0f);
+
+   std::vector<int32> acc(m * n);
+   quant::QuantizedGemm(a, n, b.data(), n, b_params, acc.data(), n);
+
+   quant::OutputStage stage;
+   stage.bias = bias.data();
+   stage.activation = ActivationFunction::kRelu;
+   stage.output = quant::ChooseQuantizationParams(0.0f, 4.0f, 0, 255);
+   std::vector<float> real(m * n);
+   std::vector<uint8> requantized(m * n);
+   quant::QuantizedGemm(a, n, b.data(), n, b_params, stage, real.data(), n);
+   quant::QuantizedGemm(a, n, b.data(), n, b_params, stage,
+                        requantized.data(), n);
+   for (int64 i = 0; i < m; ++i) {
+      for (int64 j = 0; j < n; ++j) {
+         const float x = std::max(
+             0.0f, a.params[i].scale * b_params.scale * acc[i * n + j] +
+                       bias[i]);
+         ASSERT_TRUE(std::abs(real[i * n + j] - x) <= 1e-5f * (1.0f + x));
+         uint8 q;
+         quant::Quantize(&x, 1, stage.output, &q);
+         ASSERT_TRUE(std::abs(requantized[i * n + j] - q) <= 1);
+      }
+   }
+}
+
+void QGemmTest::EveryIsaVariant()
+{
+   for (int i = 0; i < kNumIsas; ++i) {
+      const Isa isa = static_cast<Isa>(i);
+      if (!IsaSupported(isa)) {
+         continue;
+      }
+      SetMaxIsa(isa);
+      ExactAccumulators();
+      RequantizedOutput();
+   }
+   SetMaxIsa(static_cast<Isa>(kNumIsas - 1));
+}
+
+void QGemmTest::run()
+{
+   ChooseParams();
+   QuantizeRoundTrip();
+   ObserverTracksRange();
+   WeightsPerChannel();
+   ExactAccumulators();
+   RequantizedOutput();
+   EveryIsaVariant();
+}
+
+}  // namespace
+}  // namespace xla
@@ -0,0 +1,187 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "quantization.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "logging.h"
+
+namespace xla {
+namespace quant {
+namespace {
+
+template <typename Q>
+void QuantizeImpl(const float* values, int64 n,
+                  const QuantizationParams& params, int32 qmin, int32 qmax,
+                  Q* out) {
+  const float zero_point = static_cast<float>(params.zero_point);
+  for (int64 i = 0; i < n; ++i) {
+    const float q = std::round(values[i] / params.scale) + zero_point;
+    out[i] = static_cast<Q>(std::min(std::max(q, static_cast<float>(qmin)),
+                                     static_cast<float>(qmax)));
+  }
+}
+
+template <typename Q>
+void DequantizeImpl(const Q* values, int64 n, const QuantizationParams& params,
+                    float* out) {
+  for (int64 i = 0; i < n; ++i) {
+    out[i] = params.scale * static_cast<float>(static_cast<int32>(values[i]) -
+                                               params.zero_point);
+  }
+}
+
+}  // namespace
+
+QuantizationParams ChooseQuantizationParams(float min, float max, int32 qmin,
+                                            int32 qmax) {
+  CHECK_LT(qmin, qmax);
+  CHECK_LE(min, max);
+  min = std::min(min, 0.0f);
+  max = std::max(max, 0.0f);
+  QuantizationParams params;
+  if (max == min) {
+    params.zero_point = std::min(std::max(0, qmin), qmax);
+    return params;
+  }
+  params.scale = (max - min) / static_cast<float>(qmax - qmin);
+  const float zero_point = std::round(qmin - min / params.scale);
+  params.zero_point = static_cast<int32>(
+      std::min(std::max(zero_point, static_cast<float>(qmin)),
+               static_cast<float>(qmax)));
+  return params;
+}
+
+QuantizationParams ChooseSymmetricParams(float min, float max, int32 qmax) {
+  CHECK_GT(qmax, 0);
+  const float magnitude = std::max(std::abs(min), std::abs(max));
+  QuantizationParams params;
+  if (magnitude > 0.0f) {
+    params.scale = magnitude / static_cast<float>(qmax);
+  }
+  return params;
+}
+
+void Quantize(const float* values, int64 n, const QuantizationParams& params,
+              uint8* out) {
+  QuantizeImpl(values, n, params, kUint8Min, kUint8Max, out);
+}
+
+void Quantize(const float* values, int64 n, const QuantizationParams& params,
+              int8* out) {
+  QuantizeImpl(values, n, params, kInt8Min, kInt8Max, out);
+}
+
+void Dequantize(const uint8* values, int64 n, const QuantizationParams& params,
+                float* out) {
+  DequantizeImpl(values, n, params, out);
+}
+
+void Dequantize(const int8* values, int64 n, const QuantizationParams& params,
+                float* out) {
+  DequantizeImpl(values, n, params, out);
+}
+
+void RangeObserver::Observe(const float* values, int64 n) {
+  if (n == 0) {
+    return;
+  }
+  const auto range = std::minmax_element(values, values + n);
+  if (empty_) {
+    min_ = *range.first;
+    max_ = *range.second;
+    empty_ = false;
+    return;
+  }
+  min_ = std::min(min_, *range.first);
+  max_ = std::max(max_, *range.second);
+}
+
+void RangeObserver::Observe(const Array4D<float>& activations) {
+  Observe(activations.data(), activations.num_elements());
+}
+
+QuantizationParams RangeObserver::Params() const {
+  if (empty_) {
+    return QuantizationParams();
+  }
+  return ChooseQuantizationParams(min_, max_, kUint8Min, kUint8Max);
+}
+
+QuantizedWeights QuantizeWeights(const float* weights, int64 rows, int64 cols,
+                                 Granularity granularity, bool symmetric) {
+  CHECK_GE(rows, 0);
+  CHECK_GE(cols, 0);
+  QuantizedWeights result;
+  result.rows = rows;
+  result.cols = cols;
+  result.values.resize(rows * cols);
+  result.params.resize(rows);
+  result.row_sums.resize(rows);
+
+  auto choose = [symmetric](const float* first, const float* last) {
+    if (first == last) {
+      return QuantizationParams();
+    }
+    const auto range = std::minmax_element(first, last);
+    return symmetric ? ChooseSymmetricParams(*range.first, *range.second)
+                     : ChooseQuantizationParams(*range.first, *range.second,
+                                                kInt8Min, kInt8Max);
+  };
+  const QuantizationParams tensor_params =
+      choose(weights, weights + rows * cols);
+  for (int64 i = 0; i < rows; ++i) {
+    const float* row = weights + i * cols;
+    result.params[i] = granularity == Granularity::kPerChannel
+                           ? choose(row, row + cols)
+                           : tensor_params;
+    int8* values = result.values.data() + i * cols;
+    Quantize(row, cols, result.params[i], values);
+    int32 sum = 0;
+    for (int64 j = 0; j < cols; ++j) {
+      sum += values[j];
+    }
+    result.row_sums[i] = sum;
+  }
+  return result;
+}
+
+std::vector<float> DequantizeWeights(const QuantizedWeights& weights) {
+  std::vector<float> result(weights.rows * weights.cols);
+  for (int64 i = 0; i < weights.rows; ++i) {
+    Dequantize(weights.values.data() + i * weights.cols, weights.cols,
+               weights.params[i], result.data() + i * weights.cols);
+  }
+  return result;
+}
+
+QuantizedFilter QuantizeFilter(const Array4D<float>& filter,
+                               Granularity granularity, bool symmetric) {
+  QuantizedFilter result;
+  result.output_features = filter.n1();
+  result.input_features = filter.n2();
+  result.kernel_height = filter.n3();
+  result.kernel_width = filter.n4();
+  result.weights = QuantizeWeights(
+      filter.data(), result.output_features,
+      result.input_features * result.kernel_height * result.kernel_width,
+      granularity, symmetric);
+  return result;
+}
+
+}  // namespace quant
+}  // namespace xla
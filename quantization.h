@@ -0,0 +1,142 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_QUANTIZATION_H_
+#define TENSORFLOW_COMPILER_XLA_QUANTIZATION_H_
+
+// 8-bit affine quantization. A real value x is represented by the integer
+//
+//   q = clamp(round(x / scale) + zero_point, qmin, qmax)
+//
+// and recovered as scale * (q - zero_point). Activations are stored as uint8
+// with one scale and zero point per tensor, weights as int8 with one scale
+// and zero point per tensor or per output channel. The integer kernels
+// built on these types are in qgemm.h and conv_quantized.h.
+
+#include <vector>
+
+#include "array4d.h"
+#include "types.h"
+
+namespace xla {
+namespace quant {
+
+constexpr int32 kUint8Min = 0;
+constexpr int32 kUint8Max = 255;
+constexpr int32 kInt8Min = -128;
+constexpr int32 kInt8Max = 127;
+
+struct QuantizationParams {
+  float scale = 1.0f;
+  int32 zero_point = 0;
+};
+
+// Returns the parameters that map [min, max] onto [qmin, qmax]. The range is
+// first widened to contain zero, so that zero (e.g. padding) is exactly
+// representable.
+QuantizationParams ChooseQuantizationParams(float min, float max, int32 qmin,
+                                            int32 qmax);
+
+// Returns zero-point-free parameters that map [-m, m] onto [-qmax, qmax],
+// where m is the larger magnitude of min and max. Symmetric weights keep the
+// zero point corrections of the integer GEMM to a single term.
+QuantizationParams ChooseSymmetricParams(float min, float max,
+                                         int32 qmax = kInt8Max);
+
+// Quantizes or dequantizes n values with params.
+void Quantize(const float* values, int64 n, const QuantizationParams& params,
+              uint8* out);
+void Quantize(const float* values, int64 n, const QuantizationParams& params,
+              int8* out);
+void Dequantize(const uint8* values, int64 n, const QuantizationParams& params,
+                float* out);
+void Dequantize(const int8* values, int64 n, const QuantizationParams& params,
+                float* out);
+
+// Calibration: records the range of the activations a layer produces over a
+// set of representative inputs, and turns it into uint8 parameters.
+class RangeObserver {
+ public:
+  void Observe(const float* values, int64 n);
+  void Observe(const Array4D<float>& activations);
+
+  // Whether nothing has been observed yet.
+  bool empty() const { return empty_; }
+  float min() const { return min_; }
+  float max() const { return max_; }
+
+  // The uint8 parameters for the observed range; the identity mapping of
+  // [0, 255] before anything has been observed.
+  QuantizationParams Params() const;
+
+ private:
+  bool empty_ = true;
+  float min_ = 0.0f;
+  float max_ = 0.0f;
+};
+
+enum class Granularity {
+  // One scale and zero point for the whole tensor.
+  kPerTensor,
+  // One scale and zero point per output channel (row).
+  kPerChannel,
+};
+
+// A rows x cols int8 weight matrix with the parameters of each row. Rows are
+// output channels, e.g. the output features of a convolution filter, so the
+// matrix is the left operand of QuantizedGemm.
+struct QuantizedWeights {
+  int64 rows = 0;
+  int64 cols = 0;
+  // Row-major rows x cols values.
+  std::vector<int8> values;
+  // One entry per row; all equal for kPerTensor.
+  std::vector<QuantizationParams> params;
+  // Sum of the stored values of each row, for the zero point corrections.
+  std::vector<int32> row_sums;
+};
+
+// Quantizes the row-major rows x cols matrix weights. Symmetric weights use
+// [-127, 127] with a zero point of 0, otherwise the range of each row (or of
+// the whole matrix) is mapped onto [-128, 127].
+QuantizedWeights QuantizeWeights(const float* weights, int64 rows, int64 cols,
+                                 Granularity granularity,
+                                 bool symmetric = true);
+
+// Returns the real values of weights, row-major.
+std::vector<float> DequantizeWeights(const QuantizedWeights& weights);
+
+// A quantized convolution filter in the canonical
+// [output_features][input_features][kernel_height][kernel_width] layout,
+// viewed as an output_features x (input_features * kernel_height *
+// kernel_width) matrix.
+struct QuantizedFilter {
+  int64 output_features = 0;
+  int64 input_features = 0;
+  int64 kernel_height = 0;
+  int64 kernel_width = 0;
+  QuantizedWeights weights;
+};
+
+// Quantizes a filter in the canonical layout, per output feature for
+// kPerChannel.
+QuantizedFilter QuantizeFilter(const Array4D<float>& filter,
+                               Granularity granularity,
+                               bool symmetric = true);
+
+}  // namespace quant
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_QUANTIZATION_H_
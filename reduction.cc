@@ -0,0 +1,338 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "reduction.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "simd_kernels.h"
+#include "summation.h"
+
+namespace xla {
+namespace {
+
+using reduction_internal::RunReduction;
+
+// Rows shorter than this are folded inline; longer ones go to the dispatched
+// simd kernels.
+constexpr int64 kShortRow = 16;
+
+// Block size of full reductions, which are split into fixed blocks so that
+// the result does not depend on the thread count.
+constexpr int64 kFlatBlock = 1 << 14;
+
+// Folds rows into the output with combine, using the horizontal kernel
+// row_fn for reduced rows and the vertical kernel columns_fn for kept ones.
+template <typename CombineFn, float (*row_fn)(const float*, int64),
+          void (*columns_fn)(const float*, const float*, float*, int64)>
+struct VectorKernel {
+  float Combine(float a, float b) const { return CombineFn()(a, b); }
+
+  void Row(const float* row, int64 n, float* out) const {
+    if (n < kShortRow) {
+      float acc = *out;
+      for (int64 i = 0; i < n; ++i) {
+        acc = Combine(acc, row[i]);
+      }
+      *out = acc;
+      return;
+    }
+    *out = Combine(*out, row_fn(row, n));
+  }
+
+  void Columns(const float* row, int64 n, float* out) const {
+    if (n < kShortRow) {
+      for (int64 i = 0; i < n; ++i) {
+        out[i] = Combine(out[i], row[i]);
+      }
+      return;
+    }
+    columns_fn(out, row, out, n);
+  }
+};
+
+using SumKernel = VectorKernel<std::plus<float>, simd::Sum, simd::Add>;
+using ProductKernel =
+    VectorKernel<std::multiplies<float>, simd::Product, simd::Multiply>;
+using MaxKernel = VectorKernel<MaxFunctor, simd::Max, simd::Maximum>;
+using MinKernel = VectorKernel<MinFunctor, simd::Min, simd::Minimum>;
+
+// Sums in Summation::kPairwise mode: every reduced row adds its pairwise sum,
+// and kept rows are added elementwise, which rounds the same way on every
+// instruction set.
+struct PairwiseSumKernel {
+  void Row(const float* row, int64 n, float* out) const {
+    *out += PairwiseSum(row, n);
+  }
+
+  void Columns(const float* row, int64 n, float* out) const {
+    simd::Add(out, row, out, n);
+  }
+};
+
+// Sums in Summation::kCompensated mode, into the running sum stored in sums
+// at the offset of every output element.
+struct CompensatedSumKernel {
+  const float* output;
+  CompensatedSum* sums;
+
+  void Row(const float* row, int64 n, float* out) const {
+    CompensatedSum sum;
+    sum.Add(row, n);
+    sums[out - output].Add(sum);
+  }
+
+  void Columns(const float* row, int64 n, float* out) const {
+    CompensatedSum* s = sums + (out - output);
+    for (int64 i = 0; i < n; ++i) {
+      s[i].Add(row[i]);
+    }
+  }
+};
+
+// The shift of the exponentials of a log-sum-exp whose maximum is m. An
+// infinite maximum is the result itself, and must not turn exp(x - m) into
+// exp(inf - inf).
+float LogSumExpShift(float m) { return std::isfinite(m) ? m : 0.0f; }
+
+// Rows are exponentiated through a stack buffer of this many elements, so
+// that simd::Exp runs on whole vectors without allocating.
+constexpr int64 kExpChunk = 256;
+
+// Returns the sum of exp(values[i] - shift).
+float ExpSum(const float* values, int64 n, float shift) {
+  float buffer[kExpChunk];
+  float acc = 0.0f;
+  for (int64 first = 0; first < n; first += kExpChunk) {
+    const int64 count = std::min(kExpChunk, n - first);
+    std::copy(values + first, values + first + count, buffer);
+    simd::AddScalar(-shift, buffer, count);
+    simd::Exp(buffer, buffer, count);
+    acc += simd::Sum(buffer, count);
+  }
+  return acc;
+}
+
+// Accumulates exp(x - shift) into sums, where the shift of every output
+// element is stored at the same offset in shifts.
+struct ExpSumKernel {
+  const float* shifts;
+  const float* sums;
+
+  void Row(const float* row, int64 n, float* out) const {
+    *out += ExpSum(row, n, shifts[out - sums]);
+  }
+
+  void Columns(const float* row, int64 n, float* out) const {
+    const float* s = shifts + (out - sums);
+    float buffer[kExpChunk];
+    for (int64 first = 0; first < n; first += kExpChunk) {
+      const int64 count = std::min(kExpChunk, n - first);
+      simd::Subtract(row + first, s + first, buffer, count);
+      simd::Exp(buffer, buffer, count);
+      simd::Add(out + first, buffer, out + first, count);
+    }
+  }
+};
+
+// Runs kernel with the output initialized to identity, then applies finish to
+// every range of outputs. Full reductions, whose canonical shape is a single
+// reduced dimension, are split into fixed blocks instead.
+template <typename Kernel, typename Finish>
+void RunVectorReduction(const ReductionShape& shape, const float* input,
+                        float identity, const Kernel& kernel, float* output,
+                        const Finish& finish) {
+  if (shape.partition_dimension < 0 && shape.sizes.size() == 1 &&
+      shape.input_size > kFlatBlock) {
+    output[0] = ParallelReduce(
+        shape.input_size, kFlatBlock, 1, identity,
+        [&](int64 first, int64 last) {
+          float acc = identity;
+          kernel.Row(input + first, last - first, &acc);
+          return acc;
+        },
+        [&](float acc, float partial) {
+          kernel.Row(&partial, 1, &acc);
+          return acc;
+        });
+    finish(0, 1);
+    return;
+  }
+  RunReduction(shape, input, output, kernel,
+               [&](int64 first, int64 last) {
+                 std::fill(output + first, output + last, identity);
+               },
+               finish);
+}
+
+template <typename Kernel>
+void RunVectorReduction(const ReductionShape& shape, const float* input,
+                        float identity, const Kernel& kernel, float* output) {
+  RunVectorReduction(shape, input, identity, kernel, output,
+                     [](int64, int64) {});
+}
+
+// Sums over shape in the DefaultSummation() mode, then applies finish to
+// every range of outputs. Full reductions are ParallelSum itself, so they
+// match xla::Sum bit for bit.
+template <typename Finish>
+void RunSum(const ReductionShape& shape, const float* input, float* output,
+            const Finish& finish) {
+  const Summation summation = DefaultSummation();
+  if (shape.partition_dimension < 0 && shape.sizes.size() == 1) {
+    output[0] = ParallelSum(input, shape.input_size, summation);
+    finish(0, 1);
+    return;
+  }
+  auto zero = [output](int64 first, int64 last) {
+    std::fill(output + first, output + last, 0.0f);
+  };
+  switch (summation) {
+    case Summation::kFast:
+      RunVectorReduction(shape, input, 0.0f, SumKernel(), output, finish);
+      return;
+    case Summation::kPairwise:
+      RunReduction(shape, input, output, PairwiseSumKernel(), zero, finish);
+      return;
+    case Summation::kCompensated: {
+      std::vector<CompensatedSum> sums(shape.output_size);
+      RunReduction(shape, input, output,
+                   CompensatedSumKernel{output, sums.data()}, zero,
+                   [&](int64 first, int64 last) {
+                     for (int64 i = first; i < last; ++i) {
+                       output[i] = sums[i].value();
+                     }
+                     finish(first, last);
+                   });
+      return;
+    }
+  }
+}
+
+}  // namespace
+
+ReductionShape MakeReductionShape(
+    tensorflow::gtl::ArraySlice<int64> dimensions,
+    tensorflow::gtl::ArraySlice<int64> axes) {
+  std::vector<bool> is_reduced(dimensions.size(), false);
+  for (int64 axis : axes) {
+    CHECK_GE(axis, 0);
+    CHECK_LT(axis, static_cast<int64>(dimensions.size()));
+    CHECK(!is_reduced[axis]) << "dimension " << axis << " reduced twice";
+    is_reduced[axis] = true;
+  }
+  ReductionShape shape;
+  for (size_t i = 0; i < dimensions.size(); ++i) {
+    CHECK_GE(dimensions[i], 0);
+    shape.input_size *= dimensions[i];
+    if (!is_reduced[i]) {
+      shape.output_size *= dimensions[i];
+    }
+    if (dimensions[i] == 1) {
+      continue;
+    }
+    if (!shape.sizes.empty() && shape.reduced.back() == is_reduced[i]) {
+      shape.sizes.back() *= dimensions[i];
+    } else {
+      shape.sizes.push_back(dimensions[i]);
+      shape.reduced.push_back(is_reduced[i]);
+    }
+  }
+  const int rank = static_cast<int>(shape.sizes.size());
+  shape.input_strides.resize(rank);
+  shape.output_strides.resize(rank);
+  int64 input_stride = 1;
+  int64 output_stride = 1;
+  for (int i = rank - 1; i >= 0; --i) {
+    shape.input_strides[i] = input_stride;
+    input_stride *= shape.sizes[i];
+    if (shape.reduced[i]) {
+      shape.output_strides[i] = 0;
+    } else {
+      shape.output_strides[i] = output_stride;
+      output_stride *= shape.sizes[i];
+      shape.partition_dimension = i;
+    }
+  }
+  return shape;
+}
+
+void ReduceDimensions(ReduceOp op, const float* input,
+                      tensorflow::gtl::ArraySlice<int64> dimensions,
+                      tensorflow::gtl::ArraySlice<int64> axes, float* output) {
+  const ReductionShape shape = MakeReductionShape(dimensions, axes);
+  const float infinity = std::numeric_limits<float>::infinity();
+  switch (op) {
+    case ReduceOp::kSum:
+      RunSum(shape, input, output, [](int64, int64) {});
+      return;
+    case ReduceOp::kProduct:
+      RunVectorReduction(shape, input, 1.0f, ProductKernel(), output);
+      return;
+    case ReduceOp::kMax:
+      RunVectorReduction(shape, input, -infinity, MaxKernel(), output);
+      return;
+    case ReduceOp::kMin:
+      RunVectorReduction(shape, input, infinity, MinKernel(), output);
+      return;
+    case ReduceOp::kMean: {
+      const int64 count =
+          shape.output_size == 0 ? 0 : shape.input_size / shape.output_size;
+      RunSum(shape, input, output, [&](int64 first, int64 last) {
+        if (count > 0) {
+          for (int64 i = first; i < last; ++i) {
+            output[i] /= static_cast<float>(count);
+          }
+        }
+      });
+      return;
+    }
+    case ReduceOp::kLogSumExp: {
+      RunVectorReduction(shape, input, -infinity, MaxKernel(), output);
+      std::vector<float> sums(shape.output_size);
+      if (shape.partition_dimension < 0 && shape.sizes.size() == 1) {
+        const float shift = LogSumExpShift(output[0]);
+        sums[0] = ParallelReduce(
+            shape.input_size, kFlatBlock, 1, 0.0f,
+            [&](int64 first, int64 last) {
+              return ExpSum(input + first, last - first, shift);
+            },
+            [](float acc, float partial) { return acc + partial; });
+      } else {
+        std::vector<float> shifts(shape.output_size);
+        std::transform(output, output + shape.output_size, shifts.begin(),
+                       LogSumExpShift);
+        RunReduction(shape, input, sums.data(),
+                     ExpSumKernel{shifts.data(), sums.data()},
+                     [&](int64 first, int64 last) {
+                       std::fill(sums.begin() + first, sums.begin() + last,
+                                 0.0f);
+                     },
+                     [](int64, int64) {});
+      }
+      for (int64 i = 0; i < shape.output_size; ++i) {
+        if (std::isfinite(output[i])) {
+          output[i] += std::log(sums[i]);
+        }
+      }
+      return;
+    }
+  }
+  LOG(FATAL) << "unknown reduction";
+}
+
+}  // namespace xla
@@ -0,0 +1,263 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_REDUCTION_H_
+#define TENSORFLOW_COMPILER_XLA_REDUCTION_H_
+
+// Reduction of dense row-major arrays over an arbitrary set of dimensions,
+// shared by the ReferenceUtil reductions.
+//
+// Like TransposeDimensions, the dimensions are first canonicalized: size-1
+// dimensions are dropped and adjacent dimensions that are both reduced or
+// both kept are merged, so e.g. reducing a [2, 3, 4, 5] array over {2, 3} is
+// a reduction of a 6 x 20 matrix to its 6 row results. Only two kinds of
+// inner loops remain:
+//
+//   - The innermost dimension is reduced: every contiguous row folds into a
+//     single output element (a horizontal vector reduction).
+//   - The innermost dimension is kept: every contiguous row folds
+//     elementwise into a contiguous run of outputs (vertical vector
+//     operations), so reducing outer dimensions never walks memory with a
+//     stride.
+//
+// Work is split over the outermost kept dimension, whose outputs are
+// contiguous and owned by one thread each, so the result does not depend on
+// the thread count.
+
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+#include "array_slice.h"
+#include "intra_op_thread_pool.h"
+#include "logging.h"
+#include "types.h"
+
+namespace xla {
+
+// Reductions with a vectorized fast path.
+enum class ReduceOp {
+  kSum,
+  kProduct,
+  kMax,
+  kMin,
+  // The sum divided by the number of reduced elements (0 when there are
+  // none).
+  kMean,
+  // log(sum(exp(x))), computed as m + log(sum(exp(x - m))) with m the
+  // maximum, so it neither overflows nor underflows. The exponentials run on
+  // simd::Exp and have its error.
+  kLogSumExp,
+};
+
+// Binary functors recognized by the templated ReduceDimensions below, in
+// addition to std::plus<float> and std::multiplies<float>.
+struct MaxFunctor {
+  float operator()(float a, float b) const { return std::max(a, b); }
+};
+struct MinFunctor {
+  float operator()(float a, float b) const { return std::min(a, b); }
+};
+
+// A reduction after canonicalization: sizes[i] is the extent of merged
+// dimension i, outermost first, and reduced[i] whether it is reduced away.
+struct ReductionShape {
+  std::vector<int64> sizes;
+  std::vector<bool> reduced;
+  // Row-major strides of every merged dimension in the input, and in the
+  // output (zero for reduced dimensions).
+  std::vector<int64> input_strides;
+  std::vector<int64> output_strides;
+  // The outermost kept dimension, which is split between threads, or -1 when
+  // everything is reduced.
+  int partition_dimension = -1;
+  int64 input_size = 1;
+  int64 output_size = 1;
+};
+
+// Canonicalizes the reduction of an array with the given dimensions over the
+// dimensions in axes, which must be distinct and in range.
+ReductionShape MakeReductionShape(
+    tensorflow::gtl::ArraySlice<int64> dimensions,
+    tensorflow::gtl::ArraySlice<int64> axes);
+
+// Reduces the row-major array input with the given dimensions over the
+// dimensions in axes and stores the result, whose dimensions are those of
+// input without axes, in output. input and output must not overlap.
+//
+// Sums and means are accumulated in the DefaultSummation() mode of
+// summation.h; a full reduction is ParallelSum itself. Products are
+// accumulated in several vector lanes, so their rounding differs from a
+// sequential loop, as for simd::Sum.
+void ReduceDimensions(ReduceOp op, const float* input,
+                      tensorflow::gtl::ArraySlice<int64> dimensions,
+                      tensorflow::gtl::ArraySlice<int64> axes, float* output);
+
+namespace reduction_internal {
+
+// Visits the rows of one range [first, last) of the partition dimension.
+// kernel.Row(row, n, out) folds the n contiguous values of a row whose
+// innermost dimension is reduced into *out, and kernel.Columns(row, n, out)
+// folds them elementwise into out[0, n) when it is kept.
+template <typename T, typename Kernel>
+void WalkReduction(const ReductionShape& shape, int dimension, const T* input,
+                   T* output, int64 first, int64 last, const Kernel& kernel) {
+  const int inner = static_cast<int>(shape.sizes.size()) - 1;
+  int64 begin = 0;
+  int64 end = shape.sizes[dimension];
+  if (dimension == shape.partition_dimension) {
+    begin = first;
+    end = last;
+  }
+  if (dimension == inner) {
+    if (shape.reduced[inner]) {
+      kernel.Row(input + begin, end - begin, output);
+    } else {
+      kernel.Columns(input + begin, end - begin, output + begin);
+    }
+    return;
+  }
+  const int64 input_stride = shape.input_strides[dimension];
+  const int64 output_stride = shape.output_strides[dimension];
+  for (int64 i = begin; i < end; ++i) {
+    WalkReduction(shape, dimension + 1, input + i * input_stride,
+                  output + i * output_stride, first, last, kernel);
+  }
+}
+
+// Runs kernel over the whole shape. init(first, last) prepares, and
+// finish(first, last) completes, the output elements [first, last) that one
+// range of the partition dimension owns; both run on the same thread as the
+// walk over that range.
+template <typename T, typename Kernel, typename Init, typename Finish>
+void RunReduction(const ReductionShape& shape, const T* input, T* output,
+                  const Kernel& kernel, const Init& init,
+                  const Finish& finish) {
+  if (shape.output_size == 0) {
+    return;
+  }
+  if (shape.input_size == 0 || shape.sizes.empty()) {
+    // Nothing to reduce, or nothing to reduce over: the canonical shape has
+    // no dimensions left, so the single input element is the single output.
+    init(0, shape.output_size);
+    if (shape.input_size != 0) {
+      kernel.Columns(input, 1, output);
+    }
+    finish(0, shape.output_size);
+    return;
+  }
+  if (shape.partition_dimension < 0) {
+    init(0, 1);
+    WalkReduction(shape, 0, input, output, 0, 0, kernel);
+    finish(0, 1);
+    return;
+  }
+  const int p = shape.partition_dimension;
+  const int64 output_stride = shape.output_strides[p];
+  ParallelFor(shape.sizes[p], shape.input_size / shape.sizes[p],
+              [&](int64 first, int64 last) {
+    init(first * output_stride, last * output_stride);
+    WalkReduction(shape, 0, input, output, first, last, kernel);
+    finish(first * output_stride, last * output_stride);
+  });
+}
+
+// Sequential fold with an arbitrary binary function: every output element is
+// reduce(...reduce(reduce(init, x0), x1)..., xn) in input order.
+template <typename T, typename F>
+struct FoldKernel {
+  const F& reduce;
+
+  void Row(const T* row, int64 n, T* out) const {
+    T acc = *out;
+    for (int64 i = 0; i < n; ++i) {
+      acc = reduce(acc, row[i]);
+    }
+    *out = acc;
+  }
+  void Columns(const T* row, int64 n, T* out) const {
+    for (int64 i = 0; i < n; ++i) {
+      out[i] = reduce(out[i], row[i]);
+    }
+  }
+};
+
+template <typename T, typename F>
+struct KnownReduceOp : std::false_type {};
+template <>
+struct KnownReduceOp<float, std::plus<float>> : std::true_type {
+  static constexpr ReduceOp kOp = ReduceOp::kSum;
+};
+template <>
+struct KnownReduceOp<float, std::multiplies<float>> : std::true_type {
+  static constexpr ReduceOp kOp = ReduceOp::kProduct;
+};
+template <>
+struct KnownReduceOp<float, MaxFunctor> : std::true_type {
+  static constexpr ReduceOp kOp = ReduceOp::kMax;
+};
+template <>
+struct KnownReduceOp<float, MinFunctor> : std::true_type {
+  static constexpr ReduceOp kOp = ReduceOp::kMin;
+};
+
+template <typename T, typename F>
+void ReduceDimensions(const T* input,
+                      tensorflow::gtl::ArraySlice<int64> dimensions,
+                      tensorflow::gtl::ArraySlice<int64> axes, T init,
+                      const F& reduce, T* output, std::true_type) {
+  ReduceDimensions(KnownReduceOp<T, F>::kOp, input, dimensions, axes, output);
+  const int64 output_size = MakeReductionShape(dimensions, axes).output_size;
+  for (int64 i = 0; i < output_size; ++i) {
+    output[i] = reduce(init, output[i]);
+  }
+}
+
+template <typename T, typename F>
+void ReduceDimensions(const T* input,
+                      tensorflow::gtl::ArraySlice<int64> dimensions,
+                      tensorflow::gtl::ArraySlice<int64> axes, T init,
+                      const F& reduce, T* output, std::false_type) {
+  const ReductionShape shape = MakeReductionShape(dimensions, axes);
+  RunReduction(shape, input, output, FoldKernel<T, F>{reduce},
+               [&](int64 first, int64 last) {
+                 std::fill(output + first, output + last, init);
+               },
+               [](int64, int64) {});
+}
+
+}  // namespace reduction_internal
+
+// As above with an arbitrary associative binary function reduce and initial
+// value init. std::plus<float>, std::multiplies<float>, MaxFunctor and
+// MinFunctor take the vectorized path; any other function is inlined into a
+// sequential fold of every output element in input order. Different output
+// elements are folded on different threads at once, so reduce must be safe to
+// call concurrently.
+template <typename T, typename F>
+void ReduceDimensions(const T* input,
+                      tensorflow::gtl::ArraySlice<int64> dimensions,
+                      tensorflow::gtl::ArraySlice<int64> axes, T init,
+                      const F& reduce, T* output) {
+  reduction_internal::ReduceDimensions(
+      input, dimensions, axes, init, reduce, output,
+      std::integral_constant<bool,
+                             reduction_internal::KnownReduceOp<T, F>::value>());
+}
+
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_REDUCTION_H_
@@ -0,0 +1,326 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "reduction.h"
+
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include "intra_op_thread_pool.h"
+#include "kernel_registry.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+class ReductionTest /* : public ::testing::Test */
+{
+public:
+
+   ReductionTest() { run(); }
+
+   void Canonicalization();
+   void KnownOpsMatchNaive();
+   void ArbitraryFunctions();
+   void KnownFunctorsUseInit();
+   void LogSumExpIsStable();
+   void EmptyDimensions();
+   void IndependentOfThreadCount();
+
+   void run();
+};
+
+// Values in [0.83, 1.17], so that products of a few hundred of them stay in
+// range.
+std::vector<float> Values(int64 n, int seed)
+{
+   std::vector<float> values(n);
+   for (int64 i = 0; i < n; ++i) {
+      values[i] =
+          1.0f + static_cast<float>((i * 37 + seed * 11) % 23 - 11) / 64.0f;
+   }
+   return values;
+}
+
+// Reduces input with a scalar double-precision loop over every element.
+std::vector<double> NaiveReduce(ReduceOp op, const std::vector<float>& input,
+                                const std::vector<int64>& dimensions,
+                                const std::vector<int64>& axes)
+{
+   std::vector<bool> reduced(dimensions.size(), false);
+   for (int64 axis : axes) {
+      reduced[axis] = true;
+   }
+   int64 output_size = 1;
+   for (size_t d = 0; d < dimensions.size(); ++d) {
+      if (!reduced[d]) {
+         output_size *= dimensions[d];
+      }
+   }
+   const int64 count = output_size == 0
+                           ? 0
+                           : static_cast<int64>(input.size()) / output_size;
+   const double infinity = std::numeric_limits<double>::infinity();
+   double identity = 0.0;
+   if (op == ReduceOp::kProduct) {
+      identity = 1.0;
+   } else if (op == ReduceOp::kMax || op == ReduceOp::kLogSumExp) {
+      identity = -infinity;
+   } else if (op == ReduceOp::kMin) {
+      identity = infinity;
+   }
+   std::vector<double> result(output_size, identity);
+   std::vector<double> sums(output_size, 0.0);
+   for (int pass = 0; pass < (op == ReduceOp::kLogSumExp ? 2 : 1); ++pass) {
+      for (size_t i = 0; i < input.size(); ++i) {
+         // Decomposes i into the input index and composes the output index.
+         int64 rest = i;
+         int64 out = 0;
+         int64 out_stride = 1;
+         for (int d = static_cast<int>(dimensions.size()) - 1; d >= 0; --d) {
+            const int64 index = rest % dimensions[d];
+            rest /= dimensions[d];
+            if (!reduced[d]) {
+               out += index * out_stride;
+               out_stride *= dimensions[d];
+            }
+         }
+         const double x = input[i];
+         switch (op) {
+            case ReduceOp::kSum:
+            case ReduceOp::kMean:
+               result[out] += x;
+               break;
+            case ReduceOp::kProduct:
+               result[out] *= x;
+               break;
+            case ReduceOp::kMax:
+               result[out] = std::max(result[out], x);
+               break;
+            case ReduceOp::kMin:
+               result[out] = std::min(result[out], x);
+               break;
+            case ReduceOp::kLogSumExp:
+               if (pass == 0) {
+                  result[out] = std::max(result[out], x);
+               } else {
+                  sums[out] += std::exp(x - result[out]);
+               }
+               break;
+         }
+      }
+   }
+   for (int64 i = 0; i < output_size; ++i) {
+      if (op == ReduceOp::kMean && count > 0) {
+         result[i] /= count;
+      } else if (op == ReduceOp::kLogSumExp && count > 0) {
+         result[i] += std::log(sums[i]);
+      }
+   }
+   return result;
+}
+
+void ExpectNear(const std::vector<double>& expected,
+                const std::vector<float>& actual, double tolerance)
+{
+   ASSERT_EQ(expected.size(), actual.size());
+   for (size_t i = 0; i < expected.size(); ++i) {
+      if (std::isinf(expected[i])) {
+         ASSERT_EQ(static_cast<float>(expected[i]), actual[i]);
+      } else {
+         ASSERT_TRUE(std::abs(expected[i] - actual[i]) <=
+                     tolerance * std::max(1.0, std::abs(expected[i])));
+      }
+   }
+}
+
+void ReductionTest::Canonicalization()
+{
+   // The unit dimension is dropped and the three reduced dimensions merge,
+   // leaving the rows of a 2 x 60 matrix.
+   ReductionShape shape = MakeReductionShape({2, 1, 3, 4, 5}, {2, 3, 4});
+   ASSERT_EQ(shape.sizes, std::vector<int64>({2, 60}));
+   ASSERT_EQ(shape.reduced, std::vector<bool>({false, true}));
+   ASSERT_EQ(shape.partition_dimension, 0);
+   ASSERT_EQ(shape.output_size, 2);
+
+   shape = MakeReductionShape({6, 7, 8}, {0, 1});
+   ASSERT_EQ(shape.sizes, std::vector<int64>({42, 8}));
+   ASSERT_EQ(shape.input_strides, std::vector<int64>({8, 1}));
+   ASSERT_EQ(shape.output_strides, std::vector<int64>({0, 1}));
+   ASSERT_EQ(shape.partition_dimension, 1);
+
+   shape = MakeReductionShape({6, 7, 8}, {0, 1, 2});
+   ASSERT_EQ(shape.sizes, std::vector<int64>({336}));
+   ASSERT_EQ(shape.partition_dimension, -1);
+   ASSERT_EQ(shape.output_size, 1);
+}
+
+void ReductionTest::KnownOpsMatchNaive()
+{
+   // Rows shorter and longer than a vector, with and without unit dimensions.
+   for (const std::vector<int64>& dimensions :
+        {std::vector<int64>{3, 1, 5, 7}, std::vector<int64>{2, 9, 4, 37},
+         std::vector<int64>{5, 2, 1, 1}}) {
+      const int rank = static_cast<int>(dimensions.size());
+      int64 size = 1;
+      for (int64 d : dimensions) {
+         size *= d;
+      }
+      const std::vector<float> input = Values(size, rank);
+      for (int mask = 0; mask < (1 << rank); ++mask) {
+         std::vector<int64> axes;
+         for (int d = 0; d < rank; ++d) {
+            if (mask & (1 << d)) {
+               axes.push_back(d);
+            }
+         }
+         for (ReduceOp op : {ReduceOp::kSum, ReduceOp::kProduct, ReduceOp::kMax,
+                             ReduceOp::kMin, ReduceOp::kMean,
+                             ReduceOp::kLogSumExp}) {
+            const std::vector<double> expected =
+                NaiveReduce(op, input, dimensions, axes);
+            std::vector<float> actual(expected.size());
+            ReduceDimensions(op, input.data(), dimensions, axes, actual.data());
+            ExpectNear(expected, actual, 1e-5);
+         }
+      }
+   }
+}
+
+void ReductionTest::ArbitraryFunctions()
+{
+   // A fold that is not one of the known operations, so it runs the generic
+   // path in input order: the sum of squares.
+   const std::vector<int64> dimensions = {4, 6, 19};
+   const std::vector<float> input = Values(4 * 6 * 19, 2);
+   auto sum_of_squares = [](float acc, float x) { return acc + x * x; };
+   for (const std::vector<int64>& axes :
+        {std::vector<int64>{0}, std::vector<int64>{1}, std::vector<int64>{2},
+         std::vector<int64>{0, 2}, std::vector<int64>{0, 1, 2}}) {
+      std::vector<float> squares(input.size());
+      for (size_t i = 0; i < input.size(); ++i) {
+         squares[i] = input[i] * input[i];
+      }
+      std::vector<double> expected =
+          NaiveReduce(ReduceOp::kSum, squares, dimensions, axes);
+      for (double& value : expected) {
+         value += 0.5;
+      }
+      std::vector<float> actual(expected.size());
+      ReduceDimensions(input.data(), dimensions, axes, 0.5f, sum_of_squares,
+                       actual.data());
+      ExpectNear(expected, actual, 1e-5);
+   }
+
+   // Other element types take the generic path too.
+   const std::vector<int64> integers = {1, 2, 3, 4, 5, 6};
+   std::vector<int64> column_sums(3);
+   ReduceDimensions(integers.data(), {2, 3}, {0}, int64{100},
+                    std::plus<int64>(), column_sums.data());
+   ASSERT_EQ(column_sums, std::vector<int64>({105, 107, 109}));
+}
+
+void ReductionTest::KnownFunctorsUseInit()
+{
+   const std::vector<float> input = {1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f};
+   std::vector<float> rows(2);
+   ReduceDimensions(input.data(), {2, 3}, {1}, 10.0f, std::plus<float>(),
+                    rows.data());
+   ASSERT_EQ(rows, std::vector<float>({16.0f, 25.0f}));
+   ReduceDimensions(input.data(), {2, 3}, {1}, 2.0f, std::multiplies<float>(),
+                    rows.data());
+   ASSERT_EQ(rows, std::vector<float>({12.0f, 240.0f}));
+   ReduceDimensions(input.data(), {2, 3}, {1}, 5.0f, MaxFunctor(),
+                    rows.data());
+   ASSERT_EQ(rows, std::vector<float>({5.0f, 6.0f}));
+   ReduceDimensions(input.data(), {2, 3}, {1}, 2.0f, MinFunctor(),
+                    rows.data());
+   ASSERT_EQ(rows, std::vector<float>({1.0f, 2.0f}));
+}
+
+void ReductionTest::LogSumExpIsStable()
+{
+   const float infinity = std::numeric_limits<float>::infinity();
+   const std::vector<float> input = {1000.0f, 1000.0f, -infinity, -infinity,
+                                     -1000.0f, -1000.0f, infinity, 0.0f};
+   std::vector<float> rows(4);
+   ReduceDimensions(ReduceOp::kLogSumExp, input.data(), {4, 2}, {1},
+                    rows.data());
+   ASSERT_TRUE(std::abs(rows[0] - (1000.0f + std::log(2.0f))) < 1e-3f);
+   ASSERT_EQ(rows[1], -infinity);
+   ASSERT_TRUE(std::abs(rows[2] - (-1000.0f + std::log(2.0f))) < 1e-3f);
+   ASSERT_EQ(rows[3], infinity);
+}
+
+void ReductionTest::EmptyDimensions()
+{
+   std::vector<float> columns(5, 7.0f);
+   ReduceDimensions(ReduceOp::kSum, nullptr, {0, 5}, {0}, columns.data());
+   ASSERT_EQ(columns, std::vector<float>(5, 0.0f));
+   ReduceDimensions(ReduceOp::kMean, nullptr, {0, 5}, {0}, columns.data());
+   ASSERT_EQ(columns, std::vector<float>(5, 0.0f));
+   ReduceDimensions(ReduceOp::kMax, nullptr, {0, 5}, {0}, columns.data());
+   ASSERT_EQ(columns,
+             std::vector<float>(5, -std::numeric_limits<float>::infinity()));
+   // No outputs at all.
+   ReduceDimensions(ReduceOp::kSum, nullptr, {0, 5}, {1}, columns.data());
+}
+
+void ReductionTest::IndependentOfThreadCount()
+{
+   const std::vector<int64> dimensions = {37, 3000};
+   const std::vector<float> input = Values(37 * 3000, 9);
+   std::vector<std::vector<float>> results;
+   for (int threads : {1, 3}) {
+      SetIntraOpThreadCount(threads);
+      std::vector<float> all(1), rows(37), columns(3000);
+      ReduceDimensions(ReduceOp::kSum, input.data(), dimensions, {0, 1},
+                       all.data());
+      ReduceDimensions(ReduceOp::kSum, input.data(), dimensions, {1},
+                       rows.data());
+      ReduceDimensions(ReduceOp::kLogSumExp, input.data(), dimensions, {0},
+                       columns.data());
+      all.insert(all.end(), rows.begin(), rows.end());
+      all.insert(all.end(), columns.begin(), columns.end());
+      results.push_back(all);
+   }
+   SetIntraOpThreadCount(0);
+   ASSERT_EQ(results[0], results[1]);
+}
+
+void ReductionTest::run()
+{
+   for (int i = 0; i < kNumIsas; ++i) {
+      const Isa isa = static_cast<Isa>(i);
+      if (!IsaSupported(isa)) {
+         continue;
+      }
+      SetMaxIsa(isa);
+      KnownOpsMatchNaive();
+      ArbitraryFunctions();
+   }
+   SetMaxIsa(static_cast<Isa>(kNumIsas - 1));
+   Canonicalization();
+   KnownFunctorsUseInit();
+   LogSumExpIsStable();
+   EmptyDimensions();
+   IndependentOfThreadCount();
+}
+
+}  // namespace
+}  // namespace xla
@@ -15,23 +15,249 @@ limitations under the License.
 
 #include "reference_util.h"
 
+#include <limits>
+
+#include "conv_backprop.h"
+#include "conv_fft.h"
+#include "conv_im2col.h"
+#include "conv_plan.h"
+#include "conv_quantized.h"
+#include "conv_separable.h"
+#include "intra_op_thread_pool.h"
+#include "sliding_window.h"
+#include "transpose.h"
 #include "window_util.h"
 #include "xla_data.pb.h"
 #include "math_util.h"
 #include "logging.h"
 
 namespace xla {
+namespace {
 
-/* static */
-std::unique_ptr<Array2D<float>> ReferenceUtil::TransposeArray2D(const Array2D<float>& operand) 
+// Evaluates the convolution with one scalar multiply-add per tap; this is the
+// definition of ConvArray4DGeneralDimensionsDilated.
+std::unique_ptr<Array4D<float>> ConvArray4DDirect(
+   const Array4D<float>& lhs,
+   const Array4D<float>& rhs,
+   std::pair<int64, int64> kernel_stride,
+   Padding padding,
+   std::pair<int64, int64> lhs_dilation,
+   std::pair<int64, int64> rhs_dilation,
+   const ConvolutionDimensionNumbers& dnums,
+   int64 feature_group_count)
 {
-  auto result = MakeUnique<Array2D<float>>(operand.width(), operand.height());
-  for (int64 w = 0; w < operand.width(); ++w) {
-    for (int64 h = 0; h < operand.height(); ++h) {
-      (*result)(w, h) = operand(h, w);
+  std::array<int64, 4> lhs_dimensions{{lhs.n1(), lhs.n2(), lhs.n3(), lhs.n4()}};
+  std::array<int64, 4> rhs_dimensions{{rhs.n1(), rhs.n2(), rhs.n3(), rhs.n4()}};
+
+  const int64 ksy = kernel_stride.first;
+  const int64 ksx = kernel_stride.second;
+  const int64 dy = lhs_dilation.first;
+  const int64 dx = lhs_dilation.second;
+  const int64 dky = rhs_dilation.first;
+  const int64 dkx = rhs_dilation.second;
+  CHECK_GE(dky, 1);
+  CHECK_GE(dkx, 1);
+  CHECK_GE(dy, 1);
+  CHECK_GE(dx, 1);
+
+  // Get all dimension sizes in lhs and rhs based on the given convolution
+  // dimension configuration.
+  const int64 ix = window_util::DilatedBound(
+      lhs_dimensions[dnums.spatial_dimensions(1)], dx);
+  const int64 iy = window_util::DilatedBound(
+      lhs_dimensions[dnums.spatial_dimensions(0)], dy);
+  const int64 iz = lhs_dimensions[dnums.feature_dimension()];
+  const int64 samples = lhs_dimensions[dnums.batch_dimension()];
+  const int64 kx = window_util::DilatedBound(
+      rhs_dimensions[dnums.kernel_spatial_dimensions(1)], dkx);
+  const int64 ky = window_util::DilatedBound(
+      rhs_dimensions[dnums.kernel_spatial_dimensions(0)], dky);
+  const int64 oz = rhs_dimensions[dnums.kernel_output_feature_dimension()];
+  // Input and kernel features of one feature group, and its output features.
+  const int64 kiz = rhs_dimensions[dnums.kernel_input_feature_dimension()];
+  CHECK_GE(feature_group_count, 1);
+  CHECK_EQ(iz % feature_group_count, 0);
+  CHECK_EQ(oz % feature_group_count, 0);
+  CHECK_EQ(kiz, iz / feature_group_count);
+  const int64 group_oz = oz / feature_group_count;
+
+  if (padding == Padding::kSame) {
+    // We reject same padding with kernel striding, since it's somewhat
+    // nonsensical. We can always follow up to implement this with the desired
+    // semantics if anybody actually uses it.
+    CHECK_EQ(1, ksy);
+    CHECK_EQ(1, ksx);
+  }
+
+  const int64 ox = (padding == Padding::kSame) ?
+     ix :
+     window_util::StridedBound(ix, kx, ksx);
+
+  const int64 oy = (padding == Padding::kSame) ?
+     iy :
+     window_util::StridedBound(iy, ky, ksy);
+
+  const int64 istartx = (padding == Padding::kValid) ?
+     0 :
+     (kx % 2 == 0) ? -(kx / 2 - 1) : -kx / 2;
+
+  const int64 istarty = (padding == Padding::kValid) ?
+     0 :
+     (ky % 2 == 0) ? -(ky / 2 - 1) : -ky / 2;
+
+  // Create the output result array and reset the values to 0.
+  std::array<int64, 4> result_dimensions;
+  result_dimensions[dnums.batch_dimension()] = samples;
+  result_dimensions[dnums.feature_dimension()] = oz;
+  result_dimensions[dnums.spatial_dimensions(0)] = oy;
+  result_dimensions[dnums.spatial_dimensions(1)] = ox;
+  
+  auto result = MakeUnique<Array4D<float>>(result_dimensions[0], result_dimensions[1],
+                                           result_dimensions[2], result_dimensions[3]);
+  result->Fill(0.0);
+
+  // Lambda to access the lhs operand at the given 4D index.
+  const auto lhs_element = [&](int64 batch, int64 feature, int64 height,
+                               int64 width) 
+  {
+    if (height % dy != 0 || width % dx != 0)
+    {
+      return 0.0f;
     }
+
+    std::array<int64, 4> index;
+    index[dnums.batch_dimension()] = batch;
+    index[dnums.feature_dimension()] = feature;
+    index[dnums.spatial_dimensions(0)] = height / dy;
+    index[dnums.spatial_dimensions(1)] = width / dx;
+    return lhs(index[0], index[1], index[2], index[3]);
+  };
+
+  // Lambda to access the rhs operand at the given 4D index.
+  const auto rhs_element = [&](int64 kernel_output_feature,
+                               int64 kernel_input_feature, int64 height,
+                               int64 width) {
+    CHECK_EQ(height % dky, 0);
+    CHECK_EQ(width % dkx, 0);
+    std::array<int64, 4> index;
+    index[dnums.kernel_output_feature_dimension()] = kernel_output_feature;
+    index[dnums.kernel_input_feature_dimension()] = kernel_input_feature;
+    index[dnums.kernel_spatial_dimensions(0)] = height / dky;
+    index[dnums.kernel_spatial_dimensions(1)] = width / dkx;
+    return rhs(index[0], index[1], index[2], index[3]);
+  };
+
+  // Lambda to access the result data at the given 4D index.
+  const auto result_element = [&](int64 batch, int64 kernel_output_feature,
+                                  int64 height, int64 width) -> float& 
+  {
+    std::array<int64, 4> index;
+    index[dnums.batch_dimension()] = batch;
+    index[dnums.feature_dimension()] = kernel_output_feature;
+    index[dnums.spatial_dimensions(0)] = height;
+    index[dnums.spatial_dimensions(1)] = width;
+    return (*result)(index[0], index[1], index[2], index[3]);
+  };
+
+  // Output rows are independent, so they are spread over the intra-op pool.
+  // The accumulation order of every output element is unchanged.
+  const int64 row_cost = ox * samples * kiz * oz * (ky / dky) * (kx / dkx);
+  ParallelFor(oy, row_cost, [&](int64 first_row, int64 last_row) {
+    for (int64 oyi = first_row; oyi < last_row; ++oyi) {
+      for (int64 oxi = 0; oxi < ox; ++oxi) {
+        for (int64 sample = 0; sample < samples; ++sample) {
+          for (int64 kizi = 0; kizi < kiz; ++kizi) {
+            for (int64 ozi = 0; ozi < oz; ++ozi) {
+              const int64 izi = ozi / group_oz * kiz + kizi;
+              for (int64 kyi = 0; kyi < ky; kyi += dky) {
+                for (int64 kxi = 0; kxi < kx; kxi += dkx) {
+                  int64 iyi = istarty + ksy * oyi + kyi;
+                  int64 ixi = istartx + ksx * oxi + kxi;
+                  float input = (iyi >= iy || ixi >= ix || iyi < 0 || ixi < 0)
+                                    ? 0.0f
+                                    : lhs_element(sample, izi, iyi, ixi);
+                  float gain = rhs_element(ozi, kizi, kyi, kxi);
+                  float addend = input * gain;
+                  result_element(sample, ozi, oyi, oxi) += addend;
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  });
+  return result;
+}
+
+// The window dimensions of an operand padded as MakePadding pads it for
+// padding. Padding is left out of every window, so it reads as the identity
+// of the reduction.
+std::vector<SlidingWindowDimension> MakeSlidingWindows(
+    tensorflow::gtl::ArraySlice<int64> dimensions,
+    tensorflow::gtl::ArraySlice<int64> window,
+    tensorflow::gtl::ArraySlice<int64> stride, Padding padding)
+{
+  CHECK_EQ(window.size(), dimensions.size());
+  CHECK_EQ(stride.size(), dimensions.size());
+  const auto padding_both = MakePadding(dimensions, window, stride, padding);
+  std::vector<SlidingWindowDimension> windows;
+  for (size_t i = 0; i < dimensions.size(); ++i) {
+    windows.push_back(MakeSlidingWindowDimension(
+        dimensions[i], window[i], stride[i], padding_both[i].first,
+        padding_both[i].second));
   }
+  return windows;
+}
+
+// Reduces every window of operand padded with padding; padding reads as
+// pad_value.
+std::unique_ptr<Array4D<float>> ReduceWindow4DPadded(
+    ReduceOp op, const Array4D<float>& operand, float init,
+    const tensorflow::gtl::ArraySlice<int64>& window,
+    const tensorflow::gtl::ArraySlice<int64>& stride,
+    const PaddingConfig& padding, float pad_value)
+{
+  CHECK_EQ(window.size(), 4);
+  CHECK_EQ(stride.size(), 4);
+  CHECK_EQ(padding.dimensions_size(), 4);
+  const std::array<int64, 4> sizes{
+      {operand.n1(), operand.n2(), operand.n3(), operand.n4()}};
+  std::vector<SlidingWindowDimension> windows;
+  for (int i = 0; i < 4; ++i) {
+    windows.push_back(MakeSlidingWindowDimension(sizes[i], window[i],
+                                                 stride[i],
+                                                 padding.dimensions(i)));
+  }
+  auto result = MakeUnique<Array4D<float>>(
+      SlidingWindowCount(windows[0]), SlidingWindowCount(windows[1]),
+      SlidingWindowCount(windows[2]), SlidingWindowCount(windows[3]));
+  SlidingWindowReduce(op, operand.data(), sizes, windows, init, pad_value,
+                      result->flatten().data());
+  return result;
+}
+
+// Checks that output_gradient has the shape of the convolution output.
+void CheckOutputGradientShape(const conv::ConvGeometry& geometry,
+                              const Array4D<float>& output_gradient,
+                              const ConvolutionDimensionNumbers& dnums)
+{
+  const std::array<int64, 4> dims{{output_gradient.n1(), output_gradient.n2(),
+                                   output_gradient.n3(), output_gradient.n4()}};
+  CHECK_EQ(dims[dnums.batch_dimension()], geometry.batch);
+  CHECK_EQ(dims[dnums.feature_dimension()], geometry.output_features);
+  CHECK_EQ(dims[dnums.spatial_dimensions(0)], geometry.output_height);
+  CHECK_EQ(dims[dnums.spatial_dimensions(1)], geometry.output_width);
+}
+
+}  // namespace
 
+/* static */
+std::unique_ptr<Array2D<float>> ReferenceUtil::TransposeArray2D(const Array2D<float>& operand) 
+{
+  auto result = MakeUnique<Array2D<float>>(operand.width(), operand.height());
+  Transpose2D(operand.data(), operand.height(), operand.width(),
+              result->data());
   return result;
 }
 
@@ -66,6 +292,98 @@ std::unique_ptr<Array2D<double>> ReferenceUtil::MatmulArray2D(
   return result;
 }
 
+/* static */
+std::unique_ptr<Array2D<float>> ReferenceUtil::MatmulArray2D(
+   const Array2D<float>& lhs,
+   const Array2D<float>& rhs,
+   const std::vector<float>& bias,
+   const Array2D<float>* residual,
+   ActivationFunction activation,
+   float scale)
+{
+  CHECK_EQ(lhs.width(), rhs.height());
+  const int64 m = lhs.height();
+  const int64 n = rhs.width();
+  const int64 k = lhs.width();
+  auto result = MakeUnique<Array2D<float>>(m, n);
+
+  gemm::Epilogue<float> epilogue;
+  if (!bias.empty()) {
+    CHECK_EQ(int64(bias.size()), n);
+    epilogue.bias = bias.data();
+  }
+  if (residual != nullptr) {
+    CHECK_EQ(residual->height(), m);
+    CHECK_EQ(residual->width(), n);
+    epilogue.residual = residual->data();
+    epilogue.residual_ld = n;
+  }
+  epilogue.activation = activation;
+  epilogue.scale = scale;
+  gemm::Gemm<float>(gemm::Transpose::kNoTranspose,
+                    gemm::Transpose::kNoTranspose, m, n, k, 1.0f, lhs.data(),
+                    k, rhs.data(), n, 0.0f, result->data(), n, epilogue);
+  return result;
+}
+
+namespace {
+
+template <typename Sparse>
+std::unique_ptr<Array2D<float>> SparseDenseMatmul(const Sparse& lhs,
+                                                  const Array2D<float>& rhs)
+{
+  CHECK_EQ(lhs.cols, rhs.height());
+  auto result = MakeUnique<Array2D<float>>(lhs.rows, rhs.width());
+  sparse::SparseDenseMatMul(lhs, rhs.width(), rhs.data(), rhs.width(),
+                            result->data(), rhs.width());
+  return result;
+}
+
+template <typename Sparse>
+std::unique_ptr<Array2D<float>> DenseSparseMatmul(const Array2D<float>& lhs,
+                                                  const Sparse& rhs)
+{
+  CHECK_EQ(lhs.width(), rhs.rows);
+  auto result = MakeUnique<Array2D<float>>(lhs.height(), rhs.cols);
+  sparse::DenseSparseMatMul(lhs.height(), lhs.data(), lhs.width(), rhs,
+                            result->data(), rhs.cols);
+  return result;
+}
+
+}  // namespace
+
+/* static */
+std::unique_ptr<Array2D<float>> ReferenceUtil::MatmulArray2D(
+   const sparse::CsrMatrix& lhs,
+   const Array2D<float>& rhs)
+{
+  return SparseDenseMatmul(lhs, rhs);
+}
+
+/* static */
+std::unique_ptr<Array2D<float>> ReferenceUtil::MatmulArray2D(
+   const Array2D<float>& lhs,
+   const sparse::CsrMatrix& rhs)
+{
+  return DenseSparseMatmul(lhs, rhs);
+}
+
+/* static */
+std::unique_ptr<Array2D<float>> ReferenceUtil::MatmulArray2D(
+   const sparse::BsrMatrix& lhs,
+   const Array2D<float>& rhs)
+{
+  return SparseDenseMatmul(lhs, rhs);
+}
+
+/* static */
+std::unique_ptr<Array2D<float>> ReferenceUtil::MatmulArray2D(
+   const Array2D<float>& lhs,
+   const sparse::BsrMatrix& rhs)
+{
+  return DenseSparseMatmul(lhs, rhs);
+}
+
 /* static */
 std::unique_ptr<Array2D<double>> ReferenceUtil::Array2DF32ToF64(
     const Array2D<float>& input)
@@ -169,6 +487,113 @@ std::unique_ptr<Array4D<float>> ReferenceUtil::Conv4D(
       lhs, rhs, kernel_stride, padding, CreateDefaultConvDimensionNumbers());
 }
 
+/* static */
+std::unique_ptr<Array4D<float>> ReferenceUtil::Conv4D(
+   const Array4D<float>& lhs,
+   const Array4D<float>& rhs,
+   std::pair<int64, int64> kernel_stride,
+   Padding padding,
+   conv::ConvAlgorithm algorithm)
+{
+  return ConvArray4DGeneralDimensionsDilated(
+      lhs, rhs, kernel_stride, padding, {1, 1}, {1, 1},
+      CreateDefaultConvDimensionNumbers(), algorithm);
+}
+
+namespace {
+
+// Conv4D for operands stored in 16 bits, which are in the default (canonical)
+// dimension order already.
+template <typename S>
+std::unique_ptr<Array4D<float>> SixteenBitConv4D(
+    const Array4D<S>& lhs, const Array4D<S>& rhs,
+    std::pair<int64, int64> kernel_stride, Padding padding)
+{
+  const conv::ConvGeometry geometry = conv::MakeConvGeometry(
+      {{lhs.n1(), lhs.n2(), lhs.n3(), lhs.n4()}},
+      {{rhs.n1(), rhs.n2(), rhs.n3(), rhs.n4()}}, kernel_stride, padding,
+      {1, 1}, {1, 1}, CreateDefaultConvDimensionNumbers());
+  auto result = MakeUnique<Array4D<float>>(
+      geometry.batch, geometry.output_features, geometry.output_height,
+      geometry.output_width);
+  conv::ConvIm2Col(geometry, lhs.data(), rhs.data(), conv::ConvEpilogue(),
+                   result->flatten().data());
+  return result;
+}
+
+}  // namespace
+
+/* static */
+std::unique_ptr<Array4D<float>> ReferenceUtil::Conv4D(
+   const Array4D<half>& lhs,
+   const Array4D<half>& rhs,
+   std::pair<int64, int64> kernel_stride,
+   Padding padding)
+{
+  return SixteenBitConv4D(lhs, rhs, kernel_stride, padding);
+}
+
+/* static */
+std::unique_ptr<Array4D<float>> ReferenceUtil::Conv4D(
+   const Array4D<bfloat16>& lhs,
+   const Array4D<bfloat16>& rhs,
+   std::pair<int64, int64> kernel_stride,
+   Padding padding)
+{
+  return SixteenBitConv4D(lhs, rhs, kernel_stride, padding);
+}
+
+/* static */
+bool ReferenceUtil::Conv2DFft(
+   const Array4D<float>& input,
+   const Array2D<float>& kernel,
+   const tensorflow::gtl::ArraySlice<int64>& stride,
+   Padding padding,
+   std::unique_ptr<Array4D<float>>* result)
+{
+  if (stride[0] != 1 || stride[1] != 1) {
+    return false;
+  }
+  const std::vector<int64> dim_lengths{input.n3(), input.n4()};
+  const auto padding_both = MakePadding(
+      dim_lengths, {kernel.height(), kernel.width()}, stride, padding);
+
+  // Conv2D applies the one kernel to every input channel and sums them: a
+  // convolution with a single output feature whose filter repeats the kernel.
+  conv::ConvGeometry geometry;
+  geometry.batch = input.n1();
+  geometry.input_features = input.n2();
+  geometry.input_height = input.n3();
+  geometry.input_width = input.n4();
+  geometry.output_features = 1;
+  geometry.kernel_height = kernel.height();
+  geometry.kernel_width = kernel.width();
+  geometry.output_height =
+      WindowCount(input.n3(), kernel.height(), stride[0], padding);
+  geometry.output_width =
+      WindowCount(input.n4(), kernel.width(), stride[1], padding);
+  geometry.stride_y = geometry.stride_x = 1;
+  geometry.lhs_dilation_y = geometry.lhs_dilation_x = 1;
+  geometry.rhs_dilation_y = geometry.rhs_dilation_x = 1;
+  geometry.pad_top = padding_both[0].first;
+  geometry.pad_left = padding_both[1].first;
+  if (!conv::PreferFft(geometry)) {
+    return false;
+  }
+
+  std::vector<float> filter;
+  filter.reserve(input.n2() * kernel.num_elements());
+  for (int64 c = 0; c < input.n2(); ++c) {
+    filter.insert(filter.end(), kernel.data(),
+                  kernel.data() + kernel.num_elements());
+  }
+  *result = MakeUnique<Array4D<float>>(input.n1(), 1, geometry.output_height,
+                                       geometry.output_width);
+  conv::ConvFft(geometry, input.data(), filter.data(),
+                (*result)->flatten().data());
+  return true;
+}
+
 /* static */
 std::unique_ptr<Array4D<float>> ReferenceUtil::SeparableConvArray4D(
    const Array4D<float>& input,
@@ -179,28 +604,50 @@ std::unique_ptr<Array4D<float>> ReferenceUtil::SeparableConvArray4D(
 {
   const int64 depth_multiplier = depthwise_weights.planes();
   CHECK_EQ(pointwise_weights.depth(), input.depth() * depth_multiplier);
+  CHECK_EQ(pointwise_weights.height(), 1);
+  CHECK_EQ(pointwise_weights.width(), 1);
+
+  // The default dimension numbers are the canonical layouts, so the operands
+  // are used in place. The depthwise stage yields depth_multiplier features
+  // per input feature.
+  conv::ConvGeometry geometry = conv::MakeConvGeometry(
+      input, depthwise_weights, kernel_stride, padding, {1, 1}, {1, 1},
+      CreateDefaultConvDimensionNumbers());
+  geometry.output_features = input.depth() * depth_multiplier;
+
+  auto result = MakeUnique<Array4D<float>>(
+      input.planes(), pointwise_weights.planes(), geometry.output_height,
+      geometry.output_width);
+  conv::SeparableConv(geometry, depth_multiplier, input.data(),
+                      depthwise_weights.data(), pointwise_weights.planes(),
+                      pointwise_weights.data(), result->flatten().data());
+  return result;
+}
 
-  // Combine the two weights by reducing the depth_multiplier, so that we can
-  // apply a single convolution on the combined weights.
-  Array4D<float> weights(pointwise_weights.planes(), input.depth(),
-                         depthwise_weights.height(), depthwise_weights.width());
-  for (int64 kx = 0; kx < depthwise_weights.width(); ++kx) {
-    for (int64 ky = 0; ky < depthwise_weights.height(); ++ky) {
-      for (int64 kz = 0; kz < input.depth(); ++kz) {
-        for (int64 out = 0; out < pointwise_weights.planes(); ++out) {
-          float weight = 0.0;
-          for (int64 depth = 0; depth < depth_multiplier; ++depth) {
-            weight +=
-                depthwise_weights(depth, kz, ky, kx) *
-                pointwise_weights(out, depth + kz * depth_multiplier, 0, 0);
-          }
-          weights(out, kz, ky, kx) = weight;
-        }
-      }
-    }
-  }
-
-  return Conv4D(input, weights, kernel_stride, padding);
+/* static */
+std::unique_ptr<Array4D<float>> ReferenceUtil::QuantizedConvArray4D(
+   const Array4D<float>& input,
+   const quant::QuantizationParams& input_params,
+   const quant::QuantizedFilter& filter,
+   std::pair<int64, int64> kernel_stride,
+   Padding padding)
+{
+  const conv::ConvGeometry geometry = conv::MakeConvGeometry(
+      {{input.n1(), input.n2(), input.n3(), input.n4()}},
+      {{filter.output_features, filter.input_features, filter.kernel_height,
+        filter.kernel_width}},
+      kernel_stride, padding, {1, 1}, {1, 1},
+      CreateDefaultConvDimensionNumbers());
+  std::vector<uint8> quantized(input.num_elements());
+  quant::Quantize(input.data(), input.num_elements(), input_params,
+                  quantized.data());
+
+  auto result = MakeUnique<Array4D<float>>(
+      geometry.batch, geometry.output_features, geometry.output_height,
+      geometry.output_width);
+  conv::QuantizedConv(geometry, quantized.data(), input_params, filter,
+                      quant::OutputStage(), result->flatten().data());
+  return result;
 }
 
 /* static */
@@ -225,57 +672,42 @@ std::unique_ptr<Array4D<float>> ReferenceUtil::ReduceWindow4DAdd(
    const tensorflow::gtl::ArraySlice<int64>& stride,
    Padding padding)
 {
-   std::vector<int64> dim_lengths{ operand.n1(), operand.n2(), operand.n3(),
-      operand.n4() };
+  CHECK_EQ(window.size(), 4);
+  const std::vector<int64> dim_lengths{operand.n1(), operand.n2(),
+                                       operand.n3(), operand.n4()};
+  const auto windows = MakeSlidingWindows(dim_lengths, window, stride, padding);
+  auto result = MakeUnique<Array4D<float>>(
+      SlidingWindowCount(windows[0]), SlidingWindowCount(windows[1]),
+      SlidingWindowCount(windows[2]), SlidingWindowCount(windows[3]));
+  SlidingWindowReduce(ReduceOp::kSum, operand.data(), dim_lengths, windows,
+                      init, 0.0f, result->flatten().data());
+  return result;
+}
 
-   CHECK_GE(window.size(), 4);
-   auto padding_both = xla::MakePadding(dim_lengths, window, stride, padding);
+/* static */
+std::unique_ptr<Array4D<float>> ReferenceUtil::ReduceWindow4DAdd(
+   const Array4D<float>& operand,
+   float init,
+   const tensorflow::gtl::ArraySlice<int64>& window,
+   const tensorflow::gtl::ArraySlice<int64>& stride,
+   const PaddingConfig& padding,
+   float pad_value)
+{
+  return ReduceWindow4DPadded(ReduceOp::kSum, operand, init, window, stride,
+                              padding, pad_value);
+}
 
-   std::vector<int64> window_counts(window.size(), 0);
-   std::vector<int64> pad_low(window.size(), 0);
-   for (size_t i = 0; i < window.size(); ++i)
-   {
-      window_counts[i] =
-         WindowCount(dim_lengths[i], window[i], stride[i], padding);
-      pad_low[i] = padding_both[i].first;
-   }
-   auto result = MakeUnique<Array4D<float>>(window_counts[0], window_counts[1],
-      window_counts[2], window_counts[3]);
-
-   // Do a full 4D reduce window.
-   for (int64 i0 = 0; i0 < window_counts[0]; ++i0) {
-      for (int64 i1 = 0; i1 < window_counts[1]; ++i1) {
-         for (int64 i2 = 0; i2 < window_counts[2]; ++i2) {
-            for (int64 i3 = 0; i3 < window_counts[3]; ++i3) {
-               int64 i0_base = i0 * stride[0] - pad_low[0];
-               int64 i1_base = i1 * stride[1] - pad_low[1];
-               int64 i2_base = i2 * stride[2] - pad_low[2];
-               int64 i3_base = i3 * stride[3] - pad_low[3];
-
-               float val = init;
-               for (int64 i0_win = 0; i0_win < window[0]; ++i0_win) {
-                  for (int64 i1_win = 0; i1_win < window[1]; ++i1_win) {
-                     for (int64 i2_win = 0; i2_win < window[2]; ++i2_win) {
-                        for (int64 i3_win = 0; i3_win < window[3]; ++i3_win) {
-                           if (i0_base + i0_win >= 0 && i1_base + i1_win >= 0 &&
-                              i2_base + i2_win >= 0 && i3_base + i3_win >= 0 &&
-                              i0_base + i0_win < operand.n1() &&
-                              i1_base + i1_win < operand.n2() &&
-                              i2_base + i2_win < operand.n3() &&
-                              i3_base + i3_win < operand.n4()) {
-                              val += operand(i0_base + i0_win, i1_base + i1_win,
-                                 i2_base + i2_win, i3_base + i3_win);
-                           }
-                        }
-                     }
-                  }
-               }
-               (*result)(i0, i1, i2, i3) = val;
-            }
-         }
-      }
-   }
-   return result;
+/* static */
+std::unique_ptr<Array4D<float>> ReferenceUtil::ReduceWindow4DMax(
+   const Array4D<float>& operand,
+   float init,
+   const tensorflow::gtl::ArraySlice<int64>& window,
+   const tensorflow::gtl::ArraySlice<int64>& stride,
+   const PaddingConfig& padding,
+   float pad_value)
+{
+  return ReduceWindow4DPadded(ReduceOp::kMax, operand, init, window, stride,
+                              padding, pad_value);
 }
 
 /* static */
@@ -285,49 +717,15 @@ std::unique_ptr<Array3D<float>> ReferenceUtil::ReduceWindow3D(
    const tensorflow::gtl::ArraySlice<int64>& stride,
    Padding padding)
 {
-  std::vector<int64> dim_lengths{operand.n1(), operand.n2(), operand.n3()};
-
   CHECK_EQ(window.size(), 3);
-  auto padding_both = xla::MakePadding(dim_lengths, window, stride, padding);
-
-  std::vector<int64> window_counts(window.size(), 0);
-  std::vector<int64> pad_low(window.size(), 0);
-  for (size_t i = 0; i < window.size(); ++i)
-  {
-    window_counts[i] =
-        WindowCount(dim_lengths[i], window[i], stride[i], padding);
-    pad_low[i] = padding_both[i].first;
-  }
-  auto result = MakeUnique<Array3D<float>>(window_counts[0], window_counts[1], window_counts[2]);
-  // Do a full 3D reduce window.
-  for (int64 i0 = 0; i0 < window_counts[0]; ++i0) {
-    for (int64 i1 = 0; i1 < window_counts[1]; ++i1) {
-      for (int64 i2 = 0; i2 < window_counts[2]; ++i2) {
-          int64 i0_base = i0 * stride[0] - pad_low[0];
-          int64 i1_base = i1 * stride[1] - pad_low[1];
-          int64 i2_base = i2 * stride[2] - pad_low[2];
-
-          float val = 0.f;
-          for (int64 i0_win = 0; i0_win < window[0]; ++i0_win) {
-            for (int64 i1_win = 0; i1_win < window[1]; ++i1_win) {
-              for (int64 i2_win = 0; i2_win < window[2]; ++i2_win) {
-
-               if (i0_base + i0_win >= 0 && i1_base + i1_win >= 0 &&
-                     i2_base + i2_win >= 0  &&
-                     i0_base + i0_win < operand.n1() &&
-                     i1_base + i1_win < operand.n2() &&
-                     i2_base + i2_win < operand.n3()) 
-               {
-                  val += operand(i0_base + i0_win, i1_base + i1_win, i2_base + i2_win);
-               }
-              }
-            }
-          }
-          (*result)(i0, i1, i2) = val;
-        }
-      }
-    }
-
+  const std::vector<int64> dim_lengths{operand.n1(), operand.n2(),
+                                       operand.n3()};
+  const auto windows = MakeSlidingWindows(dim_lengths, window, stride, padding);
+  auto result = MakeUnique<Array3D<float>>(SlidingWindowCount(windows[0]),
+                                           SlidingWindowCount(windows[1]),
+                                           SlidingWindowCount(windows[2]));
+  SlidingWindowReduce(ReduceOp::kSum, operand.data(), dim_lengths, windows,
+                      0.0f, 0.0f, result->flatten().data());
   return result;
 }
 
@@ -338,42 +736,13 @@ std::unique_ptr<Array2D<float>> ReferenceUtil::ReduceWindow2D(
    const tensorflow::gtl::ArraySlice<int64>& stride,
    Padding padding)
 {
-  std::vector<int64> dim_lengths{operand.n1(), operand.n2()};
-
   CHECK_EQ(window.size(), 2);
-  auto padding_both = xla::MakePadding(dim_lengths, window, stride, padding);
-
-  std::vector<int64> window_counts(window.size(), 0);
-  std::vector<int64> pad_low(window.size(), 0);
-  for (size_t i = 0; i < window.size(); ++i)
-  {
-    window_counts[i] =
-        WindowCount(dim_lengths[i], window[i], stride[i], padding);
-    pad_low[i] = padding_both[i].first;
-  }
-  auto result = MakeUnique<Array2D<float>>(window_counts[0], window_counts[1]);
-  // Do a full 2D reduce window.
-  for (int64 i0 = 0; i0 < window_counts[0]; ++i0) {
-    for (int64 i1 = 0; i1 < window_counts[1]; ++i1) {
-         int64 i0_base = i0 * stride[0] - pad_low[0];
-         int64 i1_base = i1 * stride[1] - pad_low[1];
-
-         float val = 0.f;
-         for (int64 i0_win = 0; i0_win < window[0]; ++i0_win) {
-         for (int64 i1_win = 0; i1_win < window[1]; ++i1_win) {
-            if (i0_base + i0_win >= 0 && i1_base + i1_win >= 0 &&
-                  i0_base + i0_win < operand.n1() &&
-                  i1_base + i1_win < operand.n2() ) 
-            {
-               val += operand(i0_base + i0_win, i1_base + i1_win);
-            }
-         }
-      }
-
-      (*result)(i0, i1) = val;
-      }
-   }
-
+  const std::vector<int64> dim_lengths{operand.n1(), operand.n2()};
+  const auto windows = MakeSlidingWindows(dim_lengths, window, stride, padding);
+  auto result = MakeUnique<Array2D<float>>(SlidingWindowCount(windows[0]),
+                                           SlidingWindowCount(windows[1]));
+  SlidingWindowReduce(ReduceOp::kSum, operand.data(), dim_lengths, windows,
+                      0.0f, 0.0f, result->data());
   return result;
 }
 
@@ -386,14 +755,17 @@ std::unique_ptr<Array4D<float>> ReferenceUtil::BatchNorm4D(
    const Array4D<float>& offset,
    float epsilon)
 {
-  auto normalized =
-      *MapArray4D(input, mean, [](float a, float b) { return a - b; });
-  normalized = *MapArray4D(normalized, var, [&](float a, float b) {
-    return a / std::sqrt(b + epsilon);
-  });
-  normalized =
-      *MapArray4D(normalized, scale, [](float a, float b) { return a * b; });
-  return MapArray4D(normalized, offset, [](float a, float b) { return a + b; });
+  // A single pass over the input; the float rounding of every intermediate is
+  // the same as applying the four element-wise steps one after another.
+  return MapWithIndexArray4D(
+      input, [&](float value, int64 plane, int64 depth, int64 height,
+                 int64 width) {
+        float normalized = value - mean(plane, depth, height, width);
+        normalized =
+            normalized / std::sqrt(var(plane, depth, height, width) + epsilon);
+        normalized = normalized * scale(plane, depth, height, width);
+        return normalized + offset(plane, depth, height, width);
+      });
 }
 
 /* static */
@@ -405,74 +777,62 @@ std::unique_ptr<Array4D<float>> ReferenceUtil::SelectAndScatter4DGePlus(
    const tensorflow::gtl::ArraySlice<int64>& stride,
    bool same_padding)
 {
-  Padding padding = same_padding ? Padding::kSame : Padding::kValid;
-  auto result = MakeUnique<Array4D<float>>(operand.n1(), operand.n2(),
-                                           operand.n3(), operand.n4());
-  std::vector<int64> dim_lengths{operand.n1(), operand.n2(), operand.n3(),
-                                 operand.n4()};
+  CHECK_EQ(window.size(), 4);
+  const Padding padding = same_padding ? Padding::kSame : Padding::kValid;
+  Array4D<int32> argmax(0, 0, 0, 0);
+  MaxPool4DWithArgmax(operand, window, stride, padding, &argmax);
+  CHECK_EQ(argmax.n1(), source.n1());
+  CHECK_EQ(argmax.n2(), source.n2());
+  CHECK_EQ(argmax.n3(), source.n3());
+  CHECK_EQ(argmax.n4(), source.n4());
+  return MaxPool4DBackward(
+      argmax, source, init,
+      {operand.n1(), operand.n2(), operand.n3(), operand.n4()}, window,
+      stride, padding);
+}
 
+/* static */
+std::unique_ptr<Array4D<float>> ReferenceUtil::MaxPool4DWithArgmax(
+   const Array4D<float>& operand,
+   const tensorflow::gtl::ArraySlice<int64>& window,
+   const tensorflow::gtl::ArraySlice<int64>& stride,
+   Padding padding,
+   Array4D<int32>* argmax)
+{
   CHECK_EQ(window.size(), 4);
-  auto padding_both = xla::MakePadding(dim_lengths, window, stride, padding);
-  // Fill the output, with the initial value.
-  result->Fill(init);
-
-  std::vector<int64> window_counts(window.size(), 0);
-  std::vector<int64> pad_low(window.size(), 0);
-  for (size_t i = 0; i < window.size(); ++i) {
-    window_counts[i] =
-        WindowCount(dim_lengths[i], window[i], stride[i], padding);
-    pad_low[i] = padding_both[i].first;
-  }
-  CHECK_EQ(window_counts[0], source.n1());
-  CHECK_EQ(window_counts[1], source.n2());
-  CHECK_EQ(window_counts[2], source.n3());
-  CHECK_EQ(window_counts[3], source.n4());
-
-  // Do a full 4D select and Scatter.
-  for (int64 i0 = 0; i0 < window_counts[0]; ++i0) {
-    for (int64 i1 = 0; i1 < window_counts[1]; ++i1) {
-      for (int64 i2 = 0; i2 < window_counts[2]; ++i2) {
-        for (int64 i3 = 0; i3 < window_counts[3]; ++i3) {
-          // Now we are inside a window and need to find the max and the argmax.
-          int64 i0_base = i0 * stride[0] - pad_low[0];
-          int64 i1_base = i1 * stride[1] - pad_low[1];
-          int64 i2_base = i2 * stride[2] - pad_low[2];
-          int64 i3_base = i3 * stride[3] - pad_low[3];
-          int64 scatter_0 = (i0_base >= 0) ? i0_base : 0;
-          int64 scatter_1 = (i1_base >= 0) ? i1_base : 0;
-          int64 scatter_2 = (i2_base >= 0) ? i2_base : 0;
-          int64 scatter_3 = (i3_base >= 0) ? i3_base : 0;
-          float val = operand(scatter_0, scatter_1, scatter_2, scatter_3);
-          for (int64 i0_win = 0; i0_win < window[0]; ++i0_win) {
-            for (int64 i1_win = 0; i1_win < window[1]; ++i1_win) {
-              for (int64 i2_win = 0; i2_win < window[2]; ++i2_win) {
-                for (int64 i3_win = 0; i3_win < window[3]; ++i3_win) {
-                  if (i0_base + i0_win >= 0 && i1_base + i1_win >= 0 &&
-                      i2_base + i2_win >= 0 && i3_base + i3_win >= 0 &&
-                      i0_base + i0_win < operand.n1() &&
-                      i1_base + i1_win < operand.n2() &&
-                      i2_base + i2_win < operand.n3() &&
-                      i3_base + i3_win < operand.n4()) {
-                    float tmp = operand(i0_base + i0_win, i1_base + i1_win,
-                                        i2_base + i2_win, i3_base + i3_win);
-                    if (tmp >= val) {
-                      val = tmp;
-                      scatter_0 = i0_base + i0_win;
-                      scatter_1 = i1_base + i1_win;
-                      scatter_2 = i2_base + i2_win;
-                      scatter_3 = i3_base + i3_win;
-                    }
-                  }
-                }
-              }
-            }
-          }
-          (*result)(scatter_0, scatter_1, scatter_2, scatter_3) +=
-              source(i0, i1, i2, i3);
-        }
-      }
-    }
-  }
+  const std::vector<int64> dim_lengths{operand.n1(), operand.n2(),
+                                       operand.n3(), operand.n4()};
+  const auto windows = MakeSlidingWindows(dim_lengths, window, stride, padding);
+  auto result = MakeUnique<Array4D<float>>(
+      SlidingWindowCount(windows[0]), SlidingWindowCount(windows[1]),
+      SlidingWindowCount(windows[2]), SlidingWindowCount(windows[3]));
+  *argmax = Array4D<int32>(result->n1(), result->n2(), result->n3(),
+                           result->n4());
+  SlidingWindowMaxWithArgmax(operand.data(), dim_lengths, windows,
+                             result->flatten().data(),
+                             argmax->flatten().data());
+  return result;
+}
+
+/* static */
+std::unique_ptr<Array4D<float>> ReferenceUtil::MaxPool4DBackward(
+   const Array4D<int32>& argmax,
+   const Array4D<float>& source,
+   float init,
+   tensorflow::gtl::ArraySlice<int64> operand_dimensions,
+   const tensorflow::gtl::ArraySlice<int64>& window,
+   const tensorflow::gtl::ArraySlice<int64>& stride,
+   Padding padding)
+{
+  CHECK_EQ(operand_dimensions.size(), 4);
+  CHECK_EQ(argmax.num_elements(), source.num_elements());
+  const auto windows =
+      MakeSlidingWindows(operand_dimensions, window, stride, padding);
+  auto result = MakeUnique<Array4D<float>>(
+      operand_dimensions[0], operand_dimensions[1], operand_dimensions[2],
+      operand_dimensions[3], init);
+  SlidingWindowMaxBackward(argmax.data(), source.data(), windows,
+                           result->flatten().data());
   return result;
 }
 
@@ -526,221 +886,220 @@ std::unique_ptr<Array4D<float>> ReferenceUtil::ConvArray4DGeneralDimensionsDilat
    std::pair<int64, int64> rhs_dilation,
    ConvolutionDimensionNumbers dnums)
 {
-  std::array<int64, 4> lhs_dimensions{{lhs.n1(), lhs.n2(), lhs.n3(), lhs.n4()}};
-  std::array<int64, 4> rhs_dimensions{{rhs.n1(), rhs.n2(), rhs.n3(), rhs.n4()}};
+  return ConvArray4DGeneralDimensionsDilated(
+      lhs, rhs, kernel_stride, padding, lhs_dilation, rhs_dilation, dnums,
+      conv::ConvAlgorithm::kDefault);
+}
 
-  const int64 ksy = kernel_stride.first;
-  const int64 ksx = kernel_stride.second;
-  const int64 dy = lhs_dilation.first;
-  const int64 dx = lhs_dilation.second;
-  const int64 dky = rhs_dilation.first;
-  const int64 dkx = rhs_dilation.second;
-  CHECK_GE(dky, 1);
-  CHECK_GE(dkx, 1);
-  CHECK_GE(dy, 1);
-  CHECK_GE(dx, 1);
+/* static */
+std::unique_ptr<Array4D<float>> ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+   const Array4D<float>& lhs,
+   const Array4D<float>& rhs,
+   std::pair<int64, int64> kernel_stride,
+   Padding padding,
+   std::pair<int64, int64> lhs_dilation,
+   std::pair<int64, int64> rhs_dilation,
+   ConvolutionDimensionNumbers dnums,
+   conv::ConvAlgorithm algorithm)
+{
+  return ConvArray4DGeneralDimensionsDilated(
+      lhs, rhs, kernel_stride, padding, lhs_dilation, rhs_dilation, dnums,
+      algorithm, {}, nullptr, ActivationFunction::kNone, 1.0f);
+}
 
-  // Get all dimension sizes in lhs and rhs based on the given convolution
-  // dimension configuration.
-  const int64 ix = window_util::DilatedBound(
-      lhs_dimensions[dnums.spatial_dimensions(1)], dx);
-  const int64 iy = window_util::DilatedBound(
-      lhs_dimensions[dnums.spatial_dimensions(0)], dy);
-  const int64 iz = lhs_dimensions[dnums.feature_dimension()];
-  const int64 samples = lhs_dimensions[dnums.batch_dimension()];
-  const int64 kx = window_util::DilatedBound(
-      rhs_dimensions[dnums.kernel_spatial_dimensions(1)], dkx);
-  const int64 ky = window_util::DilatedBound(
-      rhs_dimensions[dnums.kernel_spatial_dimensions(0)], dky);
-  const int64 oz = rhs_dimensions[dnums.kernel_output_feature_dimension()];
-  {
-    const int64 kiz = rhs_dimensions[dnums.kernel_input_feature_dimension()];
-    CHECK_EQ(kiz, iz);
-  }
+/* static */
+std::unique_ptr<Array4D<float>> ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+   const Array4D<float>& lhs,
+   const Array4D<float>& rhs,
+   std::pair<int64, int64> kernel_stride,
+   Padding padding,
+   std::pair<int64, int64> lhs_dilation,
+   std::pair<int64, int64> rhs_dilation,
+   ConvolutionDimensionNumbers dnums,
+   int64 feature_group_count,
+   conv::ConvAlgorithm algorithm)
+{
+  return ConvArray4DGeneralDimensionsDilated(
+      lhs, rhs, kernel_stride, padding, lhs_dilation, rhs_dilation, dnums,
+      algorithm, {}, nullptr, ActivationFunction::kNone, 1.0f,
+      feature_group_count);
+}
 
-  if (padding == Padding::kSame) {
-    // We reject same padding with kernel striding, since it's somewhat
-    // nonsensical. We can always follow up to implement this with the desired
-    // semantics if anybody actually uses it.
-    CHECK_EQ(1, ksy);
-    CHECK_EQ(1, ksx);
+/* static */
+std::unique_ptr<Array4D<float>> ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+   const Array4D<float>& lhs,
+   const Array4D<float>& rhs,
+   std::pair<int64, int64> kernel_stride,
+   Padding padding,
+   std::pair<int64, int64> lhs_dilation,
+   std::pair<int64, int64> rhs_dilation,
+   ConvolutionDimensionNumbers dnums,
+   conv::ConvAlgorithm algorithm,
+   const std::vector<float>& bias,
+   const Array4D<float>* residual,
+   ActivationFunction activation,
+   float scale,
+   int64 feature_group_count)
+{
+  const conv::ConvGeometry geometry =
+      conv::MakeConvGeometry(lhs, rhs, kernel_stride, padding, lhs_dilation,
+                             rhs_dilation, dnums, feature_group_count);
+  if (!bias.empty()) {
+    CHECK_EQ(int64(bias.size()), geometry.output_features);
   }
 
-  const int64 ox = (padding == Padding::kSame) ?
-     ix :
-     window_util::StridedBound(ix, kx, ksx);
-
-  const int64 oy = (padding == Padding::kSame) ?
-     iy :
-     window_util::StridedBound(iy, ky, ksy);
-
-  const int64 istartx = (padding == Padding::kValid) ?
-     0 :
-     (kx % 2 == 0) ? -(kx / 2 - 1) : -kx / 2;
-
-  const int64 istarty = (padding == Padding::kValid) ?
-     0 :
-     (ky % 2 == 0) ? -(ky / 2 - 1) : -ky / 2;
-
-  // Create the output result array and reset the values to 0.
-  std::array<int64, 4> result_dimensions;
-  result_dimensions[dnums.batch_dimension()] = samples;
-  result_dimensions[dnums.feature_dimension()] = oz;
-  result_dimensions[dnums.spatial_dimensions(0)] = oy;
-  result_dimensions[dnums.spatial_dimensions(1)] = ox;
-  
-  auto result = MakeUnique<Array4D<float>>(result_dimensions[0], result_dimensions[1],
-                                           result_dimensions[2], result_dimensions[3]);
-  result->Fill(0.0);
-
-  // Lambda to access the lhs operand at the given 4D index.
-  const auto lhs_element = [&](int64 batch, int64 feature, int64 height,
-                               int64 width) 
-  {
-    if (height % dy != 0 || width % dx != 0)
-    {
-      return 0.0f;
+  if (algorithm == conv::ConvAlgorithm::kDirect) {
+    // The definition of the fused semantics: the epilogue as a separate pass.
+    auto result = ConvArray4DDirect(lhs, rhs, kernel_stride, padding,
+                                    lhs_dilation, rhs_dilation, dnums,
+                                    feature_group_count);
+    if (residual != nullptr) {
+      CHECK_EQ(residual->num_elements(), result->num_elements());
     }
-
-    std::array<int64, 4> index;
-    index[dnums.batch_dimension()] = batch;
-    index[dnums.feature_dimension()] = feature;
-    index[dnums.spatial_dimensions(0)] = height / dy;
-    index[dnums.spatial_dimensions(1)] = width / dx;
-    return lhs(index[0], index[1], index[2], index[3]);
-  };
-
-  // Lambda to access the rhs operand at the given 4D index.
-  const auto rhs_element = [&](int64 kernel_output_feature,
-                               int64 kernel_input_feature, int64 height,
-                               int64 width) {
-    CHECK_EQ(height % dky, 0);
-    CHECK_EQ(width % dkx, 0);
-    std::array<int64, 4> index;
-    index[dnums.kernel_output_feature_dimension()] = kernel_output_feature;
-    index[dnums.kernel_input_feature_dimension()] = kernel_input_feature;
-    index[dnums.kernel_spatial_dimensions(0)] = height / dky;
-    index[dnums.kernel_spatial_dimensions(1)] = width / dkx;
-    return rhs(index[0], index[1], index[2], index[3]);
-  };
-
-  // Lambda to access the result data at the given 4D index.
-  const auto result_element = [&](int64 batch, int64 kernel_output_feature,
-                                  int64 height, int64 width) -> float& 
-  {
-    std::array<int64, 4> index;
-    index[dnums.batch_dimension()] = batch;
-    index[dnums.feature_dimension()] = kernel_output_feature;
-    index[dnums.spatial_dimensions(0)] = height;
-    index[dnums.spatial_dimensions(1)] = width;
-    return (*result)(index[0], index[1], index[2], index[3]);
-  };
-
-  for (int64 oyi = 0; oyi < oy; ++oyi) {
-    for (int64 oxi = 0; oxi < ox; ++oxi) {
-      for (int64 sample = 0; sample < samples; ++sample) {
-        for (int64 izi = 0; izi < iz; ++izi) {
-          for (int64 ozi = 0; ozi < oz; ++ozi) {
-            for (int64 kyi = 0; kyi < ky; kyi += dky) {
-              for (int64 kxi = 0; kxi < kx; kxi += dkx) {
-                int64 iyi = istarty + ksy * oyi + kyi;
-                int64 ixi = istartx + ksx * oxi + kxi;
-                float input = (iyi >= iy || ixi >= ix || iyi < 0 || ixi < 0)
-                                  ? 0.0f
-                                  : lhs_element(sample, izi, iyi, ixi);
-                float gain = rhs_element(ozi, izi, kyi, kxi);
-                float addend = input * gain;
-                result_element(sample, ozi, oyi, oxi) += addend;
-              }
-            }
-          }
-        }
+    result->Each([&](tensorflow::gtl::ArraySlice<int64> indices, float* value) {
+      float x = *value;
+      if (!bias.empty()) {
+        x += bias[indices[dnums.feature_dimension()]];
       }
-    }
+      if (residual != nullptr) {
+        x += (*residual)(indices[0], indices[1], indices[2], indices[3]);
+      }
+      *value = scale * Activate(activation, x);
+    });
+    return result;
   }
-  return result;
+
+  std::vector<float> canonical_residual;
+  conv::ConvEpilogue epilogue;
+  if (!bias.empty()) {
+    epilogue.bias = bias.data();
+  }
+  if (residual != nullptr) {
+    // The result is laid out as dnums describes the input, so the residual
+    // canonicalizes like an input.
+    canonical_residual = conv::CanonicalConvInput(*residual, dnums);
+    CHECK_EQ(int64(canonical_residual.size()),
+             geometry.batch * geometry.output_features *
+                 geometry.output_height * geometry.output_width);
+    epilogue.residual = canonical_residual.data();
+  }
+  epilogue.activation = activation;
+  epilogue.scale = scale;
+  const std::vector<float> input = conv::CanonicalConvInput(lhs, dnums);
+  const std::vector<float> filter = conv::CanonicalConvFilter(rhs, dnums);
+  std::vector<float> output(geometry.batch * geometry.output_features *
+                            geometry.output_height * geometry.output_width);
+  conv::ConvPlan plan(geometry, algorithm);
+  plan.Run(input.data(), filter.data(), epilogue, output.data());
+  return conv::ConvOutputFromCanonical(geometry, output, dnums);
 }
 
 /* static */
-std::unique_ptr<std::vector<float>> ReferenceUtil::ReduceToColArray2D(
-   const Array2D<float>& matrix,
-   float init,
-   const std::function<float(float, float)>& reduce_function)
+std::unique_ptr<Array4D<float>> ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+   const Array4D<float>& lhs,
+   const Array4D<float>& rhs,
+   std::pair<int64, int64> kernel_stride,
+   const PaddingConfig& lhs_padding,
+   std::pair<int64, int64> lhs_dilation,
+   std::pair<int64, int64> rhs_dilation,
+   ConvolutionDimensionNumbers dnums,
+   conv::ConvAlgorithm algorithm)
 {
-  int64 rows = matrix.height();
-  int64 cols = matrix.width();
-  auto result = MakeUnique<std::vector<float>>();
-  for (int64 i = 0; i < rows; ++i) {
-    float acc = init;
-    for (int64 j = 0; j < cols; ++j) {
-      acc = reduce_function(acc, matrix(i, j));
-    }
-    result->push_back(acc);
+  if (algorithm == conv::ConvAlgorithm::kDirect) {
+    return ConvArray4DDirect(PadArray4D(lhs, lhs_padding, 0.0f), rhs,
+                             kernel_stride, Padding::kValid, lhs_dilation,
+                             rhs_dilation, dnums, 1);
   }
-  return result;
+  const conv::ConvGeometry geometry = conv::MakeConvGeometry(
+      {{lhs.n1(), lhs.n2(), lhs.n3(), lhs.n4()}},
+      {{rhs.n1(), rhs.n2(), rhs.n3(), rhs.n4()}}, kernel_stride, lhs_padding,
+      lhs_dilation, rhs_dilation, dnums);
+  const std::vector<float> input = conv::CanonicalConvInput(lhs, dnums);
+  const std::vector<float> filter = conv::CanonicalConvFilter(rhs, dnums);
+  std::vector<float> output(geometry.batch * geometry.output_features *
+                            geometry.output_height * geometry.output_width);
+  conv::ConvPlan plan(geometry, algorithm);
+  plan.Run(input.data(), filter.data(), output.data());
+  return conv::ConvOutputFromCanonical(geometry, output, dnums);
 }
 
 /* static */
-std::unique_ptr<std::vector<float>> ReferenceUtil::ReduceToRowArray2D(
-   const Array2D<float>& matrix,
-   float init,
-   const std::function<float(float, float)>& reduce_function)
+std::unique_ptr<Array4D<float>>
+ReferenceUtil::ConvArray4DGeneralDimensionsDilatedBackwardFilter(
+   const Array4D<float>& lhs,
+   const Array4D<float>& output_gradient,
+   std::pair<int64, int64> kernel_spatial_dims,
+   std::pair<int64, int64> kernel_stride,
+   Padding padding,
+   std::pair<int64, int64> lhs_dilation,
+   std::pair<int64, int64> rhs_dilation,
+   ConvolutionDimensionNumbers dnums)
 {
-  int64 rows = matrix.height();
-  int64 cols = matrix.width();
-  auto result = MakeUnique<std::vector<float>>();
-  for (int64 i = 0; i < cols; ++i) 
-  {
-    float acc = init;
-    for (int64 j = 0; j < rows; ++j) 
-    {
-      acc = reduce_function(acc, matrix(j, i));
-    }
-    result->push_back(acc);
-  }
-  return result;
+  const std::array<int64, 4> lhs_dims{
+      {lhs.n1(), lhs.n2(), lhs.n3(), lhs.n4()}};
+  const std::array<int64, 4> gradient_dims{
+      {output_gradient.n1(), output_gradient.n2(), output_gradient.n3(),
+       output_gradient.n4()}};
+  std::array<int64, 4> rhs_dims;
+  rhs_dims[dnums.kernel_output_feature_dimension()] =
+      gradient_dims[dnums.feature_dimension()];
+  rhs_dims[dnums.kernel_input_feature_dimension()] =
+      lhs_dims[dnums.feature_dimension()];
+  rhs_dims[dnums.kernel_spatial_dimensions(0)] = kernel_spatial_dims.first;
+  rhs_dims[dnums.kernel_spatial_dimensions(1)] = kernel_spatial_dims.second;
+  const Array4D<float> rhs_shape(rhs_dims[0], rhs_dims[1], rhs_dims[2],
+                                 rhs_dims[3]);
+
+  const conv::ConvGeometry geometry =
+      conv::MakeConvGeometry(lhs, rhs_shape, kernel_stride, padding,
+                             lhs_dilation, rhs_dilation, dnums);
+  CheckOutputGradientShape(geometry, output_gradient, dnums);
+  const std::vector<float> input = conv::CanonicalConvInput(lhs, dnums);
+  const std::vector<float> gradient =
+      conv::CanonicalConvInput(output_gradient, dnums);
+  std::vector<float> filter_gradient(rhs_shape.num_elements());
+  conv::ConvBackwardFilter(geometry, input.data(), gradient.data(),
+                           filter_gradient.data());
+  return conv::ConvFilterFromCanonical(geometry, filter_gradient, dnums);
 }
 
 /* static */
-std::vector<float> ReferenceUtil::Reduce4DTo1D(
-   const Array4D<float>& array,
-   float init,
-   tensorflow::gtl::ArraySlice<int64> dims,
-   const std::function<float(float, float)>& reduce_function)
+std::unique_ptr<Array4D<float>>
+ReferenceUtil::ConvArray4DGeneralDimensionsDilatedBackwardInput(
+   const Array4D<float>& rhs,
+   const Array4D<float>& output_gradient,
+   std::pair<int64, int64> input_spatial_dims,
+   std::pair<int64, int64> kernel_stride,
+   Padding padding,
+   std::pair<int64, int64> lhs_dilation,
+   std::pair<int64, int64> rhs_dilation,
+   ConvolutionDimensionNumbers dnums)
 {
-  std::vector<float> result;
-  CHECK_EQ(dims.size(), 3);
-  const std::set<int64> dim_set(dims.begin(), dims.end());
-  CHECK_EQ(dim_set.size(), 3);
-  for (int64 a0 = 0; a0 == 0 || (!dim_set.count(0) && a0 < array.n1()); ++a0) 
-  {
-    for (int64 a1 = 0; a1 == 0 || (!dim_set.count(1) && a1 < array.n2());
-         ++a1) {
-      for (int64 a2 = 0; a2 == 0 || (!dim_set.count(2) && a2 < array.n3());
-           ++a2) {
-        for (int64 a3 = 0; a3 == 0 || (!dim_set.count(3) && a3 < array.n4());
-             ++a3) {
-          float accumulator = init;
-          for (int64 i0 = 0; i0 == 0 || (dim_set.count(0) && i0 < array.n1());
-               ++i0) {
-            for (int64 i1 = 0; i1 == 0 || (dim_set.count(1) && i1 < array.n2());
-                 ++i1) {
-              for (int64 i2 = 0;
-                   i2 == 0 || (dim_set.count(2) && i2 < array.n3()); ++i2) {
-                for (int64 i3 = 0;
-                     i3 == 0 || (dim_set.count(3) && i3 < array.n4()); ++i3) {
-                  accumulator = reduce_function(
-                      accumulator, array(a0 + i0, a1 + i1, a2 + i2, a3 + i3));
-                }
-              }
-            }
-          }
-          result.push_back(accumulator);
-        }
-      }
-    }
-  }
-  return result;
+  const std::array<int64, 4> rhs_dims{
+      {rhs.n1(), rhs.n2(), rhs.n3(), rhs.n4()}};
+  const std::array<int64, 4> gradient_dims{
+      {output_gradient.n1(), output_gradient.n2(), output_gradient.n3(),
+       output_gradient.n4()}};
+  std::array<int64, 4> lhs_dims;
+  lhs_dims[dnums.batch_dimension()] = gradient_dims[dnums.batch_dimension()];
+  lhs_dims[dnums.feature_dimension()] =
+      rhs_dims[dnums.kernel_input_feature_dimension()];
+  lhs_dims[dnums.spatial_dimensions(0)] = input_spatial_dims.first;
+  lhs_dims[dnums.spatial_dimensions(1)] = input_spatial_dims.second;
+  const Array4D<float> lhs_shape(lhs_dims[0], lhs_dims[1], lhs_dims[2],
+                                 lhs_dims[3]);
+
+  const conv::ConvGeometry geometry =
+      conv::MakeConvGeometry(lhs_shape, rhs, kernel_stride, padding,
+                             lhs_dilation, rhs_dilation, dnums);
+  CheckOutputGradientShape(geometry, output_gradient, dnums);
+  const std::vector<float> filter = conv::CanonicalConvFilter(rhs, dnums);
+  const std::vector<float> gradient =
+      conv::CanonicalConvInput(output_gradient, dnums);
+  std::vector<float> input_gradient(lhs_shape.num_elements());
+  conv::ConvBackwardInput(geometry, filter.data(), gradient.data(),
+                          input_gradient.data());
+  return conv::ConvInputFromCanonical(geometry, input_gradient, dnums);
 }
 
 /* static */
@@ -778,31 +1137,6 @@ std::unique_ptr<Array4D<float>> ReferenceUtil::Broadcast1DTo4D(
   return result;
 }
 
-/* static */
-std::unique_ptr<Array2D<float>> ReferenceUtil::Reduce3DTo2D(
-   const Array3D<float>& array,
-   float init,
-   tensorflow::gtl::ArraySlice<int64> dims,
-   const std::function<float(float, float)>& reduce_function)
-{
-  CHECK_EQ(dims.size(), 1);
-  int64 rows = dims[0] == 0 ? array.n2() : array.n1();
-  int64 cols = dims[0] == 2 ? array.n2() : array.n3();
-  auto result = MakeUnique<Array2D<float>>(rows, cols);
-  result->Fill(init);
-  for (int i0 = 0; i0 < array.n1(); ++i0) {
-    for (int i1 = 0; i1 < array.n2(); ++i1) {
-      for (int i2 = 0; i2 < array.n3(); ++i2) {
-        int64 row = dims[0] == 0 ? i1 : i0;
-        int64 col = dims[0] == 2 ? i1 : i2;
-        (*result)(row, col) =
-            reduce_function((*result)(row, col), array(i0, i1, i2));
-      }
-    }
-  }
-  return result;
-}
-
 /* static */
 std::unique_ptr<Array2D<float>> ReferenceUtil::MapArray2D(
    const Array2D<float>& matrix,
@@ -811,11 +1145,13 @@ std::unique_ptr<Array2D<float>> ReferenceUtil::MapArray2D(
   int64 rows = matrix.height();
   int64 cols = matrix.width();
   auto result = MakeUnique<Array2D<float>>(rows, cols);
-  for (int64 i = 0; i < rows; ++i) {
-    for (int64 j = 0; j < cols; ++j) {
-      (*result)(i, j) = map_function(matrix(i, j));
+  ParallelFor(rows, cols, [&](int64 first, int64 last) {
+    for (int64 i = first; i < last; ++i) {
+      for (int64 j = 0; j < cols; ++j) {
+        (*result)(i, j) = map_function(matrix(i, j));
+      }
     }
-  }
+  });
   return result;
 }
 
@@ -830,13 +1166,15 @@ std::unique_ptr<Array2D<float>> ReferenceUtil::MapArray2D(
   int64 rows = lhs.height();
   int64 cols = rhs.width();
   auto result = MakeUnique<Array2D<float>>(rows, cols);
-  for (int64 i = 0; i < rows; ++i) 
-  {
-    for (int64 j = 0; j < cols; ++j) 
+  ParallelFor(rows, cols, [&](int64 first, int64 last) {
+    for (int64 i = first; i < last; ++i)
     {
-      (*result)(i, j) = map_function(lhs(i, j), rhs(i, j));
+      for (int64 j = 0; j < cols; ++j)
+      {
+        (*result)(i, j) = map_function(lhs(i, j), rhs(i, j));
+      }
     }
-  }
+  });
   return result;
 }
 
@@ -848,13 +1186,15 @@ std::unique_ptr<Array2D<float>> ReferenceUtil::MapWithIndexArray2D(
   int64 rows = matrix.height();
   int64 cols = matrix.width();
   auto result = MakeUnique<Array2D<float>>(rows, cols);
-  for (int64 i = 0; i < rows; ++i) 
-  {
-    for (int64 j = 0; j < cols; ++j) 
+  ParallelFor(rows, cols, [&](int64 first, int64 last) {
+    for (int64 i = first; i < last; ++i)
     {
-      (*result)(i, j) = map_function(matrix(i, j), i, j);
+      for (int64 j = 0; j < cols; ++j)
+      {
+        (*result)(i, j) = map_function(matrix(i, j), i, j);
+      }
     }
-  }
+  });
   return result;
 }
 
@@ -880,20 +1220,22 @@ std::unique_ptr<Array2D<float>> ReferenceUtil::PadArray2D(
 
   auto result = MakeUnique<Array2D<float>>(out0, out1);
   result->Fill(pad);
-  int64 o0 = low_padding0;
-  for (int64 i0 = 0; i0 < in0; ++i0)
-  {
-    int64 o1 = low_padding1;
-    for (int64 i1 = 0; i1 < in1; ++i1)
+  // Each input row lands in its own output row.
+  ParallelFor(in0, in1, [&](int64 first, int64 last) {
+    for (int64 i0 = first; i0 < last; ++i0)
     {
-      if (o0 >= 0 && o1 >= 0 && o0 < out0 && o1 < out1)
+      const int64 o0 = low_padding0 + i0 * (interior_padding0 + 1);
+      int64 o1 = low_padding1;
+      for (int64 i1 = 0; i1 < in1; ++i1)
       {
-        (*result)(o0, o1) = operand(i0, i1);
+        if (o0 >= 0 && o1 >= 0 && o0 < out0 && o1 < out1)
+        {
+          (*result)(o0, o1) = operand(i0, i1);
+        }
+        o1 += interior_padding1 + 1;
       }
-      o1 += interior_padding1 + 1;
     }
-    o0 += interior_padding0 + 1;
-  }
+  });
   return result;
 }
 
@@ -924,34 +1266,37 @@ Array3D<float> ReferenceUtil::PadArray3D(
   }
 
   Array3D<float> result(output_bounds[0], output_bounds[1], output_bounds[2]);
-  std::vector<int> indices = {0, 0, 0};
-  for (indices[0] = 0; indices[0] < output_bounds[0]; ++indices[0]) {
-    for (indices[1] = 0; indices[1] < output_bounds[1]; ++indices[1]) {
-      for (indices[2] = 0; indices[2] < output_bounds[2]; ++indices[2]) {
-        float* value = &result(indices[0], indices[1], indices[2]);
-        bool value_padded = false;
-        for (int i = 0; i < 3; ++i) {
-          bool in_low_padding = indices[i] < pad_low[i];
-          bool in_high_padding = indices[i] >= output_bounds[i] - pad_high[i];
-          if (in_low_padding || in_high_padding) {
-            *value = pad;
-            value_padded = true;
+  ParallelFor(output_bounds[0], output_bounds[1] * output_bounds[2],
+              [&](int64 first, int64 last) {
+    std::vector<int64> indices = {first, 0, 0};
+    for (indices[0] = first; indices[0] < last; ++indices[0]) {
+      for (indices[1] = 0; indices[1] < output_bounds[1]; ++indices[1]) {
+        for (indices[2] = 0; indices[2] < output_bounds[2]; ++indices[2]) {
+          float* value = &result(indices[0], indices[1], indices[2]);
+          bool value_padded = false;
+          for (int i = 0; i < 3; ++i) {
+            bool in_low_padding = indices[i] < pad_low[i];
+            bool in_high_padding = indices[i] >= output_bounds[i] - pad_high[i];
+            if (in_low_padding || in_high_padding) {
+              *value = pad;
+              value_padded = true;
+            }
+            if (pad_interior[i] &&
+                (indices[i] - pad_low[i]) % (pad_interior[i] + 1)) {
+              *value = pad;
+              value_padded = true;
+            }
           }
-          if (pad_interior[i] &&
-              (indices[i] - pad_low[i]) % (pad_interior[i] + 1)) {
-            *value = pad;
-            value_padded = true;
+          if (value_padded) {
+            continue;
           }
+          *value = operand((indices[0] - pad_low[0]) / (pad_interior[0] + 1),
+                           (indices[1] - pad_low[1]) / (pad_interior[1] + 1),
+                           (indices[2] - pad_low[2]) / (pad_interior[2] + 1));
         }
-        if (value_padded) {
-          continue;
-        }
-        *value = operand((indices[0] - pad_low[0]) / (pad_interior[0] + 1),
-                         (indices[1] - pad_low[1]) / (pad_interior[1] + 1),
-                         (indices[2] - pad_low[2]) / (pad_interior[2] + 1));
       }
     }
-  }
+  });
   return result;
 }
 
@@ -981,7 +1326,8 @@ Array4D<float> ReferenceUtil::PadArray4D(
 
   Array4D<float> result(output_bounds[0], output_bounds[1], output_bounds[2],
                         output_bounds[3]);
-  result.Each([&](tensorflow::gtl::ArraySlice<int64> indices, float* value) {
+  const auto pad_element = [&](const std::array<int64, 4>& indices,
+                               float* value) {
     for (int i = 0; i < 4; ++i) {
       bool in_low_padding = indices[i] < pad_low[i];
       bool in_high_padding = indices[i] >= output_bounds[i] - pad_high[i];
@@ -999,6 +1345,21 @@ Array4D<float> ReferenceUtil::PadArray4D(
                      (indices[1] - pad_low[1]) / (pad_interior[1] + 1),
                      (indices[2] - pad_low[2]) / (pad_interior[2] + 1),
                      (indices[3] - pad_low[3]) / (pad_interior[3] + 1));
+  };
+  ParallelFor(output_bounds[0] * output_bounds[1],
+              output_bounds[2] * output_bounds[3],
+              [&](int64 first, int64 last) {
+    std::array<int64, 4> indices;
+    for (int64 i01 = first; i01 < last; ++i01) {
+      indices[0] = i01 / output_bounds[1];
+      indices[1] = i01 % output_bounds[1];
+      for (indices[2] = 0; indices[2] < output_bounds[2]; ++indices[2]) {
+        for (indices[3] = 0; indices[3] < output_bounds[3]; ++indices[3]) {
+          pad_element(indices, &result(indices[0], indices[1], indices[2],
+                                       indices[3]));
+        }
+      }
+    }
   });
   return result;
 }
@@ -1013,78 +1374,33 @@ std::unique_ptr<xla::Array4D<float>> ReferenceUtil::Max_Pool(
    CHECK_EQ(window_in.size(), 2);
    CHECK_EQ(stride_in.size(), 2);
 
-
-   tensorflow::gtl::ArraySlice<tensorflow::int64> window({ window_in[0], window_in[1] });
-   tensorflow::gtl::ArraySlice<tensorflow::int64> stride({ stride_in[0], stride_in[1] });
-
-
-   std::vector<int64> dim_lengths{ operand.n3(), operand.n4() };
-
-   auto padding_both = xla::MakePadding(dim_lengths, window, stride, padding);
-
-   std::vector<int64> window_counts(window.size(), 0);
-   std::vector<int64> pad_low(window.size(), 0);
-
-   for (size_t i = 0; i < window.size(); ++i)
-   {
-      // physical layer
-      window_counts[i] =
-         xla::ReferenceUtil::WindowCount(dim_lengths[i], window[i], stride[i], padding);
-      pad_low[i] = padding_both[i].first;
-   }
-
-
-   auto result = xla::MakeUnique<xla::Array4D<float>>(operand.size(0), operand.size(1), window_counts[0], window_counts[1]);
-
-   for (int64 i0 = 0; i0 < operand.size(0); i0++)
-   {
-      for (int64 i1 = 0; i1 < operand.size(1); i1++)
-      {
-         for (int64 i2 = 0; i2 < result->size(2); ++i2)
-         {
-            for (int64 i3 = 0; i3 < result->size(3); ++i3)
-            {
-               int64 i2_base = i2 * stride[0] - pad_low[0];
-               int64 i3_base = i3 * stride[1] - pad_low[1];
-
-               int64 scatter_2 = std::max<int64>(i2_base, 0);
-               int64 scatter_3 = std::max<int64>(i3_base, 0);
-
-               float val = operand(i0, i1, scatter_2, scatter_3);
-
-               //printf("operand-->>(%d, %d, %d, %d)=%f\n", i0, i1, scatter_2, scatter_3, val);
-
-               (*result)(i0, i1, i2, i3) = val; // first initializing value
-
-               for (int64 i2_win = 0; i2_win < window[0]; ++i2_win)
-               {
-                  for (int64 i3_win = 0; i3_win < window[1]; ++i3_win)
-                  {
-                     if (i2_base + i2_win >= 0 && i3_base + i3_win >= 0 &&
-                        i2_base + i2_win < operand.n3() &&
-                        i3_base + i3_win < operand.n4())
-                     {
-                        //printf("operand(%d, %d, %d, %d)\n", i0, i1, i2_base + i2_win, i3_base + i3_win);
-                        float tmp = operand(i0, i1, i2_base + i2_win, i3_base + i3_win);
-                        if (tmp >= val)
-                        {
-                           val = tmp;
-
-                           scatter_2 = i2_base + i2_win;
-                           scatter_3 = i3_base + i3_win;
-                           //printf("result MAX(%d, %d, %d, %d)=%f\n", scatter_0, scatter_1, scatter_2, scatter_3, val);
-                        }
-                     }
-                  }
-               }
-
-               //printf("result<<--(%d, %d, %d, %d)=%f\n", i0, 0, scatter_2, scatter_3, val);
-               (*result)(i0, i1, i2, i3) = std::max<float>(val, (*result)(i0, i1, i2, i3));
-            }
-         }
-      }
-   }
+   // Pools every (i0, i1) plane: the first two dimensions keep a window of one.
+   const std::vector<int64> dim_lengths{operand.n1(), operand.n2(),
+                                        operand.n3(), operand.n4()};
+   const auto windows = MakeSlidingWindows(
+       dim_lengths, {1, 1, window_in[0], window_in[1]},
+       {1, 1, stride_in[0], stride_in[1]}, padding);
+   auto result = MakeUnique<Array4D<float>>(
+       operand.n1(), operand.n2(), SlidingWindowCount(windows[2]),
+       SlidingWindowCount(windows[3]));
+   const float lowest = -std::numeric_limits<float>::infinity();
+   SlidingWindowReduce(ReduceOp::kMax, operand.data(), dim_lengths, windows,
+                       lowest, lowest, result->flatten().data());
    return result;
 }
 
+/* static */
+std::unique_ptr<xla::Array4D<float>> ReferenceUtil::Max_Pool(
+   const xla::Array4D<float>& operand,
+   const tensorflow::gtl::ArraySlice<tensorflow::int64>& window,
+   const tensorflow::gtl::ArraySlice<tensorflow::int64>& stride,
+   xla::Padding padding,
+   xla::Array4D<tensorflow::int32>* argmax)
+{
+   CHECK_EQ(window.size(), 2);
+   CHECK_EQ(stride.size(), 2);
+   return MaxPool4DWithArgmax(operand, {1, 1, window[0], window[1]},
+                              {1, 1, stride[0], stride[1]}, padding, argmax);
+}
+
 }  // namespace xla
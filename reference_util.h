@@ -19,8 +19,14 @@ limitations under the License.
 #include "array2d.h"
 #include "array3d.h"
 #include "array4d.h"
+#include "conv_geometry.h"
+#include "half.h"
+#include "intra_op_thread_pool.h"
 #include "padding.h"
 #include "ptr_util.h"
+#include "quantization.h"
+#include "reduction.h"
+#include "sparse_matrix.h"
 #include "xla_data.pb.h"
 #include "array_slice.h"
 #include "macros.h"
@@ -41,6 +47,26 @@ class ReferenceUtil {
   static std::unique_ptr<Array2D<double>> MatmulArray2D(
       const Array2D<double>& lhs, const Array2D<double>& rhs);
 
+  // Returns scale * activation(lhs x rhs + bias + residual), a dense layer
+  // whose bias add, residual add and activation are applied by the GEMM as
+  // it stores each output tile. bias holds one value per column of the
+  // result, or is empty; residual, if not null, has the shape of the result.
+  static std::unique_ptr<Array2D<float>> MatmulArray2D(
+      const Array2D<float>& lhs, const Array2D<float>& rhs,
+      const std::vector<float>& bias, const Array2D<float>* residual,
+      ActivationFunction activation, float scale);
+
+  // Returns `lhs x rhs` with one operand stored sparse, in time proportional
+  // to its stored values; see sparse_matrix.h.
+  static std::unique_ptr<Array2D<float>> MatmulArray2D(
+      const sparse::CsrMatrix& lhs, const Array2D<float>& rhs);
+  static std::unique_ptr<Array2D<float>> MatmulArray2D(
+      const Array2D<float>& lhs, const sparse::CsrMatrix& rhs);
+  static std::unique_ptr<Array2D<float>> MatmulArray2D(
+      const sparse::BsrMatrix& lhs, const Array2D<float>& rhs);
+  static std::unique_ptr<Array2D<float>> MatmulArray2D(
+      const Array2D<float>& lhs, const sparse::BsrMatrix& rhs);
+
   // Converts the input operand to use f64 values instead of f32 values.
   static std::unique_ptr<Array2D<double>> Array2DF32ToF64(
       const Array2D<float>& input);
@@ -52,6 +78,21 @@ class ReferenceUtil {
       const Array4D<float>& lhs, const Array4D<float>& rhs,
       std::pair<int64, int64> kernel_stride, Padding padding);
 
+  // As above, computed with the given algorithm.
+  static std::unique_ptr<Array4D<float>> Conv4D(
+      const Array4D<float>& lhs, const Array4D<float>& rhs,
+      std::pair<int64, int64> kernel_stride, Padding padding,
+      conv::ConvAlgorithm algorithm);
+
+  // As above for 16-bit lhs and rhs, accumulated in float32 by the im2col
+  // convolution.
+  static std::unique_ptr<Array4D<float>> Conv4D(
+      const Array4D<half>& lhs, const Array4D<half>& rhs,
+      std::pair<int64, int64> kernel_stride, Padding padding);
+  static std::unique_ptr<Array4D<float>> Conv4D(
+      const Array4D<bfloat16>& lhs, const Array4D<bfloat16>& rhs,
+      std::pair<int64, int64> kernel_stride, Padding padding);
+
   // Returns the result of a convolution `lhs <conv> rhs`, with the given
   // convolution dimension numbers.
   static std::unique_ptr<Array4D<float>> ConvArray4DGeneralDimensions(
@@ -67,6 +108,83 @@ class ReferenceUtil {
       std::pair<int64, int64> lhs_dilation,
       std::pair<int64, int64> rhs_dilation, ConvolutionDimensionNumbers dnums);
 
+  // As above, computed with the given algorithm. All algorithms implement the
+  // same semantics; kDirect is the scalar definition the others are tested
+  // against. An algorithm that cannot handle the convolution falls back to
+  // kIm2Col; kAutotune picks one with a conv::ConvPlan and remembers it in
+  // conv::ConvAlgorithmCache::Global().
+  static std::unique_ptr<Array4D<float>> ConvArray4DGeneralDimensionsDilated(
+      const Array4D<float>& lhs, const Array4D<float>& rhs,
+      std::pair<int64, int64> stride, Padding padding,
+      std::pair<int64, int64> lhs_dilation,
+      std::pair<int64, int64> rhs_dilation, ConvolutionDimensionNumbers dnums,
+      conv::ConvAlgorithm algorithm);
+
+  // As above, followed by a bias add, a residual add and an activation that
+  // the kernels fuse into the convolution (see conv::ConvEpilogue):
+  //
+  //   result = scale * activation(conv(lhs, rhs) + bias + residual)
+  //
+  // bias holds one value per output feature, or is empty; residual, if not
+  // null, has the shape and layout of the result.
+  static std::unique_ptr<Array4D<float>> ConvArray4DGeneralDimensionsDilated(
+      const Array4D<float>& lhs, const Array4D<float>& rhs,
+      std::pair<int64, int64> stride, Padding padding,
+      std::pair<int64, int64> lhs_dilation,
+      std::pair<int64, int64> rhs_dilation, ConvolutionDimensionNumbers dnums,
+      conv::ConvAlgorithm algorithm, const std::vector<float>& bias,
+      const Array4D<float>* residual, ActivationFunction activation,
+      float scale, int64 feature_group_count = 1);
+
+  // Returns the result of a grouped convolution: the input and output
+  // features are split into feature_group_count runs of consecutive
+  // features, and output group k is the convolution of input group k with
+  // the corresponding output features of rhs. rhs has input_features /
+  // feature_group_count input features. Only kDirect and kIm2Col compute
+  // grouped convolutions; other algorithms fall back to kIm2Col.
+  static std::unique_ptr<Array4D<float>> ConvArray4DGeneralDimensionsDilated(
+      const Array4D<float>& lhs, const Array4D<float>& rhs,
+      std::pair<int64, int64> stride, Padding padding,
+      std::pair<int64, int64> lhs_dilation,
+      std::pair<int64, int64> rhs_dilation, ConvolutionDimensionNumbers dnums,
+      int64 feature_group_count,
+      conv::ConvAlgorithm algorithm = conv::ConvAlgorithm::kDefault);
+
+  // Returns the kValid convolution of PadArray4D(lhs, lhs_padding, 0) with
+  // rhs, without materializing the padded lhs: the optimized kernels read the
+  // padding as zeros through their border handling (see
+  // conv::MakeConvGeometry). Only the spatial dimensions of lhs_padding may
+  // pad. kDirect pads first.
+  static std::unique_ptr<Array4D<float>> ConvArray4DGeneralDimensionsDilated(
+      const Array4D<float>& lhs, const Array4D<float>& rhs,
+      std::pair<int64, int64> stride, const PaddingConfig& lhs_padding,
+      std::pair<int64, int64> lhs_dilation,
+      std::pair<int64, int64> rhs_dilation, ConvolutionDimensionNumbers dnums,
+      conv::ConvAlgorithm algorithm = conv::ConvAlgorithm::kDefault);
+
+  // Returns the gradient of ConvArray4DGeneralDimensionsDilated(lhs, rhs, ...)
+  // with respect to rhs, given the gradient of its result. output_gradient is
+  // laid out like the result; kernel_spatial_dims are the spatial sizes of
+  // rhs, whose layout follows dnums.
+  static std::unique_ptr<Array4D<float>>
+  ConvArray4DGeneralDimensionsDilatedBackwardFilter(
+      const Array4D<float>& lhs, const Array4D<float>& output_gradient,
+      std::pair<int64, int64> kernel_spatial_dims,
+      std::pair<int64, int64> stride, Padding padding,
+      std::pair<int64, int64> lhs_dilation,
+      std::pair<int64, int64> rhs_dilation, ConvolutionDimensionNumbers dnums);
+
+  // Returns the gradient of ConvArray4DGeneralDimensionsDilated(lhs, rhs, ...)
+  // with respect to lhs, given the gradient of its result. input_spatial_dims
+  // are the spatial sizes of lhs, whose layout follows dnums.
+  static std::unique_ptr<Array4D<float>>
+  ConvArray4DGeneralDimensionsDilatedBackwardInput(
+      const Array4D<float>& rhs, const Array4D<float>& output_gradient,
+      std::pair<int64, int64> input_spatial_dims,
+      std::pair<int64, int64> stride, Padding padding,
+      std::pair<int64, int64> lhs_dilation,
+      std::pair<int64, int64> rhs_dilation, ConvolutionDimensionNumbers dnums);
+
   // Returns the result of a convolution `lhs <conv> rhs`, with the default
   // convolution dimension numbers returned from
   // ComputationBuilder::CreateDefaultConvDimensionNumbers().
@@ -90,43 +208,73 @@ class ReferenceUtil {
       const Array4D<float>& pointwise_weights,
       std::pair<int64, int64> kernel_stride, Padding padding);
 
+  // Returns the convolution of input, quantized to uint8 with input_params
+  // (e.g. from a quant::RangeObserver), with a filter quantized by
+  // quant::QuantizeFilter, both in the default (canonical) dimension order.
+  // Products are accumulated in int32 and the result is dequantized.
+  static std::unique_ptr<Array4D<float>> QuantizedConvArray4D(
+      const Array4D<float>& input,
+      const quant::QuantizationParams& input_params,
+      const quant::QuantizedFilter& filter,
+      std::pair<int64, int64> kernel_stride, Padding padding);
+
+  // The reductions below run on ReduceDimensions of reduction.h. The
+  // reduce_function of each is inlined rather than called through
+  // std::function; std::plus<float>, std::multiplies<float>, MaxFunctor and
+  // MinFunctor are recognized and take its vectorized path. Output elements
+  // are reduced in parallel, so reduce_function is called from several
+  // threads at once and must be thread-safe.
+
   // Returns the result of reducing a matrix to a column vector. init is the
   // initial value for the reduce operation, and reduce_function is the function
   // to apply for each reduction step.
+  template <typename F>
   static std::unique_ptr<std::vector<float>> ReduceToColArray2D(
-      const Array2D<float>& matrix, float init,
-      const std::function<float(float, float)>& reduce_function);
+      const Array2D<float>& matrix, float init, const F& reduce_function) {
+    auto result = MakeUnique<std::vector<float>>(matrix.height());
+    ReduceDimensions(matrix.data(), {matrix.height(), matrix.width()}, {1},
+                     init, reduce_function, result->data());
+    return result;
+  }
 
   // Returns the result of reducing a matrix to a row vector. init is the
   // initial value for the reduce operation, and reduce_function is the function
   // to apply for each reduction step.
+  template <typename F>
   static std::unique_ptr<std::vector<float>> ReduceToRowArray2D(
-      const Array2D<float>& matrix, float init,
-      const std::function<float(float, float)>& reduce_function);
+      const Array2D<float>& matrix, float init, const F& reduce_function) {
+    auto result = MakeUnique<std::vector<float>>(matrix.width());
+    ReduceDimensions(matrix.data(), {matrix.height(), matrix.width()}, {0},
+                     init, reduce_function, result->data());
+    return result;
+  }
 
   // Performs a R2=>R1 reduction by reducing away the dimension specified in
   // 'dimension_to_reduce'.
-  template <typename T>
+  template <typename T, typename F>
   static std::vector<T> ReduceR2ToR1(const Array2D<T>& input,
                                      int dimension_to_reduce, T init,
-                                     const std::function<T(T, T)>& freduce) {
-    std::vector<T> result(dimension_to_reduce == 0 ? input.n2() : input.n1(),
-                          init);
-    for (int i0 = 0; i0 < input.n1(); ++i0) {
-      for (int i1 = 0; i1 < input.n2(); ++i1) {
-        int output = dimension_to_reduce == 0 ? i1 : i0;
-        result[output] = freduce(result[output], input(i0, i1));
-      }
-    }
+                                     const F& freduce) {
+    std::vector<T> result(dimension_to_reduce == 0 ? input.n2() : input.n1());
+    ReduceDimensions(input.data(), {input.n1(), input.n2()},
+                     {dimension_to_reduce}, init, freduce, result.data());
     return result;
   }
 
   // Returns the result of reducing the 4D array to a vector, reducing away
   // the dimensions specified in dims.
+  template <typename F>
   static std::vector<float> Reduce4DTo1D(
       const Array4D<float>& array, float init,
-      tensorflow::gtl::ArraySlice<int64> dims,
-      const std::function<float(float, float)>& reduce_function);
+      tensorflow::gtl::ArraySlice<int64> dims, const F& reduce_function) {
+    CHECK_EQ(dims.size(), 3);
+    const std::vector<int64> dimensions = {array.n1(), array.n2(), array.n3(),
+                                           array.n4()};
+    std::vector<float> result(MakeReductionShape(dimensions, dims).output_size);
+    ReduceDimensions(array.data(), dimensions, dims, init, reduce_function,
+                     result.data());
+    return result;
+  }
 
   // Broadcast 1D dimension to 4D, from the dimension `broadcast_from_dim`.
   static std::unique_ptr<Array4D<float>> Broadcast1DTo4D(
@@ -135,19 +283,31 @@ class ReferenceUtil {
 
   // Returns the result of reducing the 3D array to a 2D array, reducing away
   // the dimensions specified in dims.
+  template <typename F>
   static std::unique_ptr<Array2D<float>> Reduce3DTo2D(
       const Array3D<float>& array, float init,
-      tensorflow::gtl::ArraySlice<int64> dims,
-      const std::function<float(float, float)>& reduce_function);
+      tensorflow::gtl::ArraySlice<int64> dims, const F& reduce_function) {
+    CHECK_EQ(dims.size(), 1);
+    const int64 rows = dims[0] == 0 ? array.n2() : array.n1();
+    const int64 cols = dims[0] == 2 ? array.n2() : array.n3();
+    auto result = MakeUnique<Array2D<float>>(rows, cols);
+    ReduceDimensions(array.data(), {array.n1(), array.n2(), array.n3()}, dims,
+                     init, reduce_function, result->data());
+    return result;
+  }
 
   // Applies map_function to each element in the input (2D array) and returns
-  // the result.
+  // the result. The rows are mapped in parallel: map_function is called from
+  // several threads at once and in no particular order, so it must be
+  // thread-safe and must not depend on the order of the calls. The same holds
+  // for every Map function below.
   static std::unique_ptr<Array2D<float>> MapArray2D(
       const Array2D<float>& matrix,
       const std::function<float(float)>& map_function);
 
   // Applies map_function to each pair of corresponding elements in the two
-  // inputs arrays and returns the result.
+  // inputs arrays and returns the result. map_function runs concurrently, as
+  // above.
   static std::unique_ptr<Array2D<float>> MapArray2D(
       const Array2D<float>& lhs, const Array2D<float>& rhs,
       const std::function<float(float, float)>& map_function);
@@ -183,6 +343,25 @@ class ReferenceUtil {
       const tensorflow::gtl::ArraySlice<int64>& window,
       const tensorflow::gtl::ArraySlice<int64>& stride, Padding padding);
 
+  // As ReduceWindow4DAdd, over operand padded as PadArray4D(operand, padding,
+  // pad_value) would pad it; the window then slides over the padded operand
+  // without further padding. The padded operand is never materialized: every
+  // window position is mapped back to the operand element it holds, or to
+  // pad_value.
+  static std::unique_ptr<Array4D<float>> ReduceWindow4DAdd(
+      const Array4D<float>& operand, float init,
+      const tensorflow::gtl::ArraySlice<int64>& window,
+      const tensorflow::gtl::ArraySlice<int64>& stride,
+      const PaddingConfig& padding, float pad_value);
+
+  // As above with max as the function to apply, e.g. for max pooling of a
+  // padded operand.
+  static std::unique_ptr<Array4D<float>> ReduceWindow4DMax(
+      const Array4D<float>& operand, float init,
+      const tensorflow::gtl::ArraySlice<int64>& window,
+      const tensorflow::gtl::ArraySlice<int64>& stride,
+      const PaddingConfig& padding, float pad_value);
+
   // Batch normalize data.
   static std::unique_ptr<Array4D<float>> BatchNorm4D(
       const Array4D<float>& input, const Array4D<float>& mean,
@@ -196,6 +375,27 @@ class ReferenceUtil {
       const tensorflow::gtl::ArraySlice<int64>& window,
       const tensorflow::gtl::ArraySlice<int64>& stride, bool same_padding);
 
+  // Max pooling over a 4D window that also stores in *argmax, resized to the
+  // dimensions of the result, the flat offset within operand of the element
+  // every window selects (the last maximum in row-major order, as
+  // SelectAndScatter4DGePlus selects it).
+  static std::unique_ptr<Array4D<float>> MaxPool4DWithArgmax(
+      const Array4D<float>& operand,
+      const tensorflow::gtl::ArraySlice<int64>& window,
+      const tensorflow::gtl::ArraySlice<int64>& stride, Padding padding,
+      Array4D<int32>* argmax);
+
+  // Backward pass of MaxPool4DWithArgmax: scatters source, the gradient of
+  // the pooled result, through argmax into an array of operand_dimensions
+  // filled with init. Nothing is rescanned, so the cost is proportional to
+  // the size of source; window, stride and padding must be those of the
+  // forward pass.
+  static std::unique_ptr<Array4D<float>> MaxPool4DBackward(
+      const Array4D<int32>& argmax, const Array4D<float>& source, float init,
+      tensorflow::gtl::ArraySlice<int64> operand_dimensions,
+      const tensorflow::gtl::ArraySlice<int64>& window,
+      const tensorflow::gtl::ArraySlice<int64>& stride, Padding padding);
+
   // Concatenates the lhs and rhs arrays along the concatenate_dimension.
   // E.g. if concatenate_dimension is 0, the "n1"/height dimension is
   // concatenated, so the arrays are stacked on top of each other.
@@ -377,13 +577,14 @@ class ReferenceUtil {
   // Applies map_function to each element in the input (2D array) and returns
   // the result.
   // (row, column) index of each element is also provided as arguments to
-  // map_function.
+  // map_function, which is called concurrently and in any order.
   static std::unique_ptr<Array2D<float>> MapWithIndexArray2D(
       const Array2D<float>& matrix,
       const std::function<float(float, int64, int64)>& map_function);
 
   // Applies map_function to each element in the input (4D array) and returns
-  // the result.
+  // the result. Like every Map function, it calls map_function from several
+  // threads at once and in no particular order.
   template <typename F>
   static std::unique_ptr<Array4D<float>> MapArray4D(const Array4D<float>& input,
                                                     F&& map_function) {
@@ -396,14 +597,18 @@ class ReferenceUtil {
   // Applies map_function to each element in the input (4D array) and returns
   // the result.
   // (plane, depth, height, width) index of each element is also provided as
-  // arguments to map_function.
+  // arguments to map_function. Each (plane, depth) slice is mapped by one
+  // thread, and the slices run concurrently in any order.
   template <typename F>
   static std::unique_ptr<Array4D<float>> MapWithIndexArray4D(
       const Array4D<float>& input, F&& map_function) {
     auto result = MakeUnique<Array4D<float>>(input.planes(), input.depth(),
                                              input.height(), input.width());
-    for (int64 plane = 0; plane < input.planes(); ++plane) {
-      for (int64 depth = 0; depth < input.depth(); ++depth) {
+    ParallelFor(input.planes() * input.depth(),
+                input.height() * input.width(), [&](int64 first, int64 last) {
+      for (int64 pd = first; pd < last; ++pd) {
+        const int64 plane = pd / input.depth();
+        const int64 depth = pd % input.depth();
         for (int64 height = 0; height < input.height(); ++height) {
           for (int64 width = 0; width < input.width(); ++width) {
             (*result)(plane, depth, height, width) =
@@ -412,12 +617,12 @@ class ReferenceUtil {
           }
         }
       }
-    }
+    });
     return result;
   }
 
   // Applies map_function to each pair of elements in the input lhs and rhs
-  // (4D array) and returns the result.
+  // (4D array) and returns the result, calling it concurrently.
   template <typename F>
   static std::unique_ptr<Array4D<float>> MapArray4D(const Array4D<float>& lhs,
                                                     const Array4D<float>& rhs,
@@ -431,14 +636,17 @@ class ReferenceUtil {
   // Applies map_function to each pair of element in lhs and rhs (4D array) and
   // returns the result.
   // (plane, depth, height, width) index of each element is also provided as
-  // arguments to map_function.
+  // arguments to map_function, which runs concurrently like the one above.
   template <typename F>
   static std::unique_ptr<Array4D<float>> MapWithIndexArray4D(
       const Array4D<float>& lhs, const Array4D<float>& rhs, F&& map_function) {
     auto result = MakeUnique<Array4D<float>>(lhs.planes(), lhs.depth(),
                                              lhs.height(), lhs.width());
-    for (int64 plane = 0; plane < lhs.planes(); ++plane) {
-      for (int64 depth = 0; depth < lhs.depth(); ++depth) {
+    ParallelFor(lhs.planes() * lhs.depth(), lhs.height() * lhs.width(),
+                [&](int64 first, int64 last) {
+      for (int64 pd = first; pd < last; ++pd) {
+        const int64 plane = pd / lhs.depth();
+        const int64 depth = pd % lhs.depth();
         for (int64 height = 0; height < lhs.height(); ++height) {
           for (int64 width = 0; width < lhs.width(); ++width) {
             (*result)(plane, depth, height, width) = map_function(
@@ -447,7 +655,7 @@ class ReferenceUtil {
           }
         }
       }
-    }
+    });
     return result;
   }
 
@@ -470,8 +678,16 @@ class ReferenceUtil {
   template <typename NativeT>
   static std::unique_ptr<Array4D<NativeT>> ReLu(const xla::Array4D<NativeT>& input)
   {
-     auto great_zero = [](NativeT value) { return (value > 0.f) ? value : 0.f; };
-     return ReferenceUtil::MapArray4D(input, great_zero);
+     auto result = MakeUnique<Array4D<NativeT>>(input);
+     ReLuInPlace(*result);
+     return result;
+  }
+
+  // As ReLu, overwriting input instead of allocating the result.
+  template <typename NativeT>
+  static void ReLuInPlace(xla::Array4D<NativeT>& input)
+  {
+     ReluInPlace(input.flatten().data(), input.num_elements());
   }
 
 
@@ -487,6 +703,14 @@ class ReferenceUtil {
      const tensorflow::gtl::ArraySlice<tensorflow::int64>& stride, 
      xla::Padding padding_in);
 
+  // As above, also recording the argmax of every window for
+  // MaxPool4DBackward with window {1, 1, window[0], window[1]}.
+  static std::unique_ptr<xla::Array4D<float>> Max_Pool(
+     const xla::Array4D<float>& operand,
+     const tensorflow::gtl::ArraySlice<tensorflow::int64>& window,
+     const tensorflow::gtl::ArraySlice<tensorflow::int64>& stride,
+     xla::Padding padding_in, xla::Array4D<tensorflow::int32>* argmax);
+
 
   template <typename NativeT>
   static NativeT ReduceMean(const xla::Array4D<NativeT>& input)
@@ -518,6 +742,26 @@ class ReferenceUtil {
      return xla::Sum<NativeT>(input.flatten());
   }
 
+  // Computes Conv2D with the FFT convolution of conv_fft.h into *result when
+  // the cost model prefers it, which takes unit strides and a large kernel.
+  // Returns false, leaving *result untouched, otherwise.
+  static bool Conv2DFft(const Array4D<float>& input,
+                        const Array2D<float>& kernel,
+                        const tensorflow::gtl::ArraySlice<int64>& stride,
+                        Padding padding,
+                        std::unique_ptr<Array4D<float>>* result);
+
+  // Other element types always take the direct loop of Conv2D.
+  template <typename TType>
+  static bool Conv2DFft(const Array4D<TType>& input,
+                        const Array2D<TType>& kernel,
+                        const tensorflow::gtl::ArraySlice<int64>& stride,
+                        Padding padding,
+                        std::unique_ptr<Array4D<TType>>* result)
+  {
+     return false;
+  }
+
   /*
   // https://www.pico.net/kb/what-is-the-difference-between-same-and-valid-padding-in-tf-nn-max-pool-of-tensorflow
   // https://stackoverflow.com/questions/37674306/what-is-the-difference-between-same-and-valid-padding-in-tf-nn-max-pool-of-t
@@ -535,6 +779,12 @@ class ReferenceUtil {
      CHECK_GE(input.size(2), kernel.size(0));
      CHECK_GE(input.size(3), kernel.size(1));
 
+     std::unique_ptr<Array4D<TType>> fft_result;
+     if (Conv2DFft(input, kernel, stride, padding, &fft_result))
+     {
+        return fft_result;
+     }
+
      std::vector<int64> dim_lengths{ input.n3(), input.n4() };
 
      auto padding_both = xla::MakePadding(dim_lengths, { kernel.height(), kernel.width() }, stride, padding);
@@ -549,10 +799,14 @@ class ReferenceUtil {
      }
      auto result = MakeUnique<Array4D<TType>>(input.size(0), 1, window_counts[0], window_counts[1]);
 
-     for (int64 i0 = 0; i0 < input.size(0); i0++)
+     // Each task produces whole output rows.
+     const int64 row_cost = result->size(3) * input.size(1) * kernel.num_elements();
+     ParallelFor(input.size(0) * result->size(2), row_cost, [&](int64 first, int64 last)
      {
-      for (int64 i2 = 0; i2 < result->size(2); ++i2)
+      for (int64 row = first; row < last; ++row)
       {
+         const int64 i0 = row / result->size(2);
+         const int64 i2 = row % result->size(2);
          for (int64 i3 = 0; i3 < result->size(3); ++i3)
          {
             TType mul_accum = 0.f;
@@ -578,7 +832,7 @@ class ReferenceUtil {
               (*result)(i0, 0, i2, i3) = mul_accum;
            }
         }
-     }
+     });
 
      return result;
   }
@@ -588,45 +842,38 @@ class ReferenceUtil {
   {
      CHECK_EQ(input.size(3), int64(bias.size()));
 
-     for (int64 i0 = 0; i0 < input.size(0); i0++)
+     ParallelFor(input.size(0) * input.size(1), input.size(2) * input.size(3), [&](int64 first, int64 last)
      {
-        for (int64 i1 = 0; i1 < input.size(1); i1++)
+        for (int64 i01 = first; i01 < last; i01++)
         {
-           for (int64 i2 = 0; i2 < input.size(2); i2++)
+           const int64 i0 = i01 / input.size(1);
+           const int64 i1 = i01 % input.size(1);
+           for (int64 i2 = 0; i2 < input.size(2) && input.size(3) > 0; i2++)
            {
-              for (int64 i3 = 0; i3 < input.size(3); i3++)
-              {
-                 input(i0, i1, i2, i3) += bias[i3];
-              }
+              AddInPlace(&input(i0, i1, i2, 0), bias.data(), input.size(3));
            }
         }
-     }
+     });
   }
 
   template <typename TType>
   static void SoftMax(xla::Array4D<TType>& input)
   {
-     for (int64 i0 = 0; i0 < input.size(0); i0++)
+     // Rows along dimension 3 are normalized independently of each other. The
+     // cost counts the vectorized max, exp, sum and scale of an element as
+     // roughly 5 scalar operations.
+     ParallelFor(input.size(0) * input.size(1), input.size(2) * input.size(3) * 5, [&](int64 first, int64 last)
      {
-        for (int64 i1 = 0; i1 < input.size(1); i1++)
+        for (int64 i01 = first; i01 < last; i01++)
         {
+           const int64 i0 = i01 / input.size(1);
+           const int64 i1 = i01 % input.size(1);
            for (int64 i2 = 0; i2 < input.size(2); i2++)
            {
-              TType ExpSumm = 0.f;
-              for (int64 i3 = 0; i3 < input.size(3); i3++)
-              {
-                 TType e = std::exp(input(i0, i1, i2, i3));
-                 input(i0, i1, i2, i3) = e;
-                 ExpSumm += e;
-              }
-
-              for (int64 i3 = 0; i3 < input.size(3); i3++)
-              {
-                 input(i0, i1, i2, i3) = input(i0, i1, i2, i3) / ExpSumm;
-              }
+              SoftMaxInPlace(&input(i0, i1, i2, 0), input.size(3));
            }
         }
-     }
+     });
   }
 
 
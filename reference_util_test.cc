@@ -17,9 +17,11 @@ limitations under the License.
 
 #include <cmath>
 #include <memory>
+#include <vector>
 
 #include "array2d.h"
 #include "array4d.h"
+#include "computation_builder.h"
 #include "padding.h"
 #include "literal_util.h"
 #include "ptr_util.h"
@@ -44,6 +46,7 @@ public:
    void MapWithIndexArray2D();
    void MapArray4D();
    void MapWithIndexArray4D();
+   void ReLuArray4D();
    void ConvArray3DWithSamePadding();
    void ConvArray3DWithValidPadding();
    void ConvWithSamePadding();
@@ -52,6 +55,8 @@ public:
    void ConvGeneralDimensionsWithValidPadding();
    void BiasAdd_2x2x2x3();
    void Cross_Entropy_With_Logits();
+   void ConvWithFusedPadding();
+   void ReduceWindowWithFusedPadding();
 
    void run();
 
@@ -86,6 +91,7 @@ void ReferenceUtilTest::run()
    MapWithIndexArray2D();
    MapArray4D();
    MapWithIndexArray4D();
+   ReLuArray4D();
    ConvArray3DWithSamePadding();
    ConvArray3DWithValidPadding();
    ConvWithSamePadding();
@@ -94,6 +100,8 @@ void ReferenceUtilTest::run()
    ConvGeneralDimensionsWithValidPadding();
    BiasAdd_2x2x2x3();
    Cross_Entropy_With_Logits();
+   ConvWithFusedPadding();
+   ReduceWindowWithFusedPadding();
 }
 
 void ReferenceUtilTest::TransposeArray2D() 
@@ -265,6 +273,21 @@ void SliceStridedArray4D()
 }
 */
 
+void ReferenceUtilTest::ReLuArray4D()
+{
+  Array4D<float> input(/*planes=*/2, /*depth=*/3, /*height=*/4, /*width=*/5);
+  input.FillWithMultiples(1.0f);
+  input.Each([](tensorflow::gtl::ArraySlice<int64>, float* value) {
+    *value -= 30.0f;
+  });
+  auto result = ReferenceUtil::ReLu(input);
+  for (int64 i = 0; i < input.num_elements(); ++i) {
+    ASSERT_EQ(result->flatten()[i], std::max(input.flatten()[i], 0.0f));
+  }
+  ReferenceUtil::ReLuInPlace(input);
+  ASSERT_TRUE(input.flatten() == result->flatten());
+}
+
 void ReferenceUtilTest::ConvArray3DWithSamePadding()
 {
   Array3D<float> input = {{{1, 2, 3, 4}}};
@@ -532,5 +555,111 @@ void ReferenceUtilTest::Cross_Entropy_With_Logits()
    ASSERT_EQ(*softmax_cross_entropy_with_logits, check);
 }
 
+// Returns a config padding dimension i of a 4D operand by
+// (low[i], high[i], interior[i]).
+PaddingConfig MakePaddingConfig4D(std::array<int64, 4> low,
+                                  std::array<int64, 4> high,
+                                  std::array<int64, 4> interior)
+{
+   PaddingConfig config;
+   for (int i = 0; i < 4; ++i) {
+      auto* dimension = config.add_dimensions();
+      dimension->set_edge_padding_low(low[i]);
+      dimension->set_edge_padding_high(high[i]);
+      dimension->set_interior_padding(interior[i]);
+   }
+   return config;
+}
+
+// Checks the convolution of input with config fused into it, for every
+// algorithm, against the direct convolution of the materialized padding.
+void ExpectConvWithFusedPaddingMatches(const Array4D<float>& input,
+                                       const Array4D<float>& kernel,
+                                       const PaddingConfig& config,
+                                       const ConvolutionDimensionNumbers& dnums)
+{
+   const Array4D<float> padded = ReferenceUtil::PadArray4D(input, config, 0.0f);
+   for (std::pair<int64, int64> stride :
+        {std::make_pair<int64, int64>(1, 1),
+         std::make_pair<int64, int64>(2, 1)}) {
+      for (std::pair<int64, int64> lhs_dilation :
+           {std::make_pair<int64, int64>(1, 1),
+            std::make_pair<int64, int64>(2, 2)}) {
+         auto expected = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+             padded, kernel, stride, Padding::kValid, lhs_dilation, {1, 1},
+             dnums, conv::ConvAlgorithm::kDirect);
+         for (conv::ConvAlgorithm algorithm :
+              {conv::ConvAlgorithm::kDefault, conv::ConvAlgorithm::kDirect,
+               conv::ConvAlgorithm::kIm2Col,
+               conv::ConvAlgorithm::kWinogradF2x2, conv::ConvAlgorithm::kFft,
+               conv::ConvAlgorithm::kTransposed,
+               conv::ConvAlgorithm::kAutotune}) {
+            auto actual = ReferenceUtil::ConvArray4DGeneralDimensionsDilated(
+                input, kernel, stride, config, lhs_dilation, {1, 1}, dnums,
+                algorithm);
+            LiteralTestUtil::ExpectR4NearArray4D(
+                *expected, *LiteralUtil::CreateR4FromArray4D(*actual),
+                ErrorSpec(1e-4f));
+         }
+      }
+   }
+}
+
+void ReferenceUtilTest::ConvWithFusedPadding()
+{
+   const auto dnums = ComputationBuilder::CreateDefaultConvDimensionNumbers();
+   Array4D<float> input(2, 3, 7, 9);
+   input.FillRandom(1.0f, 0.0, 71);
+   // Padding only after the input leaves pad_top and pad_left at zero and
+   // only shows as a larger output, which 1x1 kernels must not read the input
+   // as.
+   const std::vector<PaddingConfig> configs = {
+       MakePaddingConfig4D({{0, 0, 1, 1}}, {{0, 0, 1, 1}}, {{0, 0, 0, 0}}),
+       MakePaddingConfig4D({{0, 0, 3, 0}}, {{0, 0, 0, 2}}, {{0, 0, 0, 0}}),
+       MakePaddingConfig4D({{0, 0, 2, 1}}, {{0, 0, 1, 2}}, {{0, 0, 1, 2}}),
+       MakePaddingConfig4D({{0, 0, 0, 0}}, {{0, 0, 2, 3}}, {{0, 0, 0, 0}})};
+   for (int64 size : {3, 1}) {
+      Array4D<float> kernel(4, 3, size, size);
+      kernel.FillRandom(1.0f, 0.0, 72);
+      for (const PaddingConfig& config : configs) {
+         ExpectConvWithFusedPaddingMatches(input, kernel, config, dnums);
+      }
+   }
+}
+
+void ReferenceUtilTest::ReduceWindowWithFusedPadding()
+{
+   Array4D<float> input(2, 3, 6, 5);
+   input.FillRandom(1.0f, 0.0, 73);
+   const PaddingConfig config =
+       MakePaddingConfig4D({{0, 1, 2, 0}}, {{1, 0, 1, 3}}, {{0, 0, 1, 1}});
+   for (float pad_value : {0.0f, -2.0f}) {
+      const Array4D<float> padded =
+          ReferenceUtil::PadArray4D(input, config, pad_value);
+      auto expected_sum = ReferenceUtil::ReduceWindow4DAdd(
+          padded, 0.5f, {1, 2, 3, 2}, {1, 1, 2, 2}, Padding::kValid);
+      auto sum = ReferenceUtil::ReduceWindow4DAdd(
+          input, 0.5f, {1, 2, 3, 2}, {1, 1, 2, 2}, config, pad_value);
+      LiteralTestUtil::ExpectR4NearArray4D(
+          *expected_sum, *LiteralUtil::CreateR4FromArray4D(*sum),
+          ErrorSpec(1e-5f));
+
+      auto max = ReferenceUtil::ReduceWindow4DMax(
+          input, -1e30f, {1, 1, 3, 3}, {1, 1, 2, 1}, config, pad_value);
+      ASSERT_EQ(max->n3(), (padded.n3() - 3) / 2 + 1);
+      ASSERT_EQ(max->n4(), padded.n4() - 2);
+      max->Each([&](tensorflow::gtl::ArraySlice<int64> i, float* value) {
+         float expected = -1e30f;
+         for (int64 y = 0; y < 3; ++y) {
+            for (int64 x = 0; x < 3; ++x) {
+               expected = std::max(expected,
+                                   padded(i[0], i[1], i[2] * 2 + y, i[3] + x));
+            }
+         }
+         ASSERT_EQ(*value, expected);
+      });
+   }
+}
+
 }  // namespace
 }  // namespace xla
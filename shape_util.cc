@@ -232,6 +232,7 @@ void ShapeUtil::PopulateShape(
     case S32:
     case S64:
     case F16:
+    case BF16:
     case F32:
     case F64:
       return true;
@@ -512,7 +513,9 @@ int ShapeUtil::GetDimensionNumber(const Shape& shape, int dimension_number)
     case U64:
       return sizeof(uint64);
     case F16:
-      return sizeof(float) / 2;
+      return sizeof(half);
+    case BF16:
+      return sizeof(bfloat16);
     case F32:
       return sizeof(float);
     case F64:
@@ -0,0 +1,227 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "simd_kernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+#include "kernel_registry.h"
+#include "simd_ops.h"
+
+#define XLA_SIMD_TARGET XLA_SIMD_BASELINE_TARGET
+#define XLA_SIMD_NAMESPACE baseline
+#include "simd_kernels_impl.h"
+#undef XLA_SIMD_NAMESPACE
+#undef XLA_SIMD_TARGET
+
+#if XLA_SIMD_BASELINE_TARGET == XLA_SIMD_SSE2
+#define XLA_SIMD_HAS_X86_VARIANTS 1
+
+XLA_SIMD_BEGIN_AVX2
+#define XLA_SIMD_TARGET XLA_SIMD_AVX2
+#define XLA_SIMD_NAMESPACE avx2
+#include "simd_kernels_impl.h"
+#undef XLA_SIMD_NAMESPACE
+#undef XLA_SIMD_TARGET
+XLA_SIMD_END_TARGET
+
+// The AVX-512 intrinsics of GCC 12 before 12.3 pass an uninitialized
+// placeholder to their builtins, which -Wuninitialized reports in every
+// function that inlines them (GCC bug 105593).
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+XLA_SIMD_BEGIN_AVX512
+#define XLA_SIMD_TARGET XLA_SIMD_AVX512
+#define XLA_SIMD_NAMESPACE avx512
+#include "simd_kernels_impl.h"
+#undef XLA_SIMD_NAMESPACE
+#undef XLA_SIMD_TARGET
+XLA_SIMD_END_TARGET
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif  // XLA_SIMD_BASELINE_TARGET == XLA_SIMD_SSE2
+
+namespace xla {
+namespace simd {
+namespace {
+
+std::atomic<int> default_accuracy(static_cast<int>(Accuracy::kPrecise));
+
+// One target's kernels.
+struct KernelTable {
+  void (*add)(const float*, const float*, float*, int64);
+  void (*subtract)(const float*, const float*, float*, int64);
+  void (*multiply)(const float*, const float*, float*, int64);
+  void (*maximum)(const float*, const float*, float*, int64);
+  void (*minimum)(const float*, const float*, float*, int64);
+  void (*scale)(float, float*, int64);
+  void (*add_scalar)(float, float*, int64);
+  void (*square)(float*, int64);
+  void (*activate_and_scale)(ActivationFunction, float, float*, int64,
+                             Accuracy);
+  void (*gather)(const float*, const int32*, float*, int64);
+  float (*sum)(const float*, int64);
+  float (*dot)(const float*, const float*, int64);
+  float (*product)(const float*, int64);
+  float (*max)(const float*, int64);
+  float (*min)(const float*, int64);
+  void (*exp)(const float*, float*, int64, Accuracy);
+  void (*expm1)(const float*, float*, int64, Accuracy);
+  void (*log)(const float*, float*, int64, Accuracy);
+  void (*tanh)(const float*, float*, int64, Accuracy);
+  void (*sigmoid)(const float*, float*, int64, Accuracy);
+  void (*softplus)(const float*, float*, int64, Accuracy);
+  void (*erf)(const float*, float*, int64);
+  void (*gelu)(const float*, float*, int64, Accuracy);
+  void (*rsqrt)(const float*, float*, int64, Accuracy);
+};
+
+#define XLA_SIMD_KERNEL_TABLE(ns)                                         \
+  {                                                                       \
+    ns::Add, ns::Subtract, ns::Multiply, ns::Maximum, ns::Minimum,        \
+        ns::Scale, ns::AddScalar, ns::Square, ns::ActivateAndScale,       \
+        ns::Gather, ns::Sum, ns::Dot, ns::Product, ns::Max, ns::Min,      \
+        ns::Exp, ns::Expm1, ns::Log, ns::Tanh, ns::Sigmoid, ns::Softplus, \
+        ns::Erf, ns::Gelu, ns::Rsqrt                                      \
+  }
+
+const KernelTable kBaselineKernels = XLA_SIMD_KERNEL_TABLE(baseline);
+#ifdef XLA_SIMD_HAS_X86_VARIANTS
+const KernelTable kAvx2Kernels = XLA_SIMD_KERNEL_TABLE(avx2);
+const KernelTable kAvx512Kernels = XLA_SIMD_KERNEL_TABLE(avx512);
+#endif
+
+const KernelTable& Kernels() {
+  static const KernelRegistry<const KernelTable*>* registry = [] {
+    auto* kernels = new KernelRegistry<const KernelTable*>(&kBaselineKernels);
+#ifdef XLA_SIMD_HAS_X86_VARIANTS
+    kernels->Register(Isa::kAvx2, &kAvx2Kernels);
+    kernels->Register(Isa::kAvx512, &kAvx512Kernels);
+#endif
+    return kernels;
+  }();
+  return *registry->Get();
+}
+
+}  // namespace
+
+void SetDefaultAccuracy(Accuracy accuracy) {
+  default_accuracy.store(static_cast<int>(accuracy),
+                         std::memory_order_relaxed);
+}
+
+Accuracy DefaultAccuracy() {
+  return static_cast<Accuracy>(
+      default_accuracy.load(std::memory_order_relaxed));
+}
+
+void Add(const float* a, const float* b, float* out, int64 n) {
+  Kernels().add(a, b, out, n);
+}
+
+void Subtract(const float* a, const float* b, float* out, int64 n) {
+  Kernels().subtract(a, b, out, n);
+}
+
+void Multiply(const float* a, const float* b, float* out, int64 n) {
+  Kernels().multiply(a, b, out, n);
+}
+
+void Maximum(const float* a, const float* b, float* out, int64 n) {
+  Kernels().maximum(a, b, out, n);
+}
+
+void Minimum(const float* a, const float* b, float* out, int64 n) {
+  Kernels().minimum(a, b, out, n);
+}
+
+void Scale(float scale, float* values, int64 n) {
+  Kernels().scale(scale, values, n);
+}
+
+void AddScalar(float value, float* values, int64 n) {
+  Kernels().add_scalar(value, values, n);
+}
+
+void Square(float* values, int64 n) { Kernels().square(values, n); }
+
+void ActivateAndScale(ActivationFunction activation, float scale,
+                      float* values, int64 n, Accuracy accuracy) {
+  Kernels().activate_and_scale(activation, scale, values, n, accuracy);
+}
+
+void Gather(const float* base, const int32* indices, float* out, int64 n) {
+  Kernels().gather(base, indices, out, n);
+}
+
+float Sum(const float* values, int64 n) { return Kernels().sum(values, n); }
+
+float Dot(const float* a, const float* b, int64 n) {
+  return Kernels().dot(a, b, n);
+}
+
+float Product(const float* values, int64 n) {
+  return Kernels().product(values, n);
+}
+
+float Max(const float* values, int64 n) { return Kernels().max(values, n); }
+
+float Min(const float* values, int64 n) { return Kernels().min(values, n); }
+
+void Exp(const float* values, float* out, int64 n, Accuracy accuracy) {
+  Kernels().exp(values, out, n, accuracy);
+}
+
+void Expm1(const float* values, float* out, int64 n, Accuracy accuracy) {
+  Kernels().expm1(values, out, n, accuracy);
+}
+
+void Log(const float* values, float* out, int64 n, Accuracy accuracy) {
+  Kernels().log(values, out, n, accuracy);
+}
+
+void Tanh(const float* values, float* out, int64 n, Accuracy accuracy) {
+  Kernels().tanh(values, out, n, accuracy);
+}
+
+void Sigmoid(const float* values, float* out, int64 n, Accuracy accuracy) {
+  Kernels().sigmoid(values, out, n, accuracy);
+}
+
+void Softplus(const float* values, float* out, int64 n, Accuracy accuracy) {
+  Kernels().softplus(values, out, n, accuracy);
+}
+
+void Erf(const float* values, float* out, int64 n) {
+  Kernels().erf(values, out, n);
+}
+
+void Gelu(const float* values, float* out, int64 n, Accuracy accuracy) {
+  Kernels().gelu(values, out, n, accuracy);
+}
+
+void Rsqrt(const float* values, float* out, int64 n, Accuracy accuracy) {
+  Kernels().rsqrt(values, out, n, accuracy);
+}
+
+}  // namespace simd
+}  // namespace xla
@@ -0,0 +1,149 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_SIMD_KERNELS_H_
+#define TENSORFLOW_COMPILER_XLA_SIMD_KERNELS_H_
+
+// Elementwise, activation and reduction kernels on float arrays, written
+// once on the vector operations of simd_ops.h and dispatched through the
+// kernel registry to the best instruction set of the host. The kernels are
+// single-threaded; callers split large arrays with ParallelFor.
+
+#include "activation.h"
+#include "types.h"
+
+namespace xla {
+namespace simd {
+
+// Accuracy of the transcendental kernels (the math functions below and the
+// smooth activations of ActivateAndScale).
+enum class Accuracy {
+  // Within a few units in the last place (ulp) of the exact result.
+  kPrecise,
+  // Shorter polynomials and hardware estimates, for relative errors around
+  // 1e-5: 1.2 to 1.8 times the throughput, 3 times for Rsqrt.
+  kFast,
+};
+
+// Selects the accuracy of the kernels called without one. The default is
+// kPrecise. Must not be called concurrently with running ops.
+void SetDefaultAccuracy(Accuracy accuracy);
+
+// Returns the current default.
+Accuracy DefaultAccuracy();
+
+// out[i] = a[i] + b[i] for i in [0, n). out may alias a or b; the same holds
+// for the other elementwise kernels.
+void Add(const float* a, const float* b, float* out, int64 n);
+
+// out[i] = a[i] - b[i].
+void Subtract(const float* a, const float* b, float* out, int64 n);
+
+// out[i] = a[i] * b[i].
+void Multiply(const float* a, const float* b, float* out, int64 n);
+
+// out[i] = max(a[i], b[i]).
+void Maximum(const float* a, const float* b, float* out, int64 n);
+
+// out[i] = min(a[i], b[i]).
+void Minimum(const float* a, const float* b, float* out, int64 n);
+
+// values[i] *= scale.
+void Scale(float scale, float* values, int64 n);
+
+// values[i] += value.
+void AddScalar(float value, float* values, int64 n);
+
+// values[i] *= values[i].
+void Square(float* values, int64 n);
+
+// values[i] = scale * activation(values[i]), the bulk form of the
+// ActivateAndScale template in activation.h. Elu, tanh and sigmoid have the
+// errors of Expm1, Tanh and Sigmoid below.
+void ActivateAndScale(ActivationFunction activation, float scale,
+                      float* values, int64 n,
+                      Accuracy accuracy = DefaultAccuracy());
+
+// Math functions: out[i] = f(values[i]). The bounds hold on every target and
+// were measured against double precision over the whole float range; errors
+// are relative unless stated otherwise, with ulp the spacing of floats at the
+// exact result. All of them return NaN for NaN.
+
+// exp(x). Precise: 1 ulp, denormal results included. Fast: 1.5e-5.
+void Exp(const float* values, float* out, int64 n,
+         Accuracy accuracy = DefaultAccuracy());
+
+// exp(x) - 1, without cancellation near 0. Precise: 4 ulp. Fast: 2.5e-5.
+void Expm1(const float* values, float* out, int64 n,
+           Accuracy accuracy = DefaultAccuracy());
+
+// Natural logarithm: -infinity at 0 and NaN below. Precise: 1 ulp. Fast:
+// 2e-5.
+void Log(const float* values, float* out, int64 n,
+         Accuracy accuracy = DefaultAccuracy());
+
+// tanh(x). Precise: 2 ulp. Fast: 6 ulp.
+void Tanh(const float* values, float* out, int64 n,
+          Accuracy accuracy = DefaultAccuracy());
+
+// 1 / (1 + exp(-x)). Precise: 3 ulp. Fast: 1.5e-5.
+void Sigmoid(const float* values, float* out, int64 n,
+             Accuracy accuracy = DefaultAccuracy());
+
+// log(1 + exp(x)), without overflow for large x. Precise: 3 ulp. Fast:
+// 2.5e-5.
+void Softplus(const float* values, float* out, int64 n,
+              Accuracy accuracy = DefaultAccuracy());
+
+// erf(x), with a single accuracy: absolute error 5e-7 (8 ulp near +-1).
+void Erf(const float* values, float* out, int64 n);
+
+// GELU, x / 2 (1 + erf(x / sqrt(2))), and 0 below x = -10. Precise: 1.5e-6
+// times max(1, |gelu(x)|); the relative error grows where the result tends
+// to 0 for x < -3. Fast: the tanh approximation
+// x / 2 (1 + tanh(sqrt(2 / pi) (x + 0.044715 x^3))), 5e-4 times
+// max(1, |gelu(x)|) from the exact GELU.
+void Gelu(const float* values, float* out, int64 n,
+          Accuracy accuracy = DefaultAccuracy());
+
+// 1 / sqrt(x). Precise: 1.5 ulp. Fast: the hardware estimate with one Newton
+// step, 3e-7 (4 ulp); denormal inputs may give infinity.
+void Rsqrt(const float* values, float* out, int64 n,
+           Accuracy accuracy = DefaultAccuracy());
+
+// out[i] = base[indices[i]].
+void Gather(const float* base, const int32* indices, float* out, int64 n);
+
+// Returns the sum of the n values. The values are accumulated in several
+// vector lanes that are added at the end, so the rounding differs from a
+// sequential loop (and is usually smaller).
+float Sum(const float* values, int64 n);
+
+// Returns the sum of a[i] * b[i], accumulated like Sum.
+float Dot(const float* a, const float* b, int64 n);
+
+// Returns the product of the n values, accumulated like Sum.
+float Product(const float* values, int64 n);
+
+// Returns the largest of the n values, or -infinity for n == 0.
+float Max(const float* values, int64 n);
+
+// Returns the smallest of the n values, or +infinity for n == 0.
+float Min(const float* values, int64 n);
+
+}  // namespace simd
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_SIMD_KERNELS_H_
@@ -0,0 +1,274 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// The kernels of simd_kernels.h for one target. Like the per-target part of
+// simd_ops.h this file has no include guard; simd_kernels.cc includes it once
+// per target, with XLA_SIMD_TARGET and XLA_SIMD_NAMESPACE defined.
+
+#include "simd_ops.h"
+// After simd_ops.h, whose operations it uses.
+#include "simd_math.h"
+
+namespace xla {
+namespace simd {
+namespace XLA_SIMD_NAMESPACE {
+
+// Applies op to every vector of a and b, and to the partial vector at the
+// end.
+template <typename Op>
+XLA_SIMD_INLINE void Binary(const float* a, const float* b, float* out,
+                            int64 n, Op op) {
+  int64 i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    Store(op(Load(a + i), Load(b + i)), out + i);
+  }
+  if (i < n) {
+    StorePartial(op(LoadPartial(a + i, n - i), LoadPartial(b + i, n - i)),
+                 out + i, n - i);
+  }
+}
+
+template <typename Op>
+XLA_SIMD_INLINE void Unary(float* values, int64 n, Op op) {
+  int64 i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    Store(op(Load(values + i)), values + i);
+  }
+  if (i < n) {
+    StorePartial(op(LoadPartial(values + i, n - i)), values + i, n - i);
+  }
+}
+
+template <typename Op>
+XLA_SIMD_INLINE void Map(const float* values, float* out, int64 n, Op op) {
+  int64 i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    Store(op(Load(values + i)), out + i);
+  }
+  if (i < n) {
+    StorePartial(op(LoadPartial(values + i, n - i)), out + i, n - i);
+  }
+}
+
+void Add(const float* a, const float* b, float* out, int64 n) {
+  Binary(a, b, out, n, [](Vec x, Vec y) { return Add(x, y); });
+}
+
+void Subtract(const float* a, const float* b, float* out, int64 n) {
+  Binary(a, b, out, n, [](Vec x, Vec y) { return Sub(x, y); });
+}
+
+void Multiply(const float* a, const float* b, float* out, int64 n) {
+  Binary(a, b, out, n, [](Vec x, Vec y) { return Mul(x, y); });
+}
+
+void Maximum(const float* a, const float* b, float* out, int64 n) {
+  Binary(a, b, out, n, [](Vec x, Vec y) { return Max(x, y); });
+}
+
+void Minimum(const float* a, const float* b, float* out, int64 n) {
+  Binary(a, b, out, n, [](Vec x, Vec y) { return Min(x, y); });
+}
+
+void Scale(float scale, float* values, int64 n) {
+  const Vec s = Set(scale);
+  Unary(values, n, [s](Vec x) { return Mul(x, s); });
+}
+
+void AddScalar(float value, float* values, int64 n) {
+  const Vec v = Set(value);
+  Unary(values, n, [v](Vec x) { return Add(x, v); });
+}
+
+void Square(float* values, int64 n) {
+  Unary(values, n, [](Vec x) { return Mul(x, x); });
+}
+
+template <Accuracy A>
+void ActivateAndScale(ActivationFunction activation, float scale,
+                      float* values, int64 n) {
+  const Vec s = Set(scale);
+  const Vec zero = Zero();
+  switch (activation) {
+    case ActivationFunction::kNone:
+      if (scale != 1.0f) {
+        Unary(values, n, [s](Vec x) { return Mul(x, s); });
+      }
+      return;
+    case ActivationFunction::kRelu:
+      Unary(values, n, [s, zero](Vec x) { return Mul(Max(x, zero), s); });
+      return;
+    case ActivationFunction::kElu:
+      Unary(values, n, [s, zero](Vec x) {
+        return Mul(Select(Gt(x, zero), x, Expm1<A>(x)), s);
+      });
+      return;
+    case ActivationFunction::kTanh:
+      Unary(values, n, [s](Vec x) { return Mul(Tanh<A>(x), s); });
+      return;
+    case ActivationFunction::kSigmoid:
+      Unary(values, n, [s](Vec x) { return Mul(Sigmoid<A>(x), s); });
+      return;
+  }
+}
+
+void ActivateAndScale(ActivationFunction activation, float scale,
+                      float* values, int64 n, Accuracy accuracy) {
+  if (accuracy == Accuracy::kFast) {
+    ActivateAndScale<Accuracy::kFast>(activation, scale, values, n);
+  } else {
+    ActivateAndScale<Accuracy::kPrecise>(activation, scale, values, n);
+  }
+}
+
+// Defines the bulk kernel Name(values, out, n, accuracy) of the math
+// function Name<A>(Vec).
+#define XLA_SIMD_MATH_KERNEL(Name)                                        \
+  void Name(const float* values, float* out, int64 n, Accuracy accuracy) { \
+    if (accuracy == Accuracy::kFast) {                                    \
+      Map(values, out, n, [](Vec x) { return Name<Accuracy::kFast>(x); }); \
+    } else {                                                              \
+      Map(values, out, n,                                                 \
+          [](Vec x) { return Name<Accuracy::kPrecise>(x); });             \
+    }                                                                     \
+  }
+
+XLA_SIMD_MATH_KERNEL(Exp)
+XLA_SIMD_MATH_KERNEL(Expm1)
+XLA_SIMD_MATH_KERNEL(Log)
+XLA_SIMD_MATH_KERNEL(Tanh)
+XLA_SIMD_MATH_KERNEL(Sigmoid)
+XLA_SIMD_MATH_KERNEL(Softplus)
+XLA_SIMD_MATH_KERNEL(Gelu)
+XLA_SIMD_MATH_KERNEL(Rsqrt)
+
+#undef XLA_SIMD_MATH_KERNEL
+
+void Erf(const float* values, float* out, int64 n) {
+  Map(values, out, n, [](Vec x) { return Erf(x); });
+}
+
+void Gather(const float* base, const int32* indices, float* out, int64 n) {
+  int64 i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    Store(Gather(base, indices + i), out + i);
+  }
+  for (; i < n; ++i) {
+    out[i] = base[indices[i]];
+  }
+}
+
+// Four independent accumulators hide the latency of the vector adds.
+float Sum(const float* values, int64 n) {
+  Vec acc0 = Zero();
+  Vec acc1 = Zero();
+  Vec acc2 = Zero();
+  Vec acc3 = Zero();
+  int64 i = 0;
+  for (; i + 4 * kLanes <= n; i += 4 * kLanes) {
+    acc0 = Add(acc0, Load(values + i));
+    acc1 = Add(acc1, Load(values + i + kLanes));
+    acc2 = Add(acc2, Load(values + i + 2 * kLanes));
+    acc3 = Add(acc3, Load(values + i + 3 * kLanes));
+  }
+  for (; i + kLanes <= n; i += kLanes) {
+    acc0 = Add(acc0, Load(values + i));
+  }
+  if (i < n) {
+    acc1 = Add(acc1, LoadPartial(values + i, n - i));
+  }
+  return ReduceSum(Add(Add(acc0, acc1), Add(acc2, acc3)));
+}
+
+float Dot(const float* a, const float* b, int64 n) {
+  Vec acc0 = Zero();
+  Vec acc1 = Zero();
+  Vec acc2 = Zero();
+  Vec acc3 = Zero();
+  int64 i = 0;
+  for (; i + 4 * kLanes <= n; i += 4 * kLanes) {
+    acc0 = MulAdd(Load(a + i), Load(b + i), acc0);
+    acc1 = MulAdd(Load(a + i + kLanes), Load(b + i + kLanes), acc1);
+    acc2 = MulAdd(Load(a + i + 2 * kLanes), Load(b + i + 2 * kLanes), acc2);
+    acc3 = MulAdd(Load(a + i + 3 * kLanes), Load(b + i + 3 * kLanes), acc3);
+  }
+  for (; i + kLanes <= n; i += kLanes) {
+    acc0 = MulAdd(Load(a + i), Load(b + i), acc0);
+  }
+  if (i < n) {
+    acc1 = MulAdd(LoadPartial(a + i, n - i), LoadPartial(b + i, n - i), acc1);
+  }
+  return ReduceSum(Add(Add(acc0, acc1), Add(acc2, acc3)));
+}
+
+float Product(const float* values, int64 n) {
+  const Vec one = Set(1.0f);
+  Vec acc0 = one;
+  Vec acc1 = one;
+  int64 i = 0;
+  for (; i + 2 * kLanes <= n; i += 2 * kLanes) {
+    acc0 = Mul(acc0, Load(values + i));
+    acc1 = Mul(acc1, Load(values + i + kLanes));
+  }
+  for (; i + kLanes <= n; i += kLanes) {
+    acc0 = Mul(acc0, Load(values + i));
+  }
+  float lanes[kLanes];
+  Store(Mul(acc0, acc1), lanes);
+  float result = 1.0f;
+  for (int64 j = 0; j < kLanes; ++j) {
+    result *= lanes[j];
+  }
+  for (; i < n; ++i) {
+    result *= values[i];
+  }
+  return result;
+}
+
+float Max(const float* values, int64 n) {
+  float result = -std::numeric_limits<float>::infinity();
+  int64 i = 0;
+  if (n >= kLanes) {
+    Vec acc = Load(values);
+    for (i = kLanes; i + kLanes <= n; i += kLanes) {
+      acc = Max(acc, Load(values + i));
+    }
+    result = ReduceMax(acc);
+  }
+  for (; i < n; ++i) {
+    result = std::max(result, values[i]);
+  }
+  return result;
+}
+
+float Min(const float* values, int64 n) {
+  float result = std::numeric_limits<float>::infinity();
+  int64 i = 0;
+  if (n >= kLanes) {
+    Vec acc = Load(values);
+    for (i = kLanes; i + kLanes <= n; i += kLanes) {
+      acc = Min(acc, Load(values + i));
+    }
+    result = ReduceMin(acc);
+  }
+  for (; i < n; ++i) {
+    result = std::min(result, values[i]);
+  }
+  return result;
+}
+
+}  // namespace XLA_SIMD_NAMESPACE
+}  // namespace simd
+}  // namespace xla
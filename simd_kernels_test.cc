@@ -0,0 +1,376 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "simd_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "array1d.h"
+#include "array2d.h"
+#include "array4d.h"
+#include "kernel_registry.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+// Compares every kernel with a scalar loop, for every instruction set the
+// host supports and for lengths that exercise the partial-vector tails.
+class SimdKernelsTest /* : public ::testing::Test */
+{
+public:
+
+   SimdKernelsTest() { run(); }
+
+   void Elementwise();
+   void Activations();
+   void MathFunctions();
+   void MathSpecialValues();
+   void GatherIndices();
+   void Reductions();
+   void ArraysUseKernels();
+
+   void run();
+};
+
+constexpr int64 kMaxLength = 70;
+
+std::vector<float> Values(int64 n, int seed)
+{
+   std::vector<float> values(n);
+   for (int64 i = 0; i < n; ++i) {
+      values[i] = static_cast<float>((i * 37 + seed * 11) % 23) / 4.0f - 2.5f;
+   }
+   return values;
+}
+
+void ExpectNear(const std::vector<float>& expected,
+                const std::vector<float>& actual, float tolerance)
+{
+   ASSERT_EQ(expected.size(), actual.size());
+   for (size_t i = 0; i < expected.size(); ++i) {
+      ASSERT_TRUE(std::abs(expected[i] - actual[i]) <= tolerance);
+   }
+}
+
+void SimdKernelsTest::Elementwise()
+{
+   for (int64 n = 0; n <= kMaxLength; ++n) {
+      const std::vector<float> a = Values(n, 1);
+      const std::vector<float> b = Values(n, 2);
+      std::vector<float> sum(n), difference(n), product(n), maximum(n),
+          minimum(n);
+      std::vector<float> scaled = a, shifted = a, squared = a;
+      simd::Add(a.data(), b.data(), sum.data(), n);
+      simd::Subtract(a.data(), b.data(), difference.data(), n);
+      simd::Multiply(a.data(), b.data(), product.data(), n);
+      simd::Maximum(a.data(), b.data(), maximum.data(), n);
+      simd::Minimum(a.data(), b.data(), minimum.data(), n);
+      simd::Scale(-1.5f, scaled.data(), n);
+      simd::AddScalar(0.25f, shifted.data(), n);
+      simd::Square(squared.data(), n);
+      for (int64 i = 0; i < n; ++i) {
+         ASSERT_EQ(sum[i], a[i] + b[i]);
+         ASSERT_EQ(difference[i], a[i] - b[i]);
+         ASSERT_EQ(product[i], a[i] * b[i]);
+         ASSERT_EQ(maximum[i], std::max(a[i], b[i]));
+         ASSERT_EQ(minimum[i], std::min(a[i], b[i]));
+         ASSERT_EQ(scaled[i], a[i] * -1.5f);
+         ASSERT_EQ(shifted[i], a[i] + 0.25f);
+         ASSERT_EQ(squared[i], a[i] * a[i]);
+      }
+
+      // In place, with the output aliasing the first operand.
+      std::vector<float> in_place = a;
+      simd::Add(in_place.data(), b.data(), in_place.data(), n);
+      ExpectNear(sum, in_place, 0.0f);
+   }
+}
+
+void SimdKernelsTest::Activations()
+{
+   for (ActivationFunction activation :
+        {ActivationFunction::kNone, ActivationFunction::kRelu,
+         ActivationFunction::kElu, ActivationFunction::kTanh,
+         ActivationFunction::kSigmoid}) {
+      for (float scale : {1.0f, 0.5f}) {
+         for (int64 n = 0; n <= kMaxLength; n += 7) {
+            std::vector<float> expected = Values(n, 3);
+            std::vector<float> precise = expected;
+            std::vector<float> fast = expected;
+            ActivateAndScale(activation, scale, expected.data(), n);
+            simd::ActivateAndScale(activation, scale, precise.data(), n,
+                                   simd::Accuracy::kPrecise);
+            simd::ActivateAndScale(activation, scale, fast.data(), n,
+                                   simd::Accuracy::kFast);
+            ExpectNear(expected, precise, 1e-6f);
+            ExpectNear(expected, fast, 3e-5f);
+         }
+      }
+   }
+}
+
+using MathKernel = void (*)(const float* values, float* out, int64 n,
+                            simd::Accuracy accuracy);
+
+// A math kernel with its exact counterpart, the inputs to test it on and the
+// documented bounds of each accuracy: |f(x) - exact| must not exceed
+// relative * |exact| + absolute.
+struct MathFunction
+{
+   MathKernel kernel;
+   double (*exact)(double x);
+   float first;
+   float last;
+   bool geometric;
+   double precise_relative;
+   double precise_absolute;
+   double fast_relative;
+   double fast_absolute;
+};
+
+constexpr double kUlp = 1.0 / (1 << 23);
+
+// 1001 inputs spread over [first, last], so that the tails are partial
+// vectors.
+std::vector<float> MathInputs(const MathFunction& function)
+{
+   constexpr int64 kCount = 1001;
+   std::vector<float> values(kCount);
+   for (int64 i = 0; i < kCount; ++i) {
+      const double t = static_cast<double>(i) / (kCount - 1);
+      const double first = function.first;
+      const double last = function.last;
+      values[i] = static_cast<float>(
+          function.geometric ? first * std::pow(last / first, t)
+                             : first + (last - first) * t);
+   }
+   return values;
+}
+
+void SimdKernelsTest::MathFunctions()
+{
+   const MathFunction functions[] = {
+       {simd::Exp, [](double x) { return std::exp(x); }, -80.0f, 80.0f,
+        false, kUlp, 0.0, 1.5e-5, 0.0},
+       {simd::Expm1, [](double x) { return std::expm1(x); }, -20.0f, 20.0f,
+        false, 4 * kUlp, 0.0, 2.5e-5, 0.0},
+       {simd::Expm1, [](double x) { return std::expm1(x); }, 1e-30f, 0.5f,
+        true, 4 * kUlp, 0.0, 2.5e-5, 0.0},
+       {simd::Log, [](double x) { return std::log(x); }, 1e-30f, 1e30f, true,
+        kUlp, 0.0, 2e-5, 0.0},
+       {simd::Log, [](double x) { return std::log(x); }, 0.5f, 2.0f, false,
+        kUlp, 0.0, 2e-5, 0.0},
+       {simd::Tanh, [](double x) { return std::tanh(x); }, -20.0f, 20.0f,
+        false, 2 * kUlp, 0.0, 6 * kUlp, 0.0},
+       {simd::Sigmoid, [](double x) { return 1.0 / (1.0 + std::exp(-x)); },
+        -80.0f, 20.0f, false, 3 * kUlp, 0.0, 1.5e-5, 0.0},
+       {simd::Softplus,
+        [](double x) { return std::max(x, 0.0) + std::log1p(std::exp(-std::abs(x))); },
+        -80.0f, 80.0f, false, 3 * kUlp, 0.0, 2.5e-5, 0.0},
+       {[](const float* values, float* out, int64 n, simd::Accuracy) {
+          simd::Erf(values, out, n);
+        },
+        [](double x) { return std::erf(x); }, -6.0f, 6.0f, false, 0.0, 5e-7,
+        0.0, 5e-7},
+       {simd::Gelu,
+        [](double x) { return 0.5 * x * std::erfc(-x / std::sqrt(2.0)); },
+        -20.0f, 20.0f, false, 1.5e-6, 1.5e-6, 5e-4, 5e-4},
+       {simd::Rsqrt, [](double x) { return 1.0 / std::sqrt(x); }, 1e-30f,
+        1e30f, true, 1.5 * kUlp, 0.0, 3e-7, 0.0},
+   };
+   for (const MathFunction& function : functions) {
+      const std::vector<float> values = MathInputs(function);
+      std::vector<float> precise(values.size()), fast(values.size());
+      function.kernel(values.data(), precise.data(), values.size(),
+                      simd::Accuracy::kPrecise);
+      function.kernel(values.data(), fast.data(), values.size(),
+                      simd::Accuracy::kFast);
+      for (size_t i = 0; i < values.size(); ++i) {
+         const double exact = function.exact(values[i]);
+         ASSERT_TRUE(std::abs(precise[i] - exact) <=
+                     function.precise_relative * std::abs(exact) +
+                         function.precise_absolute);
+         ASSERT_TRUE(std::abs(fast[i] - exact) <=
+                     function.fast_relative * std::abs(exact) +
+                         function.fast_absolute);
+      }
+   }
+
+   // The bulk kernels work in place, and without an accuracy use the
+   // default.
+   std::vector<float> values = Values(kMaxLength, 4);
+   std::vector<float> expected(values.size());
+   simd::Tanh(values.data(), expected.data(), values.size(),
+              simd::Accuracy::kFast);
+   simd::SetDefaultAccuracy(simd::Accuracy::kFast);
+   simd::Tanh(values.data(), values.data(), values.size());
+   simd::SetDefaultAccuracy(simd::Accuracy::kPrecise);
+   ASSERT_TRUE(values == expected);
+}
+
+void SimdKernelsTest::MathSpecialValues()
+{
+   constexpr float kInf = std::numeric_limits<float>::infinity();
+   const float kNaN = std::numeric_limits<float>::quiet_NaN();
+   const std::vector<float> values = {-kInf, kInf, 0.0f, kNaN};
+   for (simd::Accuracy accuracy :
+        {simd::Accuracy::kPrecise, simd::Accuracy::kFast}) {
+      std::vector<float> out(values.size());
+      simd::Exp(values.data(), out.data(), values.size(), accuracy);
+      ASSERT_EQ(out[0], 0.0f);
+      ASSERT_EQ(out[1], kInf);
+      ASSERT_EQ(out[2], 1.0f);
+      ASSERT_TRUE(std::isnan(out[3]));
+      simd::Log(values.data(), out.data(), values.size(), accuracy);
+      ASSERT_TRUE(std::isnan(out[0]));
+      ASSERT_EQ(out[1], kInf);
+      ASSERT_EQ(out[2], -kInf);
+      ASSERT_TRUE(std::isnan(out[3]));
+      simd::Tanh(values.data(), out.data(), values.size(), accuracy);
+      ASSERT_EQ(out[0], -1.0f);
+      ASSERT_EQ(out[1], 1.0f);
+      ASSERT_EQ(out[2], 0.0f);
+      ASSERT_TRUE(std::isnan(out[3]));
+      simd::Sigmoid(values.data(), out.data(), values.size(), accuracy);
+      ASSERT_EQ(out[0], 0.0f);
+      ASSERT_EQ(out[1], 1.0f);
+      ASSERT_EQ(out[2], 0.5f);
+      ASSERT_TRUE(std::isnan(out[3]));
+      simd::Softplus(values.data(), out.data(), values.size(), accuracy);
+      ASSERT_EQ(out[0], 0.0f);
+      ASSERT_EQ(out[1], kInf);
+      ASSERT_TRUE(std::isnan(out[3]));
+      simd::Gelu(values.data(), out.data(), values.size(), accuracy);
+      ASSERT_EQ(out[0], 0.0f);
+      ASSERT_EQ(out[1], kInf);
+      ASSERT_EQ(out[2], 0.0f);
+      ASSERT_TRUE(std::isnan(out[3]));
+      simd::Rsqrt(values.data(), out.data(), values.size(), accuracy);
+      ASSERT_TRUE(std::isnan(out[0]));
+      ASSERT_EQ(out[1], 0.0f);
+      ASSERT_EQ(out[2], kInf);
+      ASSERT_TRUE(std::isnan(out[3]));
+   }
+}
+
+void SimdKernelsTest::GatherIndices()
+{
+   const std::vector<float> base = Values(kMaxLength, 4);
+   for (int64 n = 0; n <= kMaxLength; ++n) {
+      std::vector<int32> indices(n);
+      for (int64 i = 0; i < n; ++i) {
+         indices[i] = static_cast<int32>((i * 13 + 5) % kMaxLength);
+      }
+      std::vector<float> gathered(n);
+      simd::Gather(base.data(), indices.data(), gathered.data(), n);
+      for (int64 i = 0; i < n; ++i) {
+         ASSERT_EQ(gathered[i], base[indices[i]]);
+      }
+   }
+}
+
+void SimdKernelsTest::Reductions()
+{
+   ASSERT_EQ(simd::Sum(nullptr, 0), 0.0f);
+   ASSERT_EQ(simd::Dot(nullptr, nullptr, 0), 0.0f);
+   ASSERT_EQ(simd::Product(nullptr, 0), 1.0f);
+   ASSERT_EQ(simd::Max(nullptr, 0), -std::numeric_limits<float>::infinity());
+   ASSERT_EQ(simd::Min(nullptr, 0), std::numeric_limits<float>::infinity());
+   for (int64 n = 1; n <= kMaxLength; ++n) {
+      const std::vector<float> a = Values(n, 5);
+      const std::vector<float> b = Values(n, 6);
+      double sum = 0.0, dot = 0.0, product = 1.0;
+      for (int64 i = 0; i < n; ++i) {
+         sum += a[i];
+         dot += static_cast<double>(a[i]) * b[i];
+         // Factors near 1, so the product neither overflows nor vanishes.
+         product *= 1.0 + a[i] / 16.0;
+      }
+      std::vector<float> factors(n);
+      for (int64 i = 0; i < n; ++i) {
+         factors[i] = 1.0f + a[i] / 16.0f;
+      }
+      ASSERT_TRUE(std::abs(simd::Sum(a.data(), n) - sum) < 1e-4);
+      ASSERT_TRUE(std::abs(simd::Dot(a.data(), b.data(), n) - dot) < 1e-4);
+      ASSERT_TRUE(std::abs(simd::Product(factors.data(), n) - product) <
+                  1e-4 * product);
+      ASSERT_EQ(simd::Max(a.data(), n), *std::max_element(a.begin(), a.end()));
+      ASSERT_EQ(simd::Min(a.data(), n), *std::min_element(a.begin(), a.end()));
+   }
+}
+
+void SimdKernelsTest::ArraysUseKernels()
+{
+   Array2D<float> a({{1.0f, 2.0f, 3.0f}, {4.0f, 5.0f, 6.0f}});
+   Array2D<float> b({{0.5f, 0.5f, 0.5f}, {1.0f, 1.0f, 1.0f}});
+   Array2D<float> sum = a + b;
+   ASSERT_EQ(sum(1, 2), 7.0f);
+   Array2D<float> difference = a - b;
+   ASSERT_EQ(difference(0, 0), 0.5f);
+
+   Array4D<float> c(2, 3, 4, 5, 2.0f);
+   c.mul(1.5f);
+   ASSERT_EQ(c(1, 2, 3, 4), 3.0f);
+   Array4D<float> d(2, 3, 4, 5, 4.0f);
+   c * d;
+   ASSERT_EQ(c(0, 1, 2, 3), 12.0f);
+
+   // Conversions to and from the 16-bit types run on the bulk converters.
+   Array4D<float> quarters(1, 2, 3, 4);
+   quarters.FillWithMultiples(0.25f);
+   ASSERT_TRUE(quarters.convert<half>()->convert<float>()->flatten() ==
+               quarters.flatten());
+   ASSERT_TRUE(quarters.convert<bfloat16>()->convert<float>()->flatten() ==
+               quarters.flatten());
+   ASSERT_EQ((*quarters.convert<double>())(0, 1, 2, 3), 23 * 0.25);
+
+   // Softmax subtracts the maximum, so large logits do not overflow exp.
+   std::vector<float> logits = {1000.0f, 1001.0f, 0.0f};
+   SoftMaxInPlace(logits.data(), logits.size());
+   const float e = std::exp(1.0f);
+   ASSERT_TRUE(std::abs(logits[0] - 1.0f / (1.0f + e)) <= 1e-6f);
+   ASSERT_TRUE(std::abs(logits[1] - e / (1.0f + e)) <= 1e-6f);
+   ASSERT_TRUE(logits[2] <= 1e-30f);
+   std::vector<float> probabilities = {1.0f, 0.5f};
+   Log(probabilities);
+   ASSERT_EQ(probabilities[0], 0.0f);
+   ASSERT_TRUE(std::abs(probabilities[1] - std::log(0.5f)) <= 1e-7f);
+}
+
+void SimdKernelsTest::run()
+{
+   for (int i = 0; i < kNumIsas; ++i) {
+      const Isa isa = static_cast<Isa>(i);
+      if (!IsaSupported(isa)) {
+         continue;
+      }
+      SetMaxIsa(isa);
+      Elementwise();
+      Activations();
+      MathFunctions();
+      MathSpecialValues();
+      GatherIndices();
+      Reductions();
+      ArraysUseKernels();
+   }
+   SetMaxIsa(static_cast<Isa>(kNumIsas - 1));
+}
+
+}  // namespace
+}  // namespace xla
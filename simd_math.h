@@ -0,0 +1,247 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Vectorized transcendental functions on the Vec of simd_ops.h, the bodies
+// of the math kernels of simd_kernels.h, whose declarations document the
+// error bounds. Like simd_kernels_impl.h this file has no include guard;
+// simd_kernels_impl.h includes it once per target, after the operations of
+// simd_ops.h for that target.
+//
+// The precise variants follow the Cephes single-precision library: range
+// reduction to a small interval and a minimax polynomial on it. The fast
+// variants use shorter polynomials, a rational approximation (tanh) or the
+// hardware estimate (rsqrt). All of them propagate NaN.
+
+#include <limits>
+
+#include "simd_kernels.h"
+
+namespace xla {
+namespace simd {
+namespace XLA_SIMD_NAMESPACE {
+
+// Returns c[0] + c[1] x + ... + c[N - 1] x^(N - 1) by Horner's rule.
+template <int N>
+XLA_SIMD_INLINE Vec Polynomial(Vec x, const float (&c)[N]) {
+  Vec result = Set(c[N - 1]);
+  for (int i = N - 2; i >= 0; --i) {
+    result = MulAdd(result, x, Set(c[i]));
+  }
+  return result;
+}
+
+constexpr float kLog2e = 1.44269504088896341f;
+constexpr float kLn2 = 0.693147180559945309f;
+// ln(2) split into a part with few significant bits, whose products with the
+// exponents of the range reductions are exact, and the rest.
+constexpr float kLn2High = 0.693359375f;
+constexpr float kLn2Low = -2.12194440e-4f;
+constexpr float kSqrtHalf = 0.707106781186547524f;
+
+// exp(r) = 1 + r + r^2 p(r) on [-ln(2) / 2, ln(2) / 2].
+constexpr float kExpPrecise[] = {5.0000001201e-1f, 1.6666665459e-1f,
+                                 4.1665795894e-2f, 8.3334519073e-3f,
+                                 1.3981999507e-3f, 1.9875691500e-4f};
+// exp(r) = 1 + r p(r), fitted at the Chebyshev nodes of the same interval.
+constexpr float kExpFast[] = {9.999849286e-1f, 4.999974899e-1f,
+                              1.676701188e-1f, 4.183380408e-2f};
+// Taylor series of expm1(x) / x.
+constexpr float kExpm1Series[] = {1.0f,           1.0f / 2,
+                                  1.0f / 6,       1.0f / 24,
+                                  1.0f / 120,     1.0f / 720,
+                                  1.0f / 5040,    1.0f / 40320};
+// log(1 + m) = m - m^2 / 2 + m^3 p(m) on [sqrt(0.5) - 1, sqrt(2) - 1].
+constexpr float kLogPrecise[] = {3.3333331174e-1f,  -2.4999993993e-1f,
+                                 2.0000714765e-1f,  -1.6668057665e-1f,
+                                 1.4249322787e-1f,  -1.2420140846e-1f,
+                                 1.1676998740e-1f,  -1.1514610310e-1f,
+                                 7.0376836292e-2f};
+// log(1 + m) = m + m^2 p(m), fitted at the Chebyshev nodes.
+constexpr float kLogFast[] = {-4.999676134e-1f, 3.329064924e-1f,
+                              -2.528636857e-1f, 2.172563523e-1f,
+                              -1.443122745e-1f};
+// tanh(x) = x + x^3 p(x^2) for |x| < 0.625.
+constexpr float kTanhPrecise[] = {-3.33332819422e-1f, 1.33314422036e-1f,
+                                  -5.37397155531e-2f, 2.06390887954e-2f,
+                                  -5.70498872745e-3f};
+// tanh(x) = x p(x^2) / q(x^2) for |x| < 7.9, beyond which it rounds to 1.
+constexpr float kTanhNumerator[] = {
+    4.89352455891786e-3f,  6.37261928875436e-4f,  1.48572235717979e-5f,
+    5.12229709037114e-8f,  -8.60467152213735e-11f, 2.00018790482477e-13f,
+    -2.76076847742355e-16f};
+constexpr float kTanhDenominator[] = {
+    4.89352518554385e-3f, 2.26843463243900e-3f, 1.18534705686654e-4f,
+    1.19825839466702e-6f};
+// erf(x) = x p(x^2) / q(x^2) for |x| < 4, beyond which it rounds to 1.
+constexpr float kErfNumerator[] = {
+    -1.60960333262415e-2f, -2.95459980854025e-3f, -7.34990630326855e-4f,
+    -5.69250639462346e-5f, -2.10102402082508e-6f, 2.77068142495902e-8f,
+    -2.72614225801306e-10f};
+constexpr float kErfDenominator[] = {
+    -1.42647390514189e-2f, -7.37332916720468e-3f, -1.68282697438203e-3f,
+    -2.13374055278905e-4f, -1.45660718464996e-5f};
+
+// Clamps x to [low, high], keeping NaN.
+XLA_SIMD_INLINE Vec Clamp(Vec x, float low, float high) {
+  return Min(Set(high), Max(Set(low), x));
+}
+
+template <Accuracy A>
+XLA_SIMD_INLINE Vec Exp(Vec x) {
+  // exp underflows to 0 below -104 and overflows above 89; the clamp keeps
+  // the exponent n in the range of LdExp.
+  x = Clamp(x, -104.0f, 89.0f);
+  const Vec n = Round(Mul(x, Set(kLog2e)));
+  if (A == Accuracy::kFast) {
+    const Vec r = MulAdd(n, Set(-kLn2), x);
+    return LdExp(MulAdd(Polynomial(r, kExpFast), r, Set(1.0f)), n);
+  }
+  Vec r = MulAdd(n, Set(-kLn2High), x);
+  r = MulAdd(n, Set(-kLn2Low), r);
+  const Vec y = MulAdd(Polynomial(r, kExpPrecise), Mul(r, r), r);
+  return LdExp(Add(y, Set(1.0f)), n);
+}
+
+template <Accuracy A>
+XLA_SIMD_INLINE Vec Expm1(Vec x) {
+  // exp(x) - 1 cancels for small |x|, where the series converges quickly.
+  const Vec series = Mul(x, Polynomial(x, kExpm1Series));
+  return Select(Lt(Abs(x), Set(0.35f)), series,
+                Sub(Exp<A>(x), Set(1.0f)));
+}
+
+template <Accuracy A>
+XLA_SIMD_INLINE Vec Log(Vec x) {
+  // Denormals are scaled by 2^23 into the normal range Frexp expects.
+  const Mask denormal = Lt(x, Set(std::numeric_limits<float>::min()));
+  Vec e;
+  Vec m = Frexp(Select(denormal, Mul(x, Set(8388608.0f)), x), &e);
+  e = Select(denormal, Sub(e, Set(23.0f)), e);
+  // x = 2^e (1 + m) with m in [sqrt(0.5) - 1, sqrt(2) - 1).
+  const Mask low = Lt(m, Set(kSqrtHalf));
+  e = Select(low, Sub(e, Set(1.0f)), e);
+  m = Sub(Select(low, Add(m, m), m), Set(1.0f));
+  const Vec m2 = Mul(m, m);
+  Vec result;
+  if (A == Accuracy::kFast) {
+    result = MulAdd(e, Set(kLn2), MulAdd(m2, Polynomial(m, kLogFast), m));
+  } else {
+    Vec y = Mul(Mul(Polynomial(m, kLogPrecise), m), m2);
+    y = MulAdd(e, Set(kLn2Low), y);
+    y = MulAdd(m2, Set(-0.5f), y);
+    result = MulAdd(e, Set(kLn2High), Add(m, y));
+  }
+  // x - x is NaN for NaN and infinite x and 0 otherwise.
+  const float infinity = std::numeric_limits<float>::infinity();
+  result = Add(result, Sub(x, x));
+  result = Select(Eq(x, Set(infinity)), x, result);
+  result = Select(Eq(x, Zero()), Set(-infinity), result);
+  return Select(Lt(x, Zero()),
+                Set(std::numeric_limits<float>::quiet_NaN()), result);
+}
+
+template <Accuracy A>
+XLA_SIMD_INLINE Vec Tanh(Vec x) {
+  if (A == Accuracy::kFast) {
+    const Vec c = Clamp(x, -7.90531110763549805f, 7.90531110763549805f);
+    const Vec z = Mul(c, c);
+    const Vec rational = Div(Mul(c, Polynomial(z, kTanhNumerator)),
+                             Polynomial(z, kTanhDenominator));
+    // Below 0.0004 tanh(x) rounds to x, and c p(z) would lose bits to
+    // underflow for the smallest x. Beyond 9 it rounds to +-1, which the
+    // rational function misses by an ulp.
+    return Select(Lt(Abs(x), Set(0.0004f)), x,
+                  Select(Gt(Abs(x), Set(9.0f)), Clamp(x, -1.0f, 1.0f),
+                         rational));
+  }
+  const Vec a = Abs(x);
+  const Vec z = Mul(x, x);
+  const Vec series = MulAdd(Mul(Polynomial(z, kTanhPrecise), z), x, x);
+  // 1 - 2 / (exp(2 |x|) + 1), which tends to 1 as the exponential
+  // overflows.
+  const Vec large = Sub(Set(1.0f), Div(Set(2.0f), Add(Exp<A>(Add(a, a)),
+                                                      Set(1.0f))));
+  return Select(Lt(a, Set(0.625f)), series,
+                Select(Lt(x, Zero()), Sub(Zero(), large), large));
+}
+
+template <Accuracy A>
+XLA_SIMD_INLINE Vec Sigmoid(Vec x) {
+  // With e = exp(-|x|), which cannot overflow, sigmoid(x) is 1 / (1 + e) for
+  // x >= 0 and e / (1 + e) otherwise.
+  const Vec e = Exp<A>(Sub(Zero(), Abs(x)));
+  return Div(Select(Lt(x, Zero()), e, Set(1.0f)), Add(Set(1.0f), e));
+}
+
+XLA_SIMD_INLINE Vec Erf(Vec x) {
+  const Vec c = Clamp(x, -4.0f, 4.0f);
+  const Vec z = Mul(c, c);
+  const Vec rational = Div(Mul(c, Polynomial(z, kErfNumerator)),
+                           Polynomial(z, kErfDenominator));
+  // Below 1e-4 erf(x) rounds to 2 x / sqrt(pi), and c p(z) would lose bits
+  // to underflow for the smallest x.
+  return Select(Lt(Abs(x), Set(1e-4f)), Mul(x, Set(1.12837916709551257f)),
+                rational);
+}
+
+template <Accuracy A>
+XLA_SIMD_INLINE Vec Gelu(Vec x) {
+  // tanh and erf have saturated to +-1 in float beyond |x| = 10; clamping
+  // keeps x^3 finite. Below -10 the result is 0, rather than NaN for -inf.
+  const Vec c = Clamp(x, -10.0f, 10.0f);
+  Vec t;
+  if (A == Accuracy::kFast) {
+    // The tanh form: x / 2 (1 + tanh(sqrt(2 / pi) (x + 0.044715 x^3))).
+    t = Tanh<A>(Mul(Set(0.797884560802865356f),
+                    MulAdd(Mul(Mul(c, c), c), Set(0.044715f), c)));
+  } else {
+    t = Erf(Mul(c, Set(kSqrtHalf)));
+  }
+  const Vec half_x = Mul(Set(0.5f), x);
+  return Select(Lt(x, Set(-10.0f)), Zero(), MulAdd(half_x, t, half_x));
+}
+
+template <Accuracy A>
+XLA_SIMD_INLINE Vec Softplus(Vec x) {
+  // max(x, 0) + log1p(exp(-|x|)). With u = 1 + e rounded, log1p(e) is
+  // log(u) e / (u - 1), which corrects the rounding of u, or e itself where u
+  // rounds to 1.
+  const Vec e = Exp<A>(Sub(Zero(), Abs(x)));
+  const Vec u = Add(Set(1.0f), e);
+  const Vec log1p = Select(Eq(u, Set(1.0f)), e,
+                           Div(Mul(Log<A>(u), e), Sub(u, Set(1.0f))));
+  return Add(Max(Zero(), x), log1p);
+}
+
+template <Accuracy A>
+XLA_SIMD_INLINE Vec Rsqrt(Vec x) {
+  if (A == Accuracy::kPrecise) {
+    return Div(Set(1.0f), Sqrt(x));
+  }
+  // One Newton step, e (3 - x e^2) / 2, ordered so that no intermediate
+  // leaves the normal range.
+  const Vec e = RsqrtEstimate(x);
+  const Vec refined =
+      Mul(e, MulAdd(Mul(Mul(Set(-0.5f), x), e), e, Set(1.5f)));
+  // At 0, denormals and infinity the step would compute 0 * infinity, so
+  // the estimate is kept there.
+  return Select(Lt(x, Set(std::numeric_limits<float>::min())), e,
+                Select(Eq(x, Set(std::numeric_limits<float>::infinity())), e,
+                       refined));
+}
+
+}  // namespace XLA_SIMD_NAMESPACE
+}  // namespace simd
+}  // namespace xla
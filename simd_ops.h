@@ -0,0 +1,485 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Portable SIMD vector operations on float, with SSE2, AVX2, AVX-512, NEON
+// and scalar back ends.
+//
+// The first part of this file, up to the include guard's #endif, defines the
+// target ids and pulls in the intrinsic headers. The rest is skipped unless
+// XLA_SIMD_TARGET and XLA_SIMD_NAMESPACE are defined, and has no include
+// guard: it is included once per target, with XLA_SIMD_TARGET set to one of
+// the ids below and XLA_SIMD_NAMESPACE to a namespace name unique to that
+// target, and defines the operations for that target in
+// xla::simd::XLA_SIMD_NAMESPACE. Targets newer than the baseline must be
+// included between XLA_SIMD_BEGIN_<TARGET> and XLA_SIMD_END_TARGET, so the
+// compiler generates code for them; see simd_kernels.cc.
+//
+// Every target provides, with kLanes floats per Vec:
+//
+//   Zero(), Set(x), Load(p), Store(v, p), LoadPartial(p, n),
+//   StorePartial(v, p, n), Add, Sub, Mul, Div, Min, Max, Sqrt, Abs,
+//   MulAdd(a, b, c) = a * b + c, Lt, Gt, Eq (returning a Mask),
+//   Select(mask, a, b) = mask ? a : b, ReduceSum, ReduceMax, ReduceMin and
+//   Gather(base, indices) = base[indices[i]],
+//
+// and, for the transcendental functions of simd_math.h:
+//
+//   Round(a): a rounded to the nearest integer, ties to even, for
+//     |a| < 2^31.
+//   LdExp(a, n) = a * 2^n for integral n in [-252, 254].
+//   Frexp(a, &e): for positive normal a, the m in [0.5, 1) and the integral
+//     e with a = m * 2^e, as std::frexp.
+//   RsqrtEstimate(a): 1 / sqrt(a) with a relative error below 2^-12 (exact
+//     on the scalar target).
+//
+// Loads and stores do not need aligned pointers. The partial forms touch
+// only the first n < kLanes elements; LoadPartial zero-fills the other lanes.
+// Min and Max return the second operand when either one is NaN, as on x86.
+
+#ifndef TENSORFLOW_COMPILER_XLA_SIMD_OPS_H_
+#define TENSORFLOW_COMPILER_XLA_SIMD_OPS_H_
+
+#include <algorithm>
+#include <cmath>
+
+#include "types.h"
+
+#define XLA_SIMD_SCALAR 0
+#define XLA_SIMD_SSE2 1
+#define XLA_SIMD_AVX2 2
+#define XLA_SIMD_AVX512 3
+#define XLA_SIMD_NEON 4
+
+// The best target every host of the build architecture supports.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define XLA_SIMD_BASELINE_TARGET XLA_SIMD_SSE2
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define XLA_SIMD_BASELINE_TARGET XLA_SIMD_NEON
+#include <arm_neon.h>
+#else
+#define XLA_SIMD_BASELINE_TARGET XLA_SIMD_SCALAR
+#endif
+
+#if defined(_MSC_VER)
+#define XLA_SIMD_INLINE __forceinline
+#else
+#define XLA_SIMD_INLINE inline __attribute__((always_inline))
+#endif
+
+// Brackets code generated for AVX2 (with FMA) or AVX-512 (F, VL, BW, DQ),
+// the targets of Isa::kAvx2 and Isa::kAvx512. MSVC needs no target switch
+// to use their intrinsics.
+#if defined(__clang__)
+#define XLA_SIMD_BEGIN_AVX2                                             \
+  _Pragma("clang attribute push(__attribute__((target(\"avx2,fma\"))), \
+          apply_to = function)")
+#define XLA_SIMD_BEGIN_AVX512                                            \
+  _Pragma("clang attribute push(__attribute__((target(                    \
+          \"avx512f,avx512vl,avx512bw,avx512dq,avx2,fma\"))),             \
+          apply_to = function)")
+#define XLA_SIMD_END_TARGET _Pragma("clang attribute pop")
+#elif defined(__GNUC__)
+#define XLA_SIMD_BEGIN_AVX2 \
+  _Pragma("GCC push_options") _Pragma("GCC target(\"avx2,fma\")")
+#define XLA_SIMD_BEGIN_AVX512       \
+  _Pragma("GCC push_options")       \
+  _Pragma("GCC target(\"avx512f,avx512vl,avx512bw,avx512dq,avx2,fma\")")
+#define XLA_SIMD_END_TARGET _Pragma("GCC pop_options")
+#else
+#define XLA_SIMD_BEGIN_AVX2
+#define XLA_SIMD_BEGIN_AVX512
+#define XLA_SIMD_END_TARGET
+#endif
+
+#endif  // TENSORFLOW_COMPILER_XLA_SIMD_OPS_H_
+
+#if defined(XLA_SIMD_TARGET) && defined(XLA_SIMD_NAMESPACE)
+
+namespace xla {
+namespace simd {
+namespace XLA_SIMD_NAMESPACE {
+
+#if XLA_SIMD_TARGET == XLA_SIMD_SCALAR
+
+constexpr int kLanes = 1;
+
+struct Vec {
+  float v;
+};
+
+struct Mask {
+  bool m;
+};
+
+XLA_SIMD_INLINE Vec Zero() { return {0.0f}; }
+XLA_SIMD_INLINE Vec Set(float x) { return {x}; }
+XLA_SIMD_INLINE Vec Load(const float* p) { return {*p}; }
+XLA_SIMD_INLINE void Store(Vec a, float* p) { *p = a.v; }
+XLA_SIMD_INLINE Vec Add(Vec a, Vec b) { return {a.v + b.v}; }
+XLA_SIMD_INLINE Vec Sub(Vec a, Vec b) { return {a.v - b.v}; }
+XLA_SIMD_INLINE Vec Mul(Vec a, Vec b) { return {a.v * b.v}; }
+XLA_SIMD_INLINE Vec Div(Vec a, Vec b) { return {a.v / b.v}; }
+XLA_SIMD_INLINE Vec Min(Vec a, Vec b) { return {a.v < b.v ? a.v : b.v}; }
+XLA_SIMD_INLINE Vec Max(Vec a, Vec b) { return {a.v > b.v ? a.v : b.v}; }
+XLA_SIMD_INLINE Vec Sqrt(Vec a) { return {std::sqrt(a.v)}; }
+XLA_SIMD_INLINE Vec MulAdd(Vec a, Vec b, Vec c) { return {a.v * b.v + c.v}; }
+XLA_SIMD_INLINE Mask Lt(Vec a, Vec b) { return {a.v < b.v}; }
+XLA_SIMD_INLINE Mask Gt(Vec a, Vec b) { return {a.v > b.v}; }
+XLA_SIMD_INLINE Vec Select(Mask m, Vec a, Vec b) { return m.m ? a : b; }
+XLA_SIMD_INLINE float ReduceSum(Vec a) { return a.v; }
+XLA_SIMD_INLINE float ReduceMax(Vec a) { return a.v; }
+XLA_SIMD_INLINE float ReduceMin(Vec a) { return a.v; }
+XLA_SIMD_INLINE Vec Gather(const float* base, const int32* indices) {
+  return {base[indices[0]]};
+}
+XLA_SIMD_INLINE Vec Abs(Vec a) { return {std::abs(a.v)}; }
+XLA_SIMD_INLINE Mask Eq(Vec a, Vec b) { return {a.v == b.v}; }
+XLA_SIMD_INLINE Vec Round(Vec a) { return {std::nearbyint(a.v)}; }
+XLA_SIMD_INLINE Vec LdExp(Vec a, Vec n) {
+  // Converting NaN to int is undefined; a NaN exponent only comes with a NaN
+  // result.
+  return {n.v == n.v ? std::ldexp(a.v, static_cast<int>(n.v)) : a.v + n.v};
+}
+XLA_SIMD_INLINE Vec Frexp(Vec a, Vec* exponent) {
+  int e;
+  const float m = std::frexp(a.v, &e);
+  *exponent = {static_cast<float>(e)};
+  return {m};
+}
+XLA_SIMD_INLINE Vec RsqrtEstimate(Vec a) { return {1.0f / std::sqrt(a.v)}; }
+
+#elif XLA_SIMD_TARGET == XLA_SIMD_SSE2
+
+constexpr int kLanes = 4;
+
+struct Vec {
+  __m128 v;
+};
+
+struct Mask {
+  __m128 m;
+};
+
+XLA_SIMD_INLINE Vec Zero() { return {_mm_setzero_ps()}; }
+XLA_SIMD_INLINE Vec Set(float x) { return {_mm_set1_ps(x)}; }
+XLA_SIMD_INLINE Vec Load(const float* p) { return {_mm_loadu_ps(p)}; }
+XLA_SIMD_INLINE void Store(Vec a, float* p) { _mm_storeu_ps(p, a.v); }
+XLA_SIMD_INLINE Vec Add(Vec a, Vec b) { return {_mm_add_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Sub(Vec a, Vec b) { return {_mm_sub_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Mul(Vec a, Vec b) { return {_mm_mul_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Div(Vec a, Vec b) { return {_mm_div_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Min(Vec a, Vec b) { return {_mm_min_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Max(Vec a, Vec b) { return {_mm_max_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Sqrt(Vec a) { return {_mm_sqrt_ps(a.v)}; }
+XLA_SIMD_INLINE Vec MulAdd(Vec a, Vec b, Vec c) {
+  return {_mm_add_ps(_mm_mul_ps(a.v, b.v), c.v)};
+}
+XLA_SIMD_INLINE Mask Lt(Vec a, Vec b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Mask Gt(Vec a, Vec b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Select(Mask m, Vec a, Vec b) {
+  return {_mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v))};
+}
+XLA_SIMD_INLINE float ReduceSum(Vec a) {
+  const __m128 pairs = _mm_add_ps(a.v, _mm_movehl_ps(a.v, a.v));
+  return _mm_cvtss_f32(
+      _mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 1, 1, 1))));
+}
+XLA_SIMD_INLINE float ReduceMax(Vec a) {
+  const __m128 pairs = _mm_max_ps(a.v, _mm_movehl_ps(a.v, a.v));
+  return _mm_cvtss_f32(
+      _mm_max_ss(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 1, 1, 1))));
+}
+XLA_SIMD_INLINE float ReduceMin(Vec a) {
+  const __m128 pairs = _mm_min_ps(a.v, _mm_movehl_ps(a.v, a.v));
+  return _mm_cvtss_f32(
+      _mm_min_ss(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 1, 1, 1))));
+}
+XLA_SIMD_INLINE Vec Gather(const float* base, const int32* indices) {
+  return {_mm_setr_ps(base[indices[0]], base[indices[1]], base[indices[2]],
+                      base[indices[3]])};
+}
+XLA_SIMD_INLINE Vec Abs(Vec a) {
+  return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)};
+}
+XLA_SIMD_INLINE Mask Eq(Vec a, Vec b) { return {_mm_cmpeq_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Round(Vec a) {
+  return {_mm_cvtepi32_ps(_mm_cvtps_epi32(a.v))};
+}
+// 2^n is built from the exponent bits in two halves, so that both stay in
+// the normal range.
+XLA_SIMD_INLINE Vec LdExp(Vec a, Vec n) {
+  const __m128i i = _mm_cvtps_epi32(n.v);
+  const __m128i low = _mm_srai_epi32(i, 1);
+  const __m128i bias = _mm_set1_epi32(127);
+  const __m128 p =
+      _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(low, bias), 23));
+  const __m128 q = _mm_castsi128_ps(
+      _mm_slli_epi32(_mm_add_epi32(_mm_sub_epi32(i, low), bias), 23));
+  return {_mm_mul_ps(_mm_mul_ps(a.v, p), q)};
+}
+XLA_SIMD_INLINE Vec Frexp(Vec a, Vec* exponent) {
+  const __m128i bits = _mm_castps_si128(a.v);
+  *exponent = {_mm_cvtepi32_ps(
+      _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)))};
+  return {_mm_or_ps(
+      _mm_and_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(0x807fffff))),
+      _mm_set1_ps(0.5f))};
+}
+XLA_SIMD_INLINE Vec RsqrtEstimate(Vec a) { return {_mm_rsqrt_ps(a.v)}; }
+
+#elif XLA_SIMD_TARGET == XLA_SIMD_AVX2
+
+constexpr int kLanes = 8;
+
+struct Vec {
+  __m256 v;
+};
+
+struct Mask {
+  __m256 m;
+};
+
+XLA_SIMD_INLINE Vec Zero() { return {_mm256_setzero_ps()}; }
+XLA_SIMD_INLINE Vec Set(float x) { return {_mm256_set1_ps(x)}; }
+XLA_SIMD_INLINE Vec Load(const float* p) { return {_mm256_loadu_ps(p)}; }
+XLA_SIMD_INLINE void Store(Vec a, float* p) { _mm256_storeu_ps(p, a.v); }
+XLA_SIMD_INLINE Vec Add(Vec a, Vec b) { return {_mm256_add_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Sub(Vec a, Vec b) { return {_mm256_sub_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Mul(Vec a, Vec b) { return {_mm256_mul_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Div(Vec a, Vec b) { return {_mm256_div_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Min(Vec a, Vec b) { return {_mm256_min_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Max(Vec a, Vec b) { return {_mm256_max_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Sqrt(Vec a) { return {_mm256_sqrt_ps(a.v)}; }
+XLA_SIMD_INLINE Vec MulAdd(Vec a, Vec b, Vec c) {
+  return {_mm256_fmadd_ps(a.v, b.v, c.v)};
+}
+XLA_SIMD_INLINE Mask Lt(Vec a, Vec b) {
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)};
+}
+XLA_SIMD_INLINE Mask Gt(Vec a, Vec b) {
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)};
+}
+XLA_SIMD_INLINE Vec Select(Mask m, Vec a, Vec b) {
+  return {_mm256_blendv_ps(b.v, a.v, m.m)};
+}
+XLA_SIMD_INLINE float ReduceSum(Vec a) {
+  const __m128 half =
+      _mm_add_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+  const __m128 pairs = _mm_add_ps(half, _mm_movehl_ps(half, half));
+  return _mm_cvtss_f32(
+      _mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 1, 1, 1))));
+}
+XLA_SIMD_INLINE float ReduceMax(Vec a) {
+  const __m128 half =
+      _mm_max_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+  const __m128 pairs = _mm_max_ps(half, _mm_movehl_ps(half, half));
+  return _mm_cvtss_f32(
+      _mm_max_ss(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 1, 1, 1))));
+}
+XLA_SIMD_INLINE float ReduceMin(Vec a) {
+  const __m128 half =
+      _mm_min_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+  const __m128 pairs = _mm_min_ps(half, _mm_movehl_ps(half, half));
+  return _mm_cvtss_f32(
+      _mm_min_ss(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 1, 1, 1))));
+}
+XLA_SIMD_INLINE Vec Gather(const float* base, const int32* indices) {
+  const __m256i offsets =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices));
+  return {_mm256_i32gather_ps(base, offsets, sizeof(float))};
+}
+XLA_SIMD_INLINE Vec Abs(Vec a) {
+  return {_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v)};
+}
+XLA_SIMD_INLINE Mask Eq(Vec a, Vec b) {
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ)};
+}
+XLA_SIMD_INLINE Vec Round(Vec a) {
+  return {_mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)};
+}
+XLA_SIMD_INLINE Vec LdExp(Vec a, Vec n) {
+  const __m256i i = _mm256_cvtps_epi32(n.v);
+  const __m256i low = _mm256_srai_epi32(i, 1);
+  const __m256i bias = _mm256_set1_epi32(127);
+  const __m256 p =
+      _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(low, bias), 23));
+  const __m256 q = _mm256_castsi256_ps(
+      _mm256_slli_epi32(_mm256_add_epi32(_mm256_sub_epi32(i, low), bias), 23));
+  return {_mm256_mul_ps(_mm256_mul_ps(a.v, p), q)};
+}
+XLA_SIMD_INLINE Vec Frexp(Vec a, Vec* exponent) {
+  const __m256i bits = _mm256_castps_si256(a.v);
+  *exponent = {_mm256_cvtepi32_ps(
+      _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)))};
+  return {_mm256_or_ps(
+      _mm256_and_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(0x807fffff))),
+      _mm256_set1_ps(0.5f))};
+}
+XLA_SIMD_INLINE Vec RsqrtEstimate(Vec a) { return {_mm256_rsqrt_ps(a.v)}; }
+
+#elif XLA_SIMD_TARGET == XLA_SIMD_AVX512
+
+constexpr int kLanes = 16;
+
+struct Vec {
+  __m512 v;
+};
+
+struct Mask {
+  __mmask16 m;
+};
+
+XLA_SIMD_INLINE Vec Zero() { return {_mm512_setzero_ps()}; }
+XLA_SIMD_INLINE Vec Set(float x) { return {_mm512_set1_ps(x)}; }
+XLA_SIMD_INLINE Vec Load(const float* p) { return {_mm512_loadu_ps(p)}; }
+XLA_SIMD_INLINE void Store(Vec a, float* p) { _mm512_storeu_ps(p, a.v); }
+XLA_SIMD_INLINE Vec LoadPartial(const float* p, int64 n) {
+  return {_mm512_maskz_loadu_ps(static_cast<__mmask16>((1u << n) - 1), p)};
+}
+XLA_SIMD_INLINE void StorePartial(Vec a, float* p, int64 n) {
+  _mm512_mask_storeu_ps(p, static_cast<__mmask16>((1u << n) - 1), a.v);
+}
+XLA_SIMD_INLINE Vec Add(Vec a, Vec b) { return {_mm512_add_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Sub(Vec a, Vec b) { return {_mm512_sub_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Mul(Vec a, Vec b) { return {_mm512_mul_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Div(Vec a, Vec b) { return {_mm512_div_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Min(Vec a, Vec b) { return {_mm512_min_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Max(Vec a, Vec b) { return {_mm512_max_ps(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Sqrt(Vec a) { return {_mm512_sqrt_ps(a.v)}; }
+XLA_SIMD_INLINE Vec MulAdd(Vec a, Vec b, Vec c) {
+  return {_mm512_fmadd_ps(a.v, b.v, c.v)};
+}
+XLA_SIMD_INLINE Mask Lt(Vec a, Vec b) {
+  return {_mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ)};
+}
+XLA_SIMD_INLINE Mask Gt(Vec a, Vec b) {
+  return {_mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ)};
+}
+XLA_SIMD_INLINE Vec Select(Mask m, Vec a, Vec b) {
+  return {_mm512_mask_blend_ps(m.m, b.v, a.v)};
+}
+XLA_SIMD_INLINE float ReduceSum(Vec a) { return _mm512_reduce_add_ps(a.v); }
+XLA_SIMD_INLINE float ReduceMax(Vec a) { return _mm512_reduce_max_ps(a.v); }
+XLA_SIMD_INLINE float ReduceMin(Vec a) { return _mm512_reduce_min_ps(a.v); }
+XLA_SIMD_INLINE Vec Gather(const float* base, const int32* indices) {
+  return {_mm512_i32gather_ps(_mm512_loadu_si512(indices), base,
+                              sizeof(float))};
+}
+XLA_SIMD_INLINE Vec Abs(Vec a) { return {_mm512_abs_ps(a.v)}; }
+XLA_SIMD_INLINE Mask Eq(Vec a, Vec b) {
+  return {_mm512_cmp_ps_mask(a.v, b.v, _CMP_EQ_OQ)};
+}
+XLA_SIMD_INLINE Vec Round(Vec a) {
+  return {_mm512_roundscale_ps(a.v,
+                               _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)};
+}
+XLA_SIMD_INLINE Vec LdExp(Vec a, Vec n) {
+  return {_mm512_scalef_ps(a.v, n.v)};
+}
+XLA_SIMD_INLINE Vec Frexp(Vec a, Vec* exponent) {
+  *exponent = {_mm512_add_ps(_mm512_getexp_ps(a.v), _mm512_set1_ps(1.0f))};
+  return {_mm512_getmant_ps(a.v, _MM_MANT_NORM_p5_1, _MM_MANT_SIGN_src)};
+}
+XLA_SIMD_INLINE Vec RsqrtEstimate(Vec a) { return {_mm512_rsqrt14_ps(a.v)}; }
+
+#elif XLA_SIMD_TARGET == XLA_SIMD_NEON
+
+constexpr int kLanes = 4;
+
+struct Vec {
+  float32x4_t v;
+};
+
+struct Mask {
+  uint32x4_t m;
+};
+
+XLA_SIMD_INLINE Vec Zero() { return {vdupq_n_f32(0.0f)}; }
+XLA_SIMD_INLINE Vec Set(float x) { return {vdupq_n_f32(x)}; }
+XLA_SIMD_INLINE Vec Load(const float* p) { return {vld1q_f32(p)}; }
+XLA_SIMD_INLINE void Store(Vec a, float* p) { vst1q_f32(p, a.v); }
+XLA_SIMD_INLINE Vec Add(Vec a, Vec b) { return {vaddq_f32(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Sub(Vec a, Vec b) { return {vsubq_f32(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Mul(Vec a, Vec b) { return {vmulq_f32(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Div(Vec a, Vec b) { return {vdivq_f32(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Min(Vec a, Vec b) { return {vminq_f32(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Max(Vec a, Vec b) { return {vmaxq_f32(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Sqrt(Vec a) { return {vsqrtq_f32(a.v)}; }
+XLA_SIMD_INLINE Vec MulAdd(Vec a, Vec b, Vec c) {
+  return {vfmaq_f32(c.v, a.v, b.v)};
+}
+XLA_SIMD_INLINE Mask Lt(Vec a, Vec b) { return {vcltq_f32(a.v, b.v)}; }
+XLA_SIMD_INLINE Mask Gt(Vec a, Vec b) { return {vcgtq_f32(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Select(Mask m, Vec a, Vec b) {
+  return {vbslq_f32(m.m, a.v, b.v)};
+}
+XLA_SIMD_INLINE float ReduceSum(Vec a) { return vaddvq_f32(a.v); }
+XLA_SIMD_INLINE float ReduceMax(Vec a) { return vmaxvq_f32(a.v); }
+XLA_SIMD_INLINE float ReduceMin(Vec a) { return vminvq_f32(a.v); }
+XLA_SIMD_INLINE Vec Gather(const float* base, const int32* indices) {
+  const float values[4] = {base[indices[0]], base[indices[1]],
+                           base[indices[2]], base[indices[3]]};
+  return {vld1q_f32(values)};
+}
+XLA_SIMD_INLINE Vec Abs(Vec a) { return {vabsq_f32(a.v)}; }
+XLA_SIMD_INLINE Mask Eq(Vec a, Vec b) { return {vceqq_f32(a.v, b.v)}; }
+XLA_SIMD_INLINE Vec Round(Vec a) { return {vrndnq_f32(a.v)}; }
+XLA_SIMD_INLINE Vec LdExp(Vec a, Vec n) {
+  const int32x4_t i = vcvtnq_s32_f32(n.v);
+  const int32x4_t low = vshrq_n_s32(i, 1);
+  const int32x4_t bias = vdupq_n_s32(127);
+  const float32x4_t p =
+      vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(low, bias), 23));
+  const float32x4_t q = vreinterpretq_f32_s32(
+      vshlq_n_s32(vaddq_s32(vsubq_s32(i, low), bias), 23));
+  return {vmulq_f32(vmulq_f32(a.v, p), q)};
+}
+XLA_SIMD_INLINE Vec Frexp(Vec a, Vec* exponent) {
+  const uint32x4_t bits = vreinterpretq_u32_f32(a.v);
+  *exponent = {vcvtq_f32_s32(vsubq_s32(
+      vreinterpretq_s32_u32(vshrq_n_u32(bits, 23)), vdupq_n_s32(126)))};
+  return {vreinterpretq_f32_u32(vorrq_u32(
+      vandq_u32(bits, vdupq_n_u32(0x807fffff)), vdupq_n_u32(0x3f000000)))};
+}
+// The estimate alone has 8 bits; one Newton step brings it to 16.
+XLA_SIMD_INLINE Vec RsqrtEstimate(Vec a) {
+  const float32x4_t e = vrsqrteq_f32(a.v);
+  return {vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(a.v, e), e))};
+}
+
+#else
+#error "Unknown XLA_SIMD_TARGET"
+#endif
+
+#if XLA_SIMD_TARGET != XLA_SIMD_AVX512
+XLA_SIMD_INLINE Vec LoadPartial(const float* p, int64 n) {
+  float lanes[kLanes] = {};
+  std::copy(p, p + n, lanes);
+  return Load(lanes);
+}
+
+XLA_SIMD_INLINE void StorePartial(Vec a, float* p, int64 n) {
+  float lanes[kLanes];
+  Store(a, lanes);
+  std::copy(lanes, lanes + n, p);
+}
+#endif
+
+}  // namespace XLA_SIMD_NAMESPACE
+}  // namespace simd
+}  // namespace xla
+
+#endif  // defined(XLA_SIMD_TARGET) && defined(XLA_SIMD_NAMESPACE)
@@ -0,0 +1,409 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "sliding_window.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+#include "intra_op_thread_pool.h"
+#include "logging.h"
+#include "window_util.h"
+
+namespace xla {
+namespace {
+
+// Budget, in elements, for the scratch rows of one pass task.
+constexpr int64 kScratchElements = 1 << 16;
+
+// Fewest columns a pass task works on, so that its loops stay vectorizable
+// even for very long lines.
+constexpr int64 kMinColumns = 16;
+
+// Whether the pass over dimension would copy its input: no padding, a window
+// of one and a unit stride.
+bool IsIdentity(const SlidingWindowDimension& dimension, int64 size) {
+  if (dimension.window != 1 || dimension.stride != 1 ||
+      static_cast<int64>(dimension.sources.size()) != size) {
+    return false;
+  }
+  for (int64 i = 0; i < size; ++i) {
+    if (dimension.sources[i] != i) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// An element with the operand offset it came from, for argmax pooling.
+struct ValueIndex {
+  float value;
+  int32 index;
+};
+
+// Orders ValueIndex by value, then by offset, so that the maximum of a window
+// is its last largest element in row-major order.
+struct MaxIndexFunctor {
+  ValueIndex operator()(const ValueIndex& a, const ValueIndex& b) const {
+    return b.value > a.value || (b.value == a.value && b.index > a.index)
+               ? b
+               : a;
+  }
+};
+
+// The reduction, under the associative Op, of every window of a padded line.
+// A slider owns the scratch of one pass task; line is a length x columns
+// row-major block and the count results are stored out_stride apart. Values
+// are only ever combined, never removed again, so infinities, NaN and
+// elements of very different magnitude in one window do not leak into the
+// windows after it.
+template <typename T, typename Op>
+class WindowSlider {
+ public:
+  WindowSlider(int64 length, int64 width)
+      : prefix_(length * width), suffix_(length * width) {}
+
+  void operator()(const T* line, int64 columns, int64 window, int64 stride,
+                  int64 count, T* out, int64 out_stride) {
+    const Op op;
+    if (window == 1 || stride >= window) {
+      // Windows do not overlap, so every row is read at most once.
+      for (int64 j = 0; j < count; ++j) {
+        const T* src = line + j * stride * columns;
+        T* dst = out + j * out_stride;
+        std::copy(src, src + columns, dst);
+        for (int64 k = 1; k < window; ++k) {
+          for (int64 c = 0; c < columns; ++c) {
+            dst[c] = op(dst[c], src[k * columns + c]);
+          }
+        }
+      }
+      return;
+    }
+    const int64 length = (count - 1) * stride + window;
+    T* prefix = prefix_.data();
+    T* suffix = suffix_.data();
+    for (int64 i = 0; i < length; ++i) {
+      const T* src = line + i * columns;
+      T* dst = prefix + i * columns;
+      if (i % window == 0) {
+        std::copy(src, src + columns, dst);
+      } else {
+        for (int64 c = 0; c < columns; ++c) {
+          dst[c] = op(dst[c - columns], src[c]);
+        }
+      }
+    }
+    for (int64 i = length - 1; i >= 0; --i) {
+      const T* src = line + i * columns;
+      T* dst = suffix + i * columns;
+      if (i % window == window - 1 || i == length - 1) {
+        std::copy(src, src + columns, dst);
+      } else {
+        for (int64 c = 0; c < columns; ++c) {
+          dst[c] = op(dst[c + columns], src[c]);
+        }
+      }
+    }
+    // Window [p, p + window) is the suffix of p's block joined with the
+    // prefix of the next block up to p + window - 1, or, when p starts a
+    // block, that block's suffix alone: Op need not be idempotent.
+    for (int64 j = 0; j < count; ++j) {
+      const T* head = suffix + j * stride * columns;
+      T* dst = out + j * out_stride;
+      if (j * stride % window == 0) {
+        std::copy(head, head + columns, dst);
+        continue;
+      }
+      const T* tail = prefix + (j * stride + window - 1) * columns;
+      for (int64 c = 0; c < columns; ++c) {
+        dst[c] = op(head[c], tail[c]);
+      }
+    }
+  }
+
+ private:
+  std::vector<T> prefix_;
+  std::vector<T> suffix_;
+};
+
+// Reduces dimension 1 of the outer x size x inner row-major array input to
+// count windows with Slider, stored in the outer x count x inner array
+// output.
+template <typename Slider, typename T>
+void ReducePass(const T* input, int64 outer, int64 size, int64 inner,
+                const SlidingWindowDimension& dimension, int64 count,
+                const T& pad_value, T* output) {
+  const int64 length = (count - 1) * dimension.stride + dimension.window;
+  const int64 width = std::min(
+      inner, std::max(kMinColumns, kScratchElements / (3 * length)));
+  const int64 chunks = (inner + width - 1) / width;
+  ParallelFor(outer * chunks, 4 * length * width, [&](int64 first,
+                                                      int64 last) {
+    std::vector<T> line(length * width);
+    Slider slide(length, width);
+    for (int64 task = first; task < last; ++task) {
+      const int64 o = task / chunks;
+      const int64 c0 = task % chunks * width;
+      const int64 columns = std::min(width, inner - c0);
+      // Gathers the padded line, so that the scans read consecutive rows of
+      // columns elements.
+      const T* plane = input + o * size * inner + c0;
+      for (int64 i = 0; i < length; ++i) {
+        T* dst = line.data() + i * columns;
+        const int64 source = dimension.sources[i];
+        if (columns == 1) {
+          *dst = source < 0 ? pad_value : plane[source * inner];
+        } else if (source < 0) {
+          std::fill(dst, dst + columns, pad_value);
+        } else {
+          std::copy(plane + source * inner, plane + source * inner + columns,
+                    dst);
+        }
+      }
+      slide(line.data(), columns, dimension.window, dimension.stride, count,
+            output + o * count * inner + c0, inner);
+    }
+  });
+}
+
+// Runs one ReducePass per dimension that is not an identity and leaves the
+// result in output; padding of dimension d reads as pad_values[d].
+template <typename Slider, typename T>
+void RunPasses(const T* operand, tensorflow::gtl::ArraySlice<int64> dimensions,
+               const std::vector<SlidingWindowDimension>& windows,
+               const std::vector<T>& pad_values, T* output) {
+  const int rank = static_cast<int>(dimensions.size());
+  std::vector<int64> shape(dimensions.begin(), dimensions.end());
+  int64 output_size = 1;
+  int last_pass = -1;
+  for (int d = 0; d < rank; ++d) {
+    output_size *= SlidingWindowCount(windows[d]);
+    if (!IsIdentity(windows[d], dimensions[d])) {
+      last_pass = d;
+    }
+  }
+  if (last_pass < 0) {
+    std::copy(operand, operand + output_size, output);
+    return;
+  }
+  const T* current = operand;
+  std::vector<T> buffers[2];
+  int buffer = 0;
+  for (int d = 0; d <= last_pass; ++d) {
+    if (IsIdentity(windows[d], shape[d])) {
+      continue;
+    }
+    const int64 count = SlidingWindowCount(windows[d]);
+    int64 outer = 1;
+    int64 inner = 1;
+    for (int i = 0; i < d; ++i) {
+      outer *= shape[i];
+    }
+    for (int i = d + 1; i < rank; ++i) {
+      inner *= shape[i];
+    }
+    T* next = output;
+    if (d != last_pass) {
+      buffers[buffer].resize(outer * count * inner);
+      next = buffers[buffer].data();
+      buffer ^= 1;
+    }
+    ReducePass<Slider>(current, outer, shape[d], inner, windows[d], count,
+                       pad_values[d], next);
+    shape[d] = count;
+    current = next;
+  }
+}
+
+// Checks windows against the operand dimensions and returns the number of
+// windows.
+int64 CheckWindows(tensorflow::gtl::ArraySlice<int64> dimensions,
+                   const std::vector<SlidingWindowDimension>& windows) {
+  CHECK_EQ(dimensions.size(), windows.size());
+  int64 output_size = 1;
+  for (size_t d = 0; d < dimensions.size(); ++d) {
+    CHECK_GE(windows[d].window, 1);
+    CHECK_GE(windows[d].stride, 1);
+    for (int64 source : windows[d].sources) {
+      CHECK_LT(source, dimensions[d]);
+    }
+    output_size *= SlidingWindowCount(windows[d]);
+  }
+  return output_size;
+}
+
+}  // namespace
+
+SlidingWindowDimension MakeSlidingWindowDimension(int64 size, int64 window,
+                                                  int64 stride, int64 pad_low,
+                                                  int64 pad_high) {
+  CHECK_GE(pad_low, 0) << "not implemented";
+  CHECK_GE(pad_high, 0) << "not implemented";
+  SlidingWindowDimension dimension;
+  dimension.window = window;
+  dimension.stride = stride;
+  dimension.sources.assign(pad_low + size + pad_high, -1);
+  for (int64 i = 0; i < size; ++i) {
+    dimension.sources[pad_low + i] = i;
+  }
+  return dimension;
+}
+
+SlidingWindowDimension MakeSlidingWindowDimension(
+    int64 size, int64 window, int64 stride,
+    const PaddingConfig::PaddingConfigDimension& padding) {
+  CHECK_GE(padding.edge_padding_low(), 0) << "not implemented";
+  CHECK_GE(padding.edge_padding_high(), 0) << "not implemented";
+  CHECK_GE(padding.interior_padding(), 0) << "not implemented";
+  const int64 step = padding.interior_padding() + 1;
+  SlidingWindowDimension dimension;
+  dimension.window = window;
+  dimension.stride = stride;
+  dimension.sources.assign(
+      padding.edge_padding_low() + padding.edge_padding_high() + size +
+          std::max<int64>(size - 1, 0) * padding.interior_padding(),
+      -1);
+  for (int64 i = 0; i < size; ++i) {
+    dimension.sources[padding.edge_padding_low() + i * step] = i;
+  }
+  return dimension;
+}
+
+int64 SlidingWindowCount(const SlidingWindowDimension& dimension) {
+  return window_util::StridedBound(dimension.sources.size(), dimension.window,
+                                   dimension.stride);
+}
+
+void SlidingWindowReduce(ReduceOp op, const float* operand,
+                         tensorflow::gtl::ArraySlice<int64> dimensions,
+                         const std::vector<SlidingWindowDimension>& windows,
+                         float init, float pad_value, float* output) {
+  CHECK(op == ReduceOp::kSum || op == ReduceOp::kMax || op == ReduceOp::kMin);
+  const int64 output_size = CheckWindows(dimensions, windows);
+  if (output_size == 0) {
+    return;
+  }
+  std::vector<float> pad_values(windows.size(), pad_value);
+  switch (op) {
+    case ReduceOp::kSum:
+      // A padded element of dimension d stands for a whole window of padding
+      // of the dimensions reduced before it.
+      for (size_t d = 1; d < windows.size(); ++d) {
+        pad_values[d] = pad_values[d - 1] * windows[d - 1].window;
+      }
+      RunPasses<WindowSlider<float, std::plus<float>>>(
+          operand, dimensions, windows, pad_values, output);
+      for (int64 i = 0; i < output_size; ++i) {
+        output[i] = init + output[i];
+      }
+      break;
+    case ReduceOp::kMax:
+      RunPasses<WindowSlider<float, MaxFunctor>>(operand, dimensions,
+                                                 windows, pad_values, output);
+      for (int64 i = 0; i < output_size; ++i) {
+        output[i] = std::max(init, output[i]);
+      }
+      break;
+    default:
+      RunPasses<WindowSlider<float, MinFunctor>>(operand, dimensions,
+                                                 windows, pad_values, output);
+      for (int64 i = 0; i < output_size; ++i) {
+        output[i] = std::min(init, output[i]);
+      }
+      break;
+  }
+}
+
+void SlidingWindowMaxWithArgmax(
+    const float* operand, tensorflow::gtl::ArraySlice<int64> dimensions,
+    const std::vector<SlidingWindowDimension>& windows, float* output,
+    int32* argmax) {
+  const int64 output_size = CheckWindows(dimensions, windows);
+  if (output_size == 0) {
+    return;
+  }
+  int64 operand_size = 1;
+  for (int64 size : dimensions) {
+    operand_size *= size;
+  }
+  CHECK_LE(operand_size, std::numeric_limits<int32>::max());
+  std::vector<ValueIndex> values(operand_size);
+  for (int64 i = 0; i < operand_size; ++i) {
+    values[i] = {operand[i], static_cast<int32>(i)};
+  }
+  const ValueIndex padding = {-std::numeric_limits<float>::infinity(), -1};
+  std::vector<ValueIndex> result(output_size);
+  RunPasses<WindowSlider<ValueIndex, MaxIndexFunctor>>(
+      values.data(), dimensions, windows,
+      std::vector<ValueIndex>(windows.size(), padding), result.data());
+  for (int64 i = 0; i < output_size; ++i) {
+    output[i] = result[i].value;
+    argmax[i] = result[i].index;
+  }
+}
+
+void SlidingWindowMaxBackward(
+    const int32* argmax, const float* source,
+    const std::vector<SlidingWindowDimension>& windows, float* gradient) {
+  const int rank = static_cast<int>(windows.size());
+  std::vector<int64> counts(rank);
+  int64 output_size = 1;
+  for (int d = 0; d < rank; ++d) {
+    counts[d] = SlidingWindowCount(windows[d]);
+    output_size *= counts[d];
+  }
+  // Windows that do not overlap along dimension d select elements with
+  // distinct indices along d, so ranges of window indices along d write
+  // disjoint elements. All windows that select one element then share a
+  // range and add to it in the same order as a sequential loop.
+  int split = -1;
+  for (int d = 0; d < rank && split < 0; ++d) {
+    if (windows[d].window <= windows[d].stride) {
+      split = d;
+    }
+  }
+  if (output_size == 0) {
+    return;
+  }
+  auto scatter = [&](int64 first, int64 last) {
+    for (int64 i = first; i < last; ++i) {
+      if (argmax[i] >= 0) {
+        gradient[argmax[i]] += source[i];
+      }
+    }
+  };
+  if (split < 0) {
+    scatter(0, output_size);
+    return;
+  }
+  int64 outer = 1;
+  int64 inner = 1;
+  for (int d = 0; d < split; ++d) {
+    outer *= counts[d];
+  }
+  for (int d = split + 1; d < rank; ++d) {
+    inner *= counts[d];
+  }
+  const int64 size = counts[split];
+  ParallelFor(size, outer * inner, [&](int64 first, int64 last) {
+    for (int64 o = 0; o < outer; ++o) {
+      scatter((o * size + first) * inner, (o * size + last) * inner);
+    }
+  });
+}
+
+}  // namespace xla
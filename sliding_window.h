@@ -0,0 +1,107 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_SLIDING_WINDOW_H_
+#define TENSORFLOW_COMPILER_XLA_SLIDING_WINDOW_H_
+
+// Window reductions (pooling) whose cost per output element does not depend
+// on the window size.
+//
+// The window is separable, so a w0 x w1 x ... window is reduced one
+// dimension at a time, every pass reducing the lines of the previous pass's
+// result. Along a line, sums, max and min all use the van Herk/Gil-Werman
+// algorithm: the padded line is cut into blocks of the window size, and every
+// window combines a suffix of one block with a prefix of the next, both
+// precomputed by one forward and one backward scan. Unlike a running sum that
+// subtracts the elements leaving the window, this never subtracts, so an
+// infinity or a huge element only affects the windows that contain it.
+//
+// A pass costs a few operations per element. A pass over an outer
+// dimension works on whole rows of the inner dimensions at once, so its
+// loops are contiguous.
+
+#include <vector>
+
+#include "array_slice.h"
+#include "reduction.h"
+#include "types.h"
+#include "xla_data.pb.h"
+
+namespace xla {
+
+// One dimension of a window reduction. The window slides over a virtually
+// padded copy of the operand dimension, whose position i holds the operand
+// index sources[i], or padding where sources[i] is negative.
+struct SlidingWindowDimension {
+  std::vector<int64> sources;
+  int64 window = 1;
+  int64 stride = 1;
+};
+
+// A dimension of the given size with pad_low and pad_high positions of edge
+// padding, e.g. as returned by MakePadding.
+SlidingWindowDimension MakeSlidingWindowDimension(int64 size, int64 window,
+                                                  int64 stride, int64 pad_low,
+                                                  int64 pad_high);
+
+// A dimension of the given size padded as PadArray4D pads it, including
+// interior padding. Negative padding is not implemented.
+SlidingWindowDimension MakeSlidingWindowDimension(
+    int64 size, int64 window, int64 stride,
+    const PaddingConfig::PaddingConfigDimension& padding);
+
+// Returns the number of windows along dimension.
+int64 SlidingWindowCount(const SlidingWindowDimension& dimension);
+
+// Reduces every window of the row-major array operand with the given
+// dimensions, windows[i] describing dimension i, and stores
+// op(init, reduction of the window) in output, whose dimensions are the
+// SlidingWindowCount of every window dimension. op is kSum, kMax or kMin.
+// Padding reads as pad_value, so the identity of op (zero or -/+infinity)
+// ignores it. operand and output must not overlap.
+//
+// Sums are rounded differently from a sequential loop over the window.
+void SlidingWindowReduce(ReduceOp op, const float* operand,
+                         tensorflow::gtl::ArraySlice<int64> dimensions,
+                         const std::vector<SlidingWindowDimension>& windows,
+                         float init, float pad_value, float* output);
+
+// Max pooling that also records which element every window selects: stores
+// the maximum of every window in output, like SlidingWindowReduce with kMax
+// and padding ignored, and its flat offset within operand in argmax. Of
+// equal maxima the last in row-major order is selected, as SelectAndScatter
+// with a greater-or-equal select does. A window made only of padding yields
+// -infinity and offset -1. The operand must have fewer than 2^31 elements.
+void SlidingWindowMaxWithArgmax(
+    const float* operand, tensorflow::gtl::ArraySlice<int64> dimensions,
+    const std::vector<SlidingWindowDimension>& windows, float* output,
+    int32* argmax);
+
+// The backward pass of SlidingWindowMaxWithArgmax: adds the gradient source[i]
+// of every window i to gradient[argmax[i]], where gradient has the operand's
+// dimensions and is initialized by the caller. The cost is proportional to
+// the number of windows.
+//
+// Windows are split between threads along the outermost dimension whose
+// windows do not overlap (window <= stride), so no two threads add to the
+// same element and the result does not depend on the thread count. When
+// windows overlap in every dimension, the scatter runs on the calling thread.
+void SlidingWindowMaxBackward(
+    const int32* argmax, const float* source,
+    const std::vector<SlidingWindowDimension>& windows, float* gradient);
+
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_SLIDING_WINDOW_H_
@@ -0,0 +1,419 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "sliding_window.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "array4d.h"
+#include "intra_op_thread_pool.h"
+#include "padding.h"
+#include "reference_util.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+class SlidingWindowTest /* : public ::testing::Test */
+{
+public:
+
+   SlidingWindowTest() { run(); }
+
+   void MatchesDirectReduction();
+   void LargeWindows();
+   void NonFiniteAndMixedMagnitudes();
+   void PoolingUsesSlidingWindows();
+   void IndependentOfThreadCount();
+   void ArgmaxMatchesRescan();
+
+   void run();
+};
+
+std::vector<float> Values(int64 n, int seed)
+{
+   std::vector<float> values(n);
+   for (int64 i = 0; i < n; ++i) {
+      values[i] = static_cast<float>((i * 37 + seed * 11) % 29) / 8.0f - 1.75f;
+   }
+   return values;
+}
+
+// Reduces every window by visiting each of its elements.
+std::vector<double> DirectReduce(
+    ReduceOp op, const std::vector<float>& operand,
+    const std::vector<int64>& dimensions,
+    const std::vector<SlidingWindowDimension>& windows, float init,
+    float pad_value)
+{
+   const int rank = static_cast<int>(dimensions.size());
+   std::vector<int64> counts(rank);
+   int64 output_size = 1;
+   int64 window_size = 1;
+   for (int d = 0; d < rank; ++d) {
+      counts[d] = SlidingWindowCount(windows[d]);
+      output_size *= counts[d];
+      window_size *= windows[d].window;
+   }
+   std::vector<double> result(output_size);
+   for (int64 out = 0; out < output_size; ++out) {
+      double acc = init;
+      for (int64 w = 0; w < window_size; ++w) {
+         // Decomposes out and w, last dimension fastest, into the padded
+         // position of every dimension.
+         int64 out_rest = out;
+         int64 w_rest = w;
+         int64 index = 0;
+         int64 index_stride = 1;
+         bool padding = false;
+         for (int d = rank - 1; d >= 0; --d) {
+            const int64 position = out_rest % counts[d] * windows[d].stride +
+                                   w_rest % windows[d].window;
+            out_rest /= counts[d];
+            w_rest /= windows[d].window;
+            const int64 source = windows[d].sources[position];
+            padding = padding || source < 0;
+            index += source * index_stride;
+            index_stride *= dimensions[d];
+         }
+         const double x = padding ? pad_value : operand[index];
+         if (op == ReduceOp::kSum) {
+            acc += x;
+         } else if (op == ReduceOp::kMax) {
+            acc = std::max(acc, x);
+         } else {
+            acc = std::min(acc, x);
+         }
+      }
+      result[out] = acc;
+   }
+   return result;
+}
+
+void ExpectNear(const std::vector<double>& expected,
+                const std::vector<float>& actual, double tolerance)
+{
+   ASSERT_EQ(expected.size(), actual.size());
+   for (size_t i = 0; i < expected.size(); ++i) {
+      ASSERT_TRUE(std::abs(expected[i] - actual[i]) <= tolerance);
+   }
+}
+
+void CheckAgainstDirect(const std::vector<int64>& dimensions,
+                        const std::vector<SlidingWindowDimension>& windows)
+{
+   int64 size = 1;
+   for (int64 d : dimensions) {
+      size *= d;
+   }
+   const std::vector<float> operand = Values(size, size % 7);
+   int64 output_size = 1;
+   for (const SlidingWindowDimension& window : windows) {
+      output_size *= SlidingWindowCount(window);
+   }
+   for (ReduceOp op : {ReduceOp::kSum, ReduceOp::kMax, ReduceOp::kMin}) {
+      for (float pad_value : {0.0f, -3.0f}) {
+         const float init = op == ReduceOp::kSum ? 0.5f : 0.0f;
+         const std::vector<double> expected =
+             DirectReduce(op, operand, dimensions, windows, init, pad_value);
+         std::vector<float> actual(output_size);
+         SlidingWindowReduce(op, operand.data(), dimensions, windows, init,
+                             pad_value, actual.data());
+         ExpectNear(expected, actual, op == ReduceOp::kSum ? 1e-4 : 0.0);
+      }
+   }
+}
+
+void SlidingWindowTest::MatchesDirectReduction()
+{
+   // One dimension: overlapping, touching and gapped windows.
+   for (int64 window : {1, 2, 3, 5}) {
+      for (int64 stride : {1, 2, 3, 6}) {
+         CheckAgainstDirect(
+             {23}, {MakeSlidingWindowDimension(23, window, stride, 2, 1)});
+      }
+   }
+   // Several dimensions, some of them left alone.
+   CheckAgainstDirect({3, 10, 9},
+                      {MakeSlidingWindowDimension(3, 1, 1, 0, 0),
+                       MakeSlidingWindowDimension(10, 3, 2, 1, 1),
+                       MakeSlidingWindowDimension(9, 4, 1, 0, 3)});
+   CheckAgainstDirect({2, 3, 7, 8},
+                      {MakeSlidingWindowDimension(2, 2, 1, 0, 0),
+                       MakeSlidingWindowDimension(3, 1, 1, 0, 0),
+                       MakeSlidingWindowDimension(7, 3, 1, 1, 1),
+                       MakeSlidingWindowDimension(8, 1, 1, 0, 0)});
+   // Interior padding.
+   PaddingConfig::PaddingConfigDimension padding;
+   padding.set_edge_padding_low(1);
+   padding.set_edge_padding_high(2);
+   padding.set_interior_padding(2);
+   CheckAgainstDirect({4, 6}, {MakeSlidingWindowDimension(4, 3, 2, padding),
+                               MakeSlidingWindowDimension(6, 4, 3, padding)});
+   // Nothing to reduce.
+   CheckAgainstDirect({4, 5}, {MakeSlidingWindowDimension(4, 1, 1, 0, 0),
+                               MakeSlidingWindowDimension(5, 1, 1, 0, 0)});
+}
+
+void SlidingWindowTest::LargeWindows()
+{
+   // Windows spanning most of the operand, with Same padding.
+   const std::vector<int64> dimensions = {2, 40, 37};
+   const auto padding =
+       MakePadding(dimensions, {1, 31, 25}, {1, 1, 2}, Padding::kSame);
+   std::vector<SlidingWindowDimension> windows;
+   for (int d = 0; d < 3; ++d) {
+      windows.push_back(MakeSlidingWindowDimension(
+          dimensions[d], std::vector<int64>{1, 31, 25}[d],
+          std::vector<int64>{1, 1, 2}[d], padding[d].first,
+          padding[d].second));
+   }
+   ASSERT_EQ(SlidingWindowCount(windows[1]), 40);
+   ASSERT_EQ(SlidingWindowCount(windows[2]), 19);
+   CheckAgainstDirect(dimensions, windows);
+}
+
+// Sums along a line must only see the elements of their own window: an
+// infinity, a NaN or a huge element must not change the windows after it.
+void SlidingWindowTest::NonFiniteAndMixedMagnitudes()
+{
+   const float kInf = std::numeric_limits<float>::infinity();
+   const float kNaN = std::numeric_limits<float>::quiet_NaN();
+   for (const std::array<float, 2>& first :
+        {std::array<float, 2>{{kInf, kInf}},
+         std::array<float, 2>{{1e30f, 1e30f}},
+         std::array<float, 2>{{kNaN, kNaN}}}) {
+      Array4D<float> line(1, 1, 1, 6);
+      line.flatten() = {first[0], 1.0f, 2.0f, 3.0f, 4.0f, 5.0f};
+      auto summed = ReferenceUtil::ReduceWindow4DAdd(
+          line, 0.0f, {1, 1, 1, 2}, {1, 1, 1, 1}, Padding::kValid);
+      const std::vector<float> expected = {first[1], 3.0f, 5.0f, 7.0f, 9.0f};
+      ASSERT_EQ(summed->n4(), 5);
+      ASSERT_TRUE(std::isnan(expected[0]) ? std::isnan((*summed)(0, 0, 0, 0))
+                                          : (*summed)(0, 0, 0, 0) == expected[0]);
+      for (int64 i = 1; i < 5; ++i) {
+         ASSERT_EQ((*summed)(0, 0, 0, i), expected[i]);
+      }
+   }
+
+   // Two dimensions, so that the special values also pass through the
+   // outer pass, which works on whole rows.
+   const std::vector<int64> dimensions = {9, 40};
+   std::vector<float> operand = Values(9 * 40, 5);
+   operand[0 * 40 + 5] = 1e30f;
+   operand[2 * 40 + 20] = kInf;
+   operand[4 * 40 + 20] = -kInf;
+   operand[6 * 40 + 33] = kNaN;
+   operand[8 * 40 + 0] = -1e25f;
+   const std::vector<SlidingWindowDimension> windows = {
+       MakeSlidingWindowDimension(9, 2, 1, 0, 1),
+       MakeSlidingWindowDimension(40, 4, 1, 1, 2)};
+   const std::vector<double> expected =
+       DirectReduce(ReduceOp::kSum, operand, dimensions, windows, 0.0f, 0.0f);
+   std::vector<float> actual(expected.size());
+   SlidingWindowReduce(ReduceOp::kSum, operand.data(), dimensions, windows,
+                       0.0f, 0.0f, actual.data());
+   for (size_t i = 0; i < expected.size(); ++i) {
+      if (std::isnan(expected[i])) {
+         ASSERT_TRUE(std::isnan(actual[i]));
+      } else {
+         ASSERT_TRUE(expected[i] == actual[i] ||
+                     std::abs(expected[i] - actual[i]) <=
+                         1e-4 + 1e-6 * std::abs(expected[i]));
+      }
+   }
+}
+
+void SlidingWindowTest::PoolingUsesSlidingWindows()
+{
+   Array4D<float> input(2, 3, 17, 14);
+   input.FillRandom(1.0f, 0.0, 31);
+   for (Padding padding : {Padding::kSame, Padding::kValid}) {
+      auto pooled = ReferenceUtil::Max_Pool(input, {5, 4}, {2, 3}, padding);
+      const auto pads = MakePadding({17, 14}, {5, 4}, {2, 3}, padding);
+      ASSERT_EQ(pooled->n3(),
+                ReferenceUtil::WindowCount(17, 5, 2, padding));
+      ASSERT_EQ(pooled->n4(),
+                ReferenceUtil::WindowCount(14, 4, 3, padding));
+      pooled->Each([&](tensorflow::gtl::ArraySlice<int64> i, float* value) {
+         float expected = -std::numeric_limits<float>::infinity();
+         for (int64 y = 0; y < 5; ++y) {
+            for (int64 x = 0; x < 4; ++x) {
+               const int64 iy = i[2] * 2 - pads[0].first + y;
+               const int64 ix = i[3] * 3 - pads[1].first + x;
+               if (iy >= 0 && iy < 17 && ix >= 0 && ix < 14) {
+                  expected = std::max(expected, input(i[0], i[1], iy, ix));
+               }
+            }
+         }
+         ASSERT_EQ(*value, expected);
+      });
+
+      auto summed = ReferenceUtil::ReduceWindow4DAdd(
+          input, 1.0f, {1, 2, 5, 4}, {1, 1, 2, 3}, padding);
+      const auto pads4 = MakePadding({2, 3, 17, 14}, {1, 2, 5, 4},
+                                     {1, 1, 2, 3}, padding);
+      summed->Each([&](tensorflow::gtl::ArraySlice<int64> i, float* value) {
+         double expected = 1.0;
+         for (int64 c = 0; c < 2; ++c) {
+            for (int64 y = 0; y < 5; ++y) {
+               for (int64 x = 0; x < 4; ++x) {
+                  const int64 ic = i[1] - pads4[1].first + c;
+                  const int64 iy = i[2] * 2 - pads4[2].first + y;
+                  const int64 ix = i[3] * 3 - pads4[3].first + x;
+                  if (ic >= 0 && ic < 3 && iy >= 0 && iy < 17 && ix >= 0 &&
+                      ix < 14) {
+                     expected += input(i[0], ic, iy, ix);
+                  }
+               }
+            }
+         }
+         ASSERT_TRUE(std::abs(*value - expected) < 1e-4);
+      });
+   }
+}
+
+void SlidingWindowTest::IndependentOfThreadCount()
+{
+   Array4D<float> input(3, 4, 61, 45);
+   input.FillRandom(1.0f, 0.0, 32);
+   SetIntraOpThreadCount(1);
+   auto expected_sum = ReferenceUtil::ReduceWindow4DAdd(
+       input, 0.0f, {1, 1, 9, 9}, {1, 1, 1, 1}, Padding::kSame);
+   auto expected_max = ReferenceUtil::Max_Pool(input, {9, 9}, {2, 2},
+                                               Padding::kSame);
+   SetIntraOpThreadCount(3);
+   auto sum = ReferenceUtil::ReduceWindow4DAdd(
+       input, 0.0f, {1, 1, 9, 9}, {1, 1, 1, 1}, Padding::kSame);
+   auto max = ReferenceUtil::Max_Pool(input, {9, 9}, {2, 2}, Padding::kSame);
+   SetIntraOpThreadCount(0);
+   ASSERT_TRUE(expected_sum->flatten() == sum->flatten());
+   ASSERT_TRUE(expected_max->flatten() == max->flatten());
+}
+
+// Select and scatter by rescanning every window for its last maximum.
+Array4D<float> RescanSelectAndScatter(const Array4D<float>& operand,
+                                      const Array4D<float>& source,
+                                      const std::vector<int64>& window,
+                                      const std::vector<int64>& stride,
+                                      Padding padding)
+{
+   const std::vector<int64> dims = {operand.n1(), operand.n2(), operand.n3(),
+                                    operand.n4()};
+   const auto pads = MakePadding(dims, window, stride, padding);
+   Array4D<float> result(dims[0], dims[1], dims[2], dims[3], 0.0f);
+   const std::array<int64, 4> source_dims = {
+       {source.n1(), source.n2(), source.n3(), source.n4()}};
+   const int64 window_size = window[0] * window[1] * window[2] * window[3];
+   for (int64 s = 0; s < source.num_elements(); ++s) {
+      std::array<int64, 4> i;
+      int64 rest = s;
+      for (int d = 3; d >= 0; --d) {
+         i[d] = rest % source_dims[d];
+         rest /= source_dims[d];
+      }
+      std::array<int64, 4> best = {{-1, -1, -1, -1}};
+      float max = -std::numeric_limits<float>::infinity();
+      for (int64 k = 0; k < window_size; ++k) {
+         std::array<int64, 4> x;
+         bool inside = true;
+         int64 offset = k;
+         for (int d = 3; d >= 0; --d) {
+            x[d] = i[d] * stride[d] - pads[d].first + offset % window[d];
+            offset /= window[d];
+            inside = inside && x[d] >= 0 && x[d] < dims[d];
+         }
+         if (inside && operand(x[0], x[1], x[2], x[3]) >= max) {
+            max = operand(x[0], x[1], x[2], x[3]);
+            best = x;
+         }
+      }
+      result(best[0], best[1], best[2], best[3]) += source.flatten()[s];
+   }
+   return result;
+}
+
+void SlidingWindowTest::ArgmaxMatchesRescan()
+{
+   // Few distinct values, so that most windows hold ties.
+   Array4D<float> operand(2, 3, 11, 9);
+   operand.FillWithMultiples(1.0f);
+   operand.Each([](tensorflow::gtl::ArraySlice<int64>, float* value) {
+      *value = std::fmod(*value * 7.0f, 5.0f);
+   });
+   for (Padding padding : {Padding::kSame, Padding::kValid}) {
+      for (const std::vector<int64>& window :
+           {std::vector<int64>{1, 1, 3, 3}, std::vector<int64>{1, 2, 2, 2},
+            std::vector<int64>{2, 3, 4, 1}}) {
+         for (const std::vector<int64>& stride :
+              {std::vector<int64>{1, 1, 1, 1}, std::vector<int64>{1, 2, 3, 2}}) {
+            Array4D<int32> argmax(0, 0, 0, 0);
+            auto pooled = ReferenceUtil::MaxPool4DWithArgmax(
+                operand, window, stride, padding, &argmax);
+            ASSERT_EQ(argmax.num_elements(), pooled->num_elements());
+            for (int64 i = 0; i < argmax.num_elements(); ++i) {
+               ASSERT_EQ(operand.flatten()[argmax.flatten()[i]],
+                         pooled->flatten()[i]);
+            }
+
+            Array4D<float> source(pooled->n1(), pooled->n2(), pooled->n3(),
+                                  pooled->n4());
+            source.FillWithMultiples(0.25f);
+            const Array4D<float> expected =
+                RescanSelectAndScatter(operand, source, window, stride,
+                                       padding);
+            for (int threads : {1, 3}) {
+               SetIntraOpThreadCount(threads);
+               auto gradient = ReferenceUtil::MaxPool4DBackward(
+                   argmax, source, 0.0f,
+                   {operand.n1(), operand.n2(), operand.n3(), operand.n4()},
+                   window, stride, padding);
+               ASSERT_TRUE(expected.flatten() == gradient->flatten());
+            }
+            SetIntraOpThreadCount(0);
+            auto select_and_scatter = ReferenceUtil::SelectAndScatter4DGePlus(
+                operand, source, 0.0f, window, stride,
+                padding == Padding::kSame);
+            ASSERT_TRUE(expected.flatten() == select_and_scatter->flatten());
+         }
+      }
+   }
+
+   // The 2D pooling entry point records offsets into the whole operand.
+   Array4D<int32> argmax(0, 0, 0, 0);
+   auto pooled =
+       ReferenceUtil::Max_Pool(operand, {3, 2}, {2, 2}, Padding::kSame, &argmax);
+   ASSERT_TRUE(pooled->flatten() ==
+               ReferenceUtil::Max_Pool(operand, {3, 2}, {2, 2}, Padding::kSame)
+                   ->flatten());
+   ASSERT_EQ(argmax(1, 2, 0, 0) / (11 * 9), 1 * 3 + 2);
+}
+
+void SlidingWindowTest::run()
+{
+   MatchesDirectReduction();
+   LargeWindows();
+   NonFiniteAndMixedMagnitudes();
+   PoolingUsesSlidingWindows();
+   IndependentOfThreadCount();
+   ArgmaxMatchesRescan();
+}
+
+}  // namespace
+}  // namespace xla
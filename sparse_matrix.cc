@@ -0,0 +1,436 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "sparse_matrix.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "intra_op_thread_pool.h"
+#include "kernel_registry.h"
+#include "logging.h"
+#include "ptr_util.h"
+
+namespace xla {
+namespace sparse {
+namespace {
+
+void CheckIndexRange(int64 cols) {
+  CHECK_LE(cols, std::numeric_limits<int32>::max());
+}
+
+// Computes rows [first_row, last_row) of c = a * b. Four stored values are
+// applied per pass over a row of c, so the row is loaded and stored a
+// quarter as often as with one axpy per value.
+XLA_ALWAYS_INLINE void CsrDenseRows(const CsrMatrix& a, int64 first_row,
+                                    int64 last_row, int64 n, const float* b,
+                                    int64 ldb, float* c, int64 ldc) {
+  const int32* columns = a.column_indices.data();
+  const float* values = a.values.data();
+  for (int64 i = first_row; i < last_row; ++i) {
+    float* dst = c + i * ldc;
+    std::fill(dst, dst + n, 0.0f);
+    int64 p = a.row_offsets[i];
+    const int64 end = a.row_offsets[i + 1];
+    for (; p + 4 <= end; p += 4) {
+      const float v0 = values[p];
+      const float v1 = values[p + 1];
+      const float v2 = values[p + 2];
+      const float v3 = values[p + 3];
+      const float* b0 = b + columns[p] * ldb;
+      const float* b1 = b + columns[p + 1] * ldb;
+      const float* b2 = b + columns[p + 2] * ldb;
+      const float* b3 = b + columns[p + 3] * ldb;
+      for (int64 j = 0; j < n; ++j) {
+        dst[j] += v0 * b0[j] + v1 * b1[j] + v2 * b2[j] + v3 * b3[j];
+      }
+    }
+    for (; p < end; ++p) {
+      const float v = values[p];
+      const float* src = b + columns[p] * ldb;
+      for (int64 j = 0; j < n; ++j) {
+        dst[j] += v * src[j];
+      }
+    }
+  }
+}
+
+// Computes block rows [first, last) of c = a * b: every row of a block is
+// block_cols axpys over rows of b.
+XLA_ALWAYS_INLINE void BsrDenseRows(const BsrMatrix& a, int64 first,
+                                    int64 last, int64 n, const float* b,
+                                    int64 ldb, float* c, int64 ldc) {
+  const int64 block_size = a.block_rows * a.block_cols;
+  for (int64 r = first; r < last; ++r) {
+    const int64 row0 = r * a.block_rows;
+    const int64 height = std::min(a.block_rows, a.rows - row0);
+    for (int64 ii = 0; ii < height; ++ii) {
+      std::fill(c + (row0 + ii) * ldc, c + (row0 + ii) * ldc + n, 0.0f);
+    }
+    for (int64 k = a.block_row_offsets[r]; k < a.block_row_offsets[r + 1];
+         ++k) {
+      const int64 col0 = a.block_column_indices[k] * a.block_cols;
+      const int64 width = std::min(a.block_cols, a.cols - col0);
+      const float* block = a.values.data() + k * block_size;
+      for (int64 ii = 0; ii < height; ++ii) {
+        float* dst = c + (row0 + ii) * ldc;
+        for (int64 jj = 0; jj < width; ++jj) {
+          const float v = block[ii * a.block_cols + jj];
+          if (v == 0.0f) {
+            continue;
+          }
+          const float* src = b + (col0 + jj) * ldb;
+          for (int64 j = 0; j < n; ++j) {
+            dst[j] += v * src[j];
+          }
+        }
+      }
+    }
+  }
+}
+
+// Computes rows [first_row, last_row) of c = a * b: every non-zero a(i, p)
+// adds a(i, p) times the stored blocks of block row p / block_rows to
+// contiguous runs of block_cols outputs.
+XLA_ALWAYS_INLINE void DenseBsrRows(int64 first_row, int64 last_row,
+                                    const float* a, int64 lda,
+                                    const BsrMatrix& b, float* c, int64 ldc) {
+  const int64 block_size = b.block_rows * b.block_cols;
+  const int64 block_row_count = b.block_row_offsets.size() - 1;
+  for (int64 i = first_row; i < last_row; ++i) {
+    const float* src = a + i * lda;
+    float* dst = c + i * ldc;
+    std::fill(dst, dst + b.cols, 0.0f);
+    for (int64 r = 0; r < block_row_count; ++r) {
+      const int64 row0 = r * b.block_rows;
+      const int64 height = std::min(b.block_rows, b.rows - row0);
+      for (int64 k = b.block_row_offsets[r]; k < b.block_row_offsets[r + 1];
+           ++k) {
+        const int64 col0 = b.block_column_indices[k] * b.block_cols;
+        const int64 width = std::min(b.block_cols, b.cols - col0);
+        const float* block = b.values.data() + k * block_size;
+        for (int64 ii = 0; ii < height; ++ii) {
+          const float x = src[row0 + ii];
+          if (x == 0.0f) {
+            continue;
+          }
+          const float* values = block + ii * b.block_cols;
+          for (int64 jj = 0; jj < width; ++jj) {
+            dst[col0 + jj] += x * values[jj];
+          }
+        }
+      }
+    }
+  }
+}
+
+using CsrDenseRowsFn = void (*)(const CsrMatrix& a, int64 first_row,
+                                int64 last_row, int64 n, const float* b,
+                                int64 ldb, float* c, int64 ldc);
+using BsrDenseRowsFn = void (*)(const BsrMatrix& a, int64 first, int64 last,
+                                int64 n, const float* b, int64 ldb, float* c,
+                                int64 ldc);
+using DenseBsrRowsFn = void (*)(int64 first_row, int64 last_row,
+                                const float* a, int64 lda, const BsrMatrix& b,
+                                float* c, int64 ldc);
+
+void CsrDenseRowsBaseline(const CsrMatrix& a, int64 first_row, int64 last_row,
+                          int64 n, const float* b, int64 ldb, float* c,
+                          int64 ldc) {
+  CsrDenseRows(a, first_row, last_row, n, b, ldb, c, ldc);
+}
+
+void BsrDenseRowsBaseline(const BsrMatrix& a, int64 first, int64 last,
+                          int64 n, const float* b, int64 ldb, float* c,
+                          int64 ldc) {
+  BsrDenseRows(a, first, last, n, b, ldb, c, ldc);
+}
+
+void DenseBsrRowsBaseline(int64 first_row, int64 last_row, const float* a,
+                          int64 lda, const BsrMatrix& b, float* c,
+                          int64 ldc) {
+  DenseBsrRows(first_row, last_row, a, lda, b, c, ldc);
+}
+
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+XLA_TARGET_AVX2 void CsrDenseRowsAvx2(const CsrMatrix& a, int64 first_row,
+                                      int64 last_row, int64 n, const float* b,
+                                      int64 ldb, float* c, int64 ldc) {
+  CsrDenseRows(a, first_row, last_row, n, b, ldb, c, ldc);
+}
+
+XLA_TARGET_AVX2 void BsrDenseRowsAvx2(const BsrMatrix& a, int64 first,
+                                      int64 last, int64 n, const float* b,
+                                      int64 ldb, float* c, int64 ldc) {
+  BsrDenseRows(a, first, last, n, b, ldb, c, ldc);
+}
+
+XLA_TARGET_AVX2 void DenseBsrRowsAvx2(int64 first_row, int64 last_row,
+                                      const float* a, int64 lda,
+                                      const BsrMatrix& b, float* c,
+                                      int64 ldc) {
+  DenseBsrRows(first_row, last_row, a, lda, b, c, ldc);
+}
+#endif  // XLA_HAS_TARGET_ATTRIBUTES
+
+const KernelRegistry<CsrDenseRowsFn>& CsrDenseRowsKernels() {
+  static const KernelRegistry<CsrDenseRowsFn>* registry = [] {
+    auto* kernels = new KernelRegistry<CsrDenseRowsFn>(CsrDenseRowsBaseline);
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+    kernels->Register(Isa::kAvx2, CsrDenseRowsAvx2);
+#endif
+    return kernels;
+  }();
+  return *registry;
+}
+
+const KernelRegistry<BsrDenseRowsFn>& BsrDenseRowsKernels() {
+  static const KernelRegistry<BsrDenseRowsFn>* registry = [] {
+    auto* kernels = new KernelRegistry<BsrDenseRowsFn>(BsrDenseRowsBaseline);
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+    kernels->Register(Isa::kAvx2, BsrDenseRowsAvx2);
+#endif
+    return kernels;
+  }();
+  return *registry;
+}
+
+const KernelRegistry<DenseBsrRowsFn>& DenseBsrRowsKernels() {
+  static const KernelRegistry<DenseBsrRowsFn>* registry = [] {
+    auto* kernels = new KernelRegistry<DenseBsrRowsFn>(DenseBsrRowsBaseline);
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+    kernels->Register(Isa::kAvx2, DenseBsrRowsAvx2);
+#endif
+    return kernels;
+  }();
+  return *registry;
+}
+
+// Average cost of a unit of work that does nnz of the units' total
+// multiply-adds on rows of length n.
+int64 CostPerUnit(int64 nnz, int64 units, int64 n) {
+  return std::max<int64>(1, 2 * nnz * n / std::max<int64>(units, 1));
+}
+
+}  // namespace
+
+double CsrMatrix::density() const {
+  if (rows == 0 || cols == 0) {
+    return 0.0;
+  }
+  return static_cast<double>(nnz()) / (static_cast<double>(rows) * cols);
+}
+
+double BsrMatrix::density() const {
+  if (rows == 0 || cols == 0) {
+    return 0.0;
+  }
+  int64 covered = 0;
+  for (int64 r = 0; r + 1 < static_cast<int64>(block_row_offsets.size());
+       ++r) {
+    const int64 height = std::min(block_rows, rows - r * block_rows);
+    for (int64 k = block_row_offsets[r]; k < block_row_offsets[r + 1]; ++k) {
+      covered += height * std::min(block_cols,
+                                   cols - block_column_indices[k] * block_cols);
+    }
+  }
+  return static_cast<double>(covered) / (static_cast<double>(rows) * cols);
+}
+
+CsrMatrix CsrFromDense(const float* dense, int64 rows, int64 cols, int64 ld,
+                       float threshold) {
+  CHECK_GE(rows, 0);
+  CHECK_GE(cols, 0);
+  CHECK_GE(ld, cols);
+  CheckIndexRange(cols);
+  CsrMatrix result;
+  result.rows = rows;
+  result.cols = cols;
+  result.row_offsets.reserve(rows + 1);
+  result.row_offsets.push_back(0);
+  for (int64 i = 0; i < rows; ++i) {
+    const float* row = dense + i * ld;
+    for (int64 j = 0; j < cols; ++j) {
+      if (std::abs(row[j]) > threshold) {
+        result.column_indices.push_back(static_cast<int32>(j));
+        result.values.push_back(row[j]);
+      }
+    }
+    result.row_offsets.push_back(result.values.size());
+  }
+  return result;
+}
+
+CsrMatrix CsrFromArray2D(const Array2D<float>& dense, float threshold) {
+  return CsrFromDense(dense.data(), dense.height(), dense.width(),
+                      dense.width(), threshold);
+}
+
+BsrMatrix BsrFromDense(const float* dense, int64 rows, int64 cols, int64 ld,
+                       int64 block_rows, int64 block_cols, float threshold) {
+  CHECK_GE(rows, 0);
+  CHECK_GE(cols, 0);
+  CHECK_GE(ld, cols);
+  CHECK_GE(block_rows, 1);
+  CHECK_GE(block_cols, 1);
+  CheckIndexRange(cols);
+  BsrMatrix result;
+  result.rows = rows;
+  result.cols = cols;
+  result.block_rows = block_rows;
+  result.block_cols = block_cols;
+  const int64 block_row_count = (rows + block_rows - 1) / block_rows;
+  const int64 block_col_count = (cols + block_cols - 1) / block_cols;
+  const int64 block_size = block_rows * block_cols;
+  result.block_row_offsets.reserve(block_row_count + 1);
+  result.block_row_offsets.push_back(0);
+  for (int64 r = 0; r < block_row_count; ++r) {
+    const int64 row0 = r * block_rows;
+    const int64 height = std::min(block_rows, rows - row0);
+    for (int64 bc = 0; bc < block_col_count; ++bc) {
+      const int64 col0 = bc * block_cols;
+      const int64 width = std::min(block_cols, cols - col0);
+      bool keep = false;
+      for (int64 ii = 0; ii < height && !keep; ++ii) {
+        for (int64 jj = 0; jj < width; ++jj) {
+          if (std::abs(dense[(row0 + ii) * ld + col0 + jj]) > threshold) {
+            keep = true;
+            break;
+          }
+        }
+      }
+      if (!keep) {
+        continue;
+      }
+      result.block_column_indices.push_back(static_cast<int32>(bc));
+      result.values.resize(result.values.size() + block_size, 0.0f);
+      float* block = result.values.data() + result.values.size() - block_size;
+      for (int64 ii = 0; ii < height; ++ii) {
+        std::copy(dense + (row0 + ii) * ld + col0,
+                  dense + (row0 + ii) * ld + col0 + width,
+                  block + ii * block_cols);
+      }
+    }
+    result.block_row_offsets.push_back(result.block_column_indices.size());
+  }
+  return result;
+}
+
+BsrMatrix BsrFromArray2D(const Array2D<float>& dense, int64 block_rows,
+                         int64 block_cols, float threshold) {
+  return BsrFromDense(dense.data(), dense.height(), dense.width(),
+                      dense.width(), block_rows, block_cols, threshold);
+}
+
+std::unique_ptr<Array2D<float>> ToArray2D(const CsrMatrix& matrix) {
+  auto result = MakeUnique<Array2D<float>>(matrix.rows, matrix.cols, 0.0f);
+  for (int64 i = 0; i < matrix.rows; ++i) {
+    for (int64 p = matrix.row_offsets[i]; p < matrix.row_offsets[i + 1];
+         ++p) {
+      (*result)(i, matrix.column_indices[p]) = matrix.values[p];
+    }
+  }
+  return result;
+}
+
+std::unique_ptr<Array2D<float>> ToArray2D(const BsrMatrix& matrix) {
+  auto result = MakeUnique<Array2D<float>>(matrix.rows, matrix.cols, 0.0f);
+  const int64 block_size = matrix.block_rows * matrix.block_cols;
+  for (int64 r = 0; r + 1 < static_cast<int64>(matrix.block_row_offsets.size());
+       ++r) {
+    const int64 row0 = r * matrix.block_rows;
+    const int64 height = std::min(matrix.block_rows, matrix.rows - row0);
+    for (int64 k = matrix.block_row_offsets[r];
+         k < matrix.block_row_offsets[r + 1]; ++k) {
+      const int64 col0 = matrix.block_column_indices[k] * matrix.block_cols;
+      const int64 width = std::min(matrix.block_cols, matrix.cols - col0);
+      for (int64 ii = 0; ii < height; ++ii) {
+        for (int64 jj = 0; jj < width; ++jj) {
+          (*result)(row0 + ii, col0 + jj) =
+              matrix.values[k * block_size + ii * matrix.block_cols + jj];
+        }
+      }
+    }
+  }
+  return result;
+}
+
+void SparseDenseMatMul(const CsrMatrix& a, int64 n, const float* b, int64 ldb,
+                       float* c, int64 ldc) {
+  CHECK_GE(n, 0);
+  CHECK_GE(ldb, n);
+  CHECK_GE(ldc, n);
+  const CsrDenseRowsFn rows = CsrDenseRowsKernels().Get();
+  ParallelFor(a.rows, CostPerUnit(a.nnz(), a.rows, n) + n,
+              [&](int64 first, int64 last) {
+                rows(a, first, last, n, b, ldb, c, ldc);
+              });
+}
+
+void SparseDenseMatMul(const BsrMatrix& a, int64 n, const float* b, int64 ldb,
+                       float* c, int64 ldc) {
+  CHECK_GE(n, 0);
+  CHECK_GE(ldb, n);
+  CHECK_GE(ldc, n);
+  const int64 block_row_count = a.block_row_offsets.size() - 1;
+  const BsrDenseRowsFn rows = BsrDenseRowsKernels().Get();
+  ParallelFor(block_row_count,
+              CostPerUnit(a.values.size(), block_row_count, n) +
+                  a.block_rows * n,
+              [&](int64 first, int64 last) {
+                rows(a, first, last, n, b, ldb, c, ldc);
+              });
+}
+
+void DenseSparseMatMul(int64 m, const float* a, int64 lda, const CsrMatrix& b,
+                       float* c, int64 ldc) {
+  CHECK_GE(m, 0);
+  CHECK_GE(lda, b.rows);
+  CHECK_GE(ldc, b.cols);
+  // Scattered updates of single outputs do not vectorize, so there is no
+  // per-instruction-set variant.
+  ParallelFor(m, 2 * b.nnz() + b.cols, [&](int64 first, int64 last) {
+    for (int64 i = first; i < last; ++i) {
+      const float* src = a + i * lda;
+      float* dst = c + i * ldc;
+      std::fill(dst, dst + b.cols, 0.0f);
+      for (int64 p = 0; p < b.rows; ++p) {
+        const float x = src[p];
+        if (x == 0.0f) {
+          continue;
+        }
+        for (int64 q = b.row_offsets[p]; q < b.row_offsets[p + 1]; ++q) {
+          dst[b.column_indices[q]] += x * b.values[q];
+        }
+      }
+    }
+  });
+}
+
+void DenseSparseMatMul(int64 m, const float* a, int64 lda, const BsrMatrix& b,
+                       float* c, int64 ldc) {
+  CHECK_GE(m, 0);
+  CHECK_GE(lda, b.rows);
+  CHECK_GE(ldc, b.cols);
+  const DenseBsrRowsFn rows = DenseBsrRowsKernels().Get();
+  ParallelFor(m, 2 * static_cast<int64>(b.values.size()) + b.cols,
+              [&](int64 first, int64 last) {
+                rows(first, last, a, lda, b, c, ldc);
+              });
+}
+
+}  // namespace sparse
+}  // namespace xla
@@ -0,0 +1,112 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_SPARSE_MATRIX_H_
+#define TENSORFLOW_COMPILER_XLA_SPARSE_MATRIX_H_
+
+// Compressed sparse matrices for pruned weights, and matrix multiplies whose
+// work is proportional to the number of stored values rather than to the
+// dense size.
+//
+// CsrMatrix stores single values, which suits unstructured sparsity. Its
+// sparse x dense product is a sequence of row axpys and vectorizes well; the
+// dense x sparse product scatters into the output one value at a time.
+// BsrMatrix stores dense block_rows x block_cols blocks, so every product
+// runs small dense updates over block_cols contiguous outputs; with
+// block_cols a multiple of the vector width it is the SIMD friendly choice,
+// at the price of storing the zeros inside each kept block.
+
+#include <memory>
+#include <vector>
+
+#include "array2d.h"
+#include "types.h"
+
+namespace xla {
+namespace sparse {
+
+// Compressed sparse row matrix. The values of row i are
+// values[row_offsets[i] .. row_offsets[i + 1]), in increasing column order,
+// at the columns in the same range of column_indices.
+struct CsrMatrix {
+  int64 rows = 0;
+  int64 cols = 0;
+  // rows + 1 entries, starting at 0.
+  std::vector<int64> row_offsets;
+  std::vector<int32> column_indices;
+  std::vector<float> values;
+
+  int64 nnz() const { return values.size(); }
+  // Fraction of the rows x cols entries that are stored.
+  double density() const;
+};
+
+// Block compressed sparse row matrix: CSR over a grid of
+// block_rows x block_cols blocks. Block k covers rows
+// [r * block_rows, (r + 1) * block_rows) for the block row r it is listed
+// in, and columns [block_column_indices[k] * block_cols, ...); its values
+// are values[k * block_rows * block_cols ...), row-major. Blocks on the last
+// block row or column may extend past rows or cols; those entries are zero.
+struct BsrMatrix {
+  int64 rows = 0;
+  int64 cols = 0;
+  int64 block_rows = 1;
+  int64 block_cols = 1;
+  // ceil(rows / block_rows) + 1 entries, starting at 0.
+  std::vector<int64> block_row_offsets;
+  std::vector<int32> block_column_indices;
+  std::vector<float> values;
+
+  int64 num_blocks() const { return block_column_indices.size(); }
+  // Fraction of the rows x cols entries covered by stored blocks.
+  double density() const;
+};
+
+// Compresses the row-major rows x cols matrix dense with row stride ld,
+// dropping the values whose magnitude is at most threshold. A BsrMatrix keeps
+// every block that holds at least one value above threshold.
+CsrMatrix CsrFromDense(const float* dense, int64 rows, int64 cols, int64 ld,
+                       float threshold = 0.0f);
+CsrMatrix CsrFromArray2D(const Array2D<float>& dense, float threshold = 0.0f);
+BsrMatrix BsrFromDense(const float* dense, int64 rows, int64 cols, int64 ld,
+                       int64 block_rows, int64 block_cols,
+                       float threshold = 0.0f);
+BsrMatrix BsrFromArray2D(const Array2D<float>& dense, int64 block_rows,
+                         int64 block_cols, float threshold = 0.0f);
+
+// Returns the dense form of matrix.
+std::unique_ptr<Array2D<float>> ToArray2D(const CsrMatrix& matrix);
+std::unique_ptr<Array2D<float>> ToArray2D(const BsrMatrix& matrix);
+
+// c = a * b for the sparse m x k matrix a and the dense row-major k x n
+// matrix b with row stride ldb; c is m x n with row stride ldc. Rows of c are
+// spread over the intra-op thread pool.
+void SparseDenseMatMul(const CsrMatrix& a, int64 n, const float* b, int64 ldb,
+                       float* c, int64 ldc);
+void SparseDenseMatMul(const BsrMatrix& a, int64 n, const float* b, int64 ldb,
+                       float* c, int64 ldc);
+
+// c = a * b for the dense row-major m x k matrix a with row stride lda and
+// the sparse k x n matrix b; c is m x n with row stride ldc. Zeros of a are
+// skipped too, so sparse activations (e.g. after a ReLU) save work as well.
+void DenseSparseMatMul(int64 m, const float* a, int64 lda, const CsrMatrix& b,
+                       float* c, int64 ldc);
+void DenseSparseMatMul(int64 m, const float* a, int64 lda, const BsrMatrix& b,
+                       float* c, int64 ldc);
+
+}  // namespace sparse
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_SPARSE_MATRIX_H_
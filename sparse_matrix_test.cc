@@ -0,0 +1,248 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "sparse_matrix.h"
+
+#include <cmath>
+#include <vector>
+
+#include "kernel_registry.h"
+#include "reference_util.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+using sparse::BsrMatrix;
+using sparse::CsrMatrix;
+
+class SparseMatrixTest /* : public ::testing::Test */
+{
+public:
+
+   SparseMatrixTest() { run(); }
+
+   void CsrLayout();
+   void BsrLayout();
+   void SparseTimesDense();
+   void DenseTimesSparse();
+   void Strides();
+   void EveryIsaVariant();
+
+   void run();
+};
+
+// A rows x cols matrix in which about density of the entries are non-zero.
+// Whole rows and columns are zero as well when the matrix is large enough.
+Array2D<float> Pruned(int64 rows, int64 cols, double density, int seed)
+{
+   Array2D<float> matrix(rows, cols, 0.0f);
+   for (int64 i = 0; i < rows; ++i) {
+      if (rows > 4 && i % 7 == 3) {
+         continue;
+      }
+      for (int64 j = 0; j < cols; ++j) {
+         const int64 r = (i * 7919 + j * 104729 + seed * 1299709) % 10007;
+         if (r < density * 10007) {
+            matrix(i, j) = static_cast<float>(r % 200) / 100.0f - 1.0f;
+         }
+      }
+   }
+   return matrix;
+}
+
+void ExpectNear(const Array2D<float>& expected, const Array2D<float>& actual)
+{
+   ASSERT_EQ(expected.height(), actual.height());
+   ASSERT_EQ(expected.width(), actual.width());
+   for (int64 i = 0; i < expected.height(); ++i) {
+      for (int64 j = 0; j < expected.width(); ++j) {
+         const float error = std::abs(expected(i, j) - actual(i, j));
+         ASSERT_TRUE(error <= 1e-4f * (1.0f + std::abs(expected(i, j))));
+      }
+   }
+}
+
+void ExpectEqual(const Array2D<float>& expected, const Array2D<float>& actual)
+{
+   ASSERT_EQ(expected.height(), actual.height());
+   ASSERT_EQ(expected.width(), actual.width());
+   for (int64 i = 0; i < expected.height(); ++i) {
+      for (int64 j = 0; j < expected.width(); ++j) {
+         ASSERT_EQ(expected(i, j), actual(i, j));
+      }
+   }
+}
+
+void SparseMatrixTest::CsrLayout()
+{
+   const Array2D<float> dense({{0.0f, 2.0f, 0.0f, -0.5f},
+                               {0.0f, 0.0f, 0.0f, 0.0f},
+                               {1.0f, 0.0f, 0.25f, 3.0f}});
+   const CsrMatrix csr = sparse::CsrFromArray2D(dense);
+   ASSERT_EQ(csr.rows, 3);
+   ASSERT_EQ(csr.cols, 4);
+   ASSERT_EQ(csr.nnz(), 5);
+   ASSERT_TRUE(csr.row_offsets == std::vector<int64>({0, 2, 2, 5}));
+   ASSERT_TRUE(csr.column_indices == std::vector<int32>({1, 3, 0, 2, 3}));
+   ASSERT_TRUE(csr.values ==
+               std::vector<float>({2.0f, -0.5f, 1.0f, 0.25f, 3.0f}));
+   ASSERT_TRUE(std::abs(csr.density() - 5.0 / 12.0) < 1e-12);
+   ExpectEqual(dense, *sparse::ToArray2D(csr));
+
+   // Values at or below the threshold in magnitude are pruned.
+   const CsrMatrix pruned = sparse::CsrFromArray2D(dense, 0.5f);
+   ASSERT_EQ(pruned.nnz(), 3);
+   ASSERT_TRUE(pruned.values == std::vector<float>({2.0f, 1.0f, 3.0f}));
+
+   const CsrMatrix empty = sparse::CsrFromArray2D(Array2D<float>(0, 5));
+   ASSERT_EQ(empty.nnz(), 0);
+   ASSERT_TRUE(empty.row_offsets == std::vector<int64>({0}));
+   ASSERT_EQ(empty.density(), 0.0);
+}
+
+void SparseMatrixTest::BsrLayout()
+{
+   // 5 x 7 in 2 x 4 blocks: a 3 x 2 grid whose last row and column are
+   // partial.
+   Array2D<float> dense(5, 7, 0.0f);
+   dense(0, 1) = 1.0f;
+   dense(3, 6) = 2.0f;
+   dense(4, 0) = 3.0f;
+   dense(4, 5) = 4.0f;
+   const BsrMatrix bsr = sparse::BsrFromArray2D(dense, 2, 4);
+   ASSERT_EQ(bsr.num_blocks(), 4);
+   ASSERT_TRUE(bsr.block_row_offsets == std::vector<int64>({0, 1, 2, 4}));
+   ASSERT_TRUE(bsr.block_column_indices == std::vector<int32>({0, 1, 0, 1}));
+   ASSERT_EQ(static_cast<int64>(bsr.values.size()), 4 * 8);
+   // The second block covers rows 2-3 and columns 4-6 of the matrix.
+   ASSERT_EQ(bsr.values[8 + 1 * 4 + 2], 2.0f);
+   ASSERT_EQ(bsr.values[8 + 1 * 4 + 3], 0.0f);
+   // Full blocks cover 8 entries, the partial ones 6, 4 and 3.
+   ASSERT_TRUE(std::abs(bsr.density() - (8.0 + 6 + 4 + 3) / 35.0) < 1e-12);
+   ExpectEqual(dense, *sparse::ToArray2D(bsr));
+
+   const Array2D<float> pruned = Pruned(37, 29, 0.1, 1);
+   for (int64 block_rows : {1, 3, 4}) {
+      for (int64 block_cols : {1, 8, 16}) {
+         ExpectEqual(pruned, *sparse::ToArray2D(sparse::BsrFromArray2D(
+                                 pruned, block_rows, block_cols)));
+      }
+   }
+}
+
+void SparseMatrixTest::SparseTimesDense()
+{
+   for (double density : {0.0, 0.05, 0.3, 1.0}) {
+      const Array2D<float> a = Pruned(45, 70, density, 2);
+      const Array2D<float> b = Pruned(70, 33, 1.0, 3);
+      const auto expected = MakeMatrixMul(a, b);
+      ExpectNear(*expected,
+                 *ReferenceUtil::MatmulArray2D(sparse::CsrFromArray2D(a), b));
+      ExpectNear(*expected, *ReferenceUtil::MatmulArray2D(
+                                sparse::BsrFromArray2D(a, 4, 1), b));
+      ExpectNear(*expected, *ReferenceUtil::MatmulArray2D(
+                                sparse::BsrFromArray2D(a, 3, 8), b));
+   }
+}
+
+void SparseMatrixTest::DenseTimesSparse()
+{
+   for (double density : {0.0, 0.05, 0.3, 1.0}) {
+      // Half of the activations are zero, as after a ReLU.
+      const Array2D<float> a = Pruned(9, 70, 0.5, 4);
+      const Array2D<float> b = Pruned(70, 45, density, 5);
+      const auto expected = MakeMatrixMul(a, b);
+      ExpectNear(*expected,
+                 *ReferenceUtil::MatmulArray2D(a, sparse::CsrFromArray2D(b)));
+      ExpectNear(*expected, *ReferenceUtil::MatmulArray2D(
+                                a, sparse::BsrFromArray2D(b, 1, 16)));
+      ExpectNear(*expected, *ReferenceUtil::MatmulArray2D(
+                                a, sparse::BsrFromArray2D(b, 4, 8)));
+   }
+}
+
+void SparseMatrixTest::Strides()
+{
+   // Operands and results embedded in wider row-major buffers; the padding
+   // columns must be neither read into the result nor written.
+   const Array2D<float> a = Pruned(6, 10, 0.3, 6);
+   const Array2D<float> b = Pruned(10, 5, 1.0, 7);
+   const auto expected = MakeMatrixMul(a, b);
+   const int64 ld = 9;
+   std::vector<float> b_strided(10 * ld, 1e30f);
+   for (int64 i = 0; i < 10; ++i) {
+      for (int64 j = 0; j < 5; ++j) {
+         b_strided[i * ld + j] = b(i, j);
+      }
+   }
+   for (int variant = 0; variant < 2; ++variant) {
+      std::vector<float> c(6 * ld, -7.0f);
+      if (variant == 0) {
+         sparse::SparseDenseMatMul(sparse::CsrFromArray2D(a), 5,
+                                   b_strided.data(), ld, c.data(), ld);
+      } else {
+         sparse::SparseDenseMatMul(sparse::BsrFromArray2D(a, 2, 4), 5,
+                                   b_strided.data(), ld, c.data(), ld);
+      }
+      Array2D<float> actual(6, 5);
+      for (int64 i = 0; i < 6; ++i) {
+         for (int64 j = 0; j < ld; ++j) {
+            if (j < 5) {
+               actual(i, j) = c[i * ld + j];
+            } else {
+               ASSERT_EQ(c[i * ld + j], -7.0f);
+            }
+         }
+      }
+      ExpectNear(*expected, actual);
+   }
+}
+
+void SparseMatrixTest::EveryIsaVariant()
+{
+   const Array2D<float> a = Pruned(31, 67, 0.15, 8);
+   const Array2D<float> b = Pruned(67, 40, 1.0, 9);
+   const Array2D<float> c = Pruned(40, 31, 0.6, 10);
+   const auto expected_sparse_dense = MakeMatrixMul(a, b);
+   const auto expected_dense_sparse = MakeMatrixMul(c, a);
+   for (int isa = 0; isa < kNumIsas; ++isa) {
+      SetMaxIsa(static_cast<Isa>(isa));
+      ExpectNear(*expected_sparse_dense,
+                 *ReferenceUtil::MatmulArray2D(sparse::CsrFromArray2D(a), b));
+      ExpectNear(*expected_sparse_dense, *ReferenceUtil::MatmulArray2D(
+                                             sparse::BsrFromArray2D(a, 4, 8),
+                                             b));
+      ExpectNear(*expected_dense_sparse,
+                 *ReferenceUtil::MatmulArray2D(c, sparse::CsrFromArray2D(a)));
+      ExpectNear(*expected_dense_sparse, *ReferenceUtil::MatmulArray2D(
+                                             c, sparse::BsrFromArray2D(a, 2,
+                                                                       16)));
+   }
+   SetMaxIsa(static_cast<Isa>(kNumIsas - 1));
+}
+
+void SparseMatrixTest::run()
+{
+   CsrLayout();
+   BsrLayout();
+   SparseTimesDense();
+   DenseTimesSparse();
+   Strides();
+   EveryIsaVariant();
+}
+
+}  // namespace
+}  // namespace xla
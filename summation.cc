@@ -0,0 +1,168 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "summation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "intra_op_thread_pool.h"
+#include "logging.h"
+#include "simd_kernels.h"
+
+namespace xla {
+namespace {
+
+std::atomic<int> default_summation(static_cast<int>(Summation::kFast));
+
+// Leaves of the pairwise tree: runs of at most kPairwiseLeaf values are
+// summed in kLanes interleaved accumulators.
+constexpr int64 kPairwiseLeaf = 128;
+constexpr int kLanes = 8;
+
+// Block size of ParallelSum. A power-of-two multiple of kPairwiseLeaf, so
+// that the blocks are whole subtrees of the pairwise tree.
+constexpr int64 kBlock = 1 << 14;
+static_assert(kBlock % kPairwiseLeaf == 0 &&
+                  ((kBlock / kPairwiseLeaf) & (kBlock / kPairwiseLeaf - 1)) ==
+                      0,
+              "blocks must be subtrees of the pairwise tree");
+
+float LeafSum(const float* values, int64 n) {
+  float lanes[kLanes] = {};
+  int64 i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    for (int k = 0; k < kLanes; ++k) {
+      lanes[k] += values[i + k];
+    }
+  }
+  float sum = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+              ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+  for (; i < n; ++i) {
+    sum += values[i];
+  }
+  return sum;
+}
+
+// Returns the largest power of two times unit that is smaller than n > unit:
+// where the pairwise tree over n values splits.
+int64 PairwiseSplit(int64 n, int64 unit) {
+  int64 split = unit;
+  while (2 * split < n) {
+    split *= 2;
+  }
+  return split;
+}
+
+// Pairwise sum of the block partials, split like the values they cover.
+float TreeSum(const float* partials, int64 n) {
+  if (n == 1) {
+    return partials[0];
+  }
+  const int64 split = PairwiseSplit(n, 1);
+  return TreeSum(partials, split) + TreeSum(partials + split, n - split);
+}
+
+CompensatedSum CompensatedBlock(const float* values, int64 n) {
+  // Interleaved lanes hide the latency of the dependent adds.
+  CompensatedSum lanes[kLanes];
+  int64 i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    for (int k = 0; k < kLanes; ++k) {
+      lanes[k].Add(values[i + k]);
+    }
+  }
+  for (; i < n; ++i) {
+    lanes[0].Add(values[i]);
+  }
+  for (int k = 1; k < kLanes; ++k) {
+    lanes[0].Add(lanes[k]);
+  }
+  return lanes[0];
+}
+
+}  // namespace
+
+void SetSummation(Summation summation) {
+  default_summation.store(static_cast<int>(summation),
+                          std::memory_order_relaxed);
+}
+
+Summation DefaultSummation() {
+  return static_cast<Summation>(
+      default_summation.load(std::memory_order_relaxed));
+}
+
+float PairwiseSum(const float* values, int64 n) {
+  if (n <= kPairwiseLeaf) {
+    return LeafSum(values, n);
+  }
+  const int64 split = PairwiseSplit(n, kPairwiseLeaf);
+  return PairwiseSum(values, split) + PairwiseSum(values + split, n - split);
+}
+
+void CompensatedSum::Add(const float* values, int64 n) {
+  for (int64 first = 0; first < n; first += kBlock) {
+    Add(CompensatedBlock(values + first, std::min(kBlock, n - first)));
+  }
+}
+
+float ParallelSum(const float* values, int64 n, Summation summation) {
+  CHECK_GE(n, 0);
+  switch (summation) {
+    case Summation::kFast:
+      return ParallelReduce(
+          n, kBlock, 1, 0.0f,
+          [values](int64 first, int64 last) {
+            return simd::Sum(values + first, last - first);
+          },
+          [](float sum, float partial) { return sum + partial; });
+    case Summation::kPairwise: {
+      if (n <= kBlock) {
+        return PairwiseSum(values, n);
+      }
+      // The blocks are the subtrees below the top levels of the tree, which
+      // TreeSum then rebuilds over their partials.
+      std::vector<float> partials((n + kBlock - 1) / kBlock);
+      ParallelFor(partials.size(), kBlock, [&](int64 first, int64 last) {
+        for (int64 b = first; b < last; ++b) {
+          const int64 first_value = b * kBlock;
+          partials[b] = PairwiseSum(values + first_value,
+                                    std::min(kBlock, n - first_value));
+        }
+      });
+      return TreeSum(partials.data(), partials.size());
+    }
+    case Summation::kCompensated:
+      return ParallelReduce(
+                 n, kBlock, 4, CompensatedSum(),
+                 [values](int64 first, int64 last) {
+                   return CompensatedBlock(values + first, last - first);
+                 },
+                 [](CompensatedSum sum, const CompensatedSum& partial) {
+                   sum.Add(partial);
+                   return sum;
+                 })
+          .value();
+  }
+  LOG(FATAL) << "unknown summation";
+}
+
+float ParallelSum(const float* values, int64 n) {
+  return ParallelSum(values, n, DefaultSummation());
+}
+
+}  // namespace xla
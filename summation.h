@@ -0,0 +1,96 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_SUMMATION_H_
+#define TENSORFLOW_COMPILER_XLA_SUMMATION_H_
+
+// Float summation with a selectable trade-off between speed and
+// reproducibility. Every mode splits long arrays into fixed blocks, so no
+// result depends on the intra-op thread count; the modes differ in whether it
+// also survives a change of instruction set, and in how the rounding error
+// grows with the number of values n.
+
+#include <cmath>
+
+#include "types.h"
+
+namespace xla {
+
+enum class Summation {
+  // Blocks are summed by simd::Sum in the vector lanes of the widest
+  // instruction set the host supports, so results may differ between
+  // machines. Error grows as O(n).
+  kFast,
+  // Pairwise (cascade) summation in portable code: the same bits on every
+  // machine, for any thread count. Error grows as O(log n).
+  kPairwise,
+  // Neumaier's compensated summation in portable code: the same bits on
+  // every machine, for any thread count, and an error that does not grow
+  // with n, at a few times the cost of kPairwise.
+  kCompensated,
+};
+
+// Selects the mode of ParallelSum(values, n), and through it of xla::Sum,
+// the ReferenceUtil sums and means and the kSum and kMean ReduceDimensions.
+// The default is kFast. Must not be called concurrently with running ops.
+void SetSummation(Summation summation);
+
+// Returns the current mode.
+Summation DefaultSummation();
+
+// Returns the sum of the n values, spread over the intra-op thread pool.
+float ParallelSum(const float* values, int64 n, Summation summation);
+float ParallelSum(const float* values, int64 n);
+
+// Sequential pairwise sum, bit-identical to ParallelSum(values, n,
+// Summation::kPairwise).
+float PairwiseSum(const float* values, int64 n);
+
+// Running Neumaier sum: a float sum and the rounding error lost so far.
+// Adding the same values in the same order gives the same bits on every
+// machine.
+class CompensatedSum {
+ public:
+  void Add(float value) {
+    const float sum = sum_ + value;
+    // The low-order bits of whichever operand is smaller in magnitude are
+    // the ones the addition dropped.
+    const bool larger = std::abs(sum_) >= std::abs(value);
+    const float big = larger ? sum_ : value;
+    const float small = larger ? value : sum_;
+    compensation_ += (big - sum) + small;
+    sum_ = sum;
+  }
+
+  // Adds the n values in the blocks ParallelSum uses, so that a sum built
+  // from whole arrays matches ParallelSum(values, n, kCompensated).
+  void Add(const float* values, int64 n);
+
+  // Merges other, the sum of later values, into this one.
+  void Add(const CompensatedSum& other) {
+    Add(other.sum_);
+    compensation_ += other.compensation_;
+  }
+
+  float value() const { return sum_ + compensation_; }
+
+ private:
+  float sum_ = 0.0f;
+  float compensation_ = 0.0f;
+};
+
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_SUMMATION_H_
@@ -0,0 +1,180 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "summation.h"
+
+#include <cmath>
+#include <vector>
+
+#include "array1d.h"
+#include "intra_op_thread_pool.h"
+#include "kernel_registry.h"
+#include "reduction.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+class SummationTest /* : public ::testing::Test */
+{
+public:
+
+   SummationTest() { run(); }
+
+   void SequentialMatchesParallel();
+   void IndependentOfThreadsAndIsa();
+   void CompensationRecoversCancellation();
+   void ReductionsFollowMode();
+
+   void run();
+};
+
+const Summation kSummations[] = {Summation::kFast, Summation::kPairwise,
+                                 Summation::kCompensated};
+
+// Values between 0.1 and about 100, none of them exactly representable.
+std::vector<float> Values(int64 n)
+{
+   std::vector<float> values(n);
+   for (int64 i = 0; i < n; ++i) {
+      values[i] = 0.1f * static_cast<float>(1 + (i * 7919) % 997);
+   }
+   return values;
+}
+
+double DoubleSum(const float* values, int64 n)
+{
+   double sum = 0.0;
+   for (int64 i = 0; i < n; ++i) {
+      sum += values[i];
+   }
+   return sum;
+}
+
+void SummationTest::SequentialMatchesParallel()
+{
+   const std::vector<float> values = Values(5 * (1 << 14) + 17);
+   for (int64 n : {0, 1, 7, 128, 129, 1000, (1 << 14) - 1, 1 << 14,
+                   (1 << 14) + 1, 3 * (1 << 14), 5 * (1 << 14) + 17}) {
+      ASSERT_EQ(PairwiseSum(values.data(), n),
+                ParallelSum(values.data(), n, Summation::kPairwise));
+      CompensatedSum sum;
+      sum.Add(values.data(), n);
+      ASSERT_EQ(sum.value(),
+                ParallelSum(values.data(), n, Summation::kCompensated));
+   }
+}
+
+void SummationTest::IndependentOfThreadsAndIsa()
+{
+   const std::vector<float> values = Values(1000003);
+   const double exact = DoubleSum(values.data(), values.size());
+   for (Summation summation : kSummations) {
+      std::vector<float> results;
+      for (int i = 0; i < kNumIsas; ++i) {
+         const Isa isa = static_cast<Isa>(i);
+         if (!IsaSupported(isa)) {
+            continue;
+         }
+         SetMaxIsa(isa);
+         for (int threads : {1, 2, 3}) {
+            SetIntraOpThreadCount(threads);
+            results.push_back(
+                ParallelSum(values.data(), values.size(), summation));
+            if (summation == Summation::kFast) {
+               // The fast mode is only tied to the thread count.
+               ASSERT_EQ(results[results.size() - 1],
+                         results[results.size() - 1 - (threads - 1)]);
+            } else {
+               ASSERT_EQ(results[0], results.back());
+            }
+         }
+      }
+      SetMaxIsa(static_cast<Isa>(kNumIsas - 1));
+      SetIntraOpThreadCount(0);
+      const double error = std::abs(results.back() - exact) / exact;
+      if (summation == Summation::kCompensated) {
+         // Correctly rounded up to the final addition.
+         ASSERT_TRUE(error <= 1.2e-7);
+      } else {
+         ASSERT_TRUE(error <= 1e-6);
+      }
+   }
+}
+
+void SummationTest::CompensationRecoversCancellation()
+{
+   // A plain float sum loses every 1 against 1e8 and returns 0.
+   std::vector<float> values;
+   for (int i = 0; i < 1000; ++i) {
+      values.push_back(1e8f);
+      values.push_back(1.0f);
+      values.push_back(-1e8f);
+   }
+   ASSERT_EQ(1000.0f, ParallelSum(values.data(), values.size(),
+                                  Summation::kCompensated));
+}
+
+void SummationTest::ReductionsFollowMode()
+{
+   const std::vector<int64> dimensions = {37, 3000};
+   const std::vector<float> input = Values(37 * 3000);
+   for (Summation summation : kSummations) {
+      SetSummation(summation);
+      ASSERT_EQ(ParallelSum(input.data(), input.size(), summation),
+                Sum<float>(input));
+      std::vector<std::vector<float>> results;
+      for (int threads : {1, 3}) {
+         SetIntraOpThreadCount(threads);
+         std::vector<float> all(1), rows(37), columns(3000);
+         ReduceDimensions(ReduceOp::kSum, input.data(), dimensions, {0, 1},
+                          all.data());
+         ASSERT_EQ(Sum<float>(input), all[0]);
+         ReduceDimensions(ReduceOp::kSum, input.data(), dimensions, {1},
+                          rows.data());
+         ReduceDimensions(ReduceOp::kMean, input.data(), dimensions, {0},
+                          columns.data());
+         for (int64 i = 0; i < 37; ++i) {
+            const double exact = DoubleSum(input.data() + i * 3000, 3000);
+            ASSERT_TRUE(std::abs(rows[i] - exact) <= 1e-6 * exact);
+         }
+         for (int64 j = 0; j < 3000; ++j) {
+            double exact = 0.0;
+            for (int64 i = 0; i < 37; ++i) {
+               exact += input[i * 3000 + j];
+            }
+            exact /= 37;
+            ASSERT_TRUE(std::abs(columns[j] - exact) <= 1e-6 * exact);
+         }
+         all.insert(all.end(), rows.begin(), rows.end());
+         all.insert(all.end(), columns.begin(), columns.end());
+         results.push_back(all);
+      }
+      ASSERT_EQ(results[0], results[1]);
+   }
+   SetIntraOpThreadCount(0);
+   SetSummation(Summation::kFast);
+}
+
+void SummationTest::run()
+{
+   SequentialMatchesParallel();
+   IndependentOfThreadsAndIsa();
+   CompensationRecoversCancellation();
+   ReductionsFollowMode();
+}
+
+}  // namespace
+}  // namespace xla
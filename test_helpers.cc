@@ -14,6 +14,11 @@ limitations under the License.
 ==============================================================================*/
 
 #include "test_helpers.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "array4d.h"
 #include "types.h"
 
 #include "default_logging.h"
@@ -69,6 +74,20 @@ AssertionResult AssertionFailure() { return AssertionResult(false); }
 
 AssertionResult AssertionSuccess() { return AssertionResult(true); }
 
+float RelativeMaxError(const Array4D<float>& expected,
+                       const Array4D<float>& actual)
+{
+  CHECK_EQ(expected.num_elements(), actual.num_elements());
+  float max_error = 0.0f;
+  float max_value = 0.0f;
+  for (int64 i = 0; i < expected.num_elements(); ++i) {
+    max_error = std::max(max_error,
+                         std::abs(expected.flatten()[i] - actual.flatten()[i]));
+    max_value = std::max(max_value, std::abs(expected.flatten()[i]));
+  }
+  return max_value == 0.0f ? max_error : max_error / max_value;
+}
+
 // TODO:
 //std::function<bool(tensorflow::StringPiece)> ContainsRegex(
 //    const tensorflow::StringPiece regex) 
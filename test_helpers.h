@@ -70,6 +70,8 @@ class Status;
 namespace xla {
 template <typename T>
 class Array2D;
+template <typename T>
+class Array4D;
 //class Literal;
 
 namespace testing {
@@ -365,6 +367,11 @@ std::vector<T> Array2DToVec(const Array2D<T>& a) {
   return std::vector<T>(a.data(), a.data() + a.num_elements());
 }
 
+// Largest absolute difference between the arrays, relative to the largest
+// magnitude in expected (absolute when expected is all zeros).
+float RelativeMaxError(const Array4D<float>& expected,
+                       const Array4D<float>& actual);
+
 namespace internal_status {
 inline const ::tensorflow::Status& GetStatus(
     const ::tensorflow::Status& status) {
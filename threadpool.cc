@@ -0,0 +1,255 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "logging.h"
+
+namespace tensorflow {
+namespace thread {
+
+namespace {
+
+// Identifies the pool (and the worker index within it) that owns the current
+// thread, if any.
+thread_local const void* current_pool = nullptr;
+thread_local int current_thread_id = -1;
+
+// Set while the current thread is executing ParallelFor blocks; nested
+// ParallelFor calls then run inline instead of fanning out again.
+thread_local bool in_parallel_for = false;
+
+// A half-open run [begin, end) of block indices packed into one 64-bit word so
+// that the owner (popping the front) and thieves (popping the back) can both
+// claim blocks with a single compare-and-swap.
+class BlockRun {
+ public:
+  void Reset(uint32 begin, uint32 end) {
+    bounds_.store(Pack(begin, end), std::memory_order_relaxed);
+  }
+
+  // Claims the first unclaimed block of the run. Returns false when the run is
+  // exhausted.
+  bool PopFront(int64* block) {
+    uint64 bounds = bounds_.load(std::memory_order_relaxed);
+    while (Begin(bounds) < End(bounds)) {
+      if (bounds_.compare_exchange_weak(bounds,
+                                        Pack(Begin(bounds) + 1, End(bounds)),
+                                        std::memory_order_acq_rel)) {
+        *block = Begin(bounds);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Claims the last unclaimed block of the run. Returns false when the run is
+  // exhausted.
+  bool PopBack(int64* block) {
+    uint64 bounds = bounds_.load(std::memory_order_relaxed);
+    while (Begin(bounds) < End(bounds)) {
+      if (bounds_.compare_exchange_weak(bounds,
+                                        Pack(Begin(bounds), End(bounds) - 1),
+                                        std::memory_order_acq_rel)) {
+        *block = End(bounds) - 1;
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  static uint64 Pack(uint32 begin, uint32 end) {
+    return (static_cast<uint64>(begin) << 32) | end;
+  }
+  static uint32 Begin(uint64 bounds) { return bounds >> 32; }
+  static uint32 End(uint64 bounds) { return bounds & 0xFFFFFFFFu; }
+
+  std::atomic<uint64> bounds_{0};
+};
+
+// State shared between the caller of ParallelFor and the helper tasks it
+// schedules. Helpers hold a reference so that a helper which starts after all
+// blocks are done can still inspect the (exhausted) runs safely.
+struct ParallelForState {
+  ParallelForState(int64 total, int64 block_size, int64 num_blocks,
+                   int num_participants,
+                   const std::function<void(int64, int64)>& fn)
+      : total(total),
+        block_size(block_size),
+        runs(num_participants),
+        pending(num_blocks),
+        fn(fn) {}
+
+  const int64 total;
+  const int64 block_size;
+  std::vector<BlockRun> runs;
+  std::atomic<int64> pending;
+  const std::function<void(int64, int64)>& fn;
+
+  std::mutex mu;
+  std::condition_variable done_cv;
+  bool done = false;
+
+  void RunBlock(int64 block) {
+    const int64 first = block * block_size;
+    fn(first, std::min(total, first + block_size));
+    if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      std::lock_guard<std::mutex> lock(mu);
+      done = true;
+      done_cv.notify_all();
+    }
+  }
+
+  // Drains the participant's own run front to back, then steals from the
+  // back of the other runs.
+  void Participate(int participant) {
+    const bool was_in_parallel_for = in_parallel_for;
+    in_parallel_for = true;
+    int64 block;
+    while (runs[participant].PopFront(&block)) {
+      RunBlock(block);
+    }
+    const int num_runs = static_cast<int>(runs.size());
+    for (int i = 1; i < num_runs; ++i) {
+      BlockRun& victim = runs[(participant + i) % num_runs];
+      while (victim.PopBack(&block)) {
+        RunBlock(block);
+      }
+    }
+    in_parallel_for = was_in_parallel_for;
+  }
+};
+
+}  // namespace
+
+struct ThreadPool::Impl {
+  Impl(const string& name, int num_threads) : name(name) {
+    threads.reserve(num_threads);
+    for (int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([this, i]() { WorkerLoop(i); });
+    }
+  }
+
+  ~Impl() {
+    {
+      std::lock_guard<std::mutex> lock(mu);
+      stopping = true;
+    }
+    work_cv.notify_all();
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  }
+
+  void Schedule(std::function<void()> fn) {
+    {
+      std::lock_guard<std::mutex> lock(mu);
+      queue.push_back(std::move(fn));
+    }
+    work_cv.notify_one();
+  }
+
+  void WorkerLoop(int id) {
+    current_pool = this;
+    current_thread_id = id;
+    for (;;) {
+      std::function<void()> fn;
+      {
+        std::unique_lock<std::mutex> lock(mu);
+        work_cv.wait(lock, [this]() { return stopping || !queue.empty(); });
+        if (queue.empty()) {
+          return;
+        }
+        fn = std::move(queue.front());
+        queue.pop_front();
+      }
+      fn();
+    }
+  }
+
+  const string name;
+  std::vector<std::thread> threads;
+  std::mutex mu;
+  std::condition_variable work_cv;
+  std::deque<std::function<void()>> queue;
+  bool stopping = false;
+};
+
+ThreadPool::ThreadPool(const string& name, int num_threads) {
+  CHECK_GE(num_threads, 1);
+  impl_.reset(new Impl(name, num_threads));
+}
+
+ThreadPool::~ThreadPool() {}
+
+void ThreadPool::Schedule(std::function<void()> fn) {
+  CHECK(fn != nullptr);
+  impl_->Schedule(std::move(fn));
+}
+
+void ThreadPool::ParallelFor(int64 total, int64 block_size,
+                             const std::function<void(int64, int64)>& fn) {
+  CHECK_GE(total, 0);
+  CHECK_GE(block_size, 1);
+  if (total == 0) {
+    return;
+  }
+  const int64 num_blocks = (total + block_size - 1) / block_size;
+  CHECK_LE(num_blocks, static_cast<int64>(kuint32max));
+
+  const int num_participants = static_cast<int>(
+      std::min<int64>(NumThreads() + 1, num_blocks));
+  if (num_participants <= 1 || in_parallel_for || CurrentThreadId() >= 0) {
+    for (int64 first = 0; first < total; first += block_size) {
+      fn(first, std::min(total, first + block_size));
+    }
+    return;
+  }
+
+  auto state = std::make_shared<ParallelForState>(
+      total, block_size, num_blocks, num_participants, fn);
+  for (int p = 0; p < num_participants; ++p) {
+    state->runs[p].Reset(
+        static_cast<uint32>(num_blocks * p / num_participants),
+        static_cast<uint32>(num_blocks * (p + 1) / num_participants));
+  }
+  for (int p = 1; p < num_participants; ++p) {
+    impl_->Schedule([state, p]() { state->Participate(p); });
+  }
+  state->Participate(0);
+
+  std::unique_lock<std::mutex> lock(state->mu);
+  state->done_cv.wait(lock, [&state]() { return state->done; });
+}
+
+int ThreadPool::NumThreads() const {
+  return static_cast<int>(impl_->threads.size());
+}
+
+int ThreadPool::CurrentThreadId() const {
+  return current_pool == impl_.get() ? current_thread_id : -1;
+}
+
+}  // namespace thread
+}  // namespace tensorflow
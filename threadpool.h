@@ -0,0 +1,72 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_LIB_CORE_THREADPOOL_H_
+#define TENSORFLOW_CORE_LIB_CORE_THREADPOOL_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "macros.h"
+#include "types.h"
+
+namespace tensorflow {
+namespace thread {
+
+// A fixed-size pool of worker threads.
+class ThreadPool {
+ public:
+  // Constructs a pool with "num_threads" worker threads. "name" is used for
+  // diagnostics only. num_threads must be at least 1.
+  ThreadPool(const string& name, int num_threads);
+
+  // Waits until all scheduled work has finished and then destroys the set of
+  // threads.
+  ~ThreadPool();
+
+  // Schedules fn() for execution in the pool of threads.
+  void Schedule(std::function<void()> fn);
+
+  // Runs fn(first, last) over every block of [0, total), where blocks are
+  // block_size units long (the last one may be shorter), and returns once all
+  // blocks have run.
+  //
+  // The calling thread participates. Blocks are dealt out as one contiguous
+  // run per participant; a participant that finishes its run steals blocks
+  // from the tail of the other runs, so uneven block costs still balance.
+  // Calls made from inside a pool thread, or from inside another ParallelFor,
+  // run inline on the calling thread to avoid deadlocking on the pool.
+  void ParallelFor(int64 total, int64 block_size,
+                   const std::function<void(int64, int64)>& fn);
+
+  // Returns the number of worker threads in the pool.
+  int NumThreads() const;
+
+  // Returns the index in [0, NumThreads()) of the current thread if it is a
+  // worker of this pool, and -1 otherwise.
+  int CurrentThreadId() const;
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace thread
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_LIB_CORE_THREADPOOL_H_
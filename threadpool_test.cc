@@ -0,0 +1,179 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "threadpool.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "array2d.h"
+#include "array4d.h"
+#include "intra_op_thread_pool.h"
+#include "reference_util.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+// Tests the thread pool and the intra-op ParallelFor / ParallelReduce built
+// on it.
+class ThreadPoolTest /* : public ::testing::Test */
+{
+public:
+
+   ThreadPoolTest() { run(); }
+
+   void ParallelForCoversEveryUnitOnce();
+   void NestedParallelForRunsInline();
+   void ScheduleRunsEveryClosure();
+   void IntraOpThreadCountIsConfigurable();
+   void ParallelReduceIsThreadCountInvariant();
+   void KernelsAreThreadCountInvariant();
+
+   void run();
+};
+
+void ThreadPoolTest::ParallelForCoversEveryUnitOnce()
+{
+   tensorflow::thread::ThreadPool pool("test", 3);
+   ASSERT_EQ(3, pool.NumThreads());
+   ASSERT_EQ(-1, pool.CurrentThreadId());
+   for (int64 block_size : {1, 7, 64, 1000}) {
+      std::vector<std::atomic<int>> visits(999);
+      for (auto& visit : visits) {
+         visit = 0;
+      }
+      pool.ParallelFor(visits.size(), block_size, [&](int64 first, int64 last) {
+         ASSERT_TRUE(last - first <= block_size);
+         for (int64 i = first; i < last; ++i) {
+            ++visits[i];
+         }
+      });
+      for (auto& visit : visits) {
+         ASSERT_EQ(1, visit.load());
+      }
+   }
+}
+
+void ThreadPoolTest::NestedParallelForRunsInline()
+{
+   tensorflow::thread::ThreadPool pool("test", 2);
+   std::atomic<int64> total(0);
+   pool.ParallelFor(8, 1, [&](int64 first, int64 last) {
+      for (int64 i = first; i < last; ++i) {
+         // The inner loop must not wait on the (busy) pool.
+         pool.ParallelFor(100, 1, [&](int64 inner_first, int64 inner_last) {
+            total += inner_last - inner_first;
+         });
+      }
+   });
+   ASSERT_EQ(800, total.load());
+}
+
+void ThreadPoolTest::ScheduleRunsEveryClosure()
+{
+   std::atomic<int> count(0);
+   {
+      tensorflow::thread::ThreadPool pool("test", 4);
+      for (int i = 0; i < 100; ++i) {
+         pool.Schedule([&count]() {
+            ++count;
+         });
+      }
+      // The destructor drains the queue.
+   }
+   ASSERT_EQ(100, count.load());
+}
+
+void ThreadPoolTest::IntraOpThreadCountIsConfigurable()
+{
+   SetIntraOpThreadCount(3);
+   ASSERT_EQ(3, IntraOpThreadCount());
+   SetIntraOpThreadCount(1);
+   ASSERT_EQ(1, IntraOpThreadCount());
+   SetIntraOpThreadCount(0);
+   ASSERT_TRUE(IntraOpThreadCount() >= 1);
+}
+
+void ThreadPoolTest::ParallelReduceIsThreadCountInvariant()
+{
+   Array2D<float> values(1, 100003);
+   values.FillRandom(1000.0f, 0.0, 11);
+   const float* data = values.data();
+   auto sum = [&]() {
+      return ParallelReduce(
+          values.num_elements(), 1024, 1, 0.0f,
+          [&](int64 first, int64 last) {
+             float partial = 0.0f;
+             for (int64 i = first; i < last; ++i) {
+                partial += data[i];
+             }
+             return partial;
+          },
+          [](float a, float b) { return a + b; });
+   };
+
+   SetIntraOpThreadCount(1);
+   const float expected = sum();
+   for (int threads : {2, 3, 8}) {
+      SetIntraOpThreadCount(threads);
+      ASSERT_TRUE(sum() == expected);
+   }
+   SetIntraOpThreadCount(0);
+}
+
+void ThreadPoolTest::KernelsAreThreadCountInvariant()
+{
+   Array4D<float> input(2, 5, 23, 19);
+   Array4D<float> kernel(7, 5, 3, 3);
+   input.FillRandom(1.0f, 0.0f);
+   kernel.FillRandom(1.0f, 0.0f);
+   Array2D<float> lhs(150, 300);
+   Array2D<float> rhs(300, 170);
+   lhs.FillRandom(1.0f, 0.0, 12);
+   rhs.FillRandom(1.0f, 0.0, 13);
+
+   SetIntraOpThreadCount(1);
+   auto expected_conv =
+       ReferenceUtil::Conv4D(input, kernel, {1, 1}, Padding::kSame);
+   auto expected_matmul = ReferenceUtil::MatmulArray2D(lhs, rhs);
+   auto expected_pool = ReferenceUtil::ReduceWindow4DAdd(
+       input, 0.0f, {1, 1, 3, 3}, {1, 1, 2, 2}, Padding::kValid);
+
+   SetIntraOpThreadCount(4);
+   auto conv = ReferenceUtil::Conv4D(input, kernel, {1, 1}, Padding::kSame);
+   auto matmul = ReferenceUtil::MatmulArray2D(lhs, rhs);
+   auto pool = ReferenceUtil::ReduceWindow4DAdd(
+       input, 0.0f, {1, 1, 3, 3}, {1, 1, 2, 2}, Padding::kValid);
+   SetIntraOpThreadCount(0);
+
+   ASSERT_TRUE(expected_conv->flatten() == conv->flatten());
+   ASSERT_TRUE(expected_matmul->flatten() == matmul->flatten());
+   ASSERT_TRUE(expected_pool->flatten() == pool->flatten());
+}
+
+void ThreadPoolTest::run()
+{
+   ParallelForCoversEveryUnitOnce();
+   NestedParallelForRunsInline();
+   ScheduleRunsEveryClosure();
+   IntraOpThreadCountIsConfigurable();
+   ParallelReduceIsThreadCountInvariant();
+   KernelsAreThreadCountInvariant();
+}
+
+}  // namespace
+}  // namespace xla
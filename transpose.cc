@@ -0,0 +1,368 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "transpose.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "intra_op_thread_pool.h"
+#include "kernel_registry.h"
+#include "logging.h"
+
+#if defined(__SSE2__) || defined(XLA_HAS_TARGET_ATTRIBUTES)
+#include <immintrin.h>
+#endif
+
+namespace xla {
+namespace {
+
+// Largest tile, in bytes, transposed without further splitting: its source
+// and destination together stay well inside L1.
+constexpr int64 kLeafBytes = 4096;
+
+// Rows of one transpose handed to a thread at a time.
+constexpr int64 kBandRows = 64;
+
+// Transposes the rows x cols tile src into dst: dst[j * dst_ld + i] =
+// src[i * src_ld + j]. Strides are in elements of element_size bytes.
+using TileFn = void (*)(const char* src, int64 src_ld, char* dst,
+                        int64 dst_ld, int64 rows, int64 cols,
+                        int64 element_size);
+
+template <typename T>
+XLA_ALWAYS_INLINE void ScalarTile(const T* src, int64 src_ld, T* dst,
+                                  int64 dst_ld, int64 rows, int64 cols) {
+  for (int64 j = 0; j < cols; ++j) {
+    for (int64 i = 0; i < rows; ++i) {
+      dst[j * dst_ld + i] = src[i * src_ld + j];
+    }
+  }
+}
+
+template <typename T>
+void TypedTile(const char* src, int64 src_ld, char* dst, int64 dst_ld,
+               int64 rows, int64 cols, int64 element_size) {
+  ScalarTile(reinterpret_cast<const T*>(src), src_ld,
+             reinterpret_cast<T*>(dst), dst_ld, rows, cols);
+}
+
+// Elements of any other size, e.g. whole rows once the innermost dimension
+// is known not to move.
+void BytesTile(const char* src, int64 src_ld, char* dst, int64 dst_ld,
+               int64 rows, int64 cols, int64 element_size) {
+  for (int64 i = 0; i < rows; ++i) {
+    for (int64 j = 0; j < cols; ++j) {
+      std::memcpy(dst + (j * dst_ld + i) * element_size,
+                  src + (i * src_ld + j) * element_size, element_size);
+    }
+  }
+}
+
+// 4-byte elements are moved through float registers; loads, shuffles and
+// stores keep every bit pattern, NaNs included.
+#if defined(__SSE2__)
+void Tile32Baseline(const char* src_bytes, int64 src_ld, char* dst_bytes,
+                    int64 dst_ld, int64 rows, int64 cols,
+                    int64 element_size) {
+  const float* src = reinterpret_cast<const float*>(src_bytes);
+  float* dst = reinterpret_cast<float*>(dst_bytes);
+  const int64 rows4 = rows - rows % 4;
+  const int64 cols4 = cols - cols % 4;
+  for (int64 i = 0; i < rows4; i += 4) {
+    for (int64 j = 0; j < cols4; j += 4) {
+      const float* s = src + i * src_ld + j;
+      __m128 r0 = _mm_loadu_ps(s);
+      __m128 r1 = _mm_loadu_ps(s + src_ld);
+      __m128 r2 = _mm_loadu_ps(s + 2 * src_ld);
+      __m128 r3 = _mm_loadu_ps(s + 3 * src_ld);
+      _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+      float* d = dst + j * dst_ld + i;
+      _mm_storeu_ps(d, r0);
+      _mm_storeu_ps(d + dst_ld, r1);
+      _mm_storeu_ps(d + 2 * dst_ld, r2);
+      _mm_storeu_ps(d + 3 * dst_ld, r3);
+    }
+  }
+  ScalarTile(src + cols4, src_ld, dst + cols4 * dst_ld, dst_ld, rows4,
+             cols - cols4);
+  ScalarTile(src + rows4 * src_ld, src_ld, dst + rows4, dst_ld, rows - rows4,
+             cols);
+}
+#else
+void Tile32Baseline(const char* src, int64 src_ld, char* dst, int64 dst_ld,
+                    int64 rows, int64 cols, int64 element_size) {
+  TypedTile<uint32>(src, src_ld, dst, dst_ld, rows, cols, element_size);
+}
+#endif  // __SSE2__
+
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+XLA_TARGET_AVX2 void Tile32Avx2(const char* src_bytes, int64 src_ld,
+                                char* dst_bytes, int64 dst_ld, int64 rows,
+                                int64 cols, int64 element_size) {
+  const float* src = reinterpret_cast<const float*>(src_bytes);
+  float* dst = reinterpret_cast<float*>(dst_bytes);
+  const int64 rows8 = rows - rows % 8;
+  const int64 cols8 = cols - cols % 8;
+  for (int64 i = 0; i < rows8; i += 8) {
+    for (int64 j = 0; j < cols8; j += 8) {
+      const float* s = src + i * src_ld + j;
+      const __m256 r0 = _mm256_loadu_ps(s);
+      const __m256 r1 = _mm256_loadu_ps(s + src_ld);
+      const __m256 r2 = _mm256_loadu_ps(s + 2 * src_ld);
+      const __m256 r3 = _mm256_loadu_ps(s + 3 * src_ld);
+      const __m256 r4 = _mm256_loadu_ps(s + 4 * src_ld);
+      const __m256 r5 = _mm256_loadu_ps(s + 5 * src_ld);
+      const __m256 r6 = _mm256_loadu_ps(s + 6 * src_ld);
+      const __m256 r7 = _mm256_loadu_ps(s + 7 * src_ld);
+      // Interleave pairs of rows, then pairs of pairs; every 128-bit lane
+      // then holds a 4x4 transpose, and the lanes are swapped into place.
+      const __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+      const __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+      const __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+      const __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+      const __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+      const __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+      const __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+      const __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+      const __m256 u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+      const __m256 u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+      const __m256 u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+      const __m256 u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+      const __m256 u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+      const __m256 u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+      const __m256 u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+      const __m256 u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+      float* d = dst + j * dst_ld + i;
+      _mm256_storeu_ps(d, _mm256_permute2f128_ps(u0, u4, 0x20));
+      _mm256_storeu_ps(d + dst_ld, _mm256_permute2f128_ps(u1, u5, 0x20));
+      _mm256_storeu_ps(d + 2 * dst_ld, _mm256_permute2f128_ps(u2, u6, 0x20));
+      _mm256_storeu_ps(d + 3 * dst_ld, _mm256_permute2f128_ps(u3, u7, 0x20));
+      _mm256_storeu_ps(d + 4 * dst_ld, _mm256_permute2f128_ps(u0, u4, 0x31));
+      _mm256_storeu_ps(d + 5 * dst_ld, _mm256_permute2f128_ps(u1, u5, 0x31));
+      _mm256_storeu_ps(d + 6 * dst_ld, _mm256_permute2f128_ps(u2, u6, 0x31));
+      _mm256_storeu_ps(d + 7 * dst_ld, _mm256_permute2f128_ps(u3, u7, 0x31));
+    }
+  }
+  ScalarTile(src + cols8, src_ld, dst + cols8 * dst_ld, dst_ld, rows8,
+             cols - cols8);
+  ScalarTile(src + rows8 * src_ld, src_ld, dst + rows8, dst_ld, rows - rows8,
+             cols);
+}
+#endif  // XLA_HAS_TARGET_ATTRIBUTES
+
+const KernelRegistry<TileFn>& Tile32Kernels() {
+  static const KernelRegistry<TileFn>* registry = [] {
+    auto* kernels = new KernelRegistry<TileFn>(Tile32Baseline);
+#ifdef XLA_HAS_TARGET_ATTRIBUTES
+    kernels->Register(Isa::kAvx2, Tile32Avx2);
+#endif
+    return kernels;
+  }();
+  return *registry;
+}
+
+TileFn SelectTile(int64 element_size) {
+  switch (element_size) {
+    case 1:
+      return TypedTile<uint8>;
+    case 2:
+      return TypedTile<uint16>;
+    case 4:
+      return Tile32Kernels().Get();
+    case 8:
+      return TypedTile<uint64>;
+    default:
+      return BytesTile;
+  }
+}
+
+// Where a dimension of more than 16 elements is halved, rounded up to whole
+// register tiles.
+int64 SplitPoint(int64 size) {
+  return size >= 16 ? (size / 2 + 7) & ~int64{7} : size / 2;
+}
+
+// Transposes the rows x cols matrix src into dst by halving its longer side
+// until the tile fits kLeafBytes.
+void TransposeRecursive(TileFn tile, const char* src, int64 src_ld, char* dst,
+                        int64 dst_ld, int64 rows, int64 cols,
+                        int64 element_size) {
+  while (rows * cols * element_size > kLeafBytes && rows * cols > 1) {
+    if (rows >= cols) {
+      const int64 half = SplitPoint(rows);
+      TransposeRecursive(tile, src, src_ld, dst, dst_ld, half, cols,
+                         element_size);
+      src += half * src_ld * element_size;
+      dst += half * element_size;
+      rows -= half;
+    } else {
+      const int64 half = SplitPoint(cols);
+      TransposeRecursive(tile, src, src_ld, dst, dst_ld, rows, half,
+                         element_size);
+      src += half * element_size;
+      dst += half * dst_ld * element_size;
+      cols -= half;
+    }
+  }
+  tile(src, src_ld, dst, dst_ld, rows, cols, element_size);
+}
+
+// Drops the dimensions of size 1 and merges the input dimensions that stay
+// next to each other, in order, in the output.
+void Normalize(tensorflow::gtl::ArraySlice<int64> dimensions,
+               tensorflow::gtl::ArraySlice<int64> permutation,
+               std::vector<int64>* new_dimensions,
+               std::vector<int64>* new_permutation) {
+  // The dimensions of size above 1, renumbered in input order.
+  std::vector<int64> sizes;
+  std::vector<int64> index(dimensions.size(), -1);
+  for (size_t d = 0; d < dimensions.size(); ++d) {
+    if (dimensions[d] != 1) {
+      index[d] = sizes.size();
+      sizes.push_back(dimensions[d]);
+    }
+  }
+  // Runs of consecutive input dimensions, in output order.
+  std::vector<std::pair<int64, int64>> runs;
+  for (int64 dim : permutation) {
+    const int64 k = index[dim];
+    if (k < 0) {
+      continue;
+    }
+    if (!runs.empty() && runs.back().second + 1 == k) {
+      runs.back().second = k;
+    } else {
+      runs.push_back({k, k});
+    }
+  }
+
+  std::vector<std::pair<int64, int64>> sorted = runs;
+  std::sort(sorted.begin(), sorted.end());
+  new_dimensions->clear();
+  for (const auto& run : sorted) {
+    int64 size = 1;
+    for (int64 d = run.first; d <= run.second; ++d) {
+      size *= sizes[d];
+    }
+    new_dimensions->push_back(size);
+  }
+  new_permutation->clear();
+  for (const auto& run : runs) {
+    new_permutation->push_back(
+        std::lower_bound(sorted.begin(), sorted.end(), run) - sorted.begin());
+  }
+}
+
+}  // namespace
+
+void TransposeDimensions(const void* input, int64 element_size,
+                         tensorflow::gtl::ArraySlice<int64> dimensions,
+                         tensorflow::gtl::ArraySlice<int64> permutation,
+                         void* output) {
+  const int64 rank = dimensions.size();
+  CHECK_EQ(rank, static_cast<int64>(permutation.size()));
+  CHECK_GE(element_size, 1);
+  std::vector<bool> seen(rank, false);
+  int64 elements = 1;
+  for (int64 i = 0; i < rank; ++i) {
+    CHECK_GE(permutation[i], 0);
+    CHECK_LT(permutation[i], rank);
+    CHECK(!seen[permutation[i]]) << "not a permutation";
+    seen[permutation[i]] = true;
+    CHECK_GE(dimensions[i], 0);
+    elements *= dimensions[i];
+  }
+  if (elements == 0) {
+    return;
+  }
+
+  std::vector<int64> dims;
+  std::vector<int64> perm;
+  Normalize(dimensions, permutation, &dims, &perm);
+  if (dims.size() <= 1) {
+    std::memcpy(output, input, elements * element_size);
+    return;
+  }
+  // An innermost dimension that does not move makes its rows the elements.
+  if (perm.back() == static_cast<int64>(dims.size()) - 1) {
+    element_size *= dims.back();
+    dims.pop_back();
+    perm.pop_back();
+  }
+  const int64 r = dims.size();
+
+  std::vector<int64> input_strides(r, 1);
+  for (int64 i = r - 2; i >= 0; --i) {
+    input_strides[i] = input_strides[i + 1] * dims[i + 1];
+  }
+  // Output strides, indexed by input dimension.
+  std::vector<int64> output_strides(r, 1);
+  int64 stride = 1;
+  for (int64 i = r - 1; i >= 0; --i) {
+    output_strides[perm[i]] = stride;
+    stride *= dims[perm[i]];
+  }
+
+  // Rows of the 2D transposes are the input dimension that becomes
+  // innermost in the output, columns the innermost input dimension.
+  const int64 row_dim = perm[r - 1];
+  const int64 rows = dims[row_dim];
+  const int64 cols = dims[r - 1];
+  const int64 src_ld = input_strides[row_dim];
+  const int64 dst_ld = output_strides[r - 1];
+  std::vector<int64> outer_sizes;
+  std::vector<int64> outer_input_strides;
+  std::vector<int64> outer_output_strides;
+  int64 outer_count = 1;
+  for (int64 d = 0; d < r - 1; ++d) {
+    if (d != row_dim) {
+      outer_sizes.push_back(dims[d]);
+      outer_input_strides.push_back(input_strides[d]);
+      outer_output_strides.push_back(output_strides[d]);
+      outer_count *= dims[d];
+    }
+  }
+
+  const TileFn tile = SelectTile(element_size);
+  const char* src = static_cast<const char*>(input);
+  char* dst = static_cast<char*>(output);
+  const int64 bands = (rows + kBandRows - 1) / kBandRows;
+  ParallelFor(outer_count * bands,
+              kBandRows * cols * std::max<int64>(1, element_size / 4),
+              [&](int64 first, int64 last) {
+    for (int64 unit = first; unit < last; ++unit) {
+      int64 outer = unit / bands;
+      int64 src_offset = 0;
+      int64 dst_offset = 0;
+      for (int64 d = outer_sizes.size() - 1; d >= 0; --d) {
+        const int64 index = outer % outer_sizes[d];
+        outer /= outer_sizes[d];
+        src_offset += index * outer_input_strides[d];
+        dst_offset += index * outer_output_strides[d];
+      }
+      const int64 first_row = unit % bands * kBandRows;
+      const int64 band = std::min(kBandRows, rows - first_row);
+      TransposeRecursive(
+          tile, src + (src_offset + first_row * src_ld) * element_size,
+          src_ld, dst + (dst_offset + first_row) * element_size, dst_ld,
+          band, cols, element_size);
+    }
+  });
+}
+
+}  // namespace xla
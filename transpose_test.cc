@@ -0,0 +1,272 @@
+/* Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "transpose.h"
+
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "array2d.h"
+#include "kernel_registry.h"
+#include "layout_util.h"
+#include "literal_util.h"
+#include "reference_util.h"
+#include "test_helpers.h"
+
+namespace xla {
+namespace {
+
+class TransposeTest /* : public ::testing::Test */
+{
+public:
+
+   TransposeTest() { run(); }
+
+   void MatchesElementwise();
+   void Matrices();
+   void EveryIsaVariant();
+   void Array2DTranspose();
+   void LiteralTypes();
+   void LiteralLayouts();
+
+   void run();
+};
+
+// An element of an unusual size, moved with memcpy.
+struct Triple {
+   int32 a, b, c;
+};
+
+// Elementwise transpose: out[i] == in[permutation[i]].
+template <typename T>
+std::vector<T> Expected(const std::vector<T>& input,
+                        const std::vector<int64>& dimensions,
+                        const std::vector<int64>& permutation)
+{
+   const int64 rank = dimensions.size();
+   std::vector<int64> input_strides(rank, 1);
+   for (int64 i = rank - 2; i >= 0; --i) {
+      input_strides[i] = input_strides[i + 1] * dimensions[i + 1];
+   }
+   std::vector<T> output(input.size());
+   std::vector<int64> index(rank, 0);
+   for (size_t o = 0; o < output.size(); ++o) {
+      int64 offset = 0;
+      for (int64 i = 0; i < rank; ++i) {
+         offset += index[i] * input_strides[permutation[i]];
+      }
+      output[o] = input[offset];
+      for (int64 i = rank - 1; i >= 0; --i) {
+         if (++index[i] < dimensions[permutation[i]]) {
+            break;
+         }
+         index[i] = 0;
+      }
+   }
+   return output;
+}
+
+template <typename T>
+void ExpectTranspose(const std::vector<int64>& dimensions,
+                     const std::vector<int64>& permutation)
+{
+   int64 elements = 1;
+   for (int64 d : dimensions) {
+      elements *= d;
+   }
+   std::vector<T> input(elements);
+   for (int64 i = 0; i < elements; ++i) {
+      std::memset(&input[i], 0, sizeof(T));
+      const uint64 value = i * 2654435761u + 17;
+      std::memcpy(&input[i], &value, std::min(sizeof(T), sizeof(value)));
+   }
+   const std::vector<T> expected = Expected(input, dimensions, permutation);
+   std::vector<T> output(elements);
+   TransposeDimensions(input.data(), dimensions, permutation, output.data());
+   ASSERT_TRUE(elements == 0 ||
+               std::memcmp(output.data(), expected.data(),
+                           elements * sizeof(T)) == 0);
+}
+
+template <typename T>
+void ExpectEveryPermutation(const std::vector<int64>& dimensions)
+{
+   std::vector<int64> permutation(dimensions.size());
+   for (size_t i = 0; i < permutation.size(); ++i) {
+      permutation[i] = i;
+   }
+   do {
+      ExpectTranspose<T>(dimensions, permutation);
+   } while (std::next_permutation(permutation.begin(), permutation.end()));
+}
+
+void TransposeTest::MatchesElementwise()
+{
+   ExpectTranspose<float>({}, {});
+   ExpectTranspose<float>({7}, {0});
+   ExpectTranspose<float>({3, 0, 2}, {2, 0, 1});
+   ExpectEveryPermutation<float>({2, 3, 5, 7});
+   ExpectEveryPermutation<float>({1, 9, 1, 17});
+   ExpectEveryPermutation<uint8>({4, 1, 33, 6});
+   ExpectEveryPermutation<uint16>({5, 19, 3});
+   ExpectEveryPermutation<double>({3, 10, 2, 9});
+   ExpectEveryPermutation<Triple>({6, 5, 11});
+   ExpectEveryPermutation<float>({2, 3, 2, 3, 2});
+   // Several bands and a batch dimension on either side.
+   ExpectTranspose<float>({3, 150, 70}, {0, 2, 1});
+   ExpectTranspose<float>({150, 4, 70}, {2, 1, 0});
+   ExpectTranspose<int32>({70, 150, 3}, {1, 0, 2});
+}
+
+void TransposeTest::Matrices()
+{
+   for (int64 rows : {1, 4, 8, 13, 64, 100, 257}) {
+      for (int64 cols : {1, 3, 8, 16, 31, 200}) {
+         ExpectTranspose<float>({rows, cols}, {1, 0});
+         ExpectTranspose<uint16>({rows, cols}, {1, 0});
+      }
+   }
+   ExpectTranspose<float>({1000, 777}, {1, 0});
+   ExpectTranspose<uint64>({513, 129}, {1, 0});
+}
+
+void TransposeTest::EveryIsaVariant()
+{
+   // Bit patterns that floating point arithmetic would not preserve.
+   std::vector<uint32> input(77 * 45);
+   for (size_t i = 0; i < input.size(); ++i) {
+      input[i] = i % 3 == 0 ? 0x7fa00000u + i : 0x00000001u + i * 65537u;
+   }
+   const std::vector<uint32> expected = Expected(input, {77, 45}, {1, 0});
+   for (int isa = 0; isa < kNumIsas; ++isa) {
+      SetMaxIsa(static_cast<Isa>(isa));
+      std::vector<uint32> output(input.size());
+      Transpose2D(input.data(), 77, 45, output.data());
+      ASSERT_TRUE(output == expected);
+      ExpectTranspose<float>({3, 40, 24}, {2, 0, 1});
+      ExpectTranspose<float>({129, 67}, {1, 0});
+   }
+   SetMaxIsa(static_cast<Isa>(kNumIsas - 1));
+}
+
+void TransposeTest::Array2DTranspose()
+{
+   Array2D<float> matrix(37, 90);
+   for (int64 i = 0; i < 37; ++i) {
+      for (int64 j = 0; j < 90; ++j) {
+         matrix(i, j) = i * 1000 + j;
+      }
+   }
+   const auto transposed = Transpose(matrix);
+   const auto reference = ReferenceUtil::TransposeArray2D(matrix);
+   ASSERT_EQ(transposed->height(), 90);
+   ASSERT_EQ(transposed->width(), 37);
+   for (int64 i = 0; i < 37; ++i) {
+      for (int64 j = 0; j < 90; ++j) {
+         ASSERT_EQ((*transposed)(j, i), matrix(i, j));
+         ASSERT_EQ((*reference)(j, i), matrix(i, j));
+      }
+   }
+}
+
+template <typename T>
+void ExpectLiteralTranspose(const Literal& original)
+{
+   auto transposed = LiteralUtil::Transpose(original, {2, 0, 1});
+   ASSERT_EQ(transposed->shape().element_type(),
+             original.shape().element_type());
+   ASSERT_EQ(transposed->shape().dimensions(0), original.shape().dimensions(2));
+   ASSERT_EQ(transposed->shape().dimensions(1), original.shape().dimensions(0));
+   ASSERT_EQ(transposed->shape().dimensions(2), original.shape().dimensions(1));
+   for (int64 i = 0; i < original.shape().dimensions(0); ++i) {
+      for (int64 j = 0; j < original.shape().dimensions(1); ++j) {
+         for (int64 k = 0; k < original.shape().dimensions(2); ++k) {
+            const T expected = LiteralUtil::Get<T>(original, {i, j, k});
+            const T actual = LiteralUtil::Get<T>(*transposed, {k, i, j});
+            ASSERT_TRUE(std::memcmp(&expected, &actual, sizeof(T)) == 0);
+         }
+      }
+   }
+}
+
+template <typename T>
+std::unique_ptr<Literal> Iota(std::initializer_list<int64> dimensions)
+{
+   Literal literal;
+   *literal.mutable_shape() = ShapeUtil::MakeShape(
+       primitive_util::NativeToPrimitiveType<T>(), dimensions);
+   LiteralUtil::Reserve(ShapeUtil::ElementsIn(literal.shape()), &literal);
+   int64 count = 0;
+   LiteralUtil::EachCell<T>(
+       literal, [&](tensorflow::gtl::ArraySlice<int64> indices, T) {
+          LiteralUtil::Set<T>(&literal, indices,
+                              static_cast<T>(count++ % 7 * 3));
+       });
+   return MakeUnique<Literal>(literal);
+}
+
+void TransposeTest::LiteralTypes()
+{
+   ExpectLiteralTranspose<float>(*Iota<float>({3, 4, 5}));
+   ExpectLiteralTranspose<double>(*Iota<double>({3, 4, 5}));
+   ExpectLiteralTranspose<int32>(*Iota<int32>({2, 9, 5}));
+   ExpectLiteralTranspose<int64>(*Iota<int64>({2, 9, 5}));
+   ExpectLiteralTranspose<uint32>(*Iota<uint32>({4, 3, 6}));
+   ExpectLiteralTranspose<uint64>(*Iota<uint64>({4, 3, 6}));
+   ExpectLiteralTranspose<uint8>(*Iota<uint8>({5, 7, 3}));
+   ExpectLiteralTranspose<bool>(*Iota<bool>({5, 7, 3}));
+   ExpectLiteralTranspose<half>(*Iota<half>({6, 2, 9}));
+   ExpectLiteralTranspose<bfloat16>(*Iota<bfloat16>({6, 2, 9}));
+
+   auto empty = LiteralUtil::Transpose(*Iota<float>({3, 0, 2}), {2, 0, 1});
+   ASSERT_EQ(ShapeUtil::ElementsIn(empty->shape()), 0);
+}
+
+void TransposeTest::LiteralLayouts()
+{
+   // The same logical values in both 2D layouts transpose to the same
+   // result.
+   const auto row_major = LiteralUtil::CreateR2WithLayout<float>(
+       {{1, 2, 3}, {4, 5, 6}}, LayoutUtil::MakeLayout({1, 0}));
+   const auto column_major = LiteralUtil::CreateR2WithLayout<float>(
+       {{1, 2, 3}, {4, 5, 6}}, LayoutUtil::MakeLayout({0, 1}));
+   const auto expected =
+       LiteralUtil::CreateR2<float>({{1, 4}, {2, 5}, {3, 6}});
+   ASSERT_TRUE(LiteralUtil::Equal(
+       *expected, *LiteralUtil::Transpose(*row_major, {1, 0})));
+   ASSERT_TRUE(LiteralUtil::Equal(
+       *expected, *LiteralUtil::Transpose(*column_major, {1, 0})));
+
+   const auto original = Iota<int32>({3, 4, 5});
+   const auto relaid =
+       LiteralUtil::Relayout(*original, LayoutUtil::MakeLayout({1, 0, 2}));
+   ExpectLiteralTranspose<int32>(*relaid);
+   ASSERT_TRUE(LiteralUtil::Equal(*LiteralUtil::Transpose(*original, {2, 0, 1}),
+                                  *LiteralUtil::Transpose(*relaid, {2, 0, 1})));
+}
+
+void TransposeTest::run()
+{
+   MatchesElementwise();
+   Matrices();
+   EveryIsaVariant();
+   Array2DTranspose();
+   LiteralTypes();
+   LiteralLayouts();
+}
+
+}  // namespace
+}  // namespace xla
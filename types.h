@@ -18,20 +18,11 @@ limitations under the License.
 
 //#include "third_party/eigen3/Eigen/Core"
 
-//#include "half.h"
 #include "base.h"
 
 //#include "third_party/eigen3/Eigen/Core"
 //#include "tensorflow/core/platform/types.h" // base.h
 
-//#include <Eigen/Core>
-
-namespace Eigen {
-
-   typedef float half;
-
-};
-
 namespace xla {
 
 using ::tensorflow::string;
@@ -46,8 +37,6 @@ using ::tensorflow::uint16;
 using ::tensorflow::uint32;
 using ::tensorflow::uint64;
 
-using ::Eigen::half;
-
 }  // namespace xla
 
 #endif  // TENSORFLOW_COMPILER_XLA_TYPES_H_
@@ -93,6 +93,7 @@ bool PrimitiveType_IsValid(int value)
     case 12:
     case 13:
     case 14:
+    case 16:
       return true;
     default:
       return false;
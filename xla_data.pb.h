@@ -103,6 +103,7 @@ enum PrimitiveType {
   F64 = 12,
   TUPLE = 13,
   OPAQUE = 14,
+  BF16 = 16,
   PrimitiveType_INT_MIN_SENTINEL_DO_NOT_USE_ = tensorflow::kint32min,
   PrimitiveType_INT_MAX_SENTINEL_DO_NOT_USE_ = tensorflow::kint32max
 };